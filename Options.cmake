@@ -51,6 +51,11 @@ if(DAEDALUS_ENABLE_DYNAREC)
     add_compile_definitions(DAEDALUS_ENABLE_DYNAREC)
 endif()
 
+if(DAEDALUS_FASTMEM)
+    message("DAEDALUS_FASTMEM=ON")
+    add_compile_definitions(DAEDALUS_FASTMEM)
+endif()
+
 if(DAEDALUS_ENABLE_OS_HOOKS)
     message("DAEDALUS_ENABLE_OS_HOOKS=ON")
     add_compile_definitions(DAEDALUS_ENABLE_OS_HOOKS)
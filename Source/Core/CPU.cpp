@@ -24,6 +24,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "Core/CPU.h"
 
 #include <algorithm>
+#include <array>
+#include <set>
 #include <string>
 #include <vector>
 #include <mutex>
@@ -31,6 +33,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "Interface/ConfigOptions.h"
 #include "Interface/Cheats.h"
+#include "Core/CachedInterpret.h"
+#include "Core/DMA.h"
 #include "Core/Dynamo.h"
 #include "Core/Interpret.h"
 #include "Core/Interrupt.h"
@@ -41,6 +45,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "RomFile/ROMBuffer.h"
 #include "Core/RSP_HLE.h"
 #include "Core/Save.h"
+#include "HLEAudio/AudioPlugin.h"
 #include "Interface/SaveState.h"
 #include "Debug/DBGConsole.h"
 #include "Debug/DebugLog.h"
@@ -84,9 +89,12 @@ enum ESaveStateOperation
 	SSO_NONE,
 	SSO_SAVE,
 	SSO_LOAD,
+	SSO_SNAPSHOT,
+	SSO_REWIND,
 };
 
 static ESaveStateOperation		gSaveStateOperation(SSO_NONE);
+static u32						gRewindSteps(0);
 
 const  u32			kInitialVIInterruptCycles = 62500;
 static u32			gVerticalInterrupts = 0;
@@ -111,6 +119,11 @@ struct VblCallback
 
 static std::vector<VblCallback>		gVblCallbacks;
 
+// Idle loops found in the current ROM, and how much time we've saved by skipping them
+static std::set<u32>		gIdleLoops;
+static u32					gIdleLoopSkips = 0;
+static u64					gIdleLoopCyclesSkipped = 0;
+
 
 void CPU_RegisterVblCallback(VblCallbackFn fn, void * arg)
 {
@@ -131,24 +144,205 @@ void CPU_UnregisterVblCallback(VblCallbackFn fn, void * arg)
 	}
 }
 
-void CPU_SkipToNextEvent()
+//*****************************************************************************
+//	The event scheduler. Events are kept in a binary heap, ordered by the
+//	absolute cycle they fire on. Each type can only be queued once, and we
+//	track where each type is in the heap so it can be cancelled in O(log n).
+//	gCPUState.Events[0] mirrors the root of the heap, and its mCount is the
+//	countdown the cores decrement - so the current time is always
+//	gNextEventTime - Events[0].mCount.
+//*****************************************************************************
+struct SScheduledEvent
 {
-	LOCK_EVENT_QUEUE();
+	u64				Time;			// Absolute cycle the event fires on
+	u32				Sequence;		// Keeps events due on the same cycle in the order they were added
+	ECPUEventType	Type;
+};
+
+static std::vector< SScheduledEvent >			gEventHeap;
+static std::array< s32, NUM_CPU_EVENT_TYPES >	gEventHeapIndex;		// -1 if the type isn't queued
+static u64										gNextEventTime = 0;
+static u32										gEventSequence = 0;
+
+static inline bool CPU_IsEventBefore( const SScheduledEvent & a, const SScheduledEvent & b )
+{
+	if( a.Time != b.Time )
+		return a.Time < b.Time;
+
+	return s32( a.Sequence - b.Sequence ) < 0;
+}
+
+// All of the following must be called with the event queue locked
+static u64 CPU_GetEventTime()
+{
+	return gNextEventTime - u64( s64( gCPUState.Events[ 0 ].mCount ) );
+}
+
+static void CPU_PlaceEvent( u32 idx, const SScheduledEvent & event )
+{
+	gEventHeap[ idx ] = event;
+	gEventHeapIndex[ event.Type ] = s32( idx );
+}
+
+static void CPU_SiftEventUp( u32 idx )
+{
+	SScheduledEvent event = gEventHeap[ idx ];
+
+	while( idx > 0 )
+	{
+		u32 parent = (idx - 1) / 2;
+		if( !CPU_IsEventBefore( event, gEventHeap[ parent ] ) )
+			break;
+
+		CPU_PlaceEvent( idx, gEventHeap[ parent ] );
+		idx = parent;
+	}
+
+	CPU_PlaceEvent( idx, event );
+}
 
+static void CPU_SiftEventDown( u32 idx )
+{
+	SScheduledEvent event = gEventHeap[ idx ];
+	u32 num_events = gEventHeap.size();
+
+	for( ;; )
+	{
+		u32 child = idx * 2 + 1;
+		if( child >= num_events )
+			break;
+
+		if( child + 1 < num_events && CPU_IsEventBefore( gEventHeap[ child + 1 ], gEventHeap[ child ] ) )
+			child++;
+
+		if( !CPU_IsEventBefore( gEventHeap[ child ], event ) )
+			break;
+
+		CPU_PlaceEvent( idx, gEventHeap[ child ] );
+		idx = child;
+	}
+
+	CPU_PlaceEvent( idx, event );
+}
+
+static void CPU_RemoveEventAt( u32 idx )
+{
+	gEventHeapIndex[ gEventHeap[ idx ].Type ] = -1;
+
+	SScheduledEvent last = gEventHeap.back();
+	gEventHeap.pop_back();
+
+	if( idx < gEventHeap.size() )
+	{
+		CPU_PlaceEvent( idx, last );
+
+		if( idx > 0 && CPU_IsEventBefore( last, gEventHeap[ (idx - 1) / 2 ] ) )
+		{
+			CPU_SiftEventUp( idx );
+		}
+		else
+		{
+			CPU_SiftEventDown( idx );
+		}
+	}
+}
+
+// Point gCPUState.Events[0] at the root of the heap. now is the time before the heap changed
+static void CPU_UpdateNextEvent( u64 now )
+{
+	gCPUState.NumEvents = gEventHeap.size();
+
+	if( gEventHeap.empty() )
+	{
+		gNextEventTime = now;
+		gCPUState.Events[ 0 ].mCount = 0;
+		return;
+	}
+
+	const SScheduledEvent & next = gEventHeap[ 0 ];
+
+	// Can be negative if the event is already overdue
+	gNextEventTime = next.Time;
+	gCPUState.Events[ 0 ].mCount     = s32( next.Time - now );
+	gCPUState.Events[ 0 ].mEventType = next.Type;
+}
+
+// Must be called with the event queue locked. Returns the number of cycles skipped
+static u32 CPU_AdvanceToNextEvent()
+{
 #ifdef DAEDALUS_ENABLE_ASSERTS
 	DAEDALUS_ASSERT( gCPUState.NumEvents > 0, "There are no events" );
 	#endif
-	gCPUState.CPUControl[C0_COUNT]._u32 += (gCPUState.Events[ 0 ].mCount - 1);
+	// The count can already be zero or negative if earlier events overshot it
+	s32 count = gCPUState.Events[ 0 ].mCount;
+	if( count <= 1 )
+		return 0;
+
+	s32 cycles = count - 1;
+
+	gCPUState.CPUControl[C0_COUNT]._u32 += cycles;
 	gCPUState.Events[ 0 ].mCount = 1;
+	return u32( cycles );
 }
 
-static void CPU_ResetEventList()
+void CPU_SkipToNextEvent()
+{
+	LOCK_EVENT_QUEUE();
+
+	CPU_AdvanceToNextEvent();
+}
+
+void CPU_SkipIdleLoop()
 {
-	gCPUState.Events[ 0 ].mCount     = kInitialVIInterruptCycles;
-	gCPUState.Events[ 0 ].mEventType = CPU_EVENT_VBL;
-	gCPUState.NumEvents = 1;
+	LOCK_EVENT_QUEUE();
+
+	gIdleLoopCyclesSkipped += CPU_AdvanceToNextEvent();
+	gIdleLoopSkips++;
+}
 
+void CPU_AddIdleLoop( u32 address )
+{
+	if( gIdleLoops.insert( address ).second )
+	{
+		DBGConsole_Msg( 0, "Found idle loop at 0x%08x", address );
+	}
+}
+
+static void CPU_ResetIdleLoops()
+{
+	gIdleLoops.clear();
+	gIdleLoopSkips = 0;
+	gIdleLoopCyclesSkipped = 0;
+}
+
+static void CPU_ReportIdleLoops()
+{
+	if( gIdleLoops.empty() )
+		return;
+
+	DBGConsole_Msg( 0, "Idle loops: %d found, skipped %d times, %llu cycles in total",
+		u32( gIdleLoops.size() ), gIdleLoopSkips, (unsigned long long)gIdleLoopCyclesSkipped );
+
+	for( u32 address : gIdleLoops )
+	{
+		DBGConsole_Msg( 0, "  0x%08x", address );
+	}
+}
+
+static void CPU_ResetEventList()
+{
 	RESET_EVENT_QUEUE_LOCK();
+
+	// There's only ever one of each type queued, so this never needs to grow
+	gEventHeap.clear();
+	gEventHeap.reserve( NUM_CPU_EVENT_TYPES );
+	gEventHeapIndex.fill( -1 );
+	gNextEventTime = 0;
+	gEventSequence = 0;
+	gCPUState.Events[ 0 ].mCount = 0;
+	gCPUState.NumEvents = 0;
+
+	CPU_AddEvent( kInitialVIInterruptCycles, CPU_EVENT_VBL );
 }
 
 void CPU_AddEvent( s32 count, ECPUEventType event_type )
@@ -156,72 +350,64 @@ void CPU_AddEvent( s32 count, ECPUEventType event_type )
 	LOCK_EVENT_QUEUE();
 #ifdef DAEDALUS_ENABLE_ASSERTS
 	DAEDALUS_ASSERT( count > 0, "Count is invalid" );
-	DAEDALUS_ASSERT( gCPUState.NumEvents < MAX_CPU_EVENTS, "Too many events" );
+	DAEDALUS_ASSERT( event_type < NUM_CPU_EVENT_TYPES, "Invalid event type" );
 #endif
-	u32 event_idx = 0;
-	for( event_idx = 0; event_idx < gCPUState.NumEvents; ++event_idx )
+	u64 now = CPU_GetEventTime();
+
+	// Only one event of each type can be queued. Every source re-arms its event
+	// only after the previous one has fired or been flushed, so this only
+	// reschedules (COMPARE, savestate VBL), it never drops an interrupt.
+	s32 existing_idx = gEventHeapIndex[ event_type ];
+	if( existing_idx >= 0 )
 	{
-		CPUEvent & event = gCPUState.Events[ event_idx ];
+		CPU_RemoveEventAt( existing_idx );
+	}
 
-		if( count <= event.mCount )
-		{
-			//
-			//	This event belongs before the subsequent one so insert a space for it here and break out
-			//	Don't forget to decrement the counter for the subsequent event
-			//
-			event.mCount -= count;
-
-			u32 num_to_copy  = gCPUState.NumEvents - event_idx;
-			if( num_to_copy > 0 )
-			{
-				memmove( &gCPUState.Events[ event_idx+1 ], &gCPUState.Events[ event_idx ], num_to_copy * sizeof( CPUEvent ) );
-			}
-			break;
-		}
+	SScheduledEvent event;
+	event.Time     = now + count;
+	event.Sequence = gEventSequence++;
+	event.Type     = event_type;
 
-		//
-		//	Decrease counter by that for this event
-		//
-		count -= event.mCount;
-	}
-#ifdef DAEDALUS_ENABLE_ASSERTS
-	DAEDALUS_ASSERT( event_idx <= gCPUState.NumEvents, "Invalid idx" );
-	#endif
-	gCPUState.Events[ event_idx ].mCount = count;
-	gCPUState.Events[ event_idx ].mEventType = event_type;
-	gCPUState.NumEvents++;
+	gEventHeap.push_back( event );
+	CPU_SiftEventUp( gEventHeap.size() - 1 );
+	CPU_UpdateNextEvent( now );
 }
 
-static void CPU_SetCompareEvent( s32 count )
+bool CPU_RemoveEvent( ECPUEventType event_type )
 {
-	{
-		LOCK_EVENT_QUEUE();
+	LOCK_EVENT_QUEUE();
 
-#ifdef DAEDALUS_ENABLE_ASSERTS
-		DAEDALUS_ASSERT( count > 0, "Count is invalid" );
-#endif
-		//
-		//	Remove any existing compare events. Need to adjust any subsequent timer's count.
-		//
-		for( u32 i = 0; i < gCPUState.NumEvents; ++i )
-		{
-			if( gCPUState.Events[ i ].mEventType == CPU_EVENT_COMPARE )
-			{
-				//
-				//	Check for a following event, and remove
-				//
-				if( i+1 < gCPUState.NumEvents )
-				{
-					gCPUState.Events[ i+1 ].mCount += gCPUState.Events[ i ].mCount;
-					u32 num_to_copy = gCPUState.NumEvents - (i+1);
-					memmove( &gCPUState.Events[ i ], &gCPUState.Events[ i+1 ], num_to_copy * sizeof( CPUEvent ) );
-				}
-				gCPUState.NumEvents--;
-				break;
-			}
-		}
-	}
+	s32 idx = gEventHeapIndex[ event_type ];
+	if( idx < 0 )
+		return false;
+
+	u64 now = CPU_GetEventTime();
+	CPU_RemoveEventAt( idx );
+	CPU_UpdateNextEvent( now );
+	return true;
+}
 
+bool CPU_IsEventQueued( ECPUEventType event_type )
+{
+	LOCK_EVENT_QUEUE();
+
+	return gEventHeapIndex[ event_type ] >= 0;
+}
+
+s32 CPU_GetEventCycles( ECPUEventType event_type )
+{
+	LOCK_EVENT_QUEUE();
+
+	s32 idx = gEventHeapIndex[ event_type ];
+	if( idx < 0 )
+		return 0;
+
+	return s32( gEventHeap[ idx ].Time - CPU_GetEventTime() );
+}
+
+static void CPU_SetCompareEvent( s32 count )
+{
+	// Replaces any existing compare event
 	CPU_AddEvent( count, CPU_EVENT_COMPARE );
 }
 
@@ -235,14 +421,11 @@ static ECPUEventType CPU_PopEvent()
 	//DAEDALUS_ASSERT( gCPUState.Events[ 0 ].mCount == 0, "Popping event with a bit of underflow" );
 #endif
 
-	ECPUEventType event_type = gCPUState.Events[ 0 ].mEventType;
+	u64 now = CPU_GetEventTime();
+	ECPUEventType event_type = gEventHeap[ 0 ].Type;
 
-	u32	num_to_copy = gCPUState.NumEvents - 1;
-	if( num_to_copy > 0 )
-	{
-		memmove( &gCPUState.Events[ 0 ], &gCPUState.Events[ 1 ], num_to_copy * sizeof( CPUEvent ) );
-	}
-	gCPUState.NumEvents--;
+	CPU_RemoveEventAt( 0 );
+	CPU_UpdateNextEvent( now );
 
 	return event_type;
 }
@@ -250,27 +433,15 @@ static ECPUEventType CPU_PopEvent()
 // XXXX This is for savestate. Looks very suspicious to me
 u32 CPU_GetVideoInterruptEventCount()
 {
-	for( u32 i = 0; i < gCPUState.NumEvents; ++i )
-	{
-		if(gCPUState.Events[ i ].mEventType == CPU_EVENT_VBL)
-		{
-			return gCPUState.Events[ i ].mCount;
-		}
-	}
-
-	return 0;
+	return CPU_GetEventCycles( CPU_EVENT_VBL );
 }
 
 // XXXX This is for savestate. Looks very suspicious to me
 void CPU_SetVideoInterruptEventCount( u32 count )
 {
-	for( u32 i = 0; i < gCPUState.NumEvents; ++i )
+	if( CPU_IsEventQueued( CPU_EVENT_VBL ) && s32( count ) > 0 )
 	{
-		if(gCPUState.Events[ i ].mEventType == CPU_EVENT_VBL)
-		{
-			gCPUState.Events[ i ].mCount = count;
-			return;
-		}
+		CPU_AddEvent( count, CPU_EVENT_VBL );
 	}
 }
 
@@ -382,12 +553,15 @@ bool CPU_RomOpen()
 
 	// Clear event list:
 	CPU_ResetEventList();
+	CPU_ResetIdleLoops();
+	DMA_Reset();
 
 #ifdef DAEDALUS_BREAKPOINTS_ENABLED
 	g_BreakPoints.clear();
 #endif
 
 	Dynamo_Reset();
+	CachedInter_Reset();
 
 	CPU_SelectCore();
 	return true;
@@ -395,6 +569,10 @@ bool CPU_RomOpen()
 
 void CPU_RomClose()
 {
+	CPU_ReportIdleLoops();
+	Dynamo_RomClose();
+	SaveState_FiniSnapshots();
+
 #ifdef DAEDALUS_ENABLE_DYNAREC
 	#ifdef DAEDALUS_DEBUG_CONSOLE_DYNAREC
 		//This will dump the fragment cache on exit to ROMs menu
@@ -417,6 +595,9 @@ void CPU_SelectCore()
 		Dynamo_SelectCore();
 	else
 #endif
+	if (gCachedInterpreterEnabled)
+		CachedInter_SelectCore();
+	else
 		Inter_SelectCore();
 
 	if( gCPUStopOnSimpleState && CPU_IsStateSimple() )
@@ -467,6 +648,39 @@ bool CPU_RequestLoadState( const std::filesystem::path &filename )
 	return true;	// XXXX could fail
 }
 
+bool CPU_RequestSnapshot()
+{
+	DAEDALUS_ASSERT(gCPURunning, "Expecting the CPU to be running at this point");
+	std::scoped_lock lock(gSaveStateMutex);
+
+	if( gSaveStateOperation != SSO_NONE )
+	{
+		return false;
+	}
+
+	gSaveStateOperation = SSO_SNAPSHOT;
+	gCPUState.AddJob(CPU_CHANGE_CORE);
+
+	return true;
+}
+
+bool CPU_RequestRewind( u32 steps_back )
+{
+	DAEDALUS_ASSERT(gCPURunning, "Expecting the CPU to be running at this point");
+	std::scoped_lock lock(gSaveStateMutex);
+
+	if( gSaveStateOperation != SSO_NONE || steps_back >= SaveState_GetNumSnapshots() )
+	{
+		return false;
+	}
+
+	gSaveStateOperation = SSO_REWIND;
+	gRewindSteps = steps_back;
+	gCPUState.AddJob(CPU_CHANGE_CORE);
+
+	return true;
+}
+
 static void HandleSaveStateOperationOnVerticalBlank()
 {
 	DAEDALUS_ASSERT(gCPURunning, "Expecting the CPU to be running at this point");
@@ -474,6 +688,9 @@ static void HandleSaveStateOperationOnVerticalBlank()
 		return;
 	std::scoped_lock lock(gSaveStateMutex);
 
+	// The pending PI event isn't saved, so land any transfer in progress first
+	DMA_PI_FlushTransfer();
+
 	//
 	// Handle the save state
 	//
@@ -484,7 +701,18 @@ static void HandleSaveStateOperationOnVerticalBlank()
 		break;
 	case SSO_SAVE:
 		DBGConsole_Msg(0, "Saving '%s'\n", gSaveStateFilename.c_str());
-		SaveState_SaveToFile( gSaveStateFilename );
+		SaveState_SaveToFileAsync( gSaveStateFilename );
+		gSaveStateOperation = SSO_NONE;
+		break;
+	case SSO_SNAPSHOT:
+		SaveState_TakeSnapshot();
+		gSaveStateOperation = SSO_NONE;
+		break;
+	case SSO_REWIND:
+		if (SaveState_RestoreSnapshot( gRewindSteps ))
+		{
+			CPU_ResetFragmentCache();
+		}
 		gSaveStateOperation = SSO_NONE;
 		break;
 	case SSO_LOAD:
@@ -697,6 +925,11 @@ void CPU_HANDLE_COUNT_INTERRUPT()
 		break;
 	case CPU_EVENT_AUDIO:
 		{
+			if( gAudioPlugin != nullptr )
+			{
+				gAudioPlugin->WaitForAList();
+			}
+
 			u32 status = Memory_SP_SetRegisterBits(SP_STATUS_REG, SP_STATUS_TASKDONE|SP_STATUS_YIELDED|SP_STATUS_BROKE|SP_STATUS_HALT);
 			if( status & SP_STATUS_INTR_BREAK )
 				CPU_AddEvent(4000, CPU_EVENT_SPINT);
@@ -706,6 +939,25 @@ void CPU_HANDLE_COUNT_INTERRUPT()
 		Memory_MI_SetRegisterBits(MI_INTR_REG, MI_INTR_SP);
 		R4300_Interrupt_UpdateCause3();
 		break;
+	case CPU_EVENT_PI_DMA:
+		DMA_PI_FinishTransfer();
+		break;
+	case CPU_EVENT_SI_DMA:
+		DMA_SI_Complete();
+		break;
+	case CPU_EVENT_SP_DMA:
+		DMA_SP_Complete();
+		break;
+	case CPU_EVENT_AI:
+		Memory_MI_SetRegisterBits(MI_INTR_REG, MI_INTR_AI);
+		R4300_Interrupt_UpdateCause3();
+		break;
+	case CPU_EVENT_DP:
+		Memory_MI_SetRegisterBits(MI_INTR_REG, MI_INTR_DP);
+		R4300_Interrupt_UpdateCause3();
+		break;
+	default:
+		break;
 	}
 
 	#ifdef DAEDALUS_ENABLE_ASSERTS
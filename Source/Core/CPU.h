@@ -73,10 +73,14 @@ enum	ECPUEventType
 	CPU_EVENT_COMPARE,
 	CPU_EVENT_AUDIO,
 	CPU_EVENT_SPINT,
-};
+	CPU_EVENT_PI_DMA,		// PI DMA completion
+	CPU_EVENT_SI_DMA,		// SI DMA completion
+	CPU_EVENT_SP_DMA,		// SP DMA completion
+	CPU_EVENT_AI,			// AI buffer end
+	CPU_EVENT_DP,			// RDP completion
 
-// In practice there should only ever be 2
-#define MAX_CPU_EVENTS 4
+	NUM_CPU_EVENT_TYPES
+};
 
 struct CPUEvent
 {
@@ -129,9 +133,10 @@ struct alignas(CACHE_ALIGN) SCPUState
 	REG32			Temp3;				// 0x2A8	Temp storage Dynarec
 	REG32			Temp4;				// 0x2AC	Temp storage Dynarec
 
-	std::array<CPUEvent, MAX_CPU_EVENTS> Events;
-	// CPUEvent		Events[ MAX_CPU_EVENTS ];	// 0x2B0 //In practice there should only ever be 2 CPU_EVENTS
-	u32				NumEvents;
+	// The events themselves are held in a heap in CPU.cpp. Events[0] mirrors the one due next,
+	// and its mCount is the single countdown shared by the interpreter and the dynarec.
+	std::array<CPUEvent, 1> Events;		// 0x2B0
+	u32				NumEvents;			// 0x2B8	Number of events in the heap
 
 	void			AddJob( u32 job );
 	void			ClearJob( u32 job );
@@ -162,6 +167,8 @@ void	CPU_Skip();
 bool	CPU_Run();
 bool	CPU_RequestSaveState( const std::filesystem::path &filename );
 bool	CPU_RequestLoadState( const std::filesystem::path &filename );
+bool	CPU_RequestSnapshot();
+bool	CPU_RequestRewind( u32 steps_back );
 void	CPU_Halt( const char * reason );
 void	CPU_SelectCore();
 u32		CPU_GetVideoInterruptEventCount();
@@ -175,8 +182,13 @@ void	CPU_AddBreakPoint( u32 address );						// Add a break point at address dwAd
 void	CPU_EnableBreakPoint( u32 address, bool enable );		// Enable/Disable the breakpoint as the specified address
 #endif
 bool	CPU_IsRunning();
-void	CPU_AddEvent( s32 count, ECPUEventType event_type );
+void	CPU_AddEvent( s32 count, ECPUEventType event_type );	// Replaces any queued event of the same type
+bool	CPU_RemoveEvent( ECPUEventType event_type );			// Returns false if the event wasn't queued
+bool	CPU_IsEventQueued( ECPUEventType event_type );
+s32		CPU_GetEventCycles( ECPUEventType event_type );		// Cycles until the event fires, or 0 if it isn't queued
 void	CPU_SkipToNextEvent();
+void	CPU_SkipIdleLoop();						// As CPU_SkipToNextEvent(), but counted in the idle loop stats
+void	CPU_AddIdleLoop( u32 address );
 bool	CPU_CheckStuffToDo();
 using VblCallbackFn = void(*) (void * arg);
 
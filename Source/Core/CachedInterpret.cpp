@@ -0,0 +1,439 @@
+/*
+Copyright (C) 2007 StrmnNrmn
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+
+#include "Base/Types.h"
+
+#include "Core/CachedInterpret.h"
+
+#include <unordered_map>
+#include <vector>
+
+#include "Core/CPU.h"
+#include "Core/Memory.h"
+#include "Core/R4300.h"
+#include "Debug/DBGConsole.h"
+#include "Debug/Synchroniser.h"
+#include "Ultra/ultra_R4300.h"
+#include "Utility/Profiler.h"
+
+namespace
+{
+	struct SCachedOp
+	{
+		CPU_Instruction		Handler;
+		u32					OpCode;
+	};
+
+	struct SCachedBlock
+	{
+		u32						PhysicalAddress;
+		std::vector<SCachedOp>	Ops;
+	};
+
+	// Blocks never cross a page, so invalidation only has to look at the pages written to
+	const u32		PAGE_SHIFT = 12;
+	const u32		PAGE_SIZE = 1 << PAGE_SHIFT;
+	const u32		MAX_BLOCK_OPS = 64;
+
+	// Throw everything away if the cache gets this big
+	const u32		MAX_CACHED_OPS = 1024 * 1024;
+
+	// Direct mapped lookup in front of the block map, for the common case
+	const u32		LOOKUP_TABLE_SIZE = 4096;
+
+	std::unordered_map< u32, SCachedBlock >			gBlocks;
+	std::unordered_map< u32, std::vector< u32 > >	gPageBlocks;
+	SCachedBlock *									gBlockLookup[ LOOKUP_TABLE_SIZE ];
+	u32												gNumCachedOps = 0;
+
+	struct SInvalidationRange
+	{
+		u32		Address;
+		u32		Length;
+	};
+
+	const u32				MAX_PENDING_INVALIDATIONS = 8;
+	SInvalidationRange		gPendingInvalidations[ MAX_PENDING_INVALIDATIONS ];
+	u32						gNumPendingInvalidations = 0;
+	bool					gInvalidateAll = false;
+	bool					gInvalidationPending = false;
+}
+
+//*****************************************************************************
+//	The top level handlers for the COP1 ops are swapped when the coprocessor
+//	is enabled or disabled, so these have to go through the table each time.
+//*****************************************************************************
+static void CachedInter_DispatchOp( R4300_CALL_SIGNATURE )
+{
+	OpCode	op_code;
+	op_code._u32 = op_code_bits;
+
+	R4300_ExecuteInstruction( op_code );
+}
+
+static CPU_Instruction CachedInter_GetHandler( OpCode op_code )
+{
+	switch( op_code.op )
+	{
+	case OP_COPRO1:
+	case OP_LWC1:
+	case OP_LDC1:
+	case OP_SWC1:
+	case OP_SDC1:
+		return CachedInter_DispatchOp;
+
+	default:
+		return R4300_GetInstructionHandler( op_code );
+	}
+}
+
+//*****************************************************************************
+//	Returns true if the block should end after this op (or after its delay slot)
+//*****************************************************************************
+static bool CachedInter_EndsBlock( OpCode op_code, bool * p_has_delay_slot )
+{
+	*p_has_delay_slot = true;
+
+	switch( op_code.op )
+	{
+	case OP_J:		case OP_JAL:
+	case OP_BEQ:	case OP_BNE:	case OP_BLEZ:	case OP_BGTZ:
+	case OP_BEQL:	case OP_BNEL:	case OP_BLEZL:	case OP_BGTZL:
+	case OP_REGIMM:
+		return true;
+
+	case OP_SPECOP:
+		switch( op_code.spec_op )
+		{
+		case SpecOp_JR:
+		case SpecOp_JALR:
+			return true;
+		case SpecOp_SYSCALL:
+		case SpecOp_BREAK:
+			*p_has_delay_slot = false;
+			return true;
+		default:
+			return false;
+		}
+
+	case OP_COPRO0:
+		*p_has_delay_slot = false;
+		return op_code.cop0_op == Cop0Op_TLB && op_code.cop0tlb_funct == OP_ERET;
+
+	case OP_COPRO1:
+		return op_code.cop1_op == Cop1Op_BCInstr;
+
+	default:
+		return false;
+	}
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+static void CachedInter_RemoveBlock( u32 physical_address )
+{
+	auto it( gBlocks.find( physical_address ) );
+	if( it == gBlocks.end() )
+		return;
+
+	SCachedBlock *&	p_lookup( gBlockLookup[ (physical_address >> 2) & (LOOKUP_TABLE_SIZE - 1) ] );
+	if( p_lookup == &it->second )
+	{
+		p_lookup = nullptr;
+	}
+
+	gNumCachedOps -= it->second.Ops.size();
+	gBlocks.erase( it );
+}
+
+static void CachedInter_Clear()
+{
+	gBlocks.clear();
+	gPageBlocks.clear();
+	gNumCachedOps = 0;
+
+	for( u32 i = 0; i < LOOKUP_TABLE_SIZE; ++i )
+	{
+		gBlockLookup[ i ] = nullptr;
+	}
+}
+
+static void CachedInter_ProcessPendingInvalidations()
+{
+	if( gInvalidateAll )
+	{
+		CachedInter_Clear();
+	}
+	else
+	{
+		for( u32 i = 0; i < gNumPendingInvalidations; ++i )
+		{
+			// Only RDRAM is cached, and that's always accessed through KSEG0/1
+			u32		start( gPendingInvalidations[ i ].Address & 0x1fffffff );
+			u32		end( start + gPendingInvalidations[ i ].Length );
+
+			for( u32 page = start >> PAGE_SHIFT; page <= (end - 1) >> PAGE_SHIFT; ++page )
+			{
+				auto it( gPageBlocks.find( page ) );
+				if( it == gPageBlocks.end() )
+					continue;
+
+				for( u32 physical_address : it->second )
+				{
+					CachedInter_RemoveBlock( physical_address );
+				}
+				gPageBlocks.erase( it );
+			}
+		}
+	}
+
+	gNumPendingInvalidations = 0;
+	gInvalidateAll = false;
+	gInvalidationPending = false;
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+static SCachedBlock * CachedInter_BuildBlock( u32 physical_address, const u8 * p_host )
+{
+	if( gNumCachedOps >= MAX_CACHED_OPS )
+	{
+		#ifdef DAEDALUS_DEBUG_CONSOLE
+		DBGConsole_Msg( 0, "Cached interpreter is full - flushing" );
+		#endif
+		CachedInter_Clear();
+	}
+
+	SCachedBlock &	block( gBlocks[ physical_address ] );
+	block.PhysicalAddress = physical_address;
+	block.Ops.clear();
+
+	const OpCode *	p_ops( reinterpret_cast< const OpCode * >( p_host ) );
+	u32				max_ops( (PAGE_SIZE - (physical_address & (PAGE_SIZE - 1))) / 4 );
+	if( max_ops > MAX_BLOCK_OPS )
+	{
+		max_ops = MAX_BLOCK_OPS;
+	}
+
+	bool	end_after_next( false );
+	for( u32 i = 0; i < max_ops; ++i )
+	{
+		OpCode		op_code( p_ops[ i ] );
+		SCachedOp	op = { CachedInter_GetHandler( op_code ), op_code._u32 };
+		block.Ops.push_back( op );
+
+		if( end_after_next )
+			break;
+
+		bool	has_delay_slot;
+		if( CachedInter_EndsBlock( op_code, &has_delay_slot ) )
+		{
+			if( !has_delay_slot )
+				break;
+
+			end_after_next = true;
+		}
+	}
+
+	gNumCachedOps += block.Ops.size();
+	gPageBlocks[ physical_address >> PAGE_SHIFT ].push_back( physical_address );
+
+	return &block;
+}
+
+static SCachedBlock * CachedInter_GetBlock( u32 physical_address, const u8 * p_host )
+{
+	SCachedBlock *&	p_lookup( gBlockLookup[ (physical_address >> 2) & (LOOKUP_TABLE_SIZE - 1) ] );
+	if( p_lookup != nullptr && p_lookup->PhysicalAddress == physical_address )
+		return p_lookup;
+
+	auto it( gBlocks.find( physical_address ) );
+	if( it != gBlocks.end() )
+	{
+		p_lookup = &it->second;
+	}
+	else
+	{
+		p_lookup = CachedInter_BuildBlock( physical_address, p_host );
+	}
+	return p_lookup;
+}
+
+//*****************************************************************************
+//	Run the ops in order until the block ends, we branch, or something comes
+//	up. This is CPU_EXECUTE_OP from Interpret.cpp, minus the fetch and decode.
+//*****************************************************************************
+static void CachedInter_ExecuteOps( const SCachedOp * p_ops, u32 num_ops, u8 * p_host, CachedInterBranchFn p_on_branch )
+{
+	u32		expected_pc( gCPUState.CurrentPC );
+
+	for( u32 i = 0; i < num_ops; ++i )
+	{
+		// Cache instruction base pointer (used for SpeedHack() @ R4300.0)
+		gLastAddress = p_host + i * 4;
+
+		SYNCH_POINT( DAED_SYNC_REG_PC, gCPUState.CurrentPC, "Program Counter doesn't match" );
+		SYNCH_POINT( DAED_SYNC_FRAGMENT_PC, gCPUState.CurrentPC + gCPUState.Delay, "Program Counter/Delay doesn't match while interpreting" );
+
+		SYNCH_POINT( DAED_SYNC_REG_PC, gCPUState.CPUControl[C0_COUNT]._u32, "Count doesn't match" );
+
+		p_ops[ i ].Handler( p_ops[ i ].OpCode );
+		gGPR[0]._u64 = 0;	//Ensure r0 is zero
+
+#ifdef DAEDALUS_PROFILE_EXECUTION
+		gTotalInstructionsEmulated++;
+#endif
+
+		SYNCH_POINT( DAED_SYNC_REGS, CPU_ProduceRegisterHash(), "Registers don't match" );
+
+		// Increment count register
+		gCPUState.CPUControl[C0_COUNT]._u32 = gCPUState.CPUControl[C0_COUNT]._u32 + COUNTER_INCREMENT_PER_OP;
+
+		if (CPU_ProcessEventCycles( COUNTER_INCREMENT_PER_OP ) )
+		{
+			CPU_HANDLE_COUNT_INTERRUPT();
+		}
+
+		switch (gCPUState.Delay)
+		{
+		case DO_DELAY:
+			INCREMENT_PC();
+			gCPUState.Delay = EXEC_DELAY;
+			break;
+		case EXEC_DELAY:
+			{
+				bool	backwards( gCPUState.TargetPC <= gCPUState.CurrentPC );
+
+				CPU_SetPC(gCPUState.TargetPC);
+				gCPUState.Delay = NO_DELAY;
+
+				if( p_on_branch != nullptr )
+				{
+					p_on_branch( backwards );
+				}
+			}
+			return;
+		case NO_DELAY:
+			INCREMENT_PC();
+			break;
+		}
+
+		// Likely branches skipping their delay slot, exceptions etc all end up
+		// somewhere other than the next op in the block
+		expected_pc += 4;
+		if( gCPUState.CurrentPC != expected_pc || gCPUState.GetStuffToDo() != 0 || gInvalidationPending )
+			return;
+	}
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void CachedInter_Run( CachedInterBranchFn p_on_branch )
+{
+	DAEDALUS_PROFILE( __FUNCTION__ );
+
+	while( gCPUState.GetStuffToDo() == 0 )
+	{
+		if( gInvalidationPending )
+		{
+			CachedInter_ProcessPendingInvalidations();
+		}
+
+		u8 * p_Instruction = 0;
+		CPU_FETCH_INSTRUCTION( p_Instruction, gCPUState.CurrentPC );
+
+		// Only code in RDRAM is cached. Anything else (e.g. code running
+		// from the cart) just runs a single op at a time
+		if( p_Instruction >= g_pu8RamBase && p_Instruction < g_pu8RamBase + gRamSize )
+		{
+			u32					physical_address( u32( p_Instruction - g_pu8RamBase ) );
+			const SCachedBlock *	p_block( CachedInter_GetBlock( physical_address, p_Instruction ) );
+
+			CachedInter_ExecuteOps( p_block->Ops.data(), p_block->Ops.size(), p_Instruction, p_on_branch );
+		}
+		else
+		{
+			OpCode		op_code( *reinterpret_cast< const OpCode * >( p_Instruction ) );
+			SCachedOp	op = { CachedInter_GetHandler( op_code ), op_code._u32 };
+
+			CachedInter_ExecuteOps( &op, 1, p_Instruction, p_on_branch );
+		}
+	}
+}
+
+//*****************************************************************************
+//	Keep executing blocks until there are other tasks to do
+//*****************************************************************************
+static void CachedInter_Go()
+{
+	DAEDALUS_PROFILE( __FUNCTION__ );
+
+	while (CPU_KeepRunning())
+	{
+		CachedInter_Run( nullptr );
+
+		if (CPU_CheckStuffToDo())
+			break;
+	}
+}
+
+void CachedInter_SelectCore()
+{
+	g_pCPUCore = CachedInter_Go;
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void CachedInter_Reset()
+{
+	CachedInter_Clear();
+
+	gNumPendingInvalidations = 0;
+	gInvalidateAll = false;
+	gInvalidationPending = false;
+}
+
+void CachedInter_InvalidateRange( u32 address, u32 length )
+{
+	if( length == 0 )
+		return;
+
+	if( gNumPendingInvalidations < MAX_PENDING_INVALIDATIONS )
+	{
+		SInvalidationRange &	range( gPendingInvalidations[ gNumPendingInvalidations++ ] );
+		range.Address = address;
+		range.Length = length;
+	}
+	else
+	{
+		gInvalidateAll = true;
+	}
+	gInvalidationPending = true;
+}
+
+void CachedInter_InvalidateAll()
+{
+	gInvalidateAll = true;
+	gInvalidationPending = true;
+}
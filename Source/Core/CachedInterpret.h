@@ -0,0 +1,48 @@
+/*
+Copyright (C) 2007 StrmnNrmn
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#pragma once
+
+#ifndef CORE_CACHEDINTERPRET_H_
+#define CORE_CACHEDINTERPRET_H_
+
+#include "Base/Types.h"
+
+//*****************************************************************************
+//	The cached interpreter decodes straight line blocks of code from RDRAM
+//	once, into the final instruction handler for each op, and runs them from
+//	there. Otherwise it behaves exactly as the interpreter does.
+//	Blocks are keyed by physical address, and thrown away by the same
+//	invalidation calls the dynarec uses.
+//*****************************************************************************
+
+// Called after the delay slot of every branch, as the dynarec's interpreter does
+using CachedInterBranchFn = void (*)( bool backwards );
+
+void CachedInter_Reset();
+void CachedInter_SelectCore();
+
+// Run until there's something to do
+void CachedInter_Run( CachedInterBranchFn p_on_branch );
+
+// These can be called while a block is running, so the work is deferred
+void CachedInter_InvalidateRange( u32 address, u32 length );
+void CachedInter_InvalidateAll();
+
+#endif // CORE_CACHEDINTERPRET_H_
@@ -29,10 +29,12 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "Core/ROM.h"
 #include "RomFile/ROMBuffer.h"
 #include "Core/PIF.h"
+#include "Core/RamWatch.h"
 #include "Core/Interrupt.h"
 #include "Core/Save.h"
 #include "Debug/DebugLog.h"
 #include "Debug/DBGConsole.h"
+#include "Interface/ConfigOptions.h"
 #include "OSHLE/OSTask.h"
 #include "OSHLE/patch.h"
 #include "Utility/FastMemcpy.h"
@@ -45,6 +47,50 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #endif
 
 bool gDMAUsed = false;
+
+//*****************************************************************************
+//	Large PI transfers from a rom that isn't fully in memory are done
+//	asynchronously. The chunks are prefetched on the rom cache's I/O thread
+//	while the emulated transfer is in progress, and the copy and interrupt
+//	happen when CPU_EVENT_PI_DMA fires.
+//*****************************************************************************
+struct SPendingPITransfer
+{
+	u32		MemAddress;
+	u32		RomOffset;
+	u32		Length;
+};
+
+static bool					gPITransferPending = false;
+static SPendingPITransfer	gPendingPITransfer;
+
+// Smaller transfers than this are cheap enough to do straight away
+static const u32			kMinAsyncPITransferLength = 16 * 1024;
+
+//*****************************************************************************
+//	Completion of each kind of DMA. These are called straight after the copy,
+//	or from the CPU event for the DMA if its completion is being timed
+//*****************************************************************************
+void DMA_SP_Complete()
+{
+	//Clear the DMA Busy
+	Memory_SP_SetRegister(SP_DMA_BUSY_REG, 0);
+	Memory_SP_ClrRegisterBits(SP_STATUS_REG, SP_STATUS_DMA_BUSY);
+}
+
+void DMA_SI_Complete()
+{
+	Memory_SI_SetRegisterBits(SI_STATUS_REG, SI_STATUS_INTERRUPT);
+	Memory_MI_SetRegisterBits(MI_INTR_REG, MI_INTR_SI);
+	R4300_Interrupt_UpdateCause3();
+}
+
+void DMA_PI_Complete()
+{
+	Memory_PI_ClrRegisterBits(PI_STATUS_REG, PI_STATUS_DMA_BUSY);
+	Memory_MI_SetRegisterBits(MI_INTR_REG, MI_INTR_PI);
+	R4300_Interrupt_UpdateCause3();
+}
 //*****************************************************************************
 //
 //*****************************************************************************
@@ -86,9 +132,7 @@ void DMA_SP_CopyFromRDRAM()
 	}
 #endif
 
-	//Clear the DMA Busy
-	Memory_SP_SetRegister(SP_DMA_BUSY_REG, 0);
-	Memory_SP_ClrRegisterBits(SP_STATUS_REG, SP_STATUS_DMA_BUSY);
+	DMA_SP_Complete();
 }
 
 //*****************************************************************************
@@ -105,6 +149,8 @@ void DMA_SP_CopyToRDRAM()
 	u32 length = ((wrlen_reg    &0x0FFF) | 7)+1;				// Round up to 8 bytes
 
 #ifdef FAST_DMA_SP
+	RamWatch_NotifyWrite( rdram_address, length );
+
 	if((spmem_address_reg & 0x1000) == 0)
 	{
 		fast_memcpy(&g_pu8RamBase[rdram_address], &g_pu8SpDmemBase[spmem_address], length);
@@ -120,6 +166,8 @@ void DMA_SP_CopyToRDRAM()
 		return;
 	}
 
+	RamWatch_NotifyWrite( rdram_address, rdram_address_end - rdram_address );
+
 	u8 * rdram = g_pu8RamBase + rdram_address;
 	u8 * spmem = (spmem_address_reg & 0x1000)  == 0 ? g_pu8SpDmemBase + spmem_address : g_pu8SpImemBase + spmem_address;
 
@@ -131,9 +179,7 @@ void DMA_SP_CopyToRDRAM()
 	}
 #endif
 
-	//Clear the DMA Busy
-	Memory_SP_SetRegister(SP_DMA_BUSY_REG, 0);
-	Memory_SP_ClrRegisterBits(SP_STATUS_REG, SP_STATUS_DMA_BUSY);
+	DMA_SP_Complete();
 }
 
 //*****************************************************************************
@@ -152,9 +198,7 @@ void DMA_SI_CopyFromDRAM( )
 		dst[i] = BSWAP32(src[i]);
 	}
 
-	Memory_SI_SetRegisterBits(SI_STATUS_REG, SI_STATUS_INTERRUPT);
-	Memory_MI_SetRegisterBits(MI_INTR_REG, MI_INTR_SI);
-	R4300_Interrupt_UpdateCause3();
+	DMA_SI_Complete();
 }
 
 //*****************************************************************************
@@ -171,6 +215,8 @@ void DMA_SI_CopyToDRAM( )
 
 	DPF( DEBUG_MEMORY_PIF, "PIF -> DRAM (0x%08x) Transfer ", mem );
 
+	RamWatch_NotifyWrite( mem, 64 );
+
 	for(u32 i = 0; i < 16; i++)
 	{
 		dst[i] = BSWAP32(src[i]);
@@ -242,8 +288,86 @@ static void OnCopiedRom()
 	}
 }
 
+//*****************************************************************************
+//
+//*****************************************************************************
+static bool DMA_PI_CopyFromRom( u32 mem_address, u32 rom_offset, u32 length )
+{
+	CPU_InvalidateICacheRange( 0x80000000 | mem_address, length );
+	return RomBuffer::CopyToRam( g_pu8RamBase, mem_address, gRamSize, rom_offset, length );
+}
+
+//*****************************************************************************
+// Returns false if the transfer should be done straight away
+//*****************************************************************************
+static bool DMA_PI_StartAsyncTransfer( u32 mem_address, u32 rom_offset, u32 length )
+{
+	if( !gAsyncPIDMAEnabled || RomBuffer::IsRomAddressFixed() || length < kMinAsyncPITransferLength )
+		return false;
+
+	gPendingPITransfer.MemAddress = mem_address;
+	gPendingPITransfer.RomOffset  = rom_offset;
+	gPendingPITransfer.Length     = length;
+	gPITransferPending = true;
+
+	RomBuffer::Prefetch( rom_offset, length );
+
+	// Roughly the PI's bandwidth from the cart
+	u32 cycles = 0x100 + (length * 63) / 25;
+
+	Memory_PI_SetRegisterBits(PI_STATUS_REG, PI_STATUS_DMA_BUSY);
+	CPU_AddEvent( cycles, CPU_EVENT_PI_DMA );
+	return true;
+}
+
+//*****************************************************************************
+// Called when CPU_EVENT_PI_DMA fires
+//*****************************************************************************
+void DMA_PI_FinishTransfer()
+{
+	if( gPITransferPending )
+	{
+		gPITransferPending = false;
+
+		// Usually everything has been loaded by now
+		RomBuffer::WaitForPrefetch();
+
+		// Pages may have been watched again since the transfer was started
+		RamWatch_NotifyWrite( gPendingPITransfer.MemAddress, gPendingPITransfer.Length );
+
+		if( DMA_PI_CopyFromRom( gPendingPITransfer.MemAddress, gPendingPITransfer.RomOffset, gPendingPITransfer.Length ) )
+		{
+			OnCopiedRom();
+		}
+	}
+
+	DMA_PI_Complete();
+}
+
+//*****************************************************************************
+// Complete any transfer in progress immediately
+//*****************************************************************************
+void DMA_PI_FlushTransfer()
+{
+	if( gPITransferPending && CPU_RemoveEvent( CPU_EVENT_PI_DMA ) )
+	{
+		DMA_PI_FinishTransfer();
+	}
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void DMA_Reset()
+{
+	gPITransferPending = false;
+}
+
 void DMA_PI_CopyToRDRAM()
 {
+	// The PI can only do one transfer at a time
+	DMA_PI_FlushTransfer();
+
 	u32 mem_address  = Memory_PI_GetRegister(PI_DRAM_ADDR_REG) & 0x00FFFFFF;
 	u32 cart_address = Memory_PI_GetRegister(PI_CART_ADDR_REG)  & 0xFFFFFFFF;
 	u32 pi_length_reg = (Memory_PI_GetRegister(PI_WR_LEN_REG) & 0xFFFFFFFF) + 1;
@@ -257,6 +381,8 @@ void DMA_PI_CopyToRDRAM()
 
 	DPF( DEBUG_MEMORY_PI, "PI: Copying %d bytes of data from 0x%08x to 0x%08x", pi_length_reg, cart_address, mem_address );
 
+	RamWatch_NotifyWrite( mem_address, pi_length_reg );
+
 	if ( IsDom2Addr1( cart_address ))
 	{
 		//DBGConsole_Msg(0, "[YReading from Cart domain 2/addr1]");
@@ -269,8 +395,10 @@ void DMA_PI_CopyToRDRAM()
 	{
 		//DBGConsole_Msg(0, "[YReading from Cart domain 1/addr1]");
 		cart_address -= PI_DOM1_ADDR1;
-		CPU_InvalidateICacheRange( 0x80000000 | mem_address, pi_length_reg );
-		copy_succeeded = RomBuffer::CopyToRam( g_pu8RamBase, mem_address, gRamSize, cart_address, pi_length_reg );
+		if( DMA_PI_StartAsyncTransfer( mem_address, cart_address, pi_length_reg ) )
+			return;
+
+		copy_succeeded = DMA_PI_CopyFromRom( mem_address, cart_address, pi_length_reg );
 	}
 	else if ( IsDom2Addr2( cart_address ) )
 	{
@@ -289,16 +417,20 @@ void DMA_PI_CopyToRDRAM()
 	{
 		//DBGConsole_Msg(0, "[YReading from Cart domain 1/addr2]");
 		cart_address -= PI_DOM1_ADDR2;
-		CPU_InvalidateICacheRange( 0x80000000 | mem_address, pi_length_reg );
-		copy_succeeded = RomBuffer::CopyToRam( g_pu8RamBase, mem_address, gRamSize, cart_address, pi_length_reg );
+		if( DMA_PI_StartAsyncTransfer( mem_address, cart_address, pi_length_reg ) )
+			return;
+
+		copy_succeeded = DMA_PI_CopyFromRom( mem_address, cart_address, pi_length_reg );
 
 	}
 	else if ( IsDom1Addr3( cart_address ) )
 	{
 		//DBGConsole_Msg(0, "[YReading from Cart domain 1/addr3]");
 		cart_address -= PI_DOM1_ADDR3;
-		CPU_InvalidateICacheRange( 0x80000000 | mem_address, pi_length_reg );
-		copy_succeeded = RomBuffer::CopyToRam( g_pu8RamBase, mem_address, gRamSize, cart_address, pi_length_reg );
+		if( DMA_PI_StartAsyncTransfer( mem_address, cart_address, pi_length_reg ) )
+			return;
+
+		copy_succeeded = DMA_PI_CopyFromRom( mem_address, cart_address, pi_length_reg );
 	}
 	else
 	{
@@ -320,15 +452,15 @@ void DMA_PI_CopyToRDRAM()
 		DBGConsole_Msg(0, "PIXFer: Not copying, but issuing interrupt");
 	}
 #endif
-	Memory_PI_ClrRegisterBits(PI_STATUS_REG, PI_STATUS_DMA_BUSY);
-	Memory_MI_SetRegisterBits(MI_INTR_REG, MI_INTR_PI);
-	R4300_Interrupt_UpdateCause3();
+	DMA_PI_Complete();
 }
 //*****************************************************************************
 //
 //*****************************************************************************
 void DMA_PI_CopyFromRDRAM()
 {
+	DMA_PI_FlushTransfer();
+
 	u32 mem_address = Memory_PI_GetRegister(PI_DRAM_ADDR_REG) & 0xFFFFFFFF;
 	u32 cart_address = Memory_PI_GetRegister(PI_CART_ADDR_REG)  & 0xFFFFFFFF;
 	u32 pi_length_reg = (Memory_PI_GetRegister(PI_RD_LEN_REG)  & 0xFFFFFFFF) + 1;
@@ -399,7 +531,5 @@ void DMA_PI_CopyFromRDRAM()
 		DBGConsole_Msg(0, "PIXFer: Not copying, but issuing interrupt");
 	}
 #endif
-	Memory_PI_ClrRegisterBits(PI_STATUS_REG, PI_STATUS_DMA_BUSY);
-	Memory_MI_SetRegisterBits(MI_INTR_REG, MI_INTR_PI);
-	R4300_Interrupt_UpdateCause3();
+	DMA_PI_Complete();
 }
@@ -18,10 +18,12 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include <algorithm>
+#include <array>
 #include <fstream>
 
 #include "Base/Types.h"
 #include "Core/Dynamo.h"
+#include "Core/CachedInterpret.h"
 
 
 
@@ -31,13 +33,18 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "Core/Memory.h"
 #include "Core/Interrupt.h"
 #include "Core/R4300.h"
+#include "Core/ROM.h"
 #include "Debug/Registers.h"		
 #include "Interface/ConfigOptions.h"
 #include "Debug/DBGConsole.h"
 #include "Debug/DebugLog.h"
+#include "DynaRec/BackgroundCompiler.h"
+#include "DynaRec/CodeBufferManager.h"
 #include "DynaRec/DynaRecProfile.h"
 #include "DynaRec/Fragment.h"
 #include "DynaRec/FragmentCache.h"
+#include "DynaRec/HotTraceCountTable.h"
+#include "DynaRec/PersistentTraceCache.h"
 #include "DynaRec/TraceRecorder.h"
 #include "OSHLE/patch.h"				// GetCorrectOp
 #include "Ultra/ultra_R4300.h"
@@ -63,14 +70,21 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 static const u32					gMaxFragmentCacheSize = (8192 + 1024); //Maximum amount of fragments in the cache
 static const u32					gMaxHotTraceMapSize = (2048 + TRACE_SIZE);
 static const u32					gHotTraceThreshold = 10;	//How many times interpreter has to loop a trace before it becomes hot and sent to dynarec
+static const u32					gMaxPendingInvalidations = 32;	//If more writes than this are queued up before a safe point, just flush everything
 
 
-//std::map< u32, u32, std::less<u32>, MyAllocator >				gHotTraceCountMap;
-//std::map< u32, u32, std::less<u32>, boost::pool_allocator<std::pair< const u32, u32 > > >				gHotTraceCountMap;
-std::map< u32, u32 >				gHotTraceCountMap {};
+CHotTraceCountTable					gHotTraceCountTable( gMaxHotTraceMapSize );
 CFragmentCache						gFragmentCache {};
 static bool							gResetFragmentCache {false};
 
+struct SInvalidationRange
+{
+	u32		Address;
+	u32		Length;
+};
+static std::array< SInvalidationRange, gMaxPendingInvalidations >	gPendingInvalidations {};
+static u32							gNumPendingInvalidations {0};
+
 #ifdef DAEDALUS_DEBUG_DYNAREC
 std::map< u32, u32 >				gAbortedTraceReasons;
 
@@ -78,8 +92,10 @@ void								CPU_DumpFragmentCache();
 #endif
 
 static void							CPU_HandleDynaRecOnBranch( bool backwards, bool trace_already_enabled );
-static void							CPU_UpdateTrace( u32 address, OpCode op_code, bool branch_delay_slot, bool branch_taken );
+static void							CPU_UpdateTrace( u32 address, OpCode op_code, u32 access_address, bool branch_delay_slot, bool branch_taken );
 static void							CPU_CreateAndAddFragment();
+static bool							CPU_AddPersistentFragment( u32 address );
+static void							CPU_AddBackgroundFragments();
 
 
 #ifdef DAEDALUS_PROFILE_EXECUTION
@@ -107,19 +123,53 @@ void CPU_DynarecEnable()
 }
 
 //*****************************************************************************
-// If fragments overlap dynarec has to start all over which is very costly
+// If fragments overlap, only the fragments built from the written pages are
+// discarded. This can be called from within a fragment, so the work is
+// deferred to a safe point.
 //*****************************************************************************
 void  CPU_InvalidateICacheRange( u32 address, u32 length )
 {
+	CachedInter_InvalidateRange( address, length );
+
 	if( gFragmentCache.ShouldInvalidateOnWrite( address, length ) )
 	{
 #ifndef DAEDALUS_SILENT
 		printf( "Write to %08x (%d bytes) overlaps fragment cache entries\n", address, length );
 #endif
-		CPU_ResetFragmentCache();
+		if( gNumPendingInvalidations < gMaxPendingInvalidations )
+		{
+			SInvalidationRange &	range( gPendingInvalidations[ gNumPendingInvalidations++ ] );
+			range.Address = address;
+			range.Length = length;
+		}
+		else
+		{
+			CPU_ResetFragmentCache();
+		}
 	}
 }
 
+//*****************************************************************************
+//
+//*****************************************************************************
+static void CPU_ProcessPendingInvalidations()
+{
+	u32		num_invalidated( 0 );
+
+	for( u32 i = 0; i < gNumPendingInvalidations; ++i )
+	{
+		num_invalidated += gFragmentCache.InvalidateRange( gPendingInvalidations[ i ].Address, gPendingInvalidations[ i ].Length );
+	}
+	gNumPendingInvalidations = 0;
+
+#ifdef DAEDALUS_DEBUG_CONSOLE
+	if( num_invalidated > 0 )
+	{
+		DBGConsole_Msg( 0, "Invalidated %d fragments, %d remain", num_invalidated, gFragmentCache.GetCacheSize() );
+	}
+#endif
+}
+
 
 //*****************************************************************************
 //	Execute a single MIPS op. The conditionals for the templated arguments
@@ -155,13 +205,15 @@ template< bool TraceEnabled > inline void CPU_EXECUTE_OP()
 		#endif
 		u32		pc( gCPUState.CurrentPC ) ;
 		bool	branch_delay_slot( gCPUState.Delay == EXEC_DELAY );
+		// The address a load or store would access, before the op can overwrite its base
+		u32		access_address( gGPR[ op_code.base ]._u32_0 + s16( op_code.offset ) );
 
 		R4300_ExecuteInstruction(op_code);
 		gGPR[0]._u64 = 0;	//Ensure r0 is zero
 
 		bool	branch_taken( gCPUState.Delay == DO_DELAY );
 
-		CPU_UpdateTrace( pc, op_code, branch_delay_slot, branch_taken );
+		CPU_UpdateTrace( pc, op_code, access_address, branch_delay_slot, branch_taken );
 	}
 	else
 	{
@@ -221,6 +273,15 @@ void	CPU_ResetFragmentCache()
 {
 	// Need to make sure this happens at a safe point, so we use a flag
 	gResetFragmentCache	= true;
+	CachedInter_InvalidateAll();
+}
+
+//*****************************************************************************
+//	Called from the cached interpreter after each branch when not tracing
+//*****************************************************************************
+static void CPU_OnCachedInterpreterBranch( bool backwards )
+{
+	CPU_HandleDynaRecOnBranch( backwards, false );
 }
 
 //*****************************************************************************
@@ -237,12 +298,23 @@ template < bool DynaRec, bool TraceEnabled > void CPU_Go()
 		// Keep executing ops as long as there's nothing to do
 		//
 		u32	stuff_to_do( gCPUState.GetStuffToDo() );
-		while(stuff_to_do == 0)
+		if( !TraceEnabled && gCachedInterpreterEnabled )
 		{
-			CPU_EXECUTE_OP< TraceEnabled >();
+			// Every op needs to go through the trace recorder while tracing,
+			// otherwise we can use the cached interpreter until a trace starts
+			CachedInter_Run( CPU_OnCachedInterpreterBranch );
 
 			stuff_to_do = gCPUState.GetStuffToDo();
 		}
+		else
+		{
+			while(stuff_to_do == 0)
+			{
+				CPU_EXECUTE_OP< TraceEnabled >();
+
+				stuff_to_do = gCPUState.GetStuffToDo();
+			}
+		}
 
 		if( TraceEnabled && (stuff_to_do != CPU_CHANGE_CORE) )
 		{
@@ -318,11 +390,15 @@ void	CPU_DumpFragmentCache()
 	{
 		std::vector< SAddressHitCount >	hit_counts;
 
-		hit_counts.reserve( gHotTraceCountMap.size() );
+		hit_counts.reserve( gHotTraceCountTable.GetSize() );
 
-		for(std::map<u32,u32>::const_iterator it = gHotTraceCountMap.begin(); it != gHotTraceCountMap.end(); ++it )
+		for( u32 i = 0; i < gHotTraceCountTable.GetCapacity(); ++i )
 		{
-			hit_counts.push_back( SAddressHitCount( it->first, it->second ) );
+			const CHotTraceCountTable::SEntry & entry( gHotTraceCountTable.GetEntry( i ) );
+			if( entry.Count != 0 )
+			{
+				hit_counts.push_back( SAddressHitCount( entry.Address, entry.Count ) );
+			}
 		}
 
 		std::sort( hit_counts.begin(), hit_counts.end(), SortByHitCount );
@@ -368,21 +444,97 @@ void	CPU_DumpFragmentCache()
 void CPU_CreateAndAddFragment()
 {
 	// std::shared_ptr<CFragment> p_fragment( gTraceRecorder.CreateFragment( gFragmentCache.GetCodeBufferManager() ) );
-	CFragment * p_fragment( gTraceRecorder.CreateFragment( gFragmentCache.GetCodeBufferManager() ) );
+	CFragment * p_fragment( nullptr );
+	SRecordedTrace	trace;
+
+	if( gBackgroundCompiler.IsRunning() )
+	{
+		// Keep interpreting while the worker compiles it. The hot trace count is
+		// left alone so this address isn't traced again in the meantime.
+		gTraceRecorder.ReleaseTrace( trace );
+
+		if( CTraceRecorder::ValidateTrace( trace ) && gBackgroundCompiler.Queue( trace ) )
+			return;
+
+		p_fragment = CTraceRecorder::CreateFragment( gFragmentCache.GetCodeBufferManager(), trace );
+	}
+	else
+	{
+		if( gPersistentTraceCache.IsOpen() )
+		{
+			gTraceRecorder.GetRecordedTrace( trace );
+		}
+		p_fragment = gTraceRecorder.CreateFragment( gFragmentCache.GetCodeBufferManager() );
+	}
 
 	if( p_fragment != nullptr )
 	{
-		gHotTraceCountMap.erase( p_fragment->GetEntryAddress() );
+		// Only keep traces that compiled, or we'd retry the failures every session
+		gPersistentTraceCache.AddTrace( trace );
+
+		gHotTraceCountTable.Remove( p_fragment->GetEntryAddress() );
 		gFragmentCache.InsertFragment( p_fragment );
 
 		//DBGConsole_Msg( 0, "Inserted hot trace at [R%08x]! (size is %d. %dKB)", p_fragment->GetEntryAddress(), gFragmentCache.GetCacheSize(), gFragmentCache.GetMemoryUsage() / 1024 );
 	}
 }
 
+//*****************************************************************************
+// Compile a trace recorded in a previous session, if it still matches memory
+//*****************************************************************************
+bool CPU_AddPersistentFragment( u32 address )
+{
+	if( !gPersistentTraceCache.IsOpen() )
+		return false;
+
+	const SRecordedTrace * p_trace( gPersistentTraceCache.FindValidTrace( address ) );
+	if( p_trace == nullptr )
+		return false;
+
+	CFragment * p_fragment( CTraceRecorder::CreateFragment( gFragmentCache.GetCodeBufferManager(), *p_trace ) );
+	if( p_fragment == nullptr )
+		return false;
+
+	gHotTraceCountTable.Remove( address );
+	gFragmentCache.InsertFragment( p_fragment );
+	return true;
+}
+
+//*****************************************************************************
+// Publish anything the background compiler has finished
+//*****************************************************************************
+void CPU_AddBackgroundFragments()
+{
+	SRecordedTrace	trace;
+	CFragment *		p_fragment( nullptr );
+
+	while( gBackgroundCompiler.PopFinished( trace, &p_fragment ) )
+	{
+		u32 address( trace.StartAddress );
+
+		// The count was left alone while this was queued. Reset it either way, so
+		// a dropped trace can get hot again rather than sitting above the threshold
+		gHotTraceCountTable.Remove( address );
+
+		if( p_fragment == nullptr )
+			continue;
+
+		// Something else may have claimed this address while it was compiling
+		if( gFragmentCache.LookupFragmentQ( address ) != nullptr )
+		{
+			delete p_fragment;
+			continue;
+		}
+
+		gPersistentTraceCache.AddTrace( trace );
+		gFragmentCache.InsertFragment( p_fragment );
+	}
+}
+
 //*****************************************************************************
 //
 //*****************************************************************************
-void CPU_UpdateTrace( u32 address, OpCode op_code, bool branch_delay_slot, bool branch_taken )
+void CPU_UpdateTrace( u32 address, OpCode op_code, u32 access_address, bool branch_delay_slot, bool branch_taken )
 {
 	#ifdef DAEDALUS_PROFILE
 	DAEDALUS_PROFILE( "CPU_UpdateTrace" );
@@ -397,7 +549,7 @@ void CPU_UpdateTrace( u32 address, OpCode op_code, bool branch_delay_slot, bool
 #else
 	CFragment * p_address_fragment( gFragmentCache.LookupFragmentQ( address ) );
 #endif
-	if( gTraceRecorder.UpdateTrace( address, branch_delay_slot, branch_taken, op_code, p_address_fragment ) == CTraceRecorder::UTS_CREATE_FRAGMENT )
+	if( gTraceRecorder.UpdateTrace( address, branch_delay_slot, branch_taken, op_code, access_address, p_address_fragment ) == CTraceRecorder::UTS_CREATE_FRAGMENT )
 	{
 		CPU_CreateAndAddFragment();
 		#ifdef DAEDALUS_ENABLE_ASSERTS
@@ -487,8 +639,9 @@ void CPU_HandleDynaRecOnBranch( bool backwards, bool trace_already_enabled )
 						if(true)
 #endif
 						{
+							gBackgroundCompiler.Discard();
 							gFragmentCache.Clear();
-							gHotTraceCountMap.clear();		// Makes sense to clear this now, to get accurate usage stats
+							gHotTraceCountTable.Clear();		// Makes sense to clear this now, to get accurate usage stats
 #ifdef DAEDALUS_ENABLE_OS_HOOKS
 							Patch_PatchAll();
 #endif
@@ -502,31 +655,42 @@ void CPU_HandleDynaRecOnBranch( bool backwards, bool trace_already_enabled )
 						gResetFragmentCache = false;
 					}
 
-					if( gFragmentCache.GetCacheSize() > gMaxFragmentCacheSize)
+					if( gNumPendingInvalidations > 0 )
+					{
+						CPU_ProcessPendingInvalidations();
+					}
+
+					if( gBackgroundCompiler.IsRunning() )
 					{
+						CPU_AddBackgroundFragments();
+					}
+
+					// Invalidated fragments still occupy the code buffer until the cache is cleared
+					if( gFragmentCache.GetCacheSize() + gFragmentCache.GetInvalidatedCount() > gMaxFragmentCacheSize)
+					{
+						gBackgroundCompiler.Discard();
 						gFragmentCache.Clear();
-						gHotTraceCountMap.clear();		// Makes sense to clear this now, to get accurate usage stats
+						gHotTraceCountTable.Clear();		// Makes sense to clear this now, to get accurate usage stats
 #ifdef DAEDALUS_ENABLE_OS_HOOKS
 						Patch_PatchAll();
 #endif
 					}
 
 					// If there is no fragment for this target, start tracing
-					u32 trace_count( ++gHotTraceCountMap[ gCPUState.CurrentPC ] );
-					if( gHotTraceCountMap.size() >= gMaxHotTraceMapSize )
+					// (the table ages its counts once gMaxHotTraceMapSize addresses are live)
+					u32 trace_count( gHotTraceCountTable.Increment( gCPUState.CurrentPC ) );
+					DYNAREC_PROFILE_HOTTRACECOUNTS( gHotTraceCountTable );
+
+					// Code we compiled last session doesn't need to get hot again, build it now and run it
+					if( trace_count == 1 && CPU_AddPersistentFragment( gCPUState.CurrentPC ) )
 					{
-						#ifdef DAEDALUS_DEBUG_CONSOLE
-						DBGConsole_Msg( 0, "Hot trace cache hit %d, dumping", gHotTraceCountMap.size() );
-						#endif
-						gHotTraceCountMap.clear();
-						gFragmentCache.Clear();
-#ifdef DAEDALUS_ENABLE_OS_HOOKS
-						Patch_PatchAll();
-#endif
+						start_of_trace = true;
+						continue;
 					}
-					else if( trace_count == gHotTraceThreshold )
+
+					if( trace_count == gHotTraceThreshold )
 					{
-						//DBGConsole_Msg( 0, "Identified hot trace at [R%08x]! (size is %d)", gCPUState.CurrentPC, gHotTraceCountMap.size() );
+						//DBGConsole_Msg( 0, "Identified hot trace at [R%08x]! (size is %d)", gCPUState.CurrentPC, gHotTraceCountTable.GetSize() );
 						gTraceRecorder.StartTrace( gCPUState.CurrentPC );
 
 						if(!trace_already_enabled)
@@ -541,8 +705,8 @@ void CPU_HandleDynaRecOnBranch( bool backwards, bool trace_already_enabled )
 						if(gAbortedTraceReasons.find( gCPUState.CurrentPC ) != gAbortedTraceReasons.end() )
 						{
 							u32 reason [[maybe_unused]] = gAbortedTraceReasons[ gCPUState.CurrentPC ];
-							//DBGConsole_Msg( 0, "Hot trace at [R%08x] has count of %d! (reason is %x) size %d", gCPUState.CurrentPC, trace_count, reason, gHotTraceCountMap.size( ) );
-							DAED_LOG( DEBUG_DYNAREC_CACHE, "Hot trace at %08x has count of %d! (reason is %x) size %d", gCPUState.CurrentPC, trace_count, reason, gHotTraceCountMap.size( ) );
+							//DBGConsole_Msg( 0, "Hot trace at [R%08x] has count of %d! (reason is %x) size %d", gCPUState.CurrentPC, trace_count, reason, gHotTraceCountTable.GetSize() );
+							DAED_LOG( DEBUG_DYNAREC_CACHE, "Hot trace at %08x has count of %d! (reason is %x) size %d", gCPUState.CurrentPC, trace_count, reason, gHotTraceCountTable.GetSize() );
 						}
 						else
 						{
@@ -570,13 +734,44 @@ void CPU_HandleDynaRecOnBranch( bool backwards, bool trace_already_enabled )
 
 void Dynamo_Reset()
 {
-	gHotTraceCountMap.clear();
+	gHotTraceCountTable.Clear();
+	gBackgroundCompiler.Discard();
 	gFragmentCache.Clear();
 	gResetFragmentCache = false;
+	gNumPendingInvalidations = 0;
 	gTraceRecorder.AbortTrace();
 #ifdef DAEDALUS_DEBUG_DYNAREC
 	gAbortedTraceReasons.clear();
 #endif
+
+	// This is called when a ROM is opened, so pick up any traces saved for it
+	if( gDynarecPersistentCache )
+	{
+		gPersistentTraceCache.Open( g_ROM.mRomID );
+	}
+	else
+	{
+		gPersistentTraceCache.Close();
+	}
+
+	// Only backends with a background code buffer can do this
+	if( !gDynarecBackgroundCompile || !gBackgroundCompiler.Start( gFragmentCache.GetCodeBufferManager()->GetBackgroundManager() ) )
+	{
+		gBackgroundCompiler.Stop();
+	}
+}
+
+void Dynamo_RomClose()
+{
+	gPersistentTraceCache.Close();
+
+#ifdef DAEDALUS_DEBUG_CONSOLE
+	if( gBackgroundCompiler.IsRunning() )
+	{
+		gBackgroundCompiler.DumpStats();
+	}
+#endif
+	gBackgroundCompiler.Stop();
 }
 
 void Dynamo_SelectCore()
@@ -595,8 +790,9 @@ void Dynamo_SelectCore()
 
 #else
 
-void CPU_ResetFragmentCache() {}
+void CPU_ResetFragmentCache()	{ CachedInter_InvalidateAll(); }
 void Dynamo_Reset() {}
-void  CPU_InvalidateICacheRange( u32 address [[maybe_unused]], u32 length [[maybe_unused]] ) {}
+void Dynamo_RomClose() {}
+void  CPU_InvalidateICacheRange( u32 address, u32 length )	{ CachedInter_InvalidateRange( address, length ); }
 
 #endif //DAEDALUS_ENABLE_DYNAREC
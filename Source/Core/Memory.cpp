@@ -30,6 +30,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "Core/FlashMem.h"
 #include "Core/Interrupt.h"
 #include "Core/Memory.h"
+#include "Core/RamWatch.h"
 #include "Core/ROM.h"
 #include "RomFile/ROMBuffer.h"
 #include "Interface/ConfigOptions.h"
@@ -45,6 +46,13 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <windows.h>
 #endif
 
+#ifdef DAEDALUS_FASTMEM
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 static const u32	kMaximumMemSize = MEMORY_8_MEG;
 
 #undef min
@@ -115,6 +123,80 @@ MemFuncRead  	g_MemoryLookupTableRead[0x4000];
 MemFuncWrite 	g_MemoryLookupTableWrite[0x4000];
 void * 			g_pMemoryBuffers[NUM_MEM_BUFFERS];
 
+#ifdef DAEDALUS_FASTMEM
+u8 *			g_pFastmemBase = nullptr;
+static int		gFastmemFd = -1;
+
+// RDRAM is mapped at both of these. KUSEG/KSEG2 go through the TLB, so are left unmapped
+static const u32	kFastmemRamViews[] = { 0x80000000, 0xA0000000 };
+
+//*****************************************************************************
+//	Reserve the fastmem region and back both unmapped kernel segments with the
+//	same RDRAM pages. On success RDRAM lives at g_pFastmemBase + 0x80000000.
+//*****************************************************************************
+static bool Memory_InitFastmem()
+{
+	char name[ 64 ];
+	snprintf( name, sizeof( name ), "/daedalus-rdram-%d", (int)getpid() );
+
+	int fd = shm_open( name, O_RDWR | O_CREAT | O_EXCL, 0600 );
+	if (fd < 0)
+	{
+		return false;
+	}
+	shm_unlink( name );
+
+	if (ftruncate( fd, kMaximumMemSize ) != 0)
+	{
+		close( fd );
+		return false;
+	}
+
+	u8 * base = (u8*)mmap( nullptr, FASTMEM_REGION_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0 );
+	if (base == MAP_FAILED)
+	{
+		close( fd );
+		return false;
+	}
+
+	for (u32 view : kFastmemRamViews)
+	{
+		void * p = mmap( base + view, kMaximumMemSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0 );
+		if (p == MAP_FAILED)
+		{
+			munmap( base, FASTMEM_REGION_SIZE );
+			close( fd );
+			return false;
+		}
+	}
+
+	#ifdef DAEDALUS_DEBUG_CONSOLE
+	DBGConsole_Msg( 0, "Fastmem region reserved at %p", base );
+	#endif
+
+	g_pFastmemBase = base;
+	gFastmemFd = fd;
+	g_pMemoryBuffers[MEM_RD_RAM] = base + kFastmemRamViews[0];
+	return true;
+}
+
+static void Memory_FiniFastmem()
+{
+	if (g_pFastmemBase != nullptr)
+	{
+		// Nothing can be watched once the views are gone
+		RamWatch_Enable( false );
+
+		munmap( g_pFastmemBase, FASTMEM_REGION_SIZE );
+		close( gFastmemFd );
+
+		g_pFastmemBase = nullptr;
+		gFastmemFd = -1;
+		g_pMemoryBuffers[MEM_RD_RAM] = nullptr;
+	}
+}
+#endif
+
 
 #include "Memory_Read.inl"
 #include "Memory_WriteValue.inl"
@@ -162,6 +244,13 @@ bool Memory_Init()
 	for (u32 m = 0; m < NUM_MEM_BUFFERS; m++)
 	{
 		u32 region_size = MemoryRegionSizes[m];
+#ifdef DAEDALUS_FASTMEM
+		// Fall back to a normal allocation if the fastmem region isn't available
+		if (m == MEM_RD_RAM && Memory_InitFastmem())
+		{
+			continue;
+		}
+#endif
 		// Skip zero sized areas. An example of this is the cart rom
 		if (region_size > 0)
 		{
@@ -211,6 +300,9 @@ void Memory_Fini(void)
 	gMemBase = nullptr;
 
 #else
+#ifdef DAEDALUS_FASTMEM
+	Memory_FiniFastmem();
+#endif
 	for (u32 m = 0; m < NUM_MEM_BUFFERS; m++)
 	{
 		if (g_pMemoryBuffers[m] != nullptr)
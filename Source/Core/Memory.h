@@ -82,6 +82,14 @@ extern u32		gTLBWriteHit;
 extern void *	g_pMemoryBuffers[NUM_MEM_BUFFERS];
 extern const u32 MemoryRegionSizes[NUM_MEM_BUFFERS];
 
+#ifdef DAEDALUS_FASTMEM
+// 4GB of host address space laid out like the N64's, for the dynarec to access
+// directly. Only RDRAM is mapped (at 0x80000000 and 0xA0000000), everything
+// else faults. nullptr if the region couldn't be set up.
+static const u64 FASTMEM_REGION_SIZE( 0x100000000ULL );
+extern u8 *		g_pFastmemBase;
+#endif
+
 bool			Memory_Init();
 void			Memory_Fini();
 bool			Memory_Reset();
@@ -33,6 +33,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "Debug/Registers.h"			// For REG_?? defines
 #include "Debug/DBGConsole.h"
 #include "Debug/DebugLog.h"
+#include "DynaRec/StaticAnalysis.h"
 #include "DynaRec/TraceRecorder.h"
 
 #include "Ultra/ultra_R4300.h"
@@ -137,16 +138,88 @@ using d64 = f64;
 #endif
 
 
+#if defined(SPEEDHACK_INTERPRETER) && defined(DAEDALUS_ENABLE_DYNAREC)
+namespace
+{
+	// Remember which backwards branches close idle loops, so we don't
+	// have to analyse every loop each time round
+	struct SIdleLoopCacheEntry
+	{
+		u32		BranchAddress;
+		u32		TargetAddress;
+		u32		BranchOp;
+		u32		DelayOp;
+		bool	Idle;
+	};
+
+	const u32				IDLE_LOOP_CACHE_SIZE = 64;
+	SIdleLoopCacheEntry		gIdleLoopCache[ IDLE_LOOP_CACHE_SIZE ];
+}
+
+// The loop's loads have to be shown to read RDRAM, not a register which changes
+// on each read. That depends on the registers, so it's checked every time.
+static bool R4300_IsIdleLoopReadingRDRAM( u32 new_pc, const OpCode * p_loop, u32 num_ops )
+{
+	u32		load_addresses[ StaticAnalysis::MAX_IDLE_LOOP_OPS ];
+
+	return StaticAnalysis::GetIdleLoopLoadAddresses( p_loop, num_ops, load_addresses ) &&
+		   StaticAnalysis::IsIdleLoop( new_pc, p_loop, num_ops, load_addresses );
+}
+
+static bool R4300_IsIdleLoop( u32 pc, u32 new_pc )
+{
+	if( new_pc > pc )
+		return false;
+
+	u32 num_ops = (pc - new_pc) / 4 + 2;
+	if( num_ops > StaticAnalysis::MAX_IDLE_LOOP_OPS )
+		return false;
+
+	// The loop is read straight out of the page the branch was fetched from
+	if( (new_pc ^ (pc + 4)) & ~0xfff )
+		return false;
+
+	const OpCode * p_branch = reinterpret_cast< const OpCode * >( gLastAddress );
+	const OpCode * p_loop = p_branch - (num_ops - 2);
+
+	SIdleLoopCacheEntry & entry( gIdleLoopCache[ (pc >> 2) & (IDLE_LOOP_CACHE_SIZE - 1) ] );
+	if( entry.BranchAddress != pc || entry.TargetAddress != new_pc ||
+		entry.BranchOp != p_branch[ 0 ]._u32 || entry.DelayOp != p_branch[ 1 ]._u32 )
+	{
+		entry.BranchAddress = pc;
+		entry.TargetAddress = new_pc;
+		entry.BranchOp = p_branch[ 0 ]._u32;
+		entry.DelayOp = p_branch[ 1 ]._u32;
+		entry.Idle = R4300_IsIdleLoopReadingRDRAM( new_pc, p_loop, num_ops );
+
+		if( entry.Idle )
+		{
+			CPU_AddIdleLoop( new_pc );
+		}
+
+		return entry.Idle;
+	}
+
+	return entry.Idle && R4300_IsIdleLoopReadingRDRAM( new_pc, p_loop, num_ops );
+}
+#endif
+
 inline void SpeedHack(u32 pc, u32 new_pc)
 {
 #ifdef SPEEDHACK_INTERPRETER
+#ifdef DAEDALUS_ENABLE_DYNAREC
+	if (gTraceRecorder.IsTraceActive())
+		return;
+
+	// If this branch closes a loop which is just waiting for an interrupt, skip ahead to it
+	if (R4300_IsIdleLoop(pc, new_pc))
+	{
+		CPU_SkipIdleLoop();
+	}
+#else
 	// If jumping to the same address, this might be a busy-wait
 	if (pc == new_pc)
 	{
-#ifdef DAEDALUS_ENABLE_DYNAREC
-		if (gTraceRecorder.IsTraceActive())
-			return;
-#endif
 		// TODO: Should maybe use some internal function, so we can account
 		// for things like Branch/DelaySlot pair straddling a page boundary.
 		u32 next_op = *(u32 *)(gLastAddress + 4);
@@ -154,30 +227,11 @@ inline void SpeedHack(u32 pc, u32 new_pc)
 		// If nop, then this is a busy-wait for an interrupt
 		if (next_op == 0)
 		{
-			// XXXX if we leave the counter at 1, then we always terminate traces with a delay slot active.
-			// Need a more permenant fix to for this - i.e. making tracing more robust.
-			CPU_SkipToNextEvent();
+			CPU_SkipIdleLoop();
 		}
-		// XXXX check this....need to update count....
-		// This is:
-		// 0x7f0d01e8: BNEL      v0 != v1 --> 0x7f0d01e8
-		// 0x7f0d01ec: ADDIU     v0 = v0 + 0x0004
-		/*else if (op._u32 == 0x5443ffff && next_op == 0x24420004)
-		{
-			gGPR[REG_v0]._u64 = gGPR[REG_v1]._u64 - 4;
-		}*/
-		/*else
-		{
-			static bool warned = false;
-
-			if (!warned)
-			{
-				DBGConsole_Msg(0, "Missed Speedhack 0x%08x", gCPUState.CurrentPC);
-				warned = true;
-			}
-		}*/
 	}
 #endif
+#endif
 }
 //
 //	A bit on FPU exceptions.
@@ -1157,7 +1211,6 @@ static void  R4300_CACHE( R4300_CALL_SIGNATURE )
 	R4300_CALL_MAKE_OP( op_code );
 //	return;
 
-#ifdef DAEDALUS_ENABLE_DYNAREC
 	u32 cache_op  = op_code.rt;
 	u32 address = (u32)( gGPR[op_code.base]._s32_0 + (s32)(s16)op_code.immediate );
 
@@ -1171,7 +1224,6 @@ static void  R4300_CACHE( R4300_CALL_SIGNATURE )
 		CPU_InvalidateICacheRange(address, 0x20);
 	}
 	//DBGConsole_Msg(0, "CACHE %s/%d, 0x%08x", gCacheNames[dwCache], dwAction, address);
-#endif
 }
 
 static void  R4300_LWC1( R4300_CALL_SIGNATURE ) 				// Load Word to Copro 1 (FPU)
@@ -3284,6 +3336,13 @@ CPU_Instruction	R4300_GetInstructionHandler( OpCode op_code )
 //Used to swap functions(apply hacks) in interpreter mode (used for the PSP only)
 void R4300_Init()
 {
+#if defined(SPEEDHACK_INTERPRETER) && defined(DAEDALUS_ENABLE_DYNAREC)
+	for( SIdleLoopCacheEntry & entry : gIdleLoopCache )
+	{
+		entry = SIdleLoopCacheEntry();
+	}
+#endif
+
 #ifdef SIM_DOUBLES
 	if(g_ROM.GameHacks == BUCK_BUMBLE)
 	{
@@ -0,0 +1,229 @@
+/*
+Copyright (C) 2007 StrmnNrmn
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+
+#include "Base/Types.h"
+
+#include "Core/RamWatch.h"
+
+#ifdef DAEDALUS_FASTMEM
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+
+#include "Core/Memory.h"
+#include "Debug/DBGConsole.h"
+
+namespace
+{
+	const u32	kPageSize = 1 << RAMWATCH_PAGE_SHIFT;
+	const u32	kRamSize  = MEMORY_8_MEG;		// As mapped by Memory_InitFastmem
+	const u32	kNumPages = kRamSize >> RAMWATCH_PAGE_SHIFT;
+
+	// The two views of RDRAM set up by Memory_InitFastmem. Both have to be protected
+	const u32	kRamViews[] = { 0x80000000, 0xA0000000 };
+
+	// These are touched from the fault handler, which can run on any thread that writes RDRAM
+	std::atomic< bool >							gEnabled( false );
+	std::atomic< u32 >							gWriteStamp( 0 );
+	std::array< std::atomic< u8 >, kNumPages >	gPageArmed {};		// Protected, and waiting for a write
+	std::array< std::atomic< u32 >, kNumPages >	gPageStamp {};		// gWriteStamp when last written
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+static void SetPageWritable( u32 page, bool writable )
+{
+	for( u32 view : kRamViews )
+	{
+		mprotect( g_pFastmemBase + view + ( page << RAMWATCH_PAGE_SHIFT ), kPageSize, writable ? PROT_READ | PROT_WRITE : PROT_READ );
+	}
+}
+
+//*****************************************************************************
+//	Pages [first, last) covering the range. Returns false if there are none
+//*****************************************************************************
+static bool GetPageRange( u32 address, u32 length, u32 * p_first, u32 * p_last )
+{
+	address &= kRamSize - 1;
+
+	u32 end = std::min( address + std::max( length, 1u ), kRamSize );
+
+	*p_first = address >> RAMWATCH_PAGE_SHIFT;
+	*p_last  = ( end + kPageSize - 1 ) >> RAMWATCH_PAGE_SHIFT;
+	return *p_first < *p_last;
+}
+
+//*****************************************************************************
+//	Stamps the page, so anything armed before now sees it as written
+//*****************************************************************************
+static void MarkPageWritten( u32 page )
+{
+	gPageStamp[ page ].store( gWriteStamp.fetch_add( 1 ) + 1 );
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+bool RamWatch_IsEnabled()
+{
+	return gEnabled.load( std::memory_order_relaxed );
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void RamWatch_Enable( bool enable )
+{
+	if( enable == gEnabled.load() )
+		return;
+
+	if( enable )
+	{
+		if( g_pFastmemBase == nullptr || sysconf( _SC_PAGESIZE ) != long( kPageSize ) )
+			return;
+
+		DBGConsole_Msg( 0, "RDRAM write watching enabled" );
+	}
+
+	// Nothing was watched while disabled, so whatever was armed before can't be trusted
+	for( u32 page = 0; page < kNumPages; ++page )
+	{
+		if( gPageArmed[ page ].exchange( 0 ) && g_pFastmemBase != nullptr )
+		{
+			SetPageWritable( page, true );
+		}
+		MarkPageWritten( page );
+	}
+
+	gEnabled = enable;
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+u32 RamWatch_Arm( u32 address, u32 length )
+{
+	if( !RamWatch_IsEnabled() )
+		return 0;
+
+	// Read the stamp first - a write that lands before the page is protected
+	// is one the caller will see when it reads the range
+	const u32 stamp = gWriteStamp.load();
+
+	u32 first, last;
+	if( GetPageRange( address, length, &first, &last ) )
+	{
+		for( u32 page = first; page < last; ++page )
+		{
+			if( !gPageArmed[ page ].exchange( 1 ) )
+			{
+				SetPageWritable( page, false );
+			}
+		}
+	}
+
+	return stamp;
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+bool RamWatch_HasWritten( u32 address, u32 length, u32 stamp )
+{
+	if( !RamWatch_IsEnabled() )
+		return true;
+
+	u32 first, last;
+	if( GetPageRange( address, length, &first, &last ) )
+	{
+		for( u32 page = first; page < last; ++page )
+		{
+			if( gPageStamp[ page ].load( std::memory_order_relaxed ) > stamp )
+				return true;
+		}
+	}
+	return false;
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void RamWatch_NotifyWrite( u32 address, u32 length )
+{
+	if( !RamWatch_IsEnabled() )
+		return;
+
+	u32 first, last;
+	if( GetPageRange( address, length, &first, &last ) )
+	{
+		for( u32 page = first; page < last; ++page )
+		{
+			if( gPageArmed[ page ].exchange( 0 ) )
+			{
+				MarkPageWritten( page );
+				SetPageWritable( page, true );
+			}
+		}
+	}
+}
+
+//*****************************************************************************
+//	Called from the fault handler, so keep to atomics and mprotect
+//*****************************************************************************
+bool RamWatch_HandleFault( const u8 * p_fault_address )
+{
+	if( !RamWatch_IsEnabled() || g_pFastmemBase == nullptr )
+		return false;
+
+	for( u32 view : kRamViews )
+	{
+		const u8 * p_view = g_pFastmemBase + view;
+		if( p_fault_address >= p_view && p_fault_address < p_view + kRamSize )
+		{
+			const u32 page = u32( p_fault_address - p_view ) >> RAMWATCH_PAGE_SHIFT;
+
+			// If the flag's already clear, another thread beat us to it (or
+			// RamWatch_NotifyWrite raced with RamWatch_Arm) - just unprotect it
+			if( gPageArmed[ page ].exchange( 0 ) )
+			{
+				MarkPageWritten( page );
+			}
+			SetPageWritable( page, true );
+			return true;
+		}
+	}
+	return false;
+}
+
+#else
+
+bool RamWatch_IsEnabled()											{ return false; }
+void RamWatch_Enable( bool enable [[maybe_unused]] )				{}
+u32  RamWatch_Arm( u32 address [[maybe_unused]], u32 length [[maybe_unused]] )	{ return 0; }
+bool RamWatch_HasWritten( u32 address [[maybe_unused]], u32 length [[maybe_unused]], u32 stamp [[maybe_unused]] )	{ return true; }
+void RamWatch_NotifyWrite( u32 address [[maybe_unused]], u32 length [[maybe_unused]] )	{}
+bool RamWatch_HandleFault( const u8 * p_fault_address [[maybe_unused]] )	{ return false; }
+
+#endif // DAEDALUS_FASTMEM
@@ -0,0 +1,54 @@
+/*
+Copyright (C) 2007 StrmnNrmn
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef CORE_RAMWATCH_H_
+#define CORE_RAMWATCH_H_
+
+#include "Base/Types.h"
+
+//*****************************************************************************
+//	Tells us when RDRAM has been written, a 4KB page at a time, so cached
+//	data built from it (textures) can be thrown away exactly when it changes.
+//	Watched pages are write-protected in both fastmem views of RDRAM. The
+//	first store to one faults, and the fastmem fault handler passes it to
+//	RamWatch_HandleFault, which stamps the page and lets the store through.
+//	DMAs mark their destination up front with RamWatch_NotifyWrite, rather
+//	than taking a fault per page.
+//	Only available once the fastmem fault handler is installed; until then
+//	RamWatch_IsEnabled returns false and callers have to check for changes
+//	themselves.
+//*****************************************************************************
+
+static const u32	RAMWATCH_PAGE_SHIFT = 12;
+
+bool	RamWatch_IsEnabled();
+void	RamWatch_Enable( bool enable );
+
+// Protects the pages covering the range, and returns a stamp to pass to RamWatch_HasWritten.
+// Call this before reading the range, so that nothing written after the read is missed.
+u32		RamWatch_Arm( u32 address, u32 length );
+// True if any page covering the range has been written since stamp was returned by RamWatch_Arm
+bool	RamWatch_HasWritten( u32 address, u32 length, u32 stamp );
+
+void	RamWatch_NotifyWrite( u32 address, u32 length );
+
+// Returns true if the fault was a store to a watched page, and can be retried
+bool	RamWatch_HandleFault( const u8 * p_fault_address );
+
+#endif // CORE_RAMWATCH_H_
@@ -60,4 +60,17 @@ bool	PatchJumpLongAndFlush( CJumpLocation jump, CCodeLabel target )
 	return true;
 }
 
+//*****************************************************************************
+//	Decode the location a long jump currently targets
+//*****************************************************************************
+CCodeLabel	GetJumpTarget( CJumpLocation jump )
+{
+	const u32 *	p_jump_addr( reinterpret_cast< const u32 * >( jump.GetTargetU8P() ) );
+
+	// Sign extend the 24 bit word offset
+	s32 offset = s32( p_jump_addr[0] << 8 ) >> 6;
+
+	return CCodeLabel( jump.GetTargetU8P() + 8 + offset );
+}
+
 }
@@ -81,6 +81,7 @@ namespace AssemblyUtils
 {
 	bool		PatchJumpLong( CJumpLocation jump, CCodeLabel target );
 	bool		PatchJumpLongAndFlush( CJumpLocation jump, CCodeLabel target );
+	CCodeLabel	GetJumpTarget( CJumpLocation jump );
 	void		ReplaceBranchWithJump( CJumpLocation branch, CCodeLabel target );
 }
 
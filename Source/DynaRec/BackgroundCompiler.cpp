@@ -0,0 +1,270 @@
+/*
+Copyright (C) 2007 StrmnNrmn
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include "Base/Types.h"
+
+#include <cstring>
+
+#include "Debug/DBGConsole.h"
+#include "DynaRec/BackgroundCompiler.h"
+#include "DynaRec/CodeBufferManager.h"
+#include "DynaRec/Fragment.h"
+#include "DynaRec/TraceRecorder.h"
+#include "System/Timing.h"
+
+CBackgroundCompiler		gBackgroundCompiler;
+
+//*************************************************************************************
+//
+//*************************************************************************************
+CBackgroundCompiler::CBackgroundCompiler()
+:	mRunning( false )
+,	mQuit( false )
+,	mBusy( false )
+,	mTickFrequency( 0 )
+{
+	memset( &mStats, 0, sizeof( mStats ) );
+}
+
+//*************************************************************************************
+//
+//*************************************************************************************
+CBackgroundCompiler::~CBackgroundCompiler()
+{
+	Stop();
+}
+
+//*************************************************************************************
+//
+//*************************************************************************************
+bool CBackgroundCompiler::Start( std::shared_ptr<CCodeBufferManager> p_manager )
+{
+	if( mRunning )
+		return true;
+
+	if( p_manager == nullptr || !NTiming::GetPreciseFrequency( &mTickFrequency ) || mTickFrequency == 0 )
+		return false;
+
+	mpManager = p_manager;
+	mpManager->Reset();
+	memset( &mStats, 0, sizeof( mStats ) );
+
+	mQuit = false;
+	mBusy = false;
+	mThread = std::thread( &CBackgroundCompiler::WorkerLoop, this );
+	mRunning = true;
+
+	return true;
+}
+
+//*************************************************************************************
+//
+//*************************************************************************************
+void CBackgroundCompiler::Stop()
+{
+	if( !mRunning )
+		return;
+
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+		mQuit = true;
+	}
+	mWorkAvailable.notify_one();
+	mThread.join();
+
+	mRunning = false;
+
+	// The worker has gone, so there's nothing left to wait for
+	Discard();
+	mpManager = nullptr;
+}
+
+//*************************************************************************************
+//	Takes ownership of the trace's contents if it was queued. If the queue is
+//	full, the trace is left alone and the caller should compile it directly.
+//*************************************************************************************
+bool CBackgroundCompiler::Queue( SRecordedTrace & trace )
+{
+	u64 now( 0 );
+	NTiming::GetPreciseTime( &now );
+
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+
+		if( mPending.size() >= MAX_QUEUE_DEPTH )
+		{
+			mStats.NumRejected++;
+			return false;
+		}
+
+		SJob	job;
+		job.Trace = std::move( trace );
+		job.Fragment = nullptr;
+		job.QueuedTime = now;
+		mPending.push_back( std::move( job ) );
+
+		mStats.NumQueued++;
+		mStats.QueueDepth = mPending.size();
+		if( mStats.QueueDepth > mStats.MaxQueueDepth )
+		{
+			mStats.MaxQueueDepth = mStats.QueueDepth;
+		}
+	}
+	mWorkAvailable.notify_one();
+
+	return true;
+}
+
+//*************************************************************************************
+//	Must be called from the emulation thread, at a point where memory can't
+//	change underneath us. Returns false once nothing is left. The trace the
+//	job was compiled from is moved into trace. The fragment is null if it
+//	failed to compile, or if it was thrown away because it's stale.
+//*************************************************************************************
+bool CBackgroundCompiler::PopFinished( SRecordedTrace & trace, CFragment ** p_fragment )
+{
+	SJob	job;
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+		if( mFinished.empty() )
+			return false;
+
+		job = std::move( mFinished.front() );
+		mFinished.pop_front();
+	}
+
+	// The code may have been overwritten while we were compiling it
+	if( job.Fragment != nullptr && !CTraceRecorder::ValidateTrace( job.Trace ) )
+	{
+		delete job.Fragment;
+		job.Fragment = nullptr;
+
+		std::lock_guard< std::mutex > lock( mMutex );
+		mStats.NumDiscarded++;
+	}
+
+	trace = std::move( job.Trace );
+	*p_fragment = job.Fragment;
+	return true;
+}
+
+//*************************************************************************************
+//	Throw away everything queued or compiled, and reset the code buffer.
+//	Call this whenever the fragment cache is cleared. The caller has to clear
+//	the hot trace counts too, or the addresses that were queued won't be
+//	traced again.
+//*************************************************************************************
+void CBackgroundCompiler::Discard()
+{
+	std::unique_lock< std::mutex > lock( mMutex );
+
+	mStats.NumDiscarded += mPending.size();
+	mPending.clear();
+	mStats.QueueDepth = 0;
+
+	mWorkDone.wait( lock, [this] { return !mBusy; } );
+
+	mStats.NumDiscarded += mFinished.size();
+	for( SJob & job : mFinished )
+	{
+		delete job.Fragment;
+	}
+	mFinished.clear();
+
+	if( mpManager != nullptr )
+	{
+		mpManager->Reset();
+	}
+}
+
+//*************************************************************************************
+//
+//*************************************************************************************
+CBackgroundCompiler::SStats CBackgroundCompiler::GetStats()
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	return mStats;
+}
+
+//*************************************************************************************
+//
+//*************************************************************************************
+void CBackgroundCompiler::DumpStats()
+{
+#ifdef DAEDALUS_DEBUG_CONSOLE
+	SStats	stats( GetStats() );
+	u32		num_compiled( stats.NumCompiled > 0 ? stats.NumCompiled : 1 );
+
+	DBGConsole_Msg( 0, "Background compiler: %d queued, %d compiled, %d discarded, %d compiled inline",
+		stats.NumQueued, stats.NumCompiled, stats.NumDiscarded, stats.NumRejected );
+	DBGConsole_Msg( 0, "Background compiler: max queue depth %d, latency avg %dus max %dus, compile avg %dus",
+		stats.MaxQueueDepth, u32( stats.TotalLatencyUs / num_compiled ), u32( stats.MaxLatencyUs ), u32( stats.TotalCompileUs / num_compiled ) );
+#endif
+}
+
+//*************************************************************************************
+//
+//*************************************************************************************
+void CBackgroundCompiler::WorkerLoop()
+{
+	std::unique_lock< std::mutex > lock( mMutex );
+
+	for( ;; )
+	{
+		mWorkAvailable.wait( lock, [this] { return mQuit || !mPending.empty(); } );
+		if( mQuit )
+			break;
+
+		SJob	job( std::move( mPending.front() ) );
+		mPending.pop_front();
+		mStats.QueueDepth = mPending.size();
+		mBusy = true;
+
+		lock.unlock();
+
+		u64 start( 0 );
+		u64 end( 0 );
+		NTiming::GetPreciseTime( &start );
+		job.Fragment = CTraceRecorder::CreateFragment( mpManager, job.Trace );
+		NTiming::GetPreciseTime( &end );
+
+		lock.lock();
+
+		u64 latency( TicksToUs( end - job.QueuedTime ) );
+		mStats.NumCompiled++;
+		mStats.TotalCompileUs += TicksToUs( end - start );
+		mStats.TotalLatencyUs += latency;
+		if( latency > mStats.MaxLatencyUs )
+		{
+			mStats.MaxLatencyUs = latency;
+		}
+
+		mFinished.push_back( std::move( job ) );
+		mBusy = false;
+		mWorkDone.notify_all();
+	}
+}
+
+//*************************************************************************************
+//
+//*************************************************************************************
+u64 CBackgroundCompiler::TicksToUs( u64 ticks ) const
+{
+	return ( ticks * 1000000 ) / mTickFrequency;
+}
@@ -0,0 +1,107 @@
+/*
+Copyright (C) 2007 StrmnNrmn
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef DYNAREC_BACKGROUNDCOMPILER_H_
+#define DYNAREC_BACKGROUNDCOMPILER_H_
+
+#include "Base/Types.h"
+#include "DynaRec/Trace.h"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+class CFragment;
+class CCodeBufferManager;
+
+//*************************************************************************************
+//	Compiles recorded traces on a worker thread, so the emulation thread can carry
+//	on interpreting rather than stalling on big traces.
+//
+//	The worker writes into the code buffer manager's background region. Finished
+//	fragments are collected with PopFinished() from a safe point on the emulation
+//	thread and inserted into the fragment cache from there. Any fragment whose
+//	code was overwritten while it was being compiled is thrown away.
+//*************************************************************************************
+class CBackgroundCompiler
+{
+public:
+	struct SStats
+	{
+		u32		NumQueued;
+		u32		NumCompiled;
+		u32		NumDiscarded;		// Stale, or thrown away by Discard()
+		u32		NumRejected;		// Queue was full, compiled synchronously
+		u32		QueueDepth;
+		u32		MaxQueueDepth;
+		u64		TotalLatencyUs;		// From Queue() until the fragment was ready
+		u64		MaxLatencyUs;
+		u64		TotalCompileUs;		// Time spent generating code
+	};
+
+	CBackgroundCompiler();
+	~CBackgroundCompiler();
+
+	bool					Start( std::shared_ptr<CCodeBufferManager> p_manager );
+	void					Stop();
+	bool					IsRunning() const						{ return mRunning; }
+
+	bool					Queue( SRecordedTrace & trace );
+	bool					PopFinished( SRecordedTrace & trace, CFragment ** p_fragment );
+	void					Discard();
+
+	SStats					GetStats();
+	void					DumpStats();
+
+private:
+	struct SJob
+	{
+		SRecordedTrace		Trace;
+		CFragment *			Fragment;
+		u64					QueuedTime;
+	};
+
+	void					WorkerLoop();
+	u64						TicksToUs( u64 ticks ) const;
+
+private:
+	static const u32		MAX_QUEUE_DEPTH = 64;
+
+	std::shared_ptr<CCodeBufferManager>	mpManager;
+
+	std::thread				mThread;
+	std::mutex				mMutex;
+	std::condition_variable	mWorkAvailable;
+	std::condition_variable	mWorkDone;
+
+	std::deque< SJob >		mPending;
+	std::deque< SJob >		mFinished;
+	bool					mRunning;
+	bool					mQuit;
+	bool					mBusy;
+
+	u64						mTickFrequency;
+	SStats					mStats;
+};
+
+extern CBackgroundCompiler	gBackgroundCompiler;
+
+#endif // DYNAREC_BACKGROUNDCOMPILER_H_
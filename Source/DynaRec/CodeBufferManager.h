@@ -36,6 +36,10 @@ public:
 	virtual	std::shared_ptr<CCodeGenerator>		StartNewBlock() = 0;
 	virtual	u32						FinaliseCurrentBlock() = 0;
 
+	// A manager for a separate region that can be written from another thread,
+	// within jump range of this one. nullptr if the backend doesn't support it.
+	virtual	std::shared_ptr<CCodeBufferManager>	GetBackgroundManager()	{ return nullptr; }
+
 public:
 	static	std::shared_ptr<CCodeBufferManager>	Create();
 };
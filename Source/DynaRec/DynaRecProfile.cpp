@@ -24,6 +24,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "Core/ROM.h"
 #include "Debug/DebugLog.h"
 #include "DynaRec/DynaRecProfile.h"
+#include "DynaRec/HotTraceCountTable.h"
 
 
 #include <map>
@@ -41,7 +42,14 @@ namespace DynarecProfile
 static std::map<u32,u32>		gFrameLookups;
 static u32						gLastFrame;
 
-extern std::map< u32, u32 >		gHotTraceCountMap;
+SIndirectExitStats				gIndirectExitStats;
+
+// The hot trace counters are running totals, so remember where the last frame left them
+static const CHotTraceCountTable *	gpHotTraceCountTable;
+static u32						gLastHotTraceHits;
+static u32						gLastHotTraceMisses;
+static u32						gLastHotTraceEvictions;
+static u32						gLastHotTraceDecays;
 
 
 namespace
@@ -86,6 +94,35 @@ void	CheckForNewFrame()
 				DAED_LOG( DEBUG_DYNAREC_PROF, "%08x: %d lookups", LookupList[ i ].Address, LookupList[ i ].Count );
 		}
 		gFrameLookups.clear();
+
+		u32		num_indirect_exits( gIndirectExitStats.ReturnStackHits + gIndirectExitStats.InlineCacheHits + gIndirectExitStats.Lookups );
+		if( num_indirect_exits > 0 )
+		{
+			DAED_LOG( DEBUG_DYNAREC_PROF, "Indirect exits: %d, %d%% return stack hits, %d%% inline cache hits, %d lookups",
+				num_indirect_exits,
+				(100 * gIndirectExitStats.ReturnStackHits) / num_indirect_exits,
+				(100 * gIndirectExitStats.InlineCacheHits) / num_indirect_exits,
+				gIndirectExitStats.Lookups );
+		}
+		gIndirectExitStats = SIndirectExitStats();
+
+		if( gpHotTraceCountTable != nullptr )
+		{
+			const CHotTraceCountTable &	table( *gpHotTraceCountTable );
+
+			DAED_LOG( DEBUG_DYNAREC_PROF, "Hot trace table: %d entries, %d hits, %d misses, %d evictions, %d decays",
+				table.GetSize(),
+				table.GetHitCount() - gLastHotTraceHits,
+				table.GetMissCount() - gLastHotTraceMisses,
+				table.GetEvictionCount() - gLastHotTraceEvictions,
+				table.GetDecayCount() - gLastHotTraceDecays );
+
+			gLastHotTraceHits      = table.GetHitCount();
+			gLastHotTraceMisses    = table.GetMissCount();
+			gLastHotTraceEvictions = table.GetEvictionCount();
+			gLastHotTraceDecays    = table.GetDecayCount();
+		}
+
 		gLastFrame = g_dwNumFrames;
 	}
 
@@ -108,6 +145,13 @@ void	LogEnterExit( u32 enter_address, u32 exit_address, u32 instruction_count )
 	DAED_LOG( DEBUG_DYNAREC_CACHE, "Enter/Exit: %08x -> %08x (executed %d instructions)", enter_address, exit_address, instruction_count );
 }
 
+void	LogHotTraceCounts( const CHotTraceCountTable & table )
+{
+	CheckForNewFrame();
+
+	gpHotTraceCountTable = &table;
+}
+
 
 
 }
@@ -23,21 +23,34 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 //#define DAEDALUS_ENABLE_DYNAREC_PROFILE
 
 class CFragment;
+class CHotTraceCountTable;
 
 #ifdef DAEDALUS_ENABLE_DYNAREC_PROFILE
 namespace DynarecProfile
 {
+	// Where indirect exits found their target. The cache hits are counted by the generated code
+	struct SIndirectExitStats
+	{
+		u32		ReturnStackHits;
+		u32		InlineCacheHits;
+		u32		Lookups;
+	};
+	extern SIndirectExitStats	gIndirectExitStats;
+
 	void LogLookup( u32 address, CFragment * fragment );
 	void LogEnterExit( u32 enter_address, u32 exit_address, u32 instruction_count );
+	void LogHotTraceCounts( const CHotTraceCountTable & table );
 }
 
 #define DYNAREC_PROFILE_LOGLOOKUP( a, f )					DynarecProfile::LogLookup( a, f )
 #define DYNAREC_PROFILE_ENTEREXIT( enter, exit, cnt )		DynarecProfile::LogEnterExit( enter, exit, cnt )
+#define DYNAREC_PROFILE_HOTTRACECOUNTS( t )					DynarecProfile::LogHotTraceCounts( t )
 
 #else
 
 #define DYNAREC_PROFILE_LOGLOOKUP( a, f )
 #define DYNAREC_PROFILE_ENTEREXIT( enter, exit, cnt )
+#define DYNAREC_PROFILE_HOTTRACECOUNTS( t )
 
 #endif
 
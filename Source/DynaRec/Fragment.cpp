@@ -100,6 +100,7 @@ CFragment::CFragment( std::shared_ptr<CCodeBufferManager> p_manager,
 	mRegisterUsage = register_usage;
 #endif
 
+	AddCodeSpans( trace );
 	Assemble( p_manager, exit_address, trace, branch_details, register_usage );
 }
 
@@ -124,6 +125,9 @@ CFragment::CFragment(std::shared_ptr<CCodeBufferManager> p_manager, u32 entry_ad
 	,	mpCache( nullptr )
 #endif
 {
+	SFragmentCodeSpan	span = { entry_address, mInputLength };
+	mCodeSpans.push_back( span );
+
 	Assemble(p_manager, CCodeLabel(function_Ptr));
 }
 #endif
@@ -521,7 +525,8 @@ u32	CFragment::GetMemoryUsage() const
 	// Ignore the 'additional info' when computing this
 
 	return sizeof( CFragment ) +
-		   mPatchList.size() * sizeof( SFragmentPatchDetails );
+		   mPatchList.size() * sizeof( SFragmentPatchDetails ) +
+		   mCodeSpans.size() * sizeof( SFragmentCodeSpan );
 }
 
 //*************************************************************************************
@@ -561,6 +566,29 @@ void	CFragment::AddPatch( u32 address, CJumpLocation jump_location )
 }
 
 
+//*************************************************************************************
+//	Collapse the trace into runs of consecutive instructions. Traces follow
+//	taken branches, so a single fragment can be built from several distant
+//	pieces of code.
+//*************************************************************************************
+void	CFragment::AddCodeSpans( const std::vector< STraceEntry > & trace )
+{
+	for( u32 i = 0; i < trace.size(); ++i )
+	{
+		u32		address( trace[ i ].Address );
+
+		if( !mCodeSpans.empty() && mCodeSpans.back().Address + mCodeSpans.back().Length == address )
+		{
+			mCodeSpans.back().Length += sizeof( OpCode );
+		}
+		else
+		{
+			SFragmentCodeSpan	span = { address, sizeof( OpCode ) };
+			mCodeSpans.push_back( span );
+		}
+	}
+}
+
 //*************************************************************************************
 //
 //*************************************************************************************
@@ -584,31 +612,13 @@ void CFragment::Assemble( std::shared_ptr<CCodeBufferManager> p_manager,
 	p_generator->Initialise( mEntryAddress, exit_address, nullptr, &gCPUState, register_usage );
 #endif
 
-	//Trace: (3 ops, 13 hits)
-	//80317934:  SLT       at = (t7<a0)
-	//BRANCH 0 -> 80317940
-	//80317938:  BNEL      at != r0 --> 0x80317934
-	//8031793c:  LW        t7 <- 0x0000(v0)
-
-	if(trace.size() == 3)
-	{
-		if( trace[0].OpCode._u32 == 0x01E4082A &&
-			trace[1].OpCode._u32 == 0x5420FFFE &&
-			trace[2].OpCode._u32 == 0x8C4F0000)
-		{
-#ifdef DAEDALUS_DEBUG_DYNAREC
-			printf("Speedhack complex %08x\n", trace[0].Address );
-#endif
-			p_generator->ExecuteNativeFunction( CCodeLabel( reinterpret_cast< const void * >( CPU_SkipToNextEvent ) ) );
-		}
-	}
-
 	//
 	//	Keep executing ops until we take a branch
 	//
 	std::vector< CJumpLocation >		exception_handler_jumps;
 	std::vector< RegisterSnapshotHandle >   exception_handler_snapshots;
 	std::vector< SBranchHandlerInfo >	branch_handler_info( branch_details.size() );
+	s32									idle_loop_delay_slot_idx( -1 );
 //	bool								checked_cop1_usable( false );
 
 	for( u32 i = 0; i < trace.size(); ++i )
@@ -651,8 +661,6 @@ void CFragment::Assemble( std::shared_ptr<CCodeBufferManager> p_manager,
 
 						SprintOpCodeInfo( opinfo, trace[i+1].Address, trace[i+1].OpCode );
 						printf("0x%08x: <0x%08x> %s\n", trace[i+1].Address, trace[i+1].OpCode._u32, opinfo);
-
-						p_generator->ExecuteNativeFunction( CCodeLabel( reinterpret_cast< const void * >( CPU_SkipToNextEvent ) ) );
 					}
 					break;
 
@@ -683,12 +691,13 @@ void CFragment::Assemble( std::shared_ptr<CCodeBufferManager> p_manager,
 				default:
 					break;
 			}
-#else
+#endif
+			// Idle loops skip to the next event once the delay slot has run, so
+			// only when the branch was taken back round the loop
 			if(p_branch->SpeedHack == SHACK_SKIPTOEVENT)
 			{
-				p_generator->ExecuteNativeFunction( CCodeLabel( reinterpret_cast< const void * >( CPU_SkipToNextEvent ) ) );
+				idle_loop_delay_slot_idx = p_branch->DelaySlotTraceIndex;
 			}
-#endif
 		}
 
 		CJumpLocation	branch_jump( nullptr );
@@ -712,6 +721,11 @@ void CFragment::Assemble( std::shared_ptr<CCodeBufferManager> p_manager,
 			branch_handler_info[ branch_idx ].Jump = branch_jump;
 			branch_handler_info[ branch_idx ].RegisterSnapshot = p_generator->GetRegisterSnapshot();
 		}
+
+		if( s32( i ) == idle_loop_delay_slot_idx )
+		{
+			p_generator->ExecuteNativeFunction( CCodeLabel( reinterpret_cast< const void * >( CPU_SkipIdleLoop ) ) );
+		}
 	}
 #ifdef FRAGMENT_RETAIN_ADDITIONAL_INFO
 		mInstructionStartLocations.push_back( p_generator->GetCurrentLocation().GetTargetU8P() );
@@ -57,6 +57,17 @@ struct SFragmentPatchDetails
 };
 using FragmentPatchList = std::vector<SFragmentPatchDetails>;
 
+//
+//	A contiguous run of N64 code that a fragment was built from. Writes to any
+//	of these ranges mean the fragment is stale and must be discarded.
+//
+struct SFragmentCodeSpan
+{
+	u32				Address;
+	u32				Length;
+};
+using FragmentCodeSpanList = std::vector<SFragmentCodeSpan>;
+
 //*************************************************************************************
 //
 //*************************************************************************************
@@ -89,7 +100,7 @@ public:
 		void		SetCache( const CFragmentCache * p_cache );
 
 		const FragmentPatchList &	GetPatchList() const		{ return mPatchList; }
-		void		DiscardPatchList()							{ mPatchList.clear(); }
+		const FragmentCodeSpanList &	GetCodeSpans() const	{ return mCodeSpans; }
 
 #ifdef FRAGMENT_RETAIN_ADDITIONAL_INFO
 		u32			GetHitCount() const							{ return mHitCount; }
@@ -103,6 +114,7 @@ private:
 		void		Assemble( std::shared_ptr<CCodeBufferManager> p_manager, u32 exit_address, const std::vector< STraceEntry > & trace, const std::vector<SBranchDetails> & branch_details, const SRegisterUsageInfo & register_usage );
 
 		void		AddPatch( u32 address, CJumpLocation jump_location );
+		void		AddCodeSpans( const std::vector< STraceEntry > & trace );
 
 #ifdef FRAGMENT_SIMULATE_EXECUTION
 		CFragment *	Simulate();
@@ -112,6 +124,7 @@ private:
 		u32								mEntryAddress;
 
 		std::vector< SFragmentPatchDetails >	mPatchList;
+		FragmentCodeSpanList			mCodeSpans;
 
 		CCodeLabel						mEntryPoint;
 		u32								mInputLength;
@@ -31,6 +31,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "DynaRec/DynaRecProfile.h"
 #include "DynaRec/Fragment.h"
 #include "DynaRec/FragmentCache.h"
+#include "DynaRec/IndirectExitMap.h"
 #include "Debug/DBGConsole.h"
 #include "Utility/Profiler.h"
 
@@ -47,6 +48,7 @@ CFragmentCache::CFragmentCache()
 :	mMemoryUsage( 0 )
 ,	mInputLength( 0 )
 ,	mOutputLength( 0 )
+,	mInvalidatedCount( 0 )
 ,	mCachedFragmentAddress( 0 )
 ,	mpCachedFragment( nullptr )
 {
@@ -54,6 +56,8 @@ CFragmentCache::CFragmentCache()
 
 	mFragments.reserve( 2000 );
 
+	CIndirectExitMap::ResetReturnAddressStack();
+
 	mpCodeBufferManager = CCodeBufferManager::Create();
 	if(mpCodeBufferManager != nullptr)
 	{
@@ -181,7 +185,11 @@ void CFragmentCache::InsertFragment( CFragment * p_fragment )
 {
 	u32		fragment_address( p_fragment->GetEntryAddress() );
 
-	mCacheCoverage.ExtendCoverage( fragment_address, p_fragment->GetInputLength() );
+	const FragmentCodeSpanList &	spans( p_fragment->GetCodeSpans() );
+	for( FragmentCodeSpanList::const_iterator it = spans.begin(); it != spans.end(); ++it )
+	{
+		mCacheCoverage.ExtendCoverage( it->Address, it->Length, p_fragment );
+	}
 
 	SFragmentEntry				entry( fragment_address, nullptr );
 	FragmentVec::iterator		it( std::lower_bound( mFragments.begin(), mFragments.end(), entry ) );
@@ -201,9 +209,13 @@ void CFragmentCache::InsertFragment( CFragment * p_fragment )
 	if( jump_it != mJumpMap.end() )
 	{
 		const JumpList &		jumps( jump_it->second );
+		LinkedJumpList &		linked_jumps( mLinkedJumpMap[ fragment_address ] );
 		for( JumpList::const_iterator it = jumps.begin(); it != jumps.end(); ++it )
 		{
 			//DBGConsole_Msg( 0, "Inserting [R%08x], patching jump at %08x ", address, (*it) );
+			SLinkedJump		link = { *it, GetJumpTarget( *it ) };
+			linked_jumps.push_back( link );
+
 			PatchJumpLongAndFlush( (*it), p_fragment->GetEntryTarget() );
 		}
 
@@ -229,6 +241,9 @@ void CFragmentCache::InsertFragment( CFragment * p_fragment )
 #endif
 		if( p_fragment != nullptr )
 		{
+			SLinkedJump		link = { jump, GetJumpTarget( jump ) };
+			mLinkedJumpMap[ target_address ].push_back( link );
+
 			PatchJumpLongAndFlush( jump, p_fragment->GetEntryTarget() );
 
 	#ifdef DAEDALUS_ENABLE_ASSERTS
@@ -242,8 +257,7 @@ void CFragmentCache::InsertFragment( CFragment * p_fragment )
 		}
 	}
 
-	// Free memoire
-	p_fragment->DiscardPatchList();
+	// The patch list is retained so the links can be undone if this fragment is invalidated
 
 	// For simulation only
 	p_fragment->SetCache( this );
@@ -288,10 +302,16 @@ void CFragmentCache::Clear()
 	mMemoryUsage = 0;
 	mInputLength = 0;
 	mOutputLength = 0;
+	mInvalidatedCount = 0;
 	mCachedFragmentAddress = 0;
 	mpCachedFragment = nullptr;
 	std::memset( mpCacheHashTable.data(), 0, mpCacheHashTable.size() * sizeof(mpCacheHashTable[0]));
 	mJumpMap.clear();
+	mLinkedJumpMap.clear();
+
+	// The indirect exit caches are in the code buffer, so make sure nothing refers to them
+	CIndirectExitMap::FlushCaches();
+	CIndirectExitMap::ResetReturnAddressStack();
 
 	mCacheCoverage.Reset();
 
@@ -306,6 +326,116 @@ bool CFragmentCache::ShouldInvalidateOnWrite( u32 address, u32 length ) const
 	return mCacheCoverage.IsCovered( address, length );
 }
 
+//*************************************************************************************
+//	Discard only the fragments built from code in the specified range.
+//	Must be called from a safe point, i.e. not from within a fragment.
+//	Returns the number of fragments discarded.
+//*************************************************************************************
+u32 CFragmentCache::InvalidateRange( u32 address, u32 length )
+{
+	CFragmentCacheCoverage::FragmentList	fragments;
+
+	mCacheCoverage.GetFragmentsInRange( address, length, fragments );
+
+	for( CFragmentCacheCoverage::FragmentList::const_iterator it = fragments.begin(); it != fragments.end(); ++it )
+	{
+		RemoveFragment( *it );
+	}
+
+	// Indirect exits aren't tracked per target like the direct ones, so just forget them all
+	if( !fragments.empty() )
+	{
+		CIndirectExitMap::FlushCaches();
+	}
+
+	return fragments.size();
+}
+
+//*************************************************************************************
+//
+//*************************************************************************************
+void CFragmentCache::RemoveFragment( CFragment * p_fragment )
+{
+	u32		fragment_address( p_fragment->GetEntryAddress() );
+
+	SFragmentEntry				entry( fragment_address, nullptr );
+	FragmentVec::iterator		it( std::lower_bound( mFragments.begin(), mFragments.end(), entry ) );
+	#ifdef DAEDALUS_ENABLE_ASSERTS
+	DAEDALUS_ASSERT( it != mFragments.end() && it->Fragment == p_fragment, "Removing a fragment which isn't in the cache" );
+	#endif
+	mFragments.erase( it );
+
+	const FragmentCodeSpanList &	spans( p_fragment->GetCodeSpans() );
+	for( FragmentCodeSpanList::const_iterator span_it = spans.begin(); span_it != spans.end(); ++span_it )
+	{
+		mCacheCoverage.RemoveCoverage( span_it->Address, span_it->Length, p_fragment );
+	}
+
+	// Lookups for this address now fail. The hash table caches failed lookups, so we can leave the address in place
+	u32 ix {MakeHashIdx( fragment_address )};
+	if( mpCacheHashTable[ix].addr == fragment_address )
+	{
+		mpCacheHashTable[ix].ptr = 0;
+	}
+	if( mCachedFragmentAddress == fragment_address )
+	{
+		mpCachedFragment = nullptr;
+	}
+
+	// Forget about the exits of this fragment, whether they're waiting for a target or linked to one
+	const FragmentPatchList &	patch_list( p_fragment->GetPatchList() );
+	for( FragmentPatchList::const_iterator patch_it = patch_list.begin(); patch_it != patch_list.end(); ++patch_it )
+	{
+		const u8 *		p_jump( patch_it->Jump.GetTargetU8P() );
+
+		JumpMap::iterator	jump_it( mJumpMap.find( patch_it->Address ) );
+		if( jump_it != mJumpMap.end() )
+		{
+			JumpList &	jumps( jump_it->second );
+			jumps.erase( std::remove_if( jumps.begin(), jumps.end(),
+				[p_jump]( const CJumpLocation & jump ) { return jump.GetTargetU8P() == p_jump; } ), jumps.end() );
+			if( jumps.empty() )
+			{
+				mJumpMap.erase( jump_it );
+			}
+		}
+
+		LinkedJumpMap::iterator	link_it( mLinkedJumpMap.find( patch_it->Address ) );
+		if( link_it != mLinkedJumpMap.end() )
+		{
+			LinkedJumpList &	links( link_it->second );
+			links.erase( std::remove_if( links.begin(), links.end(),
+				[p_jump]( const SLinkedJump & link ) { return link.Jump.GetTargetU8P() == p_jump; } ), links.end() );
+			if( links.empty() )
+			{
+				mLinkedJumpMap.erase( link_it );
+			}
+		}
+	}
+
+	// Unlink any exits which jump directly into this fragment, and queue them up again in case it's recompiled
+	LinkedJumpMap::iterator	link_it( mLinkedJumpMap.find( fragment_address ) );
+	if( link_it != mLinkedJumpMap.end() )
+	{
+		const LinkedJumpList &	links( link_it->second );
+		JumpList &				jumps( mJumpMap[ fragment_address ] );
+		for( LinkedJumpList::const_iterator it = links.begin(); it != links.end(); ++it )
+		{
+			PatchJumpLongAndFlush( it->Jump, it->UnlinkedTarget );
+			jumps.push_back( it->Jump );
+		}
+
+		mLinkedJumpMap.erase( link_it );
+	}
+
+	mMemoryUsage -= p_fragment->GetMemoryUsage();
+	mInputLength -= p_fragment->GetInputLength();
+	mOutputLength -= p_fragment->GetOutputLength();
+	mInvalidatedCount++;
+
+	delete p_fragment;
+}
+
 
 
 
@@ -317,7 +447,7 @@ bool CFragmentCache::ShouldInvalidateOnWrite( u32 address, u32 length ) const
 //*************************************************************************************
 //
 //*************************************************************************************
-void CFragmentCacheCoverage::ExtendCoverage( u32 address, u32 len )
+void CFragmentCacheCoverage::ExtendCoverage( u32 address, u32 len, CFragment * p_fragment )
 {
 	u32 first_entry = AddressToIndex( address );
 	u32 last_entry = AddressToIndex( address + len );
@@ -326,6 +456,34 @@ void CFragmentCacheCoverage::ExtendCoverage( u32 address, u32 len )
 	for( u32 i = first_entry; i <= last_entry && i < NUM_MEM_USAGE_ENTRIES; ++i )
 	{
 		mCacheCoverage[ i ] = true;
+
+		// Spans of the same fragment can share a page
+		FragmentList &	fragments( mPageFragments[ i ] );
+		if( std::find( fragments.begin(), fragments.end(), p_fragment ) == fragments.end() )
+		{
+			fragments.push_back( p_fragment );
+		}
+	}
+}
+
+//*************************************************************************************
+//
+//*************************************************************************************
+void CFragmentCacheCoverage::RemoveCoverage( u32 address, u32 len, CFragment * p_fragment )
+{
+	u32 first_entry = AddressToIndex( address );
+	u32 last_entry = AddressToIndex( address + len );
+
+	for( u32 i = first_entry; i <= last_entry && i < NUM_MEM_USAGE_ENTRIES; ++i )
+	{
+		FragmentList &	fragments( mPageFragments[ i ] );
+		FragmentList::iterator	it( std::find( fragments.begin(), fragments.end(), p_fragment ) );
+		if( it != fragments.end() )
+		{
+			fragments.erase( it );
+		}
+
+		mCacheCoverage[ i ] = !fragments.empty();
 	}
 }
 
@@ -354,6 +512,27 @@ bool CFragmentCacheCoverage::IsCovered( u32 address, u32 len ) const
 	return false;
 }
 
+//*************************************************************************************
+//
+//*************************************************************************************
+void CFragmentCacheCoverage::GetFragmentsInRange( u32 address, u32 len, FragmentList & fragments ) const
+{
+	u32 first_entry = AddressToIndex( address );
+	u32 last_entry = AddressToIndex( address + len );
+
+	for( u32 i = first_entry; i <= last_entry && i < NUM_MEM_USAGE_ENTRIES; ++i )
+	{
+		const FragmentList &	page_fragments( mPageFragments[ i ] );
+		for( FragmentList::const_iterator it = page_fragments.begin(); it != page_fragments.end(); ++it )
+		{
+			if( std::find( fragments.begin(), fragments.end(), *it ) == fragments.end() )
+			{
+				fragments.push_back( *it );
+			}
+		}
+	}
+}
+
 //*************************************************************************************
 //
 //*************************************************************************************
@@ -447,5 +626,9 @@ void CFragmentCache::DumpStats( const std::filesystem::path outputdir ) const
 void CFragmentCacheCoverage::Reset( )
 {
 	std::fill(std::begin(mCacheCoverage), std::end(mCacheCoverage), 0);
+	for( u32 i = 0; i < NUM_MEM_USAGE_ENTRIES; ++i )
+	{
+		mPageFragments[ i ].clear();
+	}
 		// std::memset( mCacheCoverage.data(), false, mCacheCoverage.size() * sizeof( mCacheCoverage ) );
 }
@@ -21,10 +21,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define DYNAREC_FRAGMENTCACHE_H_
 
 #include "Base/Types.h"
+#include "DynaRec/AssemblyUtils.h"
 
 
 class	CFragment;
-class	CJumpLocation;
 class	CCodeBufferManager;
 
 #include <map>
@@ -45,10 +45,14 @@ struct FHashT
 class CFragmentCacheCoverage
 {
 public:
+	using FragmentList = std::vector< CFragment * >;
+
 	CFragmentCacheCoverage() { Reset(); }
 
-	void			ExtendCoverage( u32 address, u32 len );
+	void			ExtendCoverage( u32 address, u32 len, CFragment * p_fragment );
+	void			RemoveCoverage( u32 address, u32 len, CFragment * p_fragment );
 	bool			IsCovered( u32 address, u32 len ) const;
+	void			GetFragmentsInRange( u32 address, u32 len, FragmentList & fragments ) const;
 
 	void			Reset();
 
@@ -63,6 +67,7 @@ private:
 	static const u32 NUM_MEM_USAGE_ENTRIES = MEMORY_8_MEG >> MEM_USAGE_SHIFT;
 
 	std::array<bool, NUM_MEM_USAGE_ENTRIES> mCacheCoverage;
+	std::array<FragmentList, NUM_MEM_USAGE_ENTRIES> mPageFragments;		// Fragments built from code in each page
 
 };
 
@@ -93,8 +98,13 @@ public:
 	std::shared_ptr<CCodeBufferManager>	GetCodeBufferManager() const			{ return mpCodeBufferManager; }
 
 	bool					ShouldInvalidateOnWrite( u32 address, u32 length ) const;
+	u32						InvalidateRange( u32 address, u32 length );
+
+	u32						GetInvalidatedCount() const				{ return mInvalidatedCount; }
 
 private:
+	void					RemoveFragment( CFragment * p_fragment );
+
 	struct SFragmentEntry
 	{
 		SFragmentEntry( u32 address, CFragment * fragment )
@@ -118,9 +128,19 @@ private:
 	u32						mMemoryUsage;
 	u32						mInputLength;
 	u32						mOutputLength;
+	u32						mInvalidatedCount;	// Fragments discarded since the last Clear(). Their code is not reclaimed until then.
 	using JumpList = std::vector< CJumpLocation >;
 	using JumpMap = std::map< u32, JumpList >;
-	JumpMap					mJumpMap;
+	JumpMap					mJumpMap;			// Exits waiting for a fragment to be compiled at the target address
+
+	struct SLinkedJump
+	{
+		CJumpLocation	Jump;
+		CCodeLabel		UnlinkedTarget;		// Where the jump pointed before it was linked
+	};
+	using LinkedJumpList = std::vector< SLinkedJump >;
+	using LinkedJumpMap = std::map< u32, LinkedJumpList >;
+	LinkedJumpMap			mLinkedJumpMap;		// Exits that have been patched to jump directly to the fragment at the target address
 
 	mutable u32				mCachedFragmentAddress;
 	mutable CFragment *		mpCachedFragment;
@@ -0,0 +1,171 @@
+/*
+Copyright (C) 2009 StrmnNrmn
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+
+#include "Base/Types.h"
+
+#include <cstring>
+
+#include "Debug/DebugLog.h"
+#include "DynaRec/HotTraceCountTable.h"
+
+//*************************************************************************************
+//
+//*************************************************************************************
+CHotTraceCountTable::CHotTraceCountTable( u32 max_entries )
+:	mMaxEntries( max_entries )
+,	mSize( 0 )
+,	mHits( 0 )
+,	mMisses( 0 )
+,	mEvictions( 0 )
+,	mDecays( 0 )
+{
+	#ifdef DAEDALUS_ENABLE_ASSERTS
+	DAEDALUS_ASSERT( max_entries < TABLE_SIZE, "Hot trace table is too small" );
+	#endif
+	std::memset( mEntries.data(), 0, mEntries.size() * sizeof( mEntries[0] ) );
+}
+
+//*************************************************************************************
+//	Low 2 bits will always be 0. Fibonacci hashing spreads neighbouring
+//	addresses across the table.
+//*************************************************************************************
+inline u32 CHotTraceCountTable::HashAddress( u32 address )
+{
+	return ( ( address >> 2 ) * 0x9E3779B1 ) >> ( 32 - TABLE_BITS );
+}
+
+//*************************************************************************************
+//	Returns the updated count for the address
+//*************************************************************************************
+u32 CHotTraceCountTable::Increment( u32 address )
+{
+	u32		home( HashAddress( address ) );
+
+	// Free slots don't terminate the search, so removal never needs tombstones
+	for( u32 i = 0; i < PROBE_LENGTH; ++i )
+	{
+		SEntry &	entry( mEntries[ ( home + i ) & TABLE_MASK ] );
+
+		if( entry.Count != 0 && entry.Address == address )
+		{
+			mHits++;
+			return ++entry.Count;
+		}
+	}
+
+	mMisses++;
+
+	// Age the table before inserting, otherwise the new entry would be decayed straight back out
+	if( mSize + 1 >= mMaxEntries )
+	{
+		Decay();
+	}
+
+	SEntry *	p_free( nullptr );
+	SEntry *	p_coldest( nullptr );
+
+	for( u32 i = 0; i < PROBE_LENGTH && p_free == nullptr; ++i )
+	{
+		SEntry &	entry( mEntries[ ( home + i ) & TABLE_MASK ] );
+
+		if( entry.Count == 0 )
+		{
+			p_free = &entry;
+		}
+		else if( p_coldest == nullptr || entry.Count < p_coldest->Count )
+		{
+			p_coldest = &entry;
+		}
+	}
+
+	if( p_free == nullptr )
+	{
+		mEvictions++;
+		p_free = p_coldest;
+	}
+	else
+	{
+		mSize++;
+	}
+
+	p_free->Address = address;
+	p_free->Count = 1;
+
+	return 1;
+}
+
+//*************************************************************************************
+//
+//*************************************************************************************
+void CHotTraceCountTable::Remove( u32 address )
+{
+	u32		home( HashAddress( address ) );
+
+	for( u32 i = 0; i < PROBE_LENGTH; ++i )
+	{
+		SEntry &	entry( mEntries[ ( home + i ) & TABLE_MASK ] );
+
+		if( entry.Count != 0 && entry.Address == address )
+		{
+			entry.Count = 0;
+			mSize--;
+			return;
+		}
+	}
+}
+
+//*************************************************************************************
+//
+//*************************************************************************************
+void CHotTraceCountTable::Clear()
+{
+	std::memset( mEntries.data(), 0, mEntries.size() * sizeof( mEntries[0] ) );
+	mSize = 0;
+}
+
+//*************************************************************************************
+//	Age all the counts, so addresses which were only hit a few times drop out.
+//	Keep going until at least half the entries are free again.
+//*************************************************************************************
+void CHotTraceCountTable::Decay()
+{
+	u32		size( mSize );
+
+	while( size > mMaxEntries / 2 )
+	{
+		size = 0;
+		for( u32 i = 0; i < TABLE_SIZE; ++i )
+		{
+			SEntry &	entry( mEntries[ i ] );
+
+			entry.Count >>= 1;
+			if( entry.Count != 0 )
+			{
+				size++;
+			}
+		}
+
+		mDecays++;
+	}
+
+	DAED_LOG( DEBUG_DYNAREC_CACHE, "Hot trace table decayed from %d to %d entries", mSize, size );
+
+	mSize = size;
+}
@@ -0,0 +1,83 @@
+/*
+Copyright (C) 2009 StrmnNrmn
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef DYNAREC_HOTTRACECOUNTTABLE_H_
+#define DYNAREC_HOTTRACECOUNTTABLE_H_
+
+#include "Base/Types.h"
+
+#include <array>
+
+//*************************************************************************************
+//	Counts how often the interpreter branches to each address, to decide when a
+//	trace is hot enough to be sent to the dynarec.
+//
+//	This is a fixed size open addressed table, so it never allocates. Each
+//	address can live in any of PROBE_LENGTH slots following its hash. When all
+//	of those are taken, the coldest entry is evicted. When the table fills up,
+//	all counts are halved and entries that drop to zero are discarded, rather
+//	than throwing everything away.
+//*************************************************************************************
+class CHotTraceCountTable
+{
+public:
+	struct SEntry
+	{
+		u32		Address;
+		u32		Count;		// 0 means the slot is free
+	};
+
+	CHotTraceCountTable( u32 max_entries );
+
+	u32						Increment( u32 address );
+	void					Remove( u32 address );
+	void					Clear();
+
+	u32						GetSize() const							{ return mSize; }
+	u32						GetCapacity() const						{ return TABLE_SIZE; }
+	const SEntry &			GetEntry( u32 idx ) const				{ return mEntries[ idx ]; }
+
+	u32						GetHitCount() const						{ return mHits; }
+	u32						GetMissCount() const					{ return mMisses; }
+	u32						GetEvictionCount() const				{ return mEvictions; }
+	u32						GetDecayCount() const					{ return mDecays; }
+
+private:
+	void					Decay();
+
+	static u32				HashAddress( u32 address );
+
+private:
+	static const u32		TABLE_BITS = 13;
+	static const u32		TABLE_SIZE = 1 << TABLE_BITS;
+	static const u32		TABLE_MASK = TABLE_SIZE - 1;
+	static const u32		PROBE_LENGTH = 8;
+
+	std::array< SEntry, TABLE_SIZE >	mEntries;
+
+	u32						mMaxEntries;		// Decay once this many entries are live
+	u32						mSize;
+
+	u32						mHits;
+	u32						mMisses;
+	u32						mEvictions;
+	u32						mDecays;
+};
+
+#endif // DYNAREC_HOTTRACECOUNTTABLE_H_
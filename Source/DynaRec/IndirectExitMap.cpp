@@ -28,6 +28,16 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "Debug/DBGConsole.h"
 
 
+// Once an exit has gone to this many different places, we stop chasing it and just look it up
+static const u32			MAX_INDIRECT_EXIT_CACHE_MISSES = 32;
+
+// Never matches, as addresses are word aligned
+static SIndirectExitCache	gNoReturnAddress = { nullptr, u32(~0), 0 };
+
+SReturnAddressStack							gReturnAddressStack;
+std::vector< SIndirectExitCache * >			CIndirectExitMap::sFilledCaches;
+
+
 //
 
 CIndirectExitMap::CIndirectExitMap()
@@ -58,6 +68,52 @@ CFragment *	CIndirectExitMap::LookupIndirectExit( u32 exit_address )
 }
 
 
+//
+
+void	CIndirectExitMap::UpdateCache( SIndirectExitCache * p_cache, u32 address, const void * p_target )
+{
+	if( p_cache->Address != address )
+	{
+		if( p_cache->Misses >= MAX_INDIRECT_EXIT_CACHE_MISSES )
+		{
+			return;
+		}
+		p_cache->Misses++;
+		p_cache->Address = address;
+	}
+
+	if( p_cache->Target == nullptr )
+	{
+		sFilledCaches.push_back( p_cache );
+	}
+	p_cache->Target = p_target;
+}
+
+
+//
+
+void	CIndirectExitMap::FlushCaches()
+{
+	for( std::vector< SIndirectExitCache * >::const_iterator it = sFilledCaches.begin(); it != sFilledCaches.end(); ++it )
+	{
+		(*it)->Target = nullptr;
+	}
+	sFilledCaches.clear();
+}
+
+
+//
+
+void	CIndirectExitMap::ResetReturnAddressStack()
+{
+	for( u32 i = 0; i < SReturnAddressStack::SIZE; ++i )
+	{
+		gReturnAddressStack.Entries[ i ] = &gNoReturnAddress;
+	}
+	gReturnAddressStack.Top = 0;
+}
+
+
 //
 
 extern "C"
@@ -74,4 +130,22 @@ const void *	 IndirectExitMap_Lookup( CIndirectExitMap * p_map, u32 exit_address
 	return nullptr;
 }
 
+const void *	 IndirectExitMap_LookupAndCache( CIndirectExitMap * p_map, u32 exit_address, SIndirectExitCache * p_cache )
+{
+	#ifdef DAEDALUS_ENABLE_DYNAREC_PROFILE
+	DynarecProfile::gIndirectExitStats.Lookups++;
+	#endif
+
+	CFragment *	p_fragment( p_map->LookupIndirectExit( exit_address ) );
+	if( p_fragment != nullptr )
+	{
+		const void *	p_target( p_fragment->GetEntryTarget().GetTarget() );
+
+		CIndirectExitMap::UpdateCache( p_cache, exit_address, p_target );
+		return p_target;
+	}
+
+	return nullptr;
+}
+
 }
@@ -22,9 +22,38 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "Base/Types.h"
 
+#include <vector>
+
 class CFragment;
 class CFragmentCache;
 
+//
+//	A single entry cache for an indirect exit, which the generated code checks
+//	before calling IndirectExitMap_LookupAndCache(). These live in the code
+//	buffer, so they go away when the fragment cache is cleared.
+//
+struct SIndirectExitCache
+{
+	const void *		Target;			// Entry point of the fragment at Address, or null if not known
+	u32					Address;
+	u32					Misses;			// Number of times Address has been replaced
+};
+
+//
+//	Each JAL pushes the cache for its return address, so the JR RA at the end of
+//	the function can usually jump straight back to the caller. It's circular, so
+//	calls that never return just overwrite the oldest entries.
+//
+struct SReturnAddressStack
+{
+	static const u32		SIZE = 16;
+
+	SIndirectExitCache *	Entries[ SIZE ];
+	u32						Top;
+};
+
+extern SReturnAddressStack	gReturnAddressStack;
+
 class CIndirectExitMap
 {
 	public:
@@ -34,13 +63,22 @@ class CIndirectExitMap
 		CFragment *				LookupIndirectExit( u32 exit_address );
 		void					SetCache( const CFragmentCache * p_cache )				{ mpCache = p_cache; }
 
+		static void				UpdateCache( SIndirectExitCache * p_cache, u32 address, const void * p_target );
+
+		// Forget all the fragments we've cached, as some have gone
+		static void				FlushCaches();
+		static void				ResetReturnAddressStack();
+
 	private:
 		const CFragmentCache *	mpCache;
+
+		static std::vector< SIndirectExitCache * >	sFilledCaches;
 };
 
 //
 //	C-stub to allow easy access from dynarec code
 //
 extern "C" { const void *	 IndirectExitMap_Lookup( CIndirectExitMap * p_map, u32 exit_address ); }
+extern "C" { const void *	 IndirectExitMap_LookupAndCache( CIndirectExitMap * p_map, u32 exit_address, SIndirectExitCache * p_cache ); }
 
 #endif // DYNAREC_INDIRECTEXITMAP_H_
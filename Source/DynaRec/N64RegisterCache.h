@@ -45,6 +45,7 @@ public:
 					mRegisterCacheInfo[i][lo_hi_idx].Valid = false;
 					mRegisterCacheInfo[i][lo_hi_idx].Dirty = false;
 					mRegisterCacheInfo[i][lo_hi_idx].Known = false;
+					mRegisterCacheInfo[i][lo_hi_idx].SignExtended = false;
 				}
 			}
 
@@ -149,6 +150,22 @@ public:
 			return mRegisterCacheInfo[ reg ][ lo_hi_idx ].KnownValue;
 		}
 
+		// Used by 64 bit targets, which keep the whole register in the lo entry. When set,
+		// only the low 32 bits of the native register have been written, and the top half
+		// still needs to be generated by sign extending them.
+		inline bool	IsSignExtended( EN64Reg reg, u32 lo_hi_idx ) const
+		{
+			return mRegisterCacheInfo[ reg ][ lo_hi_idx ].SignExtended;
+		}
+
+		inline void	MarkAsSignExtended( EN64Reg reg, u32 lo_hi_idx, bool sign_extended )
+		{
+			#ifdef DAEDALUS_ENABLE_ASSERTS
+			DAEDALUS_ASSERT( !sign_extended || IsCached( reg, lo_hi_idx ), "Setting sign extended flag on uncached register?" );
+			#endif
+			mRegisterCacheInfo[ reg ][ lo_hi_idx ].SignExtended = sign_extended;
+		}
+
 		inline bool	IsFPValid( EN64FloatReg reg ) const
 		{
 			return mFPRegisterCacheInfo[ reg ].Valid;
@@ -189,6 +206,7 @@ public:
 			mRegisterCacheInfo[n64_reg][lo_hi_idx].Valid = false;
 			mRegisterCacheInfo[n64_reg][lo_hi_idx].Dirty = false;
 			mRegisterCacheInfo[n64_reg][lo_hi_idx].Known = false;
+			mRegisterCacheInfo[n64_reg][lo_hi_idx].SignExtended = false;
 		}
 
 	private:
@@ -200,7 +218,7 @@ public:
 			bool			Valid;				// Is the contents of the register valid?
 			bool			Dirty;				// Is the contents of the register modified?
 			bool			Known;				// Is the contents of the known?
-			//bool			SignExtended;		// Is this (high) register just sign extension of low reg?
+			bool			SignExtended;		// Is the top half of the register still to be sign extended from the low half?
 		};
 
 		// PSP fp registers are stored in a 1:1 mapping with the n64 counterparts
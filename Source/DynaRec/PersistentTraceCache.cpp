@@ -0,0 +1,328 @@
+/*
+Copyright (C) 2007 StrmnNrmn
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include "Base/Types.h"
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "Debug/DBGConsole.h"
+#include "DynaRec/PersistentTraceCache.h"
+#include "DynaRec/StaticAnalysis.h"
+#include "DynaRec/TraceRecorder.h"
+#include "Utility/Paths.h"
+
+namespace
+{
+	const u32 MAGIC_HEADER = 0x80000154;
+	const u32 CACHE_VERSION = 1;
+
+	const u32 INVALID_IDX = u32( ~0 );
+
+	// Anything larger than this in the file means it's corrupt
+	const u32 MAX_TRACE_LENGTH = 4096;
+	const u32 MAX_TRACES = 65536;
+
+	enum EBranchFlags
+	{
+		BF_CONDITIONAL_TAKEN	= 1 << 0,
+		BF_LIKELY				= 1 << 1,
+		BF_DIRECT				= 1 << 2,
+		BF_ERET					= 1 << 3,
+	};
+
+	void WriteU32( std::ofstream & fp, u32 data )
+	{
+		fp.write( reinterpret_cast< const char * >( &data ), sizeof( data ) );
+	}
+
+	bool ReadU32( std::ifstream & fp, u32 & data )
+	{
+		fp.read( reinterpret_cast< char * >( &data ), sizeof( data ) );
+		return fp.good();
+	}
+}
+
+CPersistentTraceCache		gPersistentTraceCache;
+
+//*************************************************************************************
+//
+//*************************************************************************************
+CPersistentTraceCache::CPersistentTraceCache()
+:	mUseCount( 0 )
+,	mOpen( false )
+,	mDirty( false )
+,	mNumLoaded( 0 )
+,	mNumRejected( 0 )
+{
+}
+
+//*************************************************************************************
+//
+//*************************************************************************************
+void CPersistentTraceCache::Open( const RomID & rom_id )
+{
+	Close();
+
+	std::ostringstream name;
+	name << std::hex << std::setfill( '0' )
+		 << std::setw( 8 ) << rom_id.CRC[0] << std::setw( 8 ) << rom_id.CRC[1]
+		 << "-" << std::setw( 2 ) << static_cast< int >( rom_id.CountryID ) << ".trc";
+
+	mFilename = setBasePath( "SaveGames/Cache" ) / name.str();
+	mOpen = true;
+
+	if( !Load() )
+	{
+		mTraces.clear();
+	}
+#ifdef DAEDALUS_DEBUG_CONSOLE
+	DBGConsole_Msg( 0, "Trace cache %s: %d traces", mFilename.string().c_str(), u32( mTraces.size() ) );
+#endif
+}
+
+//*************************************************************************************
+//
+//*************************************************************************************
+void CPersistentTraceCache::Close()
+{
+	if( mOpen && mDirty )
+	{
+		Save();
+	}
+#ifdef DAEDALUS_DEBUG_CONSOLE
+	if( mOpen )
+	{
+		DBGConsole_Msg( 0, "Trace cache: %d used, %d rejected", mNumLoaded, mNumRejected );
+	}
+#endif
+
+	mTraces.clear();
+	mUseCount = 0;
+	mOpen = false;
+	mDirty = false;
+	mNumLoaded = 0;
+	mNumRejected = 0;
+}
+
+//*************************************************************************************
+//	Later recordings replace earlier ones, they reflect the current code
+//*************************************************************************************
+void CPersistentTraceCache::AddTrace( const SRecordedTrace & trace )
+{
+	if( !mOpen )
+		return;
+
+	if( mTraces.size() >= MAX_TRACES && mTraces.find( trace.StartAddress ) == mTraces.end() )
+	{
+		EvictLeastRecentlyUsed();
+	}
+
+	SCachedTrace & entry( mTraces[ trace.StartAddress ] );
+	entry.Trace = trace;
+	entry.LastUsed = ++mUseCount;
+	mDirty = true;
+}
+
+//*************************************************************************************
+//	Traces loaded from the file but not used this session go first
+//*************************************************************************************
+void CPersistentTraceCache::EvictLeastRecentlyUsed()
+{
+	TraceMap::iterator oldest( mTraces.begin() );
+
+	for( TraceMap::iterator it = mTraces.begin(); it != mTraces.end(); ++it )
+	{
+		if( it->second.LastUsed < oldest->second.LastUsed )
+		{
+			oldest = it;
+		}
+	}
+
+	if( oldest != mTraces.end() )
+	{
+		mTraces.erase( oldest );
+	}
+}
+
+//*************************************************************************************
+//
+//*************************************************************************************
+const SRecordedTrace * CPersistentTraceCache::FindValidTrace( u32 address )
+{
+	TraceMap::iterator it( mTraces.find( address ) );
+	if( it == mTraces.end() )
+		return nullptr;
+
+	if( !CTraceRecorder::ValidateTrace( it->second.Trace ) )
+	{
+		mTraces.erase( it );
+		mDirty = true;
+		mNumRejected++;
+		return nullptr;
+	}
+
+	it->second.LastUsed = ++mUseCount;
+	mNumLoaded++;
+	return &it->second.Trace;
+}
+
+//*************************************************************************************
+//
+//*************************************************************************************
+bool CPersistentTraceCache::Load()
+{
+	std::ifstream fp( mFilename, std::ios::in | std::ios::binary );
+	if( !fp.is_open() )
+		return false;
+
+	u32 data( 0 );
+	if( !ReadU32( fp, data ) || data != MAGIC_HEADER )
+		return false;
+	if( !ReadU32( fp, data ) || data != CACHE_VERSION )
+		return false;
+
+	u32 num_traces( 0 );
+	if( !ReadU32( fp, num_traces ) || num_traces > MAX_TRACES )
+		return false;
+
+	for( u32 t = 0; t < num_traces; ++t )
+	{
+		SRecordedTrace	trace;
+		u32				need_indirect_exit_map( 0 );
+		u32				num_entries( 0 );
+		u32				num_branches( 0 );
+
+		if( !ReadU32( fp, trace.StartAddress ) ||
+			!ReadU32( fp, trace.ExitAddress ) ||
+			!ReadU32( fp, need_indirect_exit_map ) ||
+			!ReadU32( fp, num_entries ) ||
+			!ReadU32( fp, num_branches ) )
+			return false;
+
+		if( num_entries == 0 || num_entries > MAX_TRACE_LENGTH || num_branches > num_entries )
+			return false;
+
+		trace.NeedIndirectExitMap = need_indirect_exit_map != 0;
+		trace.Trace.resize( num_entries );
+		trace.BranchDetails.resize( num_branches );
+
+		for( STraceEntry & entry : trace.Trace )
+		{
+			u32 branch_delay_slot( 0 );
+
+			if( !ReadU32( fp, entry.Address ) ||
+				!ReadU32( fp, entry.OpCode._u32 ) ||
+				!ReadU32( fp, entry.BranchIdx ) ||
+				!ReadU32( fp, branch_delay_slot ) )
+				return false;
+
+			if( entry.BranchIdx != INVALID_IDX && entry.BranchIdx >= num_branches )
+				return false;
+
+			entry.BranchDelaySlot = branch_delay_slot != 0;
+
+			// Register usage is derived from the op, so it isn't stored
+			StaticAnalysis::Analyse( entry.OpCode, entry.Usage );
+		}
+
+		for( SBranchDetails & details : trace.BranchDetails )
+		{
+			u32 delay_slot_idx( 0 );
+			u32 flags( 0 );
+			u32 speed_hack( 0 );
+
+			if( !ReadU32( fp, details.TargetAddress ) ||
+				!ReadU32( fp, delay_slot_idx ) ||
+				!ReadU32( fp, flags ) ||
+				!ReadU32( fp, speed_hack ) )
+				return false;
+
+			details.DelaySlotTraceIndex = s32( delay_slot_idx );
+			if( details.DelaySlotTraceIndex < -1 || details.DelaySlotTraceIndex >= s32( num_entries ) || speed_hack > SHACK_COPYREG )
+				return false;
+
+			details.ConditionalBranchTaken = ( flags & BF_CONDITIONAL_TAKEN ) != 0;
+			details.Likely = ( flags & BF_LIKELY ) != 0;
+			details.Direct = ( flags & BF_DIRECT ) != 0;
+			details.Eret = ( flags & BF_ERET ) != 0;
+			details.SpeedHack = SpeedHackProbe( speed_hack );
+		}
+
+		SCachedTrace & entry( mTraces[ trace.StartAddress ] );
+		entry.Trace = std::move( trace );
+		entry.LastUsed = 0;
+	}
+
+	return true;
+}
+
+//*************************************************************************************
+//
+//*************************************************************************************
+void CPersistentTraceCache::Save() const
+{
+	std::filesystem::create_directories( mFilename.parent_path() );
+
+	std::ofstream fp( mFilename, std::ios::binary );
+	if( !fp.is_open() )
+		return;
+
+	WriteU32( fp, MAGIC_HEADER );
+	WriteU32( fp, CACHE_VERSION );
+	WriteU32( fp, mTraces.size() );
+
+	for( const auto & it : mTraces )
+	{
+		const SRecordedTrace & trace( it.second.Trace );
+
+		WriteU32( fp, trace.StartAddress );
+		WriteU32( fp, trace.ExitAddress );
+		WriteU32( fp, trace.NeedIndirectExitMap );
+		WriteU32( fp, trace.Trace.size() );
+		WriteU32( fp, trace.BranchDetails.size() );
+
+		for( const STraceEntry & entry : trace.Trace )
+		{
+			WriteU32( fp, entry.Address );
+			WriteU32( fp, entry.OpCode._u32 );
+			WriteU32( fp, entry.BranchIdx );
+			WriteU32( fp, entry.BranchDelaySlot );
+		}
+
+		for( const SBranchDetails & details : trace.BranchDetails )
+		{
+			u32 flags( 0 );
+			if( details.ConditionalBranchTaken )	flags |= BF_CONDITIONAL_TAKEN;
+			if( details.Likely )					flags |= BF_LIKELY;
+			if( details.Direct )					flags |= BF_DIRECT;
+			if( details.Eret )						flags |= BF_ERET;
+
+			WriteU32( fp, details.TargetAddress );
+			WriteU32( fp, u32( details.DelaySlotTraceIndex ) );
+			WriteU32( fp, flags );
+			WriteU32( fp, details.SpeedHack );
+		}
+	}
+
+#ifdef DAEDALUS_DEBUG_CONSOLE
+	DBGConsole_Msg( 0, "Wrote %d traces to %s", u32( mTraces.size() ), mFilename.string().c_str() );
+#endif
+}
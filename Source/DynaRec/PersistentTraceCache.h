@@ -0,0 +1,84 @@
+/*
+Copyright (C) 2007 StrmnNrmn
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef DYNAREC_PERSISTENTTRACECACHE_H_
+#define DYNAREC_PERSISTENTTRACECACHE_H_
+
+#include "Base/Types.h"
+#include "Core/ROM.h"
+#include "DynaRec/Trace.h"
+
+#include <filesystem>
+#include <map>
+
+//*************************************************************************************
+//	Keeps the traces recorded during a session and writes them out per ROM
+//	(SaveGames/Cache/<crc1><crc2>-<country>.trc) so they can be compiled as soon
+//	as they are first branched to next time, instead of waiting for them to
+//	become hot again.
+//
+//	Only the trace is stored, not the generated code. Every trace is checked
+//	against the current contents of memory before it is used, so stale entries
+//	(overlays, self modifying code) are simply dropped. Once the cache is full,
+//	the trace that has gone unused the longest makes way for a new one.
+//*************************************************************************************
+class CPersistentTraceCache
+{
+public:
+	CPersistentTraceCache();
+
+	void					Open( const RomID & rom_id );
+	void					Close();
+
+	bool					IsOpen() const							{ return mOpen; }
+
+	void					AddTrace( const SRecordedTrace & trace );
+	const SRecordedTrace *	FindValidTrace( u32 address );
+
+	u32						GetSize() const							{ return mTraces.size(); }
+	u32						GetNumLoaded() const					{ return mNumLoaded; }
+	u32						GetNumRejected() const					{ return mNumRejected; }
+
+private:
+	bool					Load();
+	void					Save() const;
+	void					EvictLeastRecentlyUsed();
+
+private:
+	struct SCachedTrace
+	{
+		SRecordedTrace		Trace;
+		u32					LastUsed;			// mUseCount when last added or found. 0 if not used this session
+	};
+
+	using TraceMap = std::map< u32, SCachedTrace >;
+
+	std::filesystem::path	mFilename;
+	TraceMap				mTraces;
+	u32						mUseCount;
+	bool					mOpen;
+	bool					mDirty;
+
+	u32						mNumLoaded;			// Traces that were used from the file this session
+	u32						mNumRejected;		// Traces dropped because memory no longer matches
+};
+
+extern CPersistentTraceCache	gPersistentTraceCache;
+
+#endif // DYNAREC_PERSISTENTTRACECACHE_H_
@@ -25,6 +25,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "Core/R4300OpCode.h"
 #include "Core/CPU.h"
 #include "Core/ROM.h"
+#include "Ultra/ultra_R4300.h"
 
 using namespace StaticAnalysis;
 
@@ -1152,6 +1153,78 @@ void StaticAnalysis_Cop1_DInstr( OpCode op_code, RegisterUsage & recorder )
 	gStaticAnalysisCop1DInstruction[ op_code.cop1_funct ]( op_code, recorder );
 }
 
+// Only simple integer ops and loads are allowed in an idle loop. Anything which
+// writes memory or touches HI/LO or the coprocessors might have an effect we'd
+// lose by skipping ahead (and reading COUNT means the loop is waiting for time
+// to pass, which skipping to the next event would overshoot).
+bool IsIdleLoopOp( OpCode op_code )
+{
+	switch( op_code.op )
+	{
+	case OP_SPECOP:
+		switch( op_code.spec_op )
+		{
+		case SpecOp_SLL:	case SpecOp_SRL:	case SpecOp_SRA:
+		case SpecOp_SLLV:	case SpecOp_SRLV:	case SpecOp_SRAV:
+		case SpecOp_SYNC:
+		case SpecOp_DSLLV:	case SpecOp_DSRLV:	case SpecOp_DSRAV:
+		case SpecOp_ADD:	case SpecOp_ADDU:	case SpecOp_SUB:	case SpecOp_SUBU:
+		case SpecOp_AND:	case SpecOp_OR:		case SpecOp_XOR:	case SpecOp_NOR:
+		case SpecOp_SLT:	case SpecOp_SLTU:
+		case SpecOp_DADD:	case SpecOp_DADDU:	case SpecOp_DSUB:	case SpecOp_DSUBU:
+		case SpecOp_DSLL:	case SpecOp_DSRL:	case SpecOp_DSRA:
+		case SpecOp_DSLL32:	case SpecOp_DSRL32:	case SpecOp_DSRA32:
+			return true;
+		default:
+			return false;
+		}
+
+	case OP_ADDI:	case OP_ADDIU:	case OP_SLTI:	case OP_SLTIU:
+	case OP_ANDI:	case OP_ORI:	case OP_XORI:	case OP_LUI:
+	case OP_DADDI:	case OP_DADDIU:
+	case OP_LB:		case OP_LBU:	case OP_LH:		case OP_LHU:
+	case OP_LW:		case OP_LWU:	case OP_LD:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+bool IsIdleLoopLoad( OpCode op_code )
+{
+	switch( op_code.op )
+	{
+	case OP_LB:		case OP_LBU:	case OP_LH:		case OP_LHU:
+	case OP_LW:		case OP_LWU:	case OP_LD:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+// Loads must come from RDRAM. Reading a register like VI_CURRENT_REG can give a
+// different value every time, so a loop polling one of those isn't idle. We only
+// know where KSEG0/KSEG1 addresses point - anything else goes through the TLB.
+bool IsIdleLoopLoadAddress( u32 address )
+{
+	return IS_K0K1( address ) && K0_TO_PHYS( address ) < gRamSize;
+}
+
+bool IsIdleLoopBranch( ER4300BranchType type )
+{
+	switch( type )
+	{
+	case BT_BEQ:	case BT_BNE:	case BT_BLEZ:	case BT_BGTZ:	case BT_BLTZ:	case BT_BGEZ:
+	case BT_BEQL:	case BT_BNEL:	case BT_BLEZL:	case BT_BGTZL:	case BT_BLTZL:	case BT_BGEZL:
+	case BT_J:
+		return true;
+	default:
+		return false;
+	}
+}
+
 }
 
 namespace StaticAnalysis
@@ -1163,4 +1236,141 @@ void Analyse( OpCode op_code, RegisterUsage & reg_usage )
 	gStaticAnalysisInstruction[ op_code.op ]( op_code, reg_usage );
 }
 
+bool IsIdleLoop( u32 address, const OpCode * p_ops, u32 num_ops, const u32 * p_load_addresses )
+{
+	if( num_ops < 2 || num_ops > MAX_IDLE_LOOP_OPS )
+		return false;
+
+	// The loop must be straight line code ending with a branch back to the start
+	const u32		branch_idx( num_ops - 2 );
+	u32				reads[ MAX_IDLE_LOOP_OPS ];
+	u32				writes[ MAX_IDLE_LOOP_OPS ];
+	u32				loop_writes( 0 );
+
+	for( u32 i = 0; i < num_ops; ++i )
+	{
+		RegisterUsage	usage;
+		Analyse( p_ops[ i ], usage );
+
+		if( i == branch_idx )
+		{
+			if( !IsIdleLoopBranch( usage.BranchType ) ||
+				GetBranchTarget( address + i * 4, p_ops[ i ], usage.BranchType ) != address )
+				return false;
+		}
+		else if( !IsIdleLoopOp( p_ops[ i ] ) )
+		{
+			return false;
+		}
+		else if( IsIdleLoopLoad( p_ops[ i ] ) && !IsIdleLoopLoadAddress( p_load_addresses[ i ] ) )
+		{
+			return false;
+		}
+
+		reads[ i ] = usage.RegReads | usage.RegBase;
+		writes[ i ] = usage.RegWrites & ~1;		// Writes to r0 are discarded
+		loop_writes |= writes[ i ];
+	}
+
+	// Every register the loop writes must end up with the same value on each
+	// iteration (as long as memory doesn't change), otherwise the loop is making
+	// progress (e.g. counting) and can't be skipped. To start with, only trust
+	// the registers the loop doesn't write. Then keep trusting registers whose
+	// last write only depended on trusted values, until nothing changes.
+	u32		stable( 0 );
+	while( true )
+	{
+		u32		known( ~loop_writes | stable );
+
+		for( u32 i = 0; i < num_ops; ++i )
+		{
+			if( (reads[ i ] & ~known) == 0 )
+			{
+				known |= writes[ i ];
+			}
+			else
+			{
+				known &= ~writes[ i ];
+			}
+		}
+
+		u32		new_stable( known & loop_writes );
+		if( new_stable == stable )
+			break;
+
+		stable = new_stable;
+	}
+
+	return stable == loop_writes;
+}
+
+bool GetIdleLoopLoadAddresses( const OpCode * p_ops, u32 num_ops, u32 * p_load_addresses )
+{
+	if( num_ops > MAX_IDLE_LOOP_OPS )
+		return false;
+
+	// Registers the loop doesn't write hold the same value all the way round it,
+	// so they can be read from the current state
+	u32		loop_writes( 0 );
+	for( u32 i = 0; i < num_ops; ++i )
+	{
+		RegisterUsage	usage;
+		Analyse( p_ops[ i ], usage );
+		loop_writes |= usage.RegWrites;
+	}
+
+	u32		known( ~(loop_writes & ~1) );
+	u32		values[ 32 ];
+	for( u32 r = 0; r < 32; ++r )
+	{
+		values[ r ] = gCPUState.CPU[ r ]._u32_0;
+	}
+	values[ 0 ] = 0;
+
+	// The rest are only known if the loop builds them from constants, as is
+	// usual for the address of the variable being polled
+	for( u32 i = 0; i < num_ops; ++i )
+	{
+		OpCode	op_code( p_ops[ i ] );
+		u32		rs_known( known & (1 << op_code.rs) );
+
+		p_load_addresses[ i ] = 0;
+		if( IsIdleLoopLoad( op_code ) )
+		{
+			if( (known & (1 << op_code.base)) == 0 )
+				return false;
+
+			p_load_addresses[ i ] = values[ op_code.base ] + s16( op_code.offset );
+		}
+
+		RegisterUsage	usage;
+		Analyse( op_code, usage );
+
+		u32		dst( usage.RegWrites & ~1 );
+		if( dst == 0 )
+			continue;
+
+		switch( op_code.op )
+		{
+		case OP_LUI:
+			values[ op_code.rt ] = op_code.immediate << 16;
+			known |= dst;
+			break;
+		case OP_ADDI:	case OP_ADDIU:	case OP_DADDI:	case OP_DADDIU:
+			values[ op_code.rt ] = values[ op_code.rs ] + s16( op_code.immediate );
+			known = rs_known ? (known | dst) : (known & ~dst);
+			break;
+		case OP_ORI:
+			values[ op_code.rt ] = values[ op_code.rs ] | op_code.immediate;
+			known = rs_known ? (known | dst) : (known & ~dst);
+			break;
+		default:
+			known &= ~dst;
+			break;
+		}
+	}
+
+	return true;
+}
+
 }
@@ -128,6 +128,20 @@ namespace StaticAnalysis
 	};
 
 	void		Analyse( OpCode op_code, RegisterUsage & reg_usage );
+
+	// Longest loop (including the branch and its delay slot) we'll check for being idle
+	static const u32	MAX_IDLE_LOOP_OPS = 16;
+
+	// Check whether the loop starting at address is just waiting for something
+	// to happen - i.e. it only reads RDRAM and registers, and nothing it writes
+	// carries over from one iteration to the next. The ops must run from the
+	// start of the loop to the delay slot of the branch back to the start, and
+	// p_load_addresses gives the address each load reads from.
+	bool		IsIdleLoop( u32 address, const OpCode * p_ops, u32 num_ops, const u32 * p_load_addresses );
+
+	// Work out the addresses the loop's loads read from, using the current
+	// register values. Fails if a load's base register can't be worked out.
+	bool		GetIdleLoopLoadAddresses( const OpCode * p_ops, u32 num_ops, u32 * p_load_addresses );
 }
 
 #endif // DYNAREC_STATICANALYSIS_H_
@@ -0,0 +1,140 @@
+#include "Base/Types.h"
+#include "DynaRec/StaticAnalysis.h"
+
+#include <gtest/gtest.h>
+
+#include "Core/CPU.h"
+#include "Core/N64Reg.h"
+#include "Core/R4300OpCode.h"
+#include "Ultra/ultra_rcp.h"
+
+//*****************************************************************************
+//	Idle loop detection. Loops which poll RDRAM can be skipped, but loops which
+//	poll a register that changes on every read (like VI_CURRENT_REG) can't.
+//*****************************************************************************
+static OpCode IType( u32 op, u32 rs, u32 rt, s16 immediate )
+{
+	OpCode op_code;
+	op_code._u32 = (op << 26) | (rs << 21) | (rt << 16) | u16( immediate );
+	return op_code;
+}
+
+static const OpCode kNop = IType( OP_SPECOP, 0, 0, 0 );
+
+class IdleLoopTest : public ::testing::Test
+{
+protected:
+	static const u32 kLoopAddress = 0x80001000;
+
+	virtual void SetUp()
+	{
+		mOldRamSize = gRamSize;
+		gRamSize = 8 * 1024 * 1024;
+		for( u32 i = 0; i < 32; ++i )
+			mOldRegs[ i ] = gCPUState.CPU[ i ];
+	}
+
+	virtual void TearDown()
+	{
+		gRamSize = mOldRamSize;
+		for( u32 i = 0; i < 32; ++i )
+			gCPUState.CPU[ i ] = mOldRegs[ i ];
+	}
+
+	// As the interpreter does it, working out the load addresses from the registers
+	bool IsIdleLoop( const OpCode * p_ops, u32 num_ops )
+	{
+		u32 load_addresses[ StaticAnalysis::MAX_IDLE_LOOP_OPS ];
+		return StaticAnalysis::GetIdleLoopLoadAddresses( p_ops, num_ops, load_addresses ) &&
+			   StaticAnalysis::IsIdleLoop( kLoopAddress, p_ops, num_ops, load_addresses );
+	}
+
+	u32		mOldRamSize;
+	REG64	mOldRegs[ 32 ];
+};
+
+TEST_F(IdleLoopTest, PollingRDRAMIsIdle)
+{
+	// lui t0, 0x8030 ; lw t1, 0x100(t0) ; beq t1, r0, loop ; nop
+	const OpCode ops[] =
+	{
+		IType( OP_LUI, 0, N64Reg_T0, s16( 0x8030 ) ),
+		IType( OP_LW, N64Reg_T0, N64Reg_T1, 0x100 ),
+		IType( OP_BEQ, N64Reg_T1, N64Reg_R0, -3 ),
+		kNop,
+	};
+	u32 load_addresses[ 4 ];
+
+	ASSERT_TRUE( StaticAnalysis::GetIdleLoopLoadAddresses( ops, 4, load_addresses ) );
+	EXPECT_EQ( 0x80300100u, load_addresses[ 1 ] );
+	EXPECT_TRUE( StaticAnalysis::IsIdleLoop( kLoopAddress, ops, 4, load_addresses ) );
+}
+
+TEST_F(IdleLoopTest, PollingVICurrentIsNotIdle)
+{
+	// lui t0, 0xa440 ; lw t1, 0x10(t0) ; bne t1, a1, loop ; nop
+	const OpCode ops[] =
+	{
+		IType( OP_LUI, 0, N64Reg_T0, s16( 0xa440 ) ),
+		IType( OP_LW, N64Reg_T0, N64Reg_T1, 0x10 ),
+		IType( OP_BNE, N64Reg_T1, N64Reg_A1, -3 ),
+		kNop,
+	};
+	u32 load_addresses[ 4 ];
+
+	ASSERT_TRUE( StaticAnalysis::GetIdleLoopLoadAddresses( ops, 4, load_addresses ) );
+	EXPECT_EQ( 0xa0000000u | VI_CURRENT_REG, load_addresses[ 1 ] );
+	EXPECT_FALSE( StaticAnalysis::IsIdleLoop( kLoopAddress, ops, 4, load_addresses ) );
+}
+
+TEST_F(IdleLoopTest, RecordedRegisterAddressIsNotIdle)
+{
+	// The trace recorder passes the addresses it saw: lw t1, 0x10(a0) ; bne t1, a1, loop ; nop
+	const OpCode ops[] =
+	{
+		IType( OP_LW, N64Reg_A0, N64Reg_T1, 0x10 ),
+		IType( OP_BNE, N64Reg_T1, N64Reg_A1, -2 ),
+		kNop,
+	};
+	const u32 rdram[] = { 0x80200010, 0, 0 };
+	const u32 vi_current[] = { 0xa0000000 | VI_CURRENT_REG, 0, 0 };
+
+	EXPECT_TRUE( StaticAnalysis::IsIdleLoop( kLoopAddress, ops, 3, rdram ) );
+	EXPECT_FALSE( StaticAnalysis::IsIdleLoop( kLoopAddress, ops, 3, vi_current ) );
+}
+
+TEST_F(IdleLoopTest, BaseRegisterFromOutsideTheLoop)
+{
+	// lw t1, 0x10(a0) ; bne t1, a1, loop ; nop - with a0 set up before the loop
+	const OpCode ops[] =
+	{
+		IType( OP_LW, N64Reg_A0, N64Reg_T1, 0x10 ),
+		IType( OP_BNE, N64Reg_T1, N64Reg_A1, -2 ),
+		kNop,
+	};
+
+	gCPUState.CPU[ N64Reg_A0 ]._s64 = s32( 0x80200000 );
+	EXPECT_TRUE( IsIdleLoop( ops, 3 ) );
+
+	gCPUState.CPU[ N64Reg_A0 ]._s64 = s32( 0xa0000000 | VI_BASE_REG );
+	EXPECT_FALSE( IsIdleLoop( ops, 3 ) );
+
+	// TLB mapped, so we can't tell where it reads from
+	gCPUState.CPU[ N64Reg_A0 ]._s64 = s32( 0x00200000 );
+	EXPECT_FALSE( IsIdleLoop( ops, 3 ) );
+}
+
+TEST_F(IdleLoopTest, UnknownBaseRegisterIsNotIdle)
+{
+	// lw t0, 0(a0) ; lw t1, 0x10(t0) ; beq t1, r0, loop ; nop - t0 could point anywhere
+	const OpCode ops[] =
+	{
+		IType( OP_LW, N64Reg_A0, N64Reg_T0, 0 ),
+		IType( OP_LW, N64Reg_T0, N64Reg_T1, 0x10 ),
+		IType( OP_BEQ, N64Reg_T1, N64Reg_R0, -3 ),
+		kNop,
+	};
+
+	gCPUState.CPU[ N64Reg_A0 ]._s64 = s32( 0x80200000 );
+	EXPECT_FALSE( IsIdleLoop( ops, 4 ) );
+}
@@ -20,6 +20,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #ifndef DYNAREC_TRACE_H_
 #define DYNAREC_TRACE_H_
 
+#include <vector>
+
 #include "Core/R4300OpCode.h"
 #include "DynaRec/StaticAnalysis.h"
 
@@ -63,4 +65,22 @@ struct SBranchDetails
 	SpeedHackProbe		SpeedHack;
 };
 
+// A complete trace as captured by the trace recorder, before it is compiled.
+// This is what gets written out to the persistent trace cache.
+struct SRecordedTrace
+{
+	SRecordedTrace()
+		:	StartAddress( 0 )
+		,	ExitAddress( 0 )
+		,	NeedIndirectExitMap( false )
+	{
+	}
+
+	u32								StartAddress;
+	u32								ExitAddress;
+	bool							NeedIndirectExitMap;
+	std::vector< STraceEntry >		Trace;
+	std::vector< SBranchDetails >	BranchDetails;
+};
+
 #endif // DYNAREC_TRACE_H_
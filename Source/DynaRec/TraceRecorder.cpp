@@ -22,6 +22,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 
 #include "Core/CPU.h"			// For dubious use of PC/NewPC
+#include "Core/Memory.h"
 #include "Debug/Registers.h"
 #include "Debug/DBGConsole.h"
 #include "DynaRec/BranchType.h"
@@ -81,6 +82,7 @@ CTraceRecorder::EUpdateTraceStatus	CTraceRecorder::UpdateTrace( u32 address,
 																 bool branch_delay_slot,
 																 bool branch_taken,
 																 OpCode op_code,
+																 u32 access_address,
 																 CFragment * p_fragment )
 {
 	#ifdef DAEDALUS_ENABLE_ASSERTS
@@ -125,10 +127,10 @@ CTraceRecorder::EUpdateTraceStatus	CTraceRecorder::UpdateTrace( u32 address,
 
 		if (mBranchDetails[ mActiveBranchIdx ].SpeedHack == SHACK_POSSIBLE)
 		{
-			if (op_code._u32 == 0)
+			if (IsIdleLoop( op_code, access_address ))
 			{
 				mBranchDetails[ mActiveBranchIdx ].SpeedHack = SHACK_SKIPTOEVENT;
-
+				CPU_AddIdleLoop( mExpectedExitTraceAddress );
 			}
 #ifndef DAEDALUS_SILENT
 			else if (op_code.op == OP_ADDIU || op_code.op == OP_DADDI || op_code.op == OP_ADDI || op_code.op == OP_DADDIU)
@@ -199,7 +201,7 @@ CTraceRecorder::EUpdateTraceStatus	CTraceRecorder::UpdateTrace( u32 address,
 				mStopTraceAfterDelaySlot = true;
 			}
 
-			if (details.Direct && gCPUState.TargetPC == gCPUState.CurrentPC)
+			if (details.Direct && gCPUState.TargetPC <= gCPUState.CurrentPC)
 			{
 				details.SpeedHack = SHACK_POSSIBLE;
 			}
@@ -218,10 +220,6 @@ CTraceRecorder::EUpdateTraceStatus	CTraceRecorder::UpdateTrace( u32 address,
 				if( backwards )
 				{
 					mStopTraceAfterDelaySlot = true;
-				}
-
-				if (gCPUState.TargetPC == gCPUState.CurrentPC)
-				{
 					details.SpeedHack = SHACK_POSSIBLE;
 				}
 			}
@@ -261,6 +259,8 @@ CTraceRecorder::EUpdateTraceStatus	CTraceRecorder::UpdateTrace( u32 address,
 	// Add this op to the trace buffer.
 	STraceEntry		entry = { address, op_code, usage, branch_idx, branch_delay_slot };
 
+	mLoadAddresses[ mTraceBuffer.size() % StaticAnalysis::MAX_IDLE_LOOP_OPS ] = access_address;
+
 	mTraceBuffer.push_back( entry );
 
 	if( stop_trace_on_exit )
@@ -276,6 +276,42 @@ CTraceRecorder::EUpdateTraceStatus	CTraceRecorder::UpdateTrace( u32 address,
 }
 
 
+//	Check whether the active branch (the last op recorded) closes an idle loop.
+//	The whole loop has to be in the trace, as straight line code, and its loads
+//	are checked against the addresses they read while we were recording.
+
+bool	CTraceRecorder::IsIdleLoop( OpCode delay_op, u32 delay_access_address ) const
+{
+	const u32	loop_address( mExpectedExitTraceAddress );
+	const u32	branch_address( mTraceBuffer.back().Address );
+
+	if( loop_address > branch_address )
+		return false;
+
+	const u32	num_ops( (branch_address - loop_address) / 4 + 2 );
+	if( num_ops > StaticAnalysis::MAX_IDLE_LOOP_OPS || num_ops - 1 > mTraceBuffer.size() )
+		return false;
+
+	OpCode		ops[ StaticAnalysis::MAX_IDLE_LOOP_OPS ];
+	u32			load_addresses[ StaticAnalysis::MAX_IDLE_LOOP_OPS ];
+	const u32	start_idx( mTraceBuffer.size() - (num_ops - 1) );
+
+	for( u32 i = 0; i < num_ops - 1; ++i )
+	{
+		const STraceEntry &	entry( mTraceBuffer[ start_idx + i ] );
+		if( entry.Address != loop_address + i * 4 )
+			return false;
+
+		ops[ i ] = entry.OpCode;
+		load_addresses[ i ] = mLoadAddresses[ (start_idx + i) % StaticAnalysis::MAX_IDLE_LOOP_OPS ];
+	}
+	ops[ num_ops - 1 ] = delay_op;
+	load_addresses[ num_ops - 1 ] = delay_access_address;
+
+	return StaticAnalysis::IsIdleLoop( loop_address, ops, num_ops, load_addresses );
+}
+
+
 //
 
 void	CTraceRecorder::StopTrace( u32 exit_address )
@@ -301,7 +337,7 @@ CFragment *		CTraceRecorder::CreateFragment( std::shared_ptr<CCodeBufferManager>
 	#endif
 
 	SRegisterUsageInfo	register_usage;
-	Analyse( register_usage );
+	Analyse( mTraceBuffer, register_usage );
 
 	CFragment *	p_frament( new CFragment( p_manager, mStartTraceAddress, mExpectedExitTraceAddress,
 		mTraceBuffer, register_usage, mBranchDetails, mNeedIndirectExitMap ) );
@@ -321,6 +357,80 @@ CFragment *		CTraceRecorder::CreateFragment( std::shared_ptr<CCodeBufferManager>
 }
 
 
+//	Take a copy of the trace that is about to be turned into a fragment
+
+void	CTraceRecorder::GetRecordedTrace( SRecordedTrace & trace ) const
+{
+	#ifdef DAEDALUS_ENABLE_ASSERTS
+	DAEDALUS_ASSERT( !mTraceBuffer.empty(), "No trace ready for recording?" );
+	#endif
+	trace.StartAddress = mStartTraceAddress;
+	trace.ExitAddress = mExpectedExitTraceAddress;
+	trace.NeedIndirectExitMap = mNeedIndirectExitMap;
+	trace.Trace = mTraceBuffer;
+	trace.BranchDetails = mBranchDetails;
+}
+
+
+//	Hand the finished trace over (e.g. to be compiled elsewhere) and get ready for the next one
+
+void	CTraceRecorder::ReleaseTrace( SRecordedTrace & trace )
+{
+	trace.StartAddress = mStartTraceAddress;
+	trace.ExitAddress = mExpectedExitTraceAddress;
+	trace.NeedIndirectExitMap = mNeedIndirectExitMap;
+	trace.Trace.swap( mTraceBuffer );
+	trace.BranchDetails.swap( mBranchDetails );
+
+	mTracing = false;
+	mStartTraceAddress = 0;
+	mTraceBuffer.clear();
+	mBranchDetails.clear();
+	mExpectedExitTraceAddress = 0;
+	mActiveBranchIdx = INVALID_IDX;
+	mStopTraceAfterDelaySlot = false;
+	mNeedIndirectExitMap = false;
+}
+
+
+//	Check every op still matches what is in memory. Addresses which aren't
+//	directly mapped (TLB, ROM) are never trusted.
+
+bool	CTraceRecorder::ValidateTrace( const SRecordedTrace & trace )
+{
+	for( const STraceEntry & entry : trace.Trace )
+	{
+		const MemFuncRead & m( g_MemoryLookupTableRead[ entry.Address >> 18 ] );
+		if( m.pRead == nullptr )
+			return false;
+
+		if( *(const u32 *)( m.pRead + entry.Address ) != entry.OpCode._u32 )
+			return false;
+	}
+
+	return !trace.Trace.empty();
+}
+
+
+//	Build a fragment from a previously recorded trace (e.g. one loaded from disk)
+
+CFragment *		CTraceRecorder::CreateFragment( std::shared_ptr<CCodeBufferManager> p_manager, const SRecordedTrace & trace )
+{
+	#ifdef DAEDALUS_ENABLE_DYNAREC_PROFILE
+	DAEDALUS_PROFILE( "CTraceRecorder::CreateFragment" );
+#endif
+#ifdef DAEDALUS_ENABLE_ASSERTS
+	DAEDALUS_ASSERT( !trace.Trace.empty(), "No trace ready for creation?" );
+	#endif
+
+	SRegisterUsageInfo	register_usage;
+	Analyse( trace.Trace, register_usage );
+
+	return new CFragment( p_manager, trace.StartAddress, trace.ExitAddress,
+		trace.Trace, register_usage, trace.BranchDetails, trace.NeedIndirectExitMap );
+}
+
+
 //
 
 void	CTraceRecorder::AbortTrace()
@@ -383,19 +493,19 @@ void	CTraceRecorder::AbortTrace()
 
 //
 
-void CTraceRecorder::Analyse( SRegisterUsageInfo & register_usage )
+void CTraceRecorder::Analyse( const std::vector< STraceEntry > & trace, SRegisterUsageInfo & register_usage )
 {
 	#ifdef DAEDALUS_ENABLE_DYNAREC_PROFILE
 	DAEDALUS_PROFILE( "CTraceRecorder::Analyse" );
 #endif
 	std::pair< s32, s32 >		reg_spans[ NUM_N64_REGS ];
-	std::pair< s32, s32 >		invalid_span( std::pair< s32, s32 >( mTraceBuffer.size(), -1 ) );
+	std::pair< s32, s32 >		invalid_span( std::pair< s32, s32 >( trace.size(), -1 ) );
 
 	std::fill( reg_spans, reg_spans + NUM_N64_REGS, invalid_span );		// Set the interval to an invalid range
 
-	for( u32 i  = 0; i < mTraceBuffer.size(); ++i )
+	for( u32 i  = 0; i < trace.size(); ++i )
 	{
-		const STraceEntry & ti( mTraceBuffer[ i ] );
+		const STraceEntry & ti( trace[ i ] );
 		const StaticAnalysis::RegisterUsage&	usage = ti.Usage;
 
 		register_usage.RegistersRead |= usage.RegReads;
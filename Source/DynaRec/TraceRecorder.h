@@ -46,9 +46,13 @@ public:
 		UTS_CREATE_FRAGMENT,
 	};
 
-	EUpdateTraceStatus	UpdateTrace( u32 address, bool branch_delay_slot, bool branch_taken, OpCode op_code, CFragment * p_fragment );
+	EUpdateTraceStatus	UpdateTrace( u32 address, bool branch_delay_slot, bool branch_taken, OpCode op_code, u32 access_address, CFragment * p_fragment );
 	void				StopTrace( u32 exit_address );
 	CFragment *			CreateFragment( std::shared_ptr<CCodeBufferManager> p_manager );
+	void				GetRecordedTrace( SRecordedTrace & trace ) const;
+	void				ReleaseTrace( SRecordedTrace & trace );
+	static CFragment *	CreateFragment( std::shared_ptr<CCodeBufferManager> p_manager, const SRecordedTrace & trace );
+	static bool			ValidateTrace( const SRecordedTrace & trace );
 	void				AbortTrace();
 
 	bool				IsTraceActive() const						{ return mTracing; }
@@ -69,7 +73,12 @@ private:
 	bool							mStopTraceAfterDelaySlot;
 	bool							mNeedIndirectExitMap;
 
-	void	Analyse(SRegisterUsageInfo & register_usage );
+	// Addresses read by the most recent loads, indexed by trace position
+	u32								mLoadAddresses[ StaticAnalysis::MAX_IDLE_LOOP_OPS ];
+
+	bool		IsIdleLoop( OpCode delay_op, u32 delay_access_address ) const;
+
+	static void	Analyse( const std::vector< STraceEntry > & trace, SRegisterUsageInfo & register_usage );
 };
 extern CTraceRecorder				gTraceRecorder;
 
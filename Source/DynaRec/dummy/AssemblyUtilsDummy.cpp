@@ -39,4 +39,12 @@ namespace AssemblyUtils
     {
         return false;
     }
+
+//*****************************************************************************
+//	Decode the location a long jump currently targets
+//*****************************************************************************
+    CCodeLabel	GetJumpTarget( CJumpLocation jump [[maybe_unused]] )
+    {
+        return CCodeLabel( nullptr );
+    }
 }
\ No newline at end of file
@@ -103,6 +103,22 @@ bool	PatchJumpLongAndFlush( CJumpLocation jump, CCodeLabel target )
 }
 
 
+//	Decode the location a jump or branch currently targets
+
+CCodeLabel	GetJumpTarget( CJumpLocation jump )
+{
+	const PspOpCode &	op_code( *reinterpret_cast< const PspOpCode * >( jump.GetTargetU8P() ) );
+	u32					address( reinterpret_cast< u32 >( jump.GetTargetU8P() ) );
+
+	if( op_code.op == OP_J || op_code.op == OP_JAL )
+	{
+		return CCodeLabel( reinterpret_cast< const void * >( ( ( address + 4 ) & 0xF0000000 ) | ( op_code.target << 2 ) ) );
+	}
+
+	return CCodeLabel( reinterpret_cast< const void * >( address + 4 + ( s32( s16( op_code.offset ) ) << 2 ) ) );
+}
+
+
 //	Replace a branch instruction with an unconditional jump
 void		ReplaceBranchWithJump( CJumpLocation branch, CCodeLabel target )
 {
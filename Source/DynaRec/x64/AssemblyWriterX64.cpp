@@ -67,22 +67,10 @@ void	CAssemblyWriterX64::PUSHI( u32 value )
 //*****************************************************************************
 void	CAssemblyWriterX64::ADD(EIntelReg reg1, EIntelReg reg2, bool is64)
 {
-	if (is64)
-	{
-		u8 first_byte = 0x48;
-		if (reg2 >= R8_CODE) {
-			first_byte |= 0x1;
-			reg2 = EIntelReg(reg2 & 7);
-		}
-		if (reg1 >= R8_CODE) {
-			first_byte |= 0x4;
-			reg1 = EIntelReg(reg1 & 7);
-		}
-		EmitBYTE(first_byte);
-	}
+	EmitREX(reg1, reg2, is64);
 
 	EmitBYTE(0x03);
-	EmitBYTE(0xc0 | (reg1<<3) | reg2);
+	EmitBYTE(0xc0 | ((reg1 & 7)<<3) | (reg2 & 7));
 }
 
 //*****************************************************************************
@@ -90,22 +78,10 @@ void	CAssemblyWriterX64::ADD(EIntelReg reg1, EIntelReg reg2, bool is64)
 //*****************************************************************************
 void	CAssemblyWriterX64::SUB(EIntelReg reg1, EIntelReg reg2, bool is64)
 {
-	if (is64)
-	{
-		u8 first_byte = 0x48;
-		if (reg2 >= R8_CODE) {
-			first_byte |= 0x1;
-			reg2 = EIntelReg(reg2 & 7);
-		}
-		if (reg1 >= R8_CODE) {
-			first_byte |= 0x4;
-			reg1 = EIntelReg(reg1 & 7);
-		}
-		EmitBYTE(first_byte);
-	}
+	EmitREX(reg1, reg2, is64);
 
 	EmitBYTE(0x2b);
-	EmitBYTE(0xc0 | (reg1<<3) | reg2);
+	EmitBYTE(0xc0 | ((reg1 & 7)<<3) | (reg2 & 7));
 }
 
 //*****************************************************************************
@@ -145,22 +121,10 @@ void	CAssemblyWriterX64::AND(EIntelReg reg1, EIntelReg reg2, bool is64)
 {
 	if (reg1 != reg2)
 	{
-		if (is64)
-		{
-			u8 first_byte = 0x48;
-			if (reg2 >= R8_CODE) {
-				first_byte |= 0x1;
-				reg2 = EIntelReg(reg2 & 7);
-			}
-			if (reg1 >= R8_CODE) {
-				first_byte |= 0x4;
-				reg1 = EIntelReg(reg1 & 7);
-			}
-			EmitBYTE(first_byte);
-		}
+		EmitREX(reg1, reg2, is64);
 
 		EmitBYTE(0x23);
-		EmitBYTE(0xc0 | (reg1<<3) | reg2);
+		EmitBYTE(0xc0 | ((reg1 & 7)<<3) | (reg2 & 7));
 	}
 }
 
@@ -181,22 +145,10 @@ void	CAssemblyWriterX64::OR(EIntelReg reg1, EIntelReg reg2, bool is64)
 {
 	if (reg1 != reg2)
 	{
-		if (is64)
-		{
-			u8 first_byte = 0x48;
-			if (reg2 >= R8_CODE) {
-				first_byte |= 0x1;
-				reg2 = EIntelReg(reg2 & 7);
-			}
-			if (reg1 >= R8_CODE) {
-				first_byte |= 0x4;
-				reg1 = EIntelReg(reg1 & 7);
-			}
-			EmitBYTE(first_byte);
-		}
+		EmitREX(reg1, reg2, is64);
 
 		EmitBYTE(0x0B);
-		EmitBYTE(0xc0 | (reg1<<3) | reg2);
+		EmitBYTE(0xc0 | ((reg1 & 7)<<3) | (reg2 & 7));
 	}
 }
 
@@ -205,22 +157,10 @@ void	CAssemblyWriterX64::OR(EIntelReg reg1, EIntelReg reg2, bool is64)
 //*****************************************************************************
 void	CAssemblyWriterX64::XOR(EIntelReg reg1, EIntelReg reg2, bool is64)
 {
-	if (is64)
-	{
-		u8 first_byte = 0x48;
-		if (reg2 >= R8_CODE) {
-			first_byte |= 0x1;
-			reg2 = EIntelReg(reg2 & 7);
-		}
-		if (reg1 >= R8_CODE) {
-			first_byte |= 0x4;
-			reg1 = EIntelReg(reg1 & 7);
-		}
-		EmitBYTE(first_byte);
-	}
-	
+	EmitREX(reg1, reg2, is64);
+
 	EmitBYTE(0x33);
-	EmitBYTE(0xc0 | (reg1<<3) | reg2);
+	EmitBYTE(0xc0 | ((reg1 & 7)<<3) | (reg2 & 7));
 }
 
 //*****************************************************************************
@@ -228,18 +168,10 @@ void	CAssemblyWriterX64::XOR(EIntelReg reg1, EIntelReg reg2, bool is64)
 //*****************************************************************************
 void	CAssemblyWriterX64::NOT(EIntelReg reg1, bool is64)
 {
-	if (is64)
-	{
-		u8 first_byte = 0x48;
-		if (reg1 >= R8_CODE) {
-			first_byte |= 0x4;
-			reg1 = EIntelReg(reg1 & 7);
-		}
-		EmitBYTE(first_byte);
-	}
-	
+	EmitREX(RAX_CODE, reg1, is64);
+
 	EmitBYTE(0xf7);
-	EmitBYTE(0xd0 | reg1);
+	EmitBYTE(0xd0 | (reg1 & 7));
 }
 
 //*****************************************************************************
@@ -250,15 +182,8 @@ void CAssemblyWriterX64::ADDI(EIntelReg reg, s32 data, bool is64)
 	if (data == 0)
 		return;
 
-	if (is64)
-	{
-		u8 first_byte = 0x48;
-		if (reg >= R8_CODE) {
-			first_byte |= 0x4;
-			reg = EIntelReg(reg & 7);
-		}
-		EmitBYTE(first_byte);
-	}
+	EmitREX(RAX_CODE, reg, is64);
+	reg = EIntelReg(reg & 7);
 
 	if (data <= 127 && data > -127)
 	{
@@ -283,15 +208,8 @@ void CAssemblyWriterX64::SUBI(EIntelReg reg, s32 data, bool is64)
 	if (data == 0)
 		return;
 
-	if (is64)
-	{
-		u8 first_byte = 0x48;
-		if (reg >= R8_CODE) {
-			first_byte |= 0x4;
-			reg = EIntelReg(reg & 7);
-		}
-		EmitBYTE(first_byte);
-	}
+	EmitREX(RAX_CODE, reg, is64);
+	reg = EIntelReg(reg & 7);
 
 	if (data <= 127 && data > -127)
 	{
@@ -338,15 +256,8 @@ void CAssemblyWriterX64::ADCI(EIntelReg reg, s32 data)
 //*****************************************************************************
 void CAssemblyWriterX64::ANDI(EIntelReg reg1, u32 data, bool is64)
 {
-	if (is64) {
-		u8 first_byte = 0x48;
-		if (reg1 >= R8_CODE) {
-			first_byte |= 0x4;
-			reg1 = EIntelReg(reg1 & 7);
-		}
-
-		EmitBYTE(first_byte);
-	}
+	EmitREX(RAX_CODE, reg1, is64);
+	reg1 = EIntelReg(reg1 & 7);
 
 	/*if (reg == EAX_CODE)
 		EmitBYTE(0x25);
@@ -363,15 +274,8 @@ void CAssemblyWriterX64::ANDI(EIntelReg reg1, u32 data, bool is64)
 //*****************************************************************************
 void CAssemblyWriterX64::ORI(EIntelReg reg1, u32 data, bool is64)
 {
-	if (is64) {
-		u8 first_byte = 0x48;
-		if (reg1 >= R8_CODE) {
-			first_byte |= 0x4;
-			reg1 = EIntelReg(reg1 & 7);
-		}
-
-		EmitBYTE(first_byte);
-	}
+	EmitREX(RAX_CODE, reg1, is64);
+	reg1 = EIntelReg(reg1 & 7);
 	
 	/*if (reg == EAX_CODE)
 		EmitBYTE(0x0D);
@@ -388,17 +292,11 @@ void CAssemblyWriterX64::ORI(EIntelReg reg1, u32 data, bool is64)
 //*****************************************************************************
 void CAssemblyWriterX64::XORI(EIntelReg reg, u32 data, bool is64)
 {
-	if (is64) {
-		u8 first_byte = 0x48;
-		if (reg >= R8_CODE) {
-			first_byte |= 0x4;
-			reg = EIntelReg(reg & 7);
-		}
-
-		EmitBYTE(first_byte);
-	}
+	EmitREX(RAX_CODE, reg, is64);
+	reg = EIntelReg(reg & 7);
 
-	if (data <= 255)
+	// The 8 bit immediate is sign extended, so this only works for small values
+	if (s32(data) <= 127 && s32(data) >= -128)
 	{
 		EmitBYTE(0x83);
 		EmitBYTE(0xf0 | reg);
@@ -415,49 +313,54 @@ void CAssemblyWriterX64::XORI(EIntelReg reg, u32 data, bool is64)
 //*****************************************************************************
 //
 //*****************************************************************************
-void	CAssemblyWriterX64::SHLI(EIntelReg reg, u8 sa)
+void	CAssemblyWriterX64::SHLI(EIntelReg reg, u8 sa, bool is64)
 {
+	EmitREX(RAX_CODE, reg, is64);
 	EmitBYTE(0xc1);
-	EmitBYTE(0xe0 | reg);
+	EmitBYTE(0xe0 | (reg & 7));
 	EmitBYTE(sa);
 }
 
 //*****************************************************************************
 //
 //*****************************************************************************
-void	CAssemblyWriterX64::SHRI(EIntelReg reg, u8 sa)
+void	CAssemblyWriterX64::SHRI(EIntelReg reg, u8 sa, bool is64)
 {
+	EmitREX(RAX_CODE, reg, is64);
 	EmitBYTE(0xc1);
-	EmitBYTE(0xe8 | reg);
+	EmitBYTE(0xe8 | (reg & 7));
 	EmitBYTE(sa);
 }
 
 //*****************************************************************************
 //
 //*****************************************************************************
-void	CAssemblyWriterX64::SARI(EIntelReg reg, u8 sa)
+void	CAssemblyWriterX64::SARI(EIntelReg reg, u8 sa, bool is64)
 {
+	EmitREX(RAX_CODE, reg, is64);
 	EmitBYTE(0xc1);
-	EmitBYTE(0xf8 | reg);
+	EmitBYTE(0xf8 | (reg & 7));
 	EmitBYTE(sa);
 }
 
 //*****************************************************************************
 //
 //*****************************************************************************
-void	CAssemblyWriterX64::CMP(EIntelReg reg1, EIntelReg reg2)
+void	CAssemblyWriterX64::CMP(EIntelReg reg1, EIntelReg reg2, bool is64)
 {
+	EmitREX(reg1, reg2, is64);
 	EmitBYTE(0x3b);
-	EmitBYTE(0xc0 | (reg1<<3) | reg2);
+	EmitBYTE(0xc0 | ((reg1 & 7)<<3) | (reg2 & 7));
 }
 
 //*****************************************************************************
 //
 //*****************************************************************************
-void	CAssemblyWriterX64::TEST(EIntelReg reg1, EIntelReg reg2)
+void	CAssemblyWriterX64::TEST(EIntelReg reg1, EIntelReg reg2, bool is64)
 {
+	EmitREX(reg1, reg2, is64);
 	EmitBYTE(0x85);
-	EmitBYTE(0xc0 | (reg1<<3) | reg2);
+	EmitBYTE(0xc0 | ((reg1 & 7)<<3) | (reg2 & 7));
 }
 
 //*****************************************************************************
@@ -521,6 +424,60 @@ void CAssemblyWriterX64::SETB(EIntelReg reg)
 	EmitBYTE(0xc0 | reg);
 }
 
+//*****************************************************************************
+//
+//*****************************************************************************
+void CAssemblyWriterX64::SETBE(EIntelReg reg)
+{
+	EmitWORD(0x960f);
+	EmitBYTE(0xc0 | reg);
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void CAssemblyWriterX64::SETA(EIntelReg reg)
+{
+	EmitWORD(0x970f);
+	EmitBYTE(0xc0 | reg);
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void CAssemblyWriterX64::SETAE(EIntelReg reg)
+{
+	EmitWORD(0x930f);
+	EmitBYTE(0xc0 | reg);
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void CAssemblyWriterX64::SETE(EIntelReg reg)
+{
+	EmitWORD(0x940f);
+	EmitBYTE(0xc0 | reg);
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void CAssemblyWriterX64::SETP(EIntelReg reg)
+{
+	EmitWORD(0x9a0f);
+	EmitBYTE(0xc0 | reg);
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void CAssemblyWriterX64::SETNP(EIntelReg reg)
+{
+	EmitWORD(0x9b0f);
+	EmitBYTE(0xc0 | reg);
+}
+
 //*****************************************************************************
 //
 //*****************************************************************************
@@ -735,22 +692,10 @@ void	CAssemblyWriterX64::MOV(EIntelReg reg1, EIntelReg reg2, bool is64)
 {
 	if (reg1 != reg2)
 	{
-		if (is64) {
-			u8 first_byte = 0x48;
-			if (reg2 >= R8_CODE) {
-				first_byte |= 0x1;
-				reg2 = EIntelReg(reg2 & 7);
-			}
-			if (reg1 >= R8_CODE) {
-				first_byte |= 0x4;
-				reg1 = EIntelReg(reg1 & 7);
-			}
-
-			EmitBYTE(first_byte);
-		}
+		EmitREX(reg1, reg2, is64);
 
 		EmitBYTE(0x8b);
-		EmitBYTE(0xc0 | (reg1<<3) | reg2);
+		EmitBYTE(0xc0 | ((reg1 & 7)<<3) | (reg2 & 7));
 	}
 }
 
@@ -774,17 +719,28 @@ void	CAssemblyWriterX64::MOVZX(EIntelReg reg1, EIntelReg reg2, bool _8bit)
 	EmitBYTE(0xc0 | (reg1<<3) | reg2);
 }
 
+//*****************************************************************************
+// movsxd reg1, reg2
+//*****************************************************************************
+void	CAssemblyWriterX64::MOVSXD(EIntelReg reg1, EIntelReg reg2)
+{
+	EmitREX(reg1, reg2, true);
+	EmitBYTE(0x63);
+	EmitBYTE(0xc0 | ((reg1 & 7)<<3) | (reg2 & 7));
+}
+
 //*****************************************************************************
 // mov dword ptr[ mem ], reg
 //*****************************************************************************
 void	CAssemblyWriterX64::MOV_MEM_REG(u32 * mem, EIntelReg isrc)
 {
+	EmitREX(isrc, RBX_CODE, false);
 	/*if (reg == EAX_CODE)
 		EmitBYTE(0xa3);
 	else*/
 	{
 		EmitBYTE(0x89);
-		EmitBYTE((isrc<<3) | 0x83);
+		EmitBYTE(((isrc & 7)<<3) | 0x83);
 	}
 	EmitADDR(mem); //  89 83 12 34 56 78       mov    DWORD PTR [rbx+0x78563412],eax
 }
@@ -794,13 +750,13 @@ void	CAssemblyWriterX64::MOV_MEM_REG(u32 * mem, EIntelReg isrc)
 //*****************************************************************************
 void	CAssemblyWriterX64::MOV64_MEM_REG(u64 * mem, EIntelReg isrc)
 {
-	EmitBYTE(0x48);
+	EmitREX(isrc, RBX_CODE, true);
 	/*if (reg == EAX_CODE)
 		EmitBYTE(0xa3);
 	else*/
 	{
 		EmitBYTE(0x89);
-		EmitBYTE((isrc<<3) | 0x83);
+		EmitBYTE(((isrc & 7)<<3) | 0x83);
 	}
 	EmitADDR(mem); // 48 89 83 12 34 56 78    mov    QWORD PTR [rbx+0x78563412],rax
 }
@@ -811,14 +767,14 @@ void	CAssemblyWriterX64::MOV64_MEM_REG(u64 * mem, EIntelReg isrc)
 //*****************************************************************************
 void	CAssemblyWriterX64::MOV64_REG_MEM(EIntelReg reg, const u64 * mem)
 {
-	EmitBYTE(0x48);
+	EmitREX(reg, RBX_CODE, true);
 
 	/*if (reg == EAX_CODE)
 		EmitBYTE(0xa1);
 	else*/
 	{
 		EmitBYTE(0x8b);
-		EmitBYTE((reg<<3) | 0x83); 
+		EmitBYTE(((reg & 7)<<3) | 0x83);
 	}
 
 	EmitADDR(mem); // 48 8b 83 12 34 56 78    mov    rax,QWORD PTR [rbx+0x78563412]
@@ -829,12 +785,13 @@ void	CAssemblyWriterX64::MOV64_REG_MEM(EIntelReg reg, const u64 * mem)
 //*****************************************************************************
 void	CAssemblyWriterX64::MOV_REG_MEM(EIntelReg reg, const u32 * mem)
 {
+	EmitREX(reg, RBX_CODE, false);
 	/*if (reg == EAX_CODE)
 		EmitBYTE(0xa1);
 	else*/
 	{
 		EmitBYTE(0x8b);
-		EmitBYTE((reg<<3) | 0x83); 
+		EmitBYTE(((reg & 7)<<3) | 0x83);
 	}
 
 	EmitADDR(mem); // 8b 83 12 34 56 78       mov    eax,DWORD PTR [rbx+0x78563412]
@@ -886,8 +843,9 @@ void	CAssemblyWriterX64::MOV16_REG_MEM_BASE( EIntelReg idst, EIntelReg ibase )
 //*****************************************************************************
 void	CAssemblyWriterX64::MOV_MEM_BASE_OFFSET32_REG( EIntelReg ibase, s32 offset, EIntelReg isrc )
 {
+	EmitREX(isrc, ibase, false);
 	EmitBYTE(0x89);
-	EmitBYTE(0x80 | (isrc<<3) | ibase);
+	EmitBYTE(0x80 | ((isrc & 7)<<3) | (ibase & 7));
 	EmitDWORD((u32)offset);
 }
 
@@ -896,8 +854,9 @@ void	CAssemblyWriterX64::MOV_MEM_BASE_OFFSET32_REG( EIntelReg ibase, s32 offset,
 //*****************************************************************************
 void	CAssemblyWriterX64::MOV_MEM_BASE_OFFSET8_REG( EIntelReg ibase, s8 offset, EIntelReg isrc )
 {
+	EmitREX(isrc, ibase, false);
 	EmitBYTE(0x89);
-	EmitBYTE(0x40 | (isrc<<3) | ibase);
+	EmitBYTE(0x40 | ((isrc & 7)<<3) | (ibase & 7));
 	EmitBYTE((u8)offset);
 }
 
@@ -906,8 +865,9 @@ void	CAssemblyWriterX64::MOV_MEM_BASE_OFFSET8_REG( EIntelReg ibase, s8 offset, E
 //*****************************************************************************
 void	CAssemblyWriterX64::MOV_MEM_BASE_REG( EIntelReg ibase, EIntelReg isrc )
 {
+	EmitREX(isrc, ibase, false);
 	EmitBYTE(0x89);
-	EmitBYTE(0x00 | (isrc<<3) | ibase);
+	EmitBYTE(0x00 | ((isrc & 7)<<3) | (ibase & 7));
 }
 
 //*****************************************************************************
@@ -934,8 +894,9 @@ void	CAssemblyWriterX64::MOV_MEM_BASE_OFFSET_REG( EIntelReg ibase, s32 offset, E
 //*****************************************************************************
 void	CAssemblyWriterX64::MOV_REG_MEM_BASE_OFFSET32( EIntelReg idst, EIntelReg ibase, s32 offset )
 {
+	EmitREX(idst, ibase, false);
 	EmitBYTE(0x8B);
-	EmitBYTE(0x80 | (idst<<3) | ibase);
+	EmitBYTE(0x80 | ((idst & 7)<<3) | (ibase & 7));
 	EmitDWORD((u32)offset);
 }
 
@@ -944,8 +905,9 @@ void	CAssemblyWriterX64::MOV_REG_MEM_BASE_OFFSET32( EIntelReg idst, EIntelReg ib
 //*****************************************************************************
 void	CAssemblyWriterX64::MOV_REG_MEM_BASE_OFFSET8( EIntelReg idst, EIntelReg ibase, s8 offset )
 {
+	EmitREX(idst, ibase, false);
 	EmitBYTE(0x8B);
-	EmitBYTE(0x40 | (idst<<3) | ibase);
+	EmitBYTE(0x40 | ((idst & 7)<<3) | (ibase & 7));
 	EmitBYTE((u8)offset);
 }
 
@@ -954,8 +916,124 @@ void	CAssemblyWriterX64::MOV_REG_MEM_BASE_OFFSET8( EIntelReg idst, EIntelReg iba
 //*****************************************************************************
 void	CAssemblyWriterX64::MOV_REG_MEM_BASE( EIntelReg idst, EIntelReg ibase )
 {
+	EmitREX(idst, ibase, false);
 	EmitBYTE(0x8B);
-	EmitBYTE(0x00 | (idst<<3) | ibase);
+	EmitBYTE(0x00 | ((idst & 7)<<3) | (ibase & 7));
+}
+
+//*****************************************************************************
+// mov dst, qword ptr [base]
+//*****************************************************************************
+void	CAssemblyWriterX64::MOV64_REG_MEM_BASE( EIntelReg idst, EIntelReg ibase )
+{
+	EmitREX(idst, ibase, true);
+	EmitBYTE(0x8B);
+	EmitBYTE(0x00 | ((idst & 7)<<3) | (ibase & 7));
+}
+
+//*****************************************************************************
+// ModRM and SIB bytes for [base + index << scale_shift]
+//*****************************************************************************
+void	CAssemblyWriterX64::EmitModRMBaseIndex( EIntelReg reg, EIntelReg ibase, EIntelReg iindex, u8 scale_shift )
+{
+	#ifdef DAEDALUS_ENABLE_ASSERTS
+	DAEDALUS_ASSERT( iindex != RSP_CODE, "RSP can't be used as an index" );
+	#endif
+
+	// rbp/r13 as a base need an explicit displacement
+	if ((ibase & 7) == RBP_CODE)
+	{
+		EmitBYTE(0x44 | ((reg & 7)<<3));
+		EmitBYTE((scale_shift<<6) | ((iindex & 7)<<3) | (ibase & 7));
+		EmitBYTE(0x00);
+	}
+	else
+	{
+		EmitBYTE(0x04 | ((reg & 7)<<3));
+		EmitBYTE((scale_shift<<6) | ((iindex & 7)<<3) | (ibase & 7));
+	}
+}
+
+//*****************************************************************************
+// mov dst, dword ptr [base + index]
+//*****************************************************************************
+void	CAssemblyWriterX64::MOV_REG_MEM_BASE_INDEX( EIntelReg idst, EIntelReg ibase, EIntelReg iindex )
+{
+	EmitREX(idst, ibase, iindex, false);
+	EmitBYTE(0x8B);
+	EmitModRMBaseIndex(idst, ibase, iindex);
+}
+
+//*****************************************************************************
+// movzx dst, word ptr [base + index]
+//*****************************************************************************
+void	CAssemblyWriterX64::MOVZX16_REG_MEM_BASE_INDEX( EIntelReg idst, EIntelReg ibase, EIntelReg iindex )
+{
+	EmitREX(idst, ibase, iindex, false);
+	EmitWORD(0xb70f);
+	EmitModRMBaseIndex(idst, ibase, iindex);
+}
+
+//*****************************************************************************
+// movzx dst, byte ptr [base + index]
+//*****************************************************************************
+void	CAssemblyWriterX64::MOVZX8_REG_MEM_BASE_INDEX( EIntelReg idst, EIntelReg ibase, EIntelReg iindex )
+{
+	EmitREX(idst, ibase, iindex, false);
+	EmitWORD(0xb60f);
+	EmitModRMBaseIndex(idst, ibase, iindex);
+}
+
+//*****************************************************************************
+// mov dst, qword ptr [base + index*8]
+//*****************************************************************************
+void	CAssemblyWriterX64::MOV64_REG_MEM_BASE_INDEXx8( EIntelReg idst, EIntelReg ibase, EIntelReg iindex )
+{
+	EmitREX(idst, ibase, iindex, false, true);
+	EmitBYTE(0x8B);
+	EmitModRMBaseIndex(idst, ibase, iindex, 3);
+}
+
+//*****************************************************************************
+// mov qword ptr [base + index*8], src
+//*****************************************************************************
+void	CAssemblyWriterX64::MOV64_MEM_BASE_INDEXx8_REG( EIntelReg ibase, EIntelReg iindex, EIntelReg isrc )
+{
+	EmitREX(isrc, ibase, iindex, false, true);
+	EmitBYTE(0x89);
+	EmitModRMBaseIndex(isrc, ibase, iindex, 3);
+}
+
+//*****************************************************************************
+// mov dword ptr [base + index], src
+//*****************************************************************************
+void	CAssemblyWriterX64::MOV_MEM_BASE_INDEX_REG( EIntelReg ibase, EIntelReg iindex, EIntelReg isrc )
+{
+	EmitREX(isrc, ibase, iindex, false);
+	EmitBYTE(0x89);
+	EmitModRMBaseIndex(isrc, ibase, iindex);
+}
+
+//*****************************************************************************
+// mov word ptr [base + index], src
+//*****************************************************************************
+void	CAssemblyWriterX64::MOV16_MEM_BASE_INDEX_REG( EIntelReg ibase, EIntelReg iindex, EIntelReg isrc )
+{
+	EmitBYTE(0x66);
+	EmitREX(isrc, ibase, iindex, false);
+	EmitBYTE(0x89);
+	EmitModRMBaseIndex(isrc, ibase, iindex);
+}
+
+//*****************************************************************************
+// mov byte ptr [base + index], src
+//*****************************************************************************
+void	CAssemblyWriterX64::MOV8_MEM_BASE_INDEX_REG( EIntelReg ibase, EIntelReg iindex, EIntelReg isrc )
+{
+	// Without a REX prefix, 4-7 would mean ah/ch/dh/bh rather than spl/bpl/sil/dil
+	EmitREX(isrc, ibase, iindex, isrc >= RSP_CODE);
+	EmitBYTE(0x88);
+	EmitModRMBaseIndex(isrc, ibase, iindex);
 }
 
 //*****************************************************************************
@@ -982,7 +1060,8 @@ void	CAssemblyWriterX64::MOV_REG_MEM_BASE_OFFSET( EIntelReg idst, EIntelReg ibas
 //*****************************************************************************
 void	CAssemblyWriterX64::MOVI(EIntelReg reg, u32 data)
 {
-	EmitBYTE(0xB8 | reg);
+	EmitREX(RAX_CODE, reg, false);
+	EmitBYTE(0xB8 | (reg & 7));
 	EmitDWORD(data);
 }
 
@@ -993,8 +1072,8 @@ void	CAssemblyWriterX64::MOVI_64(EIntelReg reg, u64 data)
 {
 	// 0:  48 b8 78 56 34 12 78    movabs rax,0x1234567812345678
 	// 7:  56 34 12
-	EmitBYTE(0x48);
-	EmitBYTE(0xB8 | reg);
+	EmitREX(RAX_CODE, reg, true);
+	EmitBYTE(0xB8 | (reg & 7));
 	EmitQWORD(data);
 }
 
@@ -1208,6 +1287,107 @@ void	CAssemblyWriterX64::FDIV( u32 i )
 	EmitWORD((u16)((0xf0 + (i))<<8) |(0xd8));
 }
 
+//*****************************************************************************
+// The prefix has to come before any REX prefix
+//*****************************************************************************
+void	CAssemblyWriterX64::EmitSSE_REG_REG( u8 prefix, u8 op, u32 reg, u32 rm, bool is64 )
+{
+	if (prefix != 0)
+	{
+		EmitBYTE(prefix);
+	}
+	EmitREX(EIntelReg(reg), EIntelReg(rm), is64);
+	EmitBYTE(0x0f);
+	EmitBYTE(op);
+	EmitBYTE(0xc0 | ((reg & 7)<<3) | (rm & 7));
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void	CAssemblyWriterX64::EmitSSE_REG_MEM( u8 prefix, u8 op, u32 reg, const void * mem )
+{
+	if (prefix != 0)
+	{
+		EmitBYTE(prefix);
+	}
+	EmitREX(EIntelReg(reg), RBX_CODE, false);
+	EmitBYTE(0x0f);
+	EmitBYTE(op);
+	EmitBYTE(((reg & 7)<<3) | 0x83);
+	EmitADDR(mem); // f3 0f 10 83 12 34 56 78    movss  xmm0,DWORD PTR [rbx+0x78563412]
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void	CAssemblyWriterX64::MOVSS_REG_MEM( EXmmReg xmm, const void * mem )
+{
+	EmitSSE_REG_MEM(0xf3, 0x10, xmm, mem);
+}
+
+void	CAssemblyWriterX64::MOVSS_MEM_REG( void * mem, EXmmReg xmm )
+{
+	EmitSSE_REG_MEM(0xf3, 0x11, xmm, mem);
+}
+
+void	CAssemblyWriterX64::MOVSD_REG_MEM( EXmmReg xmm, const void * mem )
+{
+	EmitSSE_REG_MEM(0xf2, 0x10, xmm, mem);
+}
+
+void	CAssemblyWriterX64::MOVSD_MEM_REG( void * mem, EXmmReg xmm )
+{
+	EmitSSE_REG_MEM(0xf2, 0x11, xmm, mem);
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void	CAssemblyWriterX64::ADDSS( EXmmReg xmm1, EXmmReg xmm2 )		{ EmitSSE_REG_REG(0xf3, 0x58, xmm1, xmm2, false); }
+void	CAssemblyWriterX64::SUBSS( EXmmReg xmm1, EXmmReg xmm2 )		{ EmitSSE_REG_REG(0xf3, 0x5c, xmm1, xmm2, false); }
+void	CAssemblyWriterX64::MULSS( EXmmReg xmm1, EXmmReg xmm2 )		{ EmitSSE_REG_REG(0xf3, 0x59, xmm1, xmm2, false); }
+void	CAssemblyWriterX64::DIVSS( EXmmReg xmm1, EXmmReg xmm2 )		{ EmitSSE_REG_REG(0xf3, 0x5e, xmm1, xmm2, false); }
+void	CAssemblyWriterX64::SQRTSS( EXmmReg xmm1, EXmmReg xmm2 )	{ EmitSSE_REG_REG(0xf3, 0x51, xmm1, xmm2, false); }
+void	CAssemblyWriterX64::ADDSD( EXmmReg xmm1, EXmmReg xmm2 )		{ EmitSSE_REG_REG(0xf2, 0x58, xmm1, xmm2, false); }
+void	CAssemblyWriterX64::SUBSD( EXmmReg xmm1, EXmmReg xmm2 )		{ EmitSSE_REG_REG(0xf2, 0x5c, xmm1, xmm2, false); }
+void	CAssemblyWriterX64::MULSD( EXmmReg xmm1, EXmmReg xmm2 )		{ EmitSSE_REG_REG(0xf2, 0x59, xmm1, xmm2, false); }
+void	CAssemblyWriterX64::DIVSD( EXmmReg xmm1, EXmmReg xmm2 )		{ EmitSSE_REG_REG(0xf2, 0x5e, xmm1, xmm2, false); }
+void	CAssemblyWriterX64::SQRTSD( EXmmReg xmm1, EXmmReg xmm2 )	{ EmitSSE_REG_REG(0xf2, 0x51, xmm1, xmm2, false); }
+
+void	CAssemblyWriterX64::UCOMISS( EXmmReg xmm1, EXmmReg xmm2 )	{ EmitSSE_REG_REG(0x00, 0x2e, xmm1, xmm2, false); }
+void	CAssemblyWriterX64::UCOMISD( EXmmReg xmm1, EXmmReg xmm2 )	{ EmitSSE_REG_REG(0x66, 0x2e, xmm1, xmm2, false); }
+
+void	CAssemblyWriterX64::CVTSS2SD( EXmmReg xmm1, EXmmReg xmm2 )	{ EmitSSE_REG_REG(0xf3, 0x5a, xmm1, xmm2, false); }
+void	CAssemblyWriterX64::CVTSD2SS( EXmmReg xmm1, EXmmReg xmm2 )	{ EmitSSE_REG_REG(0xf2, 0x5a, xmm1, xmm2, false); }
+
+void	CAssemblyWriterX64::CVTSI2SS( EXmmReg xmm, EIntelReg reg, bool is64 )	{ EmitSSE_REG_REG(0xf3, 0x2a, xmm, reg, is64); }
+void	CAssemblyWriterX64::CVTSI2SD( EXmmReg xmm, EIntelReg reg, bool is64 )	{ EmitSSE_REG_REG(0xf2, 0x2a, xmm, reg, is64); }
+void	CAssemblyWriterX64::CVTSS2SI( EIntelReg reg, EXmmReg xmm, bool is64 )	{ EmitSSE_REG_REG(0xf3, 0x2d, reg, xmm, is64); }
+void	CAssemblyWriterX64::CVTSD2SI( EIntelReg reg, EXmmReg xmm, bool is64 )	{ EmitSSE_REG_REG(0xf2, 0x2d, reg, xmm, is64); }
+void	CAssemblyWriterX64::CVTTSS2SI( EIntelReg reg, EXmmReg xmm, bool is64 )	{ EmitSSE_REG_REG(0xf3, 0x2c, reg, xmm, is64); }
+void	CAssemblyWriterX64::CVTTSD2SI( EIntelReg reg, EXmmReg xmm, bool is64 )	{ EmitSSE_REG_REG(0xf2, 0x2c, reg, xmm, is64); }
+
+//*****************************************************************************
+// ldmxcsr dword ptr[ mem ]
+//*****************************************************************************
+void	CAssemblyWriterX64::LDMXCSR( const u32 * mem )
+{
+	EmitWORD(0xae0f);
+	EmitBYTE(0x93);
+	EmitADDR(mem); // 0f ae 93 12 34 56 78    ldmxcsr DWORD PTR [rbx+0x78563412]
+}
+
+//*****************************************************************************
+// stmxcsr dword ptr[ mem ]
+//*****************************************************************************
+void	CAssemblyWriterX64::STMXCSR( u32 * mem )
+{
+	EmitWORD(0xae0f);
+	EmitBYTE(0x9b);
+	EmitADDR(mem); // 0f ae 9b 12 34 56 78    stmxcsr DWORD PTR [rbx+0x78563412]
+}
+
 void	CAssemblyWriterX64::CDQ()
 {
 	EmitBYTE(0x99);
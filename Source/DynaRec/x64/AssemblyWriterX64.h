@@ -84,12 +84,12 @@ class CAssemblyWriterX64
 				void				ORI(EIntelReg reg, u32 data, bool is64 = false);
 				void				XORI(EIntelReg reg, u32 data, bool is64 = false);
 
-				void				SHLI(EIntelReg reg, u8 sa);
-				void				SHRI(EIntelReg reg, u8 sa);
-				void				SARI(EIntelReg reg, u8 sa);
+				void				SHLI(EIntelReg reg, u8 sa, bool is64 = false);
+				void				SHRI(EIntelReg reg, u8 sa, bool is64 = false);
+				void				SARI(EIntelReg reg, u8 sa, bool is64 = false);
 
-				void				CMP(EIntelReg reg1, EIntelReg reg2);
-				void				TEST(EIntelReg reg1, EIntelReg reg2);
+				void				CMP(EIntelReg reg1, EIntelReg reg2, bool is64 = false);
+				void				TEST(EIntelReg reg1, EIntelReg reg2, bool is64 = false);
 				void				TEST_AH( u8 flags );
 				void				CMPI(EIntelReg reg, u32 data);
 				void				CMP_MEM32_I32(const u32 *p_mem, u32 data);			// cmp		dword ptr p_mem, data
@@ -97,6 +97,12 @@ class CAssemblyWriterX64
 
 				void				SETL(EIntelReg reg);
 				void				SETB(EIntelReg reg);
+				void				SETBE(EIntelReg reg);
+				void				SETA(EIntelReg reg);
+				void				SETAE(EIntelReg reg);
+				void				SETE(EIntelReg reg);
+				void				SETP(EIntelReg reg);
+				void				SETNP(EIntelReg reg);
 
 				void				JS(s32 off);
 				void				JA(u8 off);
@@ -132,6 +138,7 @@ class CAssemblyWriterX64
 				
 				void				MOVSX(EIntelReg reg1, EIntelReg reg2, bool _8bit);	// movsx reg1, reg2
 				void				MOVZX(EIntelReg reg1, EIntelReg reg2, bool _8bit);	// movzx reg1, reg2
+				void				MOVSXD(EIntelReg reg1, EIntelReg reg2);				// movsxd reg1, reg2 (sign extend low 32 bits of reg2 to 64)
 				void				MOV_MEM_REG(u32 * mem, EIntelReg isrc);			// mov dword ptr[ mem ], reg
 				void				MOV_REG_MEM(EIntelReg reg, const u32 * mem);		// mov reg, dword ptr[ mem ]
 
@@ -150,6 +157,16 @@ class CAssemblyWriterX64
 				void				MOV_REG_MEM_BASE_OFFSET8( EIntelReg idst, EIntelReg ibase, s8 offset );		// mov dst, dword ptr [base + nn]
 				void				MOV_REG_MEM_BASE_OFFSET( EIntelReg idst, EIntelReg ibase, s32 offset );
 				void				MOV_REG_MEM_BASE( EIntelReg idst, EIntelReg ibase );							// mov dst, dword ptr [base]
+				void				MOV64_REG_MEM_BASE( EIntelReg idst, EIntelReg ibase );						// mov dst, qword ptr [base]
+
+				void				MOV_REG_MEM_BASE_INDEX( EIntelReg idst, EIntelReg ibase, EIntelReg iindex );		// mov dst, dword ptr [base + index]
+				void				MOVZX16_REG_MEM_BASE_INDEX( EIntelReg idst, EIntelReg ibase, EIntelReg iindex );	// movzx dst, word ptr [base + index]
+				void				MOVZX8_REG_MEM_BASE_INDEX( EIntelReg idst, EIntelReg ibase, EIntelReg iindex );	// movzx dst, byte ptr [base + index]
+				void				MOV_MEM_BASE_INDEX_REG( EIntelReg ibase, EIntelReg iindex, EIntelReg isrc );		// mov dword ptr [base + index], src
+				void				MOV16_MEM_BASE_INDEX_REG( EIntelReg ibase, EIntelReg iindex, EIntelReg isrc );	// mov word ptr [base + index], src
+				void				MOV8_MEM_BASE_INDEX_REG( EIntelReg ibase, EIntelReg iindex, EIntelReg isrc );	// mov byte ptr [base + index], src
+				void				MOV64_REG_MEM_BASE_INDEXx8( EIntelReg idst, EIntelReg ibase, EIntelReg iindex );	// mov dst, qword ptr [base + index*8]
+				void				MOV64_MEM_BASE_INDEXx8_REG( EIntelReg ibase, EIntelReg iindex, EIntelReg isrc );	// mov qword ptr [base + index*8], src
 
 				void				MOVI(EIntelReg reg, u32 data);						// mov reg, data
 				void				MOVI_MEM(u32 * mem, u32 data);						// mov dword ptr[ mem ], data
@@ -183,6 +200,38 @@ class CAssemblyWriterX64
 				void				FMUL( u32 i );
 				void				FDIV( u32 i );
 
+				// SSE2 scalar instructions. Memory operands are addressed off gCPUState, as above
+				void				MOVSS_REG_MEM( EXmmReg xmm, const void * mem );		// movss	xmm, dword ptr[ mem ]
+				void				MOVSS_MEM_REG( void * mem, EXmmReg xmm );			// movss	dword ptr[ mem ], xmm
+				void				MOVSD_REG_MEM( EXmmReg xmm, const void * mem );		// movsd	xmm, qword ptr[ mem ]
+				void				MOVSD_MEM_REG( void * mem, EXmmReg xmm );			// movsd	qword ptr[ mem ], xmm
+
+				void				ADDSS( EXmmReg xmm1, EXmmReg xmm2 );				// addss	xmm1, xmm2
+				void				SUBSS( EXmmReg xmm1, EXmmReg xmm2 );
+				void				MULSS( EXmmReg xmm1, EXmmReg xmm2 );
+				void				DIVSS( EXmmReg xmm1, EXmmReg xmm2 );
+				void				SQRTSS( EXmmReg xmm1, EXmmReg xmm2 );
+				void				ADDSD( EXmmReg xmm1, EXmmReg xmm2 );
+				void				SUBSD( EXmmReg xmm1, EXmmReg xmm2 );
+				void				MULSD( EXmmReg xmm1, EXmmReg xmm2 );
+				void				DIVSD( EXmmReg xmm1, EXmmReg xmm2 );
+				void				SQRTSD( EXmmReg xmm1, EXmmReg xmm2 );
+
+				void				UCOMISS( EXmmReg xmm1, EXmmReg xmm2 );				// sets ZF, PF and CF, like an unsigned compare
+				void				UCOMISD( EXmmReg xmm1, EXmmReg xmm2 );
+
+				void				CVTSS2SD( EXmmReg xmm1, EXmmReg xmm2 );
+				void				CVTSD2SS( EXmmReg xmm1, EXmmReg xmm2 );
+				void				CVTSI2SS( EXmmReg xmm, EIntelReg reg, bool is64 = false );
+				void				CVTSI2SD( EXmmReg xmm, EIntelReg reg, bool is64 = false );
+				void				CVTSS2SI( EIntelReg reg, EXmmReg xmm, bool is64 = false );	// Rounds using MXCSR
+				void				CVTSD2SI( EIntelReg reg, EXmmReg xmm, bool is64 = false );
+				void				CVTTSS2SI( EIntelReg reg, EXmmReg xmm, bool is64 = false );	// Truncates
+				void				CVTTSD2SI( EIntelReg reg, EXmmReg xmm, bool is64 = false );
+
+				void				LDMXCSR( const u32 * mem );
+				void				STMXCSR( u32 * mem );
+
 				// 64bit functions
 				void				LEA(EIntelReg reg, const void* mem);
 
@@ -213,6 +262,41 @@ class CAssemblyWriterX64
 			mpAssemblyBuffer->EmitQWORD( qword );
 		}
 
+		// Emits a REX prefix if one is needed. reg goes in the ModRM reg field, rm in the r/m (or opcode) field
+		inline void EmitREX(EIntelReg reg, EIntelReg rm, bool is64)
+		{
+			u8 rex = 0x40;
+			if (is64)			rex |= 0x8;
+			if (reg >= R8_CODE)	rex |= 0x4;
+			if (rm >= R8_CODE)	rex |= 0x1;
+
+			if (rex != 0x40)
+			{
+				EmitBYTE(rex);
+			}
+		}
+
+		// As above, for a [base + index] operand. Always emitted if force is set (needed to get at sil/dil etc)
+		inline void EmitREX(EIntelReg reg, EIntelReg base, EIntelReg index, bool force, bool is64 = false)
+		{
+			u8 rex = 0x40;
+			if (is64)				rex |= 0x8;
+			if (reg >= R8_CODE)		rex |= 0x4;
+			if (index >= R8_CODE)	rex |= 0x2;
+			if (base >= R8_CODE)	rex |= 0x1;
+
+			if (rex != 0x40 || force)
+			{
+				EmitBYTE(rex);
+			}
+		}
+
+		void EmitModRMBaseIndex(EIntelReg reg, EIntelReg ibase, EIntelReg iindex, u8 scale_shift = 0);
+
+		// prefix (if any), REX (if needed), 0f, op, ModRM
+		void EmitSSE_REG_REG(u8 prefix, u8 op, u32 reg, u32 rm, bool is64);
+		void EmitSSE_REG_MEM(u8 prefix, u8 op, u32 reg, const void * mem);
+
 		inline void EmitADDR(const void* ptr)
 		{
 			s64 diff = (intptr_t)ptr - (intptr_t)&gCPUState;
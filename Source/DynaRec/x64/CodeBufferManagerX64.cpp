@@ -23,6 +23,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "Debug/DBGConsole.h"
 #include "DynaRec/CodeBufferManager.h"
 #include "CodeGeneratorX64.h"
+#include "FastmemX64.h"
 
 #ifdef DAEDALUS_W32
 #include <windows.h>
@@ -58,11 +59,39 @@ However managing 8-bit +127/-128 relative displacements would be challenging sin
 Otherwise a 16-bit override prefix could be used (but is it advantageous?)
 */
 
+namespace
+{
+	// Each manager gets a region this size. The background manager's region sits
+	// straight after the main one, so jumps between them stay within 32 bits.
+	const u32	CODE_REGION_SIZE = 256 * 1024 * 1024;
+	const u32	SECOND_BUFFER_OFFSET = 192 * 1024 * 1024;
+
+	// Space we make sure is committed before starting each block. The second buffer
+	// holds a slow path for every load and store, so needs more room.
+	const u32	BUFFER_HEADROOM = 32 * 1024;
+	const u32	SECOND_BUFFER_HEADROOM = 256 * 1024;
+}
+
 class CCodeBufferManagerX64 : public CCodeBufferManager
 {
 public:
 	CCodeBufferManagerX64()
-		:	mpBuffer( NULL )
+		:	mpRegion( NULL )
+		,	mOwnsRegion( true )
+		,	mpBuffer( NULL )
+		,	mBufferPtr( 0 )
+		,	mBufferSize( 0 )
+		,	mpSecondBuffer( NULL )
+		,	mSecondBufferPtr( 0 )
+		,	mSecondBufferSize( 0 )
+	{
+	}
+
+	// Use part of a region reserved by another manager
+	explicit CCodeBufferManagerX64( u8 * p_region )
+		:	mpRegion( p_region )
+		,	mOwnsRegion( false )
+		,	mpBuffer( NULL )
 		,	mBufferPtr( 0 )
 		,	mBufferSize( 0 )
 		,	mpSecondBuffer( NULL )
@@ -78,7 +107,13 @@ public:
 	virtual std::shared_ptr<CCodeGenerator> StartNewBlock();
 	virtual u32				FinaliseCurrentBlock();
 
+	virtual std::shared_ptr<CCodeBufferManager>	GetBackgroundManager()	{ return mpBackgroundManager; }
+
 private:
+	u8 *					mpRegion;
+	bool					mOwnsRegion;
+
+	std::shared_ptr<CCodeBufferManager>	mpBackgroundManager;
 
 	u8	*					mpBuffer;
 	u32						mBufferPtr;
@@ -110,19 +145,32 @@ bool	CCodeBufferManagerX64::Initialise()
 	// allocate a new buffer and copy the existing code across (this would
 	// mess up all the existing function pointers and jumps etc).
 	// Note that this call does not actually allocate any storage - we're not
-	// actually asking Windows to allocate 256Mb!
+	// actually asking Windows to allocate 512Mb!
+	// The upper half is handed to the background manager.
+	if (mOwnsRegion)
+	{
 #ifdef DAEDALUS_W32
-	mpBuffer = (u8*)VirtualAlloc(NULL, 256 * 1024 * 1024, MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+		mpRegion = (u8*)VirtualAlloc(NULL, 2 * CODE_REGION_SIZE, MEM_RESERVE, PAGE_EXECUTE_READWRITE);
 #else
-	mpBuffer = (u8*)mmap(NULL, 256 * 1024 * 1024, PROT_NONE, MAP_ANON | MAP_PRIVATE, -1, 0);
+		mpRegion = (u8*)mmap(NULL, 2 * CODE_REGION_SIZE, PROT_NONE, MAP_ANON | MAP_PRIVATE, -1, 0);
+		if (mpRegion == MAP_FAILED)
+			mpRegion = NULL;
 #endif
-	if (mpBuffer == NULL)
-		return false;
+		if (mpRegion == NULL)
+			return false;
 
+		mpBackgroundManager = std::make_shared<CCodeBufferManagerX64>( mpRegion + CODE_REGION_SIZE );
+		mpBackgroundManager->Initialise();
+
+		// Falls back to going through the memory handlers if this isn't available
+		Fastmem_Init();
+	}
+
+	mpBuffer = mpRegion;
 	mBufferPtr = 0;
 	mBufferSize = 0;
 
-	mpSecondBuffer = mpBuffer + 192 * 1024 * 1024;
+	mpSecondBuffer = mpBuffer + SECOND_BUFFER_OFFSET;
 	mSecondBufferPtr = 0;
 	mSecondBufferSize = 0;
 
@@ -130,12 +178,18 @@ bool	CCodeBufferManagerX64::Initialise()
 }
 
 //*****************************************************************************
-//
+// The background manager isn't touched here, it may be in use on another
+// thread. Its owner is responsible for resetting it.
 //*****************************************************************************
 void	CCodeBufferManagerX64::Reset()
 {
 	mBufferPtr = 0;
 	mSecondBufferPtr = 0;
+
+	if (mpBuffer != NULL)
+	{
+		Fastmem_RemoveSites( mpBuffer, mpBuffer + CODE_REGION_SIZE );
+	}
 }
 
 //*****************************************************************************
@@ -143,22 +197,31 @@ void	CCodeBufferManagerX64::Reset()
 //*****************************************************************************
 void	CCodeBufferManagerX64::Finalise()
 {
-	if (mpBuffer != NULL)
+	if (mpBackgroundManager != nullptr)
+	{
+		mpBackgroundManager->Finalise();
+		mpBackgroundManager = nullptr;
+	}
+
+	if (mOwnsRegion && mpRegion != NULL)
 	{
+		Fastmem_Fini();
+
 #ifdef DAEDALUS_W32
 		// Decommit all the pages first
-		VirtualFree(mpBuffer, 256 * 1024 * 1024, MEM_DECOMMIT);
+		VirtualFree(mpRegion, 2 * CODE_REGION_SIZE, MEM_DECOMMIT);
 		// Now release
-		VirtualFree(mpBuffer, 0, MEM_RELEASE);
+		VirtualFree(mpRegion, 0, MEM_RELEASE);
 #else
 		// Decommit all the pages first
-		madvise(mpBuffer, 256 * 1024 * 1024, MADV_FREE);
+		madvise(mpRegion, 2 * CODE_REGION_SIZE, MADV_FREE);
 
-		munmap(mpBuffer, 256 * 1024 * 1024);
+		munmap(mpRegion, 2 * CODE_REGION_SIZE);
 #endif
-		mpBuffer = NULL;
+		mpRegion = NULL;
 	}
 
+	mpBuffer = NULL;
 	mpSecondBuffer = NULL;
 }
 
@@ -179,9 +242,9 @@ std::shared_ptr<CCodeGenerator> CCodeBufferManagerX64::StartNewBlock()
 	mBufferPtr = aligned_ptr;
 
 	// This is a bit of a hack. We assume that no single entry will generate more than
-	// 32k of storage. If there appear to be problems with this assumption, this
+	// BUFFER_HEADROOM of storage. If there appear to be problems with this assumption, this
 	// value can be enlarged
-	if (mBufferPtr + 32768 > mBufferSize)
+	if (mBufferPtr + BUFFER_HEADROOM > mBufferSize)
 	{
 		// Increase by 1MB
 		void* pNewAddress;
@@ -203,7 +266,7 @@ std::shared_ptr<CCodeGenerator> CCodeBufferManagerX64::StartNewBlock()
 
 	}
 
-	if (mSecondBufferPtr + 32768 > mSecondBufferSize)
+	if (mSecondBufferPtr + SECOND_BUFFER_HEADROOM > mSecondBufferSize)
 	{
 		// Increase by 1MB
 		void* pNewAddress;
@@ -21,6 +21,9 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "Base/Types.h"
 
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
 
 #include "Interface/ConfigOptions.h"
 #include "Core/CPU.h"
@@ -29,17 +32,17 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "Debug/DBGConsole.h"
 #include "Debug/DebugLog.h"
 #include "DynaRec/AssemblyUtils.h"
+#include "DynaRec/DynaRecProfile.h"
 #include "DynaRec/IndirectExitMap.h"
 #include "DynaRec/StaticAnalysis.h"
 #include "DynaRec/Trace.h"
 #include "Ultra/ultra_R4300.h"
 
 #include "CodeGeneratorX64.h"
+#include "FastmemX64.h"
 
 using namespace AssemblyUtils;
 
-static const u32		NUM_MIPS_REGISTERS( 32 );
-static const u32		INTEL_REG_UNUSED( ~0 );
 // XX this optimisation works very well on the PSP, option to disable it was removed
 static const bool		gDynarecStackOptimisation = true;
 //*****************************************************************************
@@ -55,103 +58,48 @@ void Dynarec_SetCPUStuffToDo()
 //*****************************************************************************
 //	Register Caching
 //*****************************************************************************
-class CRegisterStatus
+// Everything is flushed and invalidated before we call out to C, so caller saved
+// registers are as good as callee saved ones here. _EnterDynaRec saves the callee
+// saved ones for us. RBX, R14 and R15 hold the pointers set up by _EnterDynaRec,
+// and RAX, RCX and RDX are kept free as scratch registers.
+static const EIntelReg	gRegistersToUseForCaching[] =
 {
-	struct CachedRegInfo
-	{
-		EIntelReg iCachedIReg;	// INVALID_CODE if uncached, else ???_CODE of intel reg we're cached in
-		bool	BLoValid;		// If cached, true if value in intel register is valid
-		bool	BLoDirty;		// If cached, true if value has been modified
-
-		u32		HiValue;		// If BHiUnknown is false, this is the value of the register (through setmipshi..)
-		bool	BHiDirty;		// Do we need to write information about this register back to memory?
-		bool	BHiUnknown;		// If true, we don't know the value of this register
-	};
-public:
-
-	void Reset()
-	{
-		for (u32 i = 0; i < NUM_REGISTERS; i++)
-		{
-			SetCachedReg( i, INVALID_CODE );
-			MarkAsValid( i, false );
-			MarkAsDirty( i, false );
-
-			MarkHiAsDirty( i, false );
-			MarkHiAsUnknown( i, true );
-			SetHiValue( i, 0 );		// Ignored
-		}
-	}
-
-	inline void MarkAsValid( u32 mreg, bool valid )
-	{
-		mCachedRegisterInfo[mreg].BLoValid = valid;
-	}
-
-	inline bool IsValid( u32 mreg ) const
-	{
-		return mCachedRegisterInfo[mreg].BLoValid;
-	}
-
-	inline bool IsDirty( u32 mreg ) const
-	{
-		return mCachedRegisterInfo[mreg].BLoDirty;
-	}
-
-	inline void MarkAsDirty( u32 mreg, bool dirty )
-	{
-		mCachedRegisterInfo[mreg].BLoDirty = dirty;
-	}
-
-	inline EIntelReg GetCachedReg( u32 mreg ) const
-	{
-		return mCachedRegisterInfo[mreg].iCachedIReg;
-	}
-
-	inline void SetCachedReg( u32 mreg, EIntelReg reg )
-	{
-		mCachedRegisterInfo[mreg].iCachedIReg = reg;
-	}
-
-	inline void MarkHiAsUnknown( u32 mreg, bool unk )
-	{
-		mCachedRegisterInfo[mreg].BHiUnknown = unk;
-	}
-
-	inline void MarkHiAsDirty( u32 mreg, bool dirty )
-	{
-		mCachedRegisterInfo[mreg].BHiDirty = dirty;
-	}
-
-	inline bool IsHiDirty( u32 mreg ) const
-	{
-		return mCachedRegisterInfo[mreg].BHiDirty;
-	}
-
-	inline bool IsHiUnknown( u32 mreg ) const
-	{
-		return mCachedRegisterInfo[mreg].BHiUnknown;
-	}
-
-	inline void SetHiValue( u32 mreg, u32 value )
-	{
-		mCachedRegisterInfo[mreg].HiValue = value;
-	}
-
-	inline u32 GetHiValue( u32 mreg ) const
-	{
-		return mCachedRegisterInfo[mreg].HiValue;
-	}
+	RSI_CODE,
+	RDI_CODE,
+	R8_CODE,
+	R9_CODE,
+	R10_CODE,
+	R11_CODE,
+	RBP_CODE,
+	R12_CODE,
+	R13_CODE,
+};
 
-private:
-	static const u32	NUM_REGISTERS = 32;
-	CachedRegInfo		mCachedRegisterInfo[NUM_REGISTERS];
+// The caching registers that C calls trash, which fastmem slow paths have to
+// preserve. There's an even number of them, so the stack stays 16 byte aligned.
+static const EIntelReg	gFastmemSavedRegisters[] =
+{
+	RSI_CODE,
+	RDI_CODE,
+	R8_CODE,
+	R9_CODE,
+	R10_CODE,
+	R11_CODE,
 };
 
+//*****************************************************************************
+//	FPU
+//*****************************************************************************
+// Doubles and longs are held in a pair of FPRs, low word first, as the interpreter does
+static inline u32 *	FPRWord( u32 reg )		{ return &gCPUState.FPU[ reg ]._u32; }
+static inline u64 *	FPRLong( u32 reg )		{ return reinterpret_cast< u64 * >( &gCPUState.FPU[ reg ]._u32 ); }
+
+// MXCSR with all exceptions masked, and where its rounding control field is
+static const u32	MXCSR_DEFAULT = 0x1f80;
+static const u32	MXCSR_RC_SHIFT = 13;
 
-static CRegisterStatus	gRegisterStatus;
-static u32				gIntelRegUsageMap[NUM_X64_REGISTERS];
-static u32				gWriteCheck[NUM_MIPS_REGISTERS];
+// LDMXCSR only takes a memory operand. This has to be within reach of gCPUState
+static u32			gMXCSR = MXCSR_DEFAULT;
 
 //*****************************************************************************
 //
@@ -163,6 +111,8 @@ CCodeGeneratorX64::CCodeGeneratorX64( CAssemblyBuffer * p_primary, CAssemblyBuff
 ,	mSetSpPostUpdate( 0 )
 ,	mpPrimary( p_primary )
 ,	mpSecondary( p_secondary )
+,	mUseFastmem( Fastmem_IsEnabled() )
+,	mHostRoundingMode( HRM_UNKNOWN )
 {
 }
 
@@ -171,7 +121,7 @@ CCodeGeneratorX64::CCodeGeneratorX64( CAssemblyBuffer * p_primary, CAssemblyBuff
 //*****************************************************************************
 void	CCodeGeneratorX64::Finalise( ExceptionHandlerFn p_exception_handler_fn, const std::vector< CJumpLocation > & exception_handler_jumps, const std::vector< RegisterSnapshotHandle >& exception_handler_snapshots )
 {
-	if( !exception_handler_jumps.empty() )
+	if( !exception_handler_jumps.empty() || !mFastmemExceptionJumps.empty() )
 	{
 		GenerateExceptionHander( p_exception_handler_fn, exception_handler_jumps, exception_handler_snapshots );
 	}
@@ -217,7 +167,88 @@ void	CCodeGeneratorX64::Initialise( u32 entry_address, u32 exit_address, u32 * h
 	// 	MOV_MEM_REG( hit_counter, RAX_CODE );
 	// }
 
-	// p_base/span_list ignored for now
+	// p_base ignored for now
+	SetRegisterSpanList( register_usage );
+
+	// We could have come from anywhere
+	mHostRoundingMode = HRM_UNKNOWN;
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void	CCodeGeneratorX64::SetRegisterSpanList( const SRegisterUsageInfo & register_usage )
+{
+	mRegisterSpanList = register_usage.SpanList;
+
+	// Sort in order of increasing start point
+	std::sort( mRegisterSpanList.begin(), mRegisterSpanList.end(), SAscendingSpanStartSort() );
+
+	const u32 NUM_CACHE_REGS( sizeof( gRegistersToUseForCaching ) / sizeof( gRegistersToUseForCaching[0] ) );
+
+#ifdef DAEDALUS_ENABLE_ASSERTS
+	DAEDALUS_ASSERT( mAvailableRegisters.empty(), "Why isn't the available register list empty?" );
+#endif
+	// Push in reverse order, so they're handed out in the order listed above
+	for( u32 i = NUM_CACHE_REGS; i > 0; --i )
+	{
+		mAvailableRegisters.push( gRegistersToUseForCaching[ i - 1 ] );
+	}
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void	CCodeGeneratorX64::ExpireOldIntervals( u32 instruction_idx )
+{
+	// mActiveIntervals is held in order of increasing end point
+	while( !mActiveIntervals.empty() && mActiveIntervals.front().SpanEnd < instruction_idx )
+	{
+		const SRegisterSpan &	span( mActiveIntervals.front() );
+
+		// This interval is no longer active - flush the register and return it to the list of available regs
+		EIntelReg	cached_reg( mRegisterCache.GetCachedReg( span.Register, 0 ) );
+
+		FlushRegister( mRegisterCache, span.Register, true );
+
+		mRegisterCache.ClearCachedReg( span.Register, 0 );
+
+		mAvailableRegisters.push( cached_reg );
+
+		mActiveIntervals.erase( mActiveIntervals.begin() );
+	}
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void	CCodeGeneratorX64::SpillAtInterval( const SRegisterSpan & live_span )
+{
+#ifdef DAEDALUS_ENABLE_ASSERTS
+	DAEDALUS_ASSERT( !mActiveIntervals.empty(), "There are no active intervals" );
+#endif
+	const SRegisterSpan &	last_span( mActiveIntervals.back() );		// Spill the last active interval (it has the greatest end point)
+
+	if( last_span.SpanEnd > live_span.SpanEnd )
+	{
+		// Uncache the old span
+		EIntelReg	cached_reg( mRegisterCache.GetCachedReg( last_span.Register, 0 ) );
+		FlushRegister( mRegisterCache, last_span.Register, true );
+		mRegisterCache.ClearCachedReg( last_span.Register, 0 );
+
+		// Cache the new span
+		mRegisterCache.SetCachedReg( live_span.Register, 0, cached_reg );
+
+		mActiveIntervals.pop_back();
+
+		// Insert in order of increasing end point
+		RegisterSpanList::iterator	it( std::upper_bound( mActiveIntervals.begin(), mActiveIntervals.end(), live_span, SAscendingSpanEndSort() ) );
+		mActiveIntervals.insert( it, live_span );
+	}
+	else
+	{
+		// There is no space for this register - we just don't update the register cache info, so we save/restore it from memory as needed
+	}
 }
 
 //*****************************************************************************
@@ -225,7 +256,36 @@ void	CCodeGeneratorX64::Initialise( u32 entry_address, u32 exit_address, u32 * h
 //*****************************************************************************
 void	CCodeGeneratorX64::UpdateRegisterCaching( u32 instruction_idx )
 {
-	// This is ignored for now
+	ExpireOldIntervals( instruction_idx );
+
+	for( RegisterSpanList::const_iterator span_it = mRegisterSpanList.begin(); span_it < mRegisterSpanList.end(); ++span_it )
+	{
+		const SRegisterSpan &	span( *span_it );
+
+		// As we keep the intervals sorted in order of SpanStart, we can exit as soon as we encounter a SpanStart in the future
+		if( instruction_idx < span.SpanStart )
+		{
+			break;
+		}
+
+		// Only process live intervals
+		if( instruction_idx <= span.SpanEnd && !mRegisterCache.IsCached( span.Register, 0 ) )
+		{
+			if( mAvailableRegisters.empty() )
+			{
+				SpillAtInterval( span );
+			}
+			else
+			{
+				// Use this register for caching. It's loaded lazily, the first time it's needed
+				mRegisterCache.SetCachedReg( span.Register, 0, mAvailableRegisters.top() );
+				mAvailableRegisters.pop();
+
+				RegisterSpanList::iterator	it( std::upper_bound( mActiveIntervals.begin(), mActiveIntervals.end(), span, SAscendingSpanEndSort() ) );
+				mActiveIntervals.insert( it, span );
+			}
+		}
+	}
 }
 
 //*****************************************************************************
@@ -233,8 +293,214 @@ void	CCodeGeneratorX64::UpdateRegisterCaching( u32 instruction_idx )
 //*****************************************************************************
 RegisterSnapshotHandle	CCodeGeneratorX64::GetRegisterSnapshot()
 {
-	// This doesn't do anything useful yet.
-	return RegisterSnapshotHandle( 0 );
+	RegisterSnapshotHandle	handle( mRegisterSnapshots.size() );
+
+	mRegisterSnapshots.push_back( mRegisterCache );
+
+	return handle;
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+const CN64RegisterCacheX64 &	CCodeGeneratorX64::GetRegisterCacheFromHandle( RegisterSnapshotHandle snapshot ) const
+{
+#ifdef DAEDALUS_ENABLE_ASSERTS
+	DAEDALUS_ASSERT( snapshot.Handle < mRegisterSnapshots.size(), "Invalid snapshot handle" );
+#endif
+	return mRegisterSnapshots[ snapshot.Handle ];
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+bool	CCodeGeneratorX64::HasDirtyRegisters( const CN64RegisterCacheX64 & cache ) const
+{
+	for( u32 i = 1; i < NUM_N64_REGS; ++i )
+	{
+		EN64Reg	n64_reg = EN64Reg( i );
+		if( cache.IsCached( n64_reg, 0 ) && cache.IsDirty( n64_reg, 0 ) )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+//*****************************************************************************
+//	Writes the register back to gCPUState if it's been modified. If invalidate
+//	is set, the native register is assumed to be trashed afterwards.
+//*****************************************************************************
+void	CCodeGeneratorX64::FlushRegister( CN64RegisterCacheX64 & cache, EN64Reg n64_reg, bool invalidate )
+{
+	if( !cache.IsCached( n64_reg, 0 ) )
+	{
+		return;
+	}
+
+	EIntelReg	cached_reg( cache.GetCachedReg( n64_reg, 0 ) );
+
+	if( cache.IsDirty( n64_reg, 0 ) )
+	{
+		if( cache.IsSignExtended( n64_reg, 0 ) )
+		{
+			MOVSXD( cached_reg, cached_reg );
+			cache.MarkAsSignExtended( n64_reg, 0, false );
+		}
+
+		MOV64_MEM_REG( &gCPUState.CPU[ n64_reg ]._u64, cached_reg );
+		cache.MarkAsDirty( n64_reg, 0, false );
+	}
+
+	if( invalidate )
+	{
+		cache.MarkAsValid( n64_reg, 0, false );
+		cache.MarkAsSignExtended( n64_reg, 0, false );
+	}
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void	CCodeGeneratorX64::FlushAllRegisters( CN64RegisterCacheX64 & cache, bool invalidate )
+{
+	// Skip r0
+	for( u32 i = 1; i < NUM_N64_REGS; ++i )
+	{
+		FlushRegister( cache, EN64Reg( i ), invalidate );
+	}
+}
+
+//*****************************************************************************
+//	True if the register is known to hold a sign extended 32 bit value
+//*****************************************************************************
+bool	CCodeGeneratorX64::IsSignExtended32( EN64Reg n64_reg ) const
+{
+	if( n64_reg == N64Reg_R0 )
+	{
+		return true;
+	}
+
+	return mRegisterCache.IsCached( n64_reg, 0 ) && mRegisterCache.IsValid( n64_reg, 0 ) && mRegisterCache.IsSignExtended( n64_reg, 0 );
+}
+
+//*****************************************************************************
+//	Returns a register with the low 32 bits of n64_reg in it. The top half of
+//	the register is undefined. scratch_reg is used if n64_reg isn't cached.
+//*****************************************************************************
+EIntelReg	CCodeGeneratorX64::GetRegisterAndLoad32( EN64Reg n64_reg, EIntelReg scratch_reg )
+{
+	if( n64_reg == N64Reg_R0 )
+	{
+		XOR( scratch_reg, scratch_reg );
+		return scratch_reg;
+	}
+
+	if( mRegisterCache.IsCached( n64_reg, 0 ) )
+	{
+		EIntelReg	cached_reg( mRegisterCache.GetCachedReg( n64_reg, 0 ) );
+		if( !mRegisterCache.IsValid( n64_reg, 0 ) )
+		{
+			MOV64_REG_MEM( cached_reg, &gCPUState.CPU[ n64_reg ]._u64 );
+			mRegisterCache.MarkAsValid( n64_reg, 0, true );
+		}
+		return cached_reg;
+	}
+
+	MOV_REG_MEM( scratch_reg, &gCPUState.CPU[ n64_reg ]._u32_0 );
+	return scratch_reg;
+}
+
+//*****************************************************************************
+//	As above, but the whole 64 bit value is loaded
+//*****************************************************************************
+EIntelReg	CCodeGeneratorX64::GetRegisterAndLoad64( EN64Reg n64_reg, EIntelReg scratch_reg )
+{
+	if( n64_reg == N64Reg_R0 )
+	{
+		XOR( scratch_reg, scratch_reg );
+		return scratch_reg;
+	}
+
+	if( mRegisterCache.IsCached( n64_reg, 0 ) )
+	{
+		EIntelReg	cached_reg( mRegisterCache.GetCachedReg( n64_reg, 0 ) );
+		if( !mRegisterCache.IsValid( n64_reg, 0 ) )
+		{
+			MOV64_REG_MEM( cached_reg, &gCPUState.CPU[ n64_reg ]._u64 );
+			mRegisterCache.MarkAsValid( n64_reg, 0, true );
+		}
+		else if( mRegisterCache.IsSignExtended( n64_reg, 0 ) )
+		{
+			MOVSXD( cached_reg, cached_reg );
+			mRegisterCache.MarkAsSignExtended( n64_reg, 0, false );
+		}
+		return cached_reg;
+	}
+
+	MOV64_REG_MEM( scratch_reg, &gCPUState.CPU[ n64_reg ]._u64 );
+	return scratch_reg;
+}
+
+//*****************************************************************************
+//	Returns the register to generate the new value of n64_reg in
+//*****************************************************************************
+EIntelReg	CCodeGeneratorX64::GetRegisterNoLoad( EN64Reg n64_reg, EIntelReg scratch_reg )
+{
+	if( mRegisterCache.IsCached( n64_reg, 0 ) )
+	{
+		return mRegisterCache.GetCachedReg( n64_reg, 0 );
+	}
+
+	return scratch_reg;
+}
+
+//*****************************************************************************
+//	Sets n64_reg to the sign extension of the low 32 bits of src_reg.
+//	If it's cached, the sign extension is put off until it's needed.
+//*****************************************************************************
+void	CCodeGeneratorX64::StoreRegister32s( EN64Reg n64_reg, EIntelReg src_reg )
+{
+	if( n64_reg == N64Reg_R0 )
+	{
+		return;
+	}
+
+	if( mRegisterCache.IsCached( n64_reg, 0 ) )
+	{
+		MOV( mRegisterCache.GetCachedReg( n64_reg, 0 ), src_reg );
+		mRegisterCache.MarkAsValid( n64_reg, 0, true );
+		mRegisterCache.MarkAsDirty( n64_reg, 0, true );
+		mRegisterCache.MarkAsSignExtended( n64_reg, 0, true );
+	}
+	else
+	{
+		MOVSXD( src_reg, src_reg );
+		MOV64_MEM_REG( &gCPUState.CPU[ n64_reg ]._u64, src_reg );
+	}
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void	CCodeGeneratorX64::StoreRegister64( EN64Reg n64_reg, EIntelReg src_reg )
+{
+	if( n64_reg == N64Reg_R0 )
+	{
+		return;
+	}
+
+	if( mRegisterCache.IsCached( n64_reg, 0 ) )
+	{
+		MOV( mRegisterCache.GetCachedReg( n64_reg, 0 ), src_reg, true );
+		mRegisterCache.MarkAsValid( n64_reg, 0, true );
+		mRegisterCache.MarkAsDirty( n64_reg, 0, true );
+		mRegisterCache.MarkAsSignExtended( n64_reg, 0, false );
+	}
+	else
+	{
+		MOV64_MEM_REG( &gCPUState.CPU[ n64_reg ]._u64, src_reg );
+	}
 }
 
 //*****************************************************************************
@@ -276,6 +542,8 @@ CJumpLocation CCodeGeneratorX64::GenerateExitCode( u32 exit_address, u32 jump_ad
 	}
 #endif
 
+	FlushAllRegisters( mRegisterCache, true );
+
 	MOVI(FIRST_PARAM_REG_CODE, num_instructions);
 	CALL( CCodeLabel( (void*)CPU_UpdateCounter ) );
 
@@ -318,6 +586,8 @@ CJumpLocation CCodeGeneratorX64::GenerateExitCode( u32 exit_address, u32 jump_ad
 //*****************************************************************************
 void CCodeGeneratorX64::GenerateEretExitCode( u32 num_instructions, CIndirectExitMap * p_map )
 {
+	FlushAllRegisters( mRegisterCache, true );
+
 	MOVI(FIRST_PARAM_REG_CODE, num_instructions);
 	CALL( CCodeLabel( (void*)CPU_UpdateCounter ) );
 
@@ -339,6 +609,8 @@ void CCodeGeneratorX64::GenerateEretExitCode( u32 num_instructions, CIndirectExi
 //*****************************************************************************
 void CCodeGeneratorX64::GenerateIndirectExitCode( u32 num_instructions, CIndirectExitMap * p_map )
 {
+	FlushAllRegisters( mRegisterCache, true );
+
 	MOVI(FIRST_PARAM_REG_CODE, num_instructions);
 	CALL( CCodeLabel( (void*) CPU_UpdateCounter ) );
 
@@ -355,20 +627,93 @@ void CCodeGeneratorX64::GenerateIndirectExitCode( u32 num_instructions, CIndirec
 
 	RET();
 
-	// gCPUState.StuffToDo == 0, try to jump to the indirect target
+	// gCPUState.StuffToDo == 0, try to jump to the indirect target.
+	// Everything has been flushed, so we're free to use any register here.
 	PatchJumpLong( jump_to_next_fragment, GetAssemblyBuffer()->GetLabel() );
 
-	MOVI_64(FIRST_PARAM_REG_CODE, (uintptr_t)p_map);
-	MOV_REG_MEM( SECOND_PARAM_REG_CODE, &gCPUState.TargetPC );
-	CALL( CCodeLabel( (void*)IndirectExitMap_Lookup ) );
+	SIndirectExitCache *	p_cache( AllocateIndirectExitCache( u32(~0) ) );
+
+	MOV_REG_MEM( RDX_CODE, &gCPUState.TargetPC );
+
+	// If we're returning from the last JAL, the return address stack has its cache
+	MOV_REG_MEM( R8_CODE, &gReturnAddressStack.Top );
+	LEA( RCX_CODE, gReturnAddressStack.Entries );
+	MOV64_REG_MEM_BASE_INDEXx8( RCX_CODE, RCX_CODE, R8_CODE );
+	MOV_REG_MEM_BASE_OFFSET8( RAX_CODE, RCX_CODE, offsetof( SIndirectExitCache, Address ) );
+	CMP( RAX_CODE, RDX_CODE );
+	CJumpLocation	not_return( JNELong( no_target ) );
+
+	SUBI( R8_CODE, 1 );
+	ANDI( R8_CODE, SReturnAddressStack::SIZE - 1 );
+	MOV_MEM_REG( &gReturnAddressStack.Top, R8_CODE );
+
+	static_assert( offsetof( SIndirectExitCache, Target ) == 0, "Target is expected first" );
+	MOV64_REG_MEM_BASE( RAX_CODE, RCX_CODE );
+	TEST( RAX_CODE, RAX_CODE, true );
+	CJumpLocation	return_not_cached( JELong( no_target ) );
+#ifdef DAEDALUS_ENABLE_DYNAREC_PROFILE
+	MOV_REG_MEM( R9_CODE, &DynarecProfile::gIndirectExitStats.ReturnStackHits );
+	ADDI( R9_CODE, 1 );
+	MOV_MEM_REG( &DynarecProfile::gIndirectExitStats.ReturnStackHits, R9_CODE );
+#endif
+	JMP_REG( RAX_CODE );
+
+	// Otherwise see if we're going to the same place as last time
+	PatchJumpLong( not_return, GetAssemblyBuffer()->GetLabel() );
+	MOVI_64( RCX_CODE, reinterpret_cast< uintptr_t >( p_cache ) );
+	MOV_REG_MEM_BASE_OFFSET8( RAX_CODE, RCX_CODE, offsetof( SIndirectExitCache, Address ) );
+	CMP( RAX_CODE, RDX_CODE );
+	CJumpLocation	cache_miss( JNELong( no_target ) );
+	MOV64_REG_MEM_BASE( RAX_CODE, RCX_CODE );
+	TEST( RAX_CODE, RAX_CODE, true );
+	CJumpLocation	cache_empty( JELong( no_target ) );
+#ifdef DAEDALUS_ENABLE_DYNAREC_PROFILE
+	MOV_REG_MEM( R9_CODE, &DynarecProfile::gIndirectExitStats.InlineCacheHits );
+	ADDI( R9_CODE, 1 );
+	MOV_MEM_REG( &DynarecProfile::gIndirectExitStats.InlineCacheHits, R9_CODE );
+#endif
+	JMP_REG( RAX_CODE );
+
+	// Look the target up, and remember it in the cache in RCX for next time
+	CCodeLabel		lookup( GetAssemblyBuffer()->GetLabel() );
+	PatchJumpLong( return_not_cached, lookup );
+	PatchJumpLong( cache_miss, lookup );
+	PatchJumpLong( cache_empty, lookup );
+
+	// Shuffle through registers which aren't parameters, as they differ between ABIs
+	MOV( R10_CODE, RCX_CODE, true );
+	MOV( R11_CODE, RDX_CODE );
+	MOVI_64( FIRST_PARAM_REG_CODE, reinterpret_cast< uintptr_t >( p_map ) );
+	MOV( SECOND_PARAM_REG_CODE, R11_CODE );
+	MOV( THIRD_PARAM_REG_CODE, R10_CODE, true );
+	CALL( CCodeLabel( (void*)IndirectExitMap_LookupAndCache ) );
 
 	// If the target was not found, exit
-	TEST( RAX_CODE, RAX_CODE );
+	TEST( RAX_CODE, RAX_CODE, true );
 	JELong( exit_dynarec );
 
 	JMP_REG( RAX_CODE );
 }
 
+//*****************************************************************************
+//	Indirect exit caches are data, so they go in the secondary buffer out of
+//	the way of the code
+//*****************************************************************************
+SIndirectExitCache *	CCodeGeneratorX64::AllocateIndirectExitCache( u32 address )
+{
+	while( (reinterpret_cast< uintptr_t >( mpSecondary->GetLabel().GetTarget() ) & 7) != 0 )
+	{
+		mpSecondary->EmitBYTE( 0xcc );
+	}
+
+	SIndirectExitCache *	p_cache( static_cast< SIndirectExitCache * >( const_cast< void * >( mpSecondary->GetLabel().GetTarget() ) ) );
+
+	SIndirectExitCache		cache = { nullptr, address, 0 };
+	mpSecondary->EmitData( &cache, sizeof( cache ) );
+
+	return p_cache;
+}
+
 //*****************************************************************************
 //
 //*****************************************************************************
@@ -379,11 +724,28 @@ void CCodeGeneratorX64::GenerateExceptionHander( ExceptionHandlerFn p_exception_
 	CALL( CCodeLabel( (void*)p_exception_handler_fn ) );
 	RET();
 
-	for( std::vector< CJumpLocation >::const_iterator it = exception_handler_jumps.begin(); it != exception_handler_jumps.end(); ++it )
+	// Fastmem slow paths have already flushed everything
+	for( const CJumpLocation & jump : mFastmemExceptionJumps )
 	{
-		CJumpLocation	jump( *it );
 		PatchJumpLong( jump, exception_handler );
 	}
+
+	for( u32 i = 0; i < exception_handler_jumps.size(); ++i )
+	{
+		CJumpLocation			jump( exception_handler_jumps[ i ] );
+		CN64RegisterCacheX64	cache( GetRegisterCacheFromHandle( exception_handler_snapshots[ i ] ) );
+
+		// Most exceptions come from generic instructions, which have already flushed everything
+		if( !HasDirtyRegisters( cache ) )
+		{
+			PatchJumpLong( jump, exception_handler );
+			continue;
+		}
+
+		PatchJumpLong( jump, GetAssemblyBuffer()->GetLabel() );
+		FlushAllRegisters( cache, true );
+		GenerateBranchAlways( exception_handler );
+	}
 }
 
 //*****************************************************************************
@@ -408,6 +770,10 @@ void	CCodeGeneratorX64::SetVar8( u32 * p_var, u8 value )
 void	CCodeGeneratorX64::GenerateBranchHandler( CJumpLocation branch_handler_jump, RegisterSnapshotHandle snapshot )
 {
 	PatchJumpLong( branch_handler_jump, GetAssemblyBuffer()->GetLabel() );
+	mRegisterCache = GetRegisterCacheFromHandle( snapshot );
+
+	// The branch could have been taken before we set the rounding mode
+	mHostRoundingMode = HRM_UNKNOWN;
 }
 
 //*****************************************************************************
@@ -511,7 +877,6 @@ CJumpLocation	CCodeGeneratorX64::GenerateOpCode( const STraceEntry& ti, bool bra
 	const EN64Reg	base = EN64Reg( op_code.base );
 	//const u32		jump_target( (address&0xF0000000) | (op_code.target<<2) );
 	//const u32		branch_target( address + ( ((s32)(s16)op_code.immediate)<<2 ) + 4);
-	const u32		ft = op_code.ft;
 
 
 	bool handled = false;
@@ -524,34 +889,19 @@ CJumpLocation	CCodeGeneratorX64::GenerateOpCode( const STraceEntry& ti, bool bra
 		case OP_DADDI:		GenerateDADDIU( rt, rs, s16( op_code.immediate ) );	handled = true; break;
 		case OP_DADDIU:		GenerateDADDIU( rt, rs, s16( op_code.immediate ) );	handled = true; break;
 
-		// For LW, SW, SWC1, LB etc, only generate an exception handler if access wasn't done through the stack (handle = false)
-		// This will have to be reworked once we handle accesses other than the stack!
-		case OP_SW:
-			handled = GenerateSW(rt, base, s16(op_code.immediate));
-			exception = !handled;
-			break;
-		case OP_SWC1:
-			handled = GenerateSWC1(ft, base, s16(op_code.immediate));
-			exception = !handled;
-			break;
-		case OP_LW:
-			handled = GenerateLW(rt, base, s16(op_code.immediate));
-			exception = !handled;
-			break;
+		// Loads and stores that are handled don't need checking here. Fastmem ones check in their slow path
 		case OP_LB:
-			handled = GenerateLB(rt, base, s16(op_code.immediate));
-			exception = !handled;
-			break;
 		case OP_LBU:
-			 handled = GenerateLBU(rt, base, s16(op_code.immediate));
-			 exception = !handled;
-			break;
 		case OP_LH:
-			handled = GenerateLH(rt, base, s16(op_code.immediate));
-			exception = !handled;
-			break;
+		case OP_LHU:
+		case OP_LW:
+		case OP_LWU:
 		case OP_LWC1:
-			handled = GenerateLWC1(ft, base, s16(op_code.immediate));
+		case OP_SB:
+		case OP_SH:
+		case OP_SW:
+		case OP_SWC1:
+			handled = GenerateLoadStore( op_code, address );
 			exception = !handled;
 			break;
 		case OP_LUI:
@@ -604,6 +954,9 @@ CJumpLocation	CCodeGeneratorX64::GenerateOpCode( const STraceEntry& ti, bool bra
 				}
 			}
 			break;
+		case OP_COPRO1:
+			handled = GenerateCOP1( op_code );
+			break;
 	}
 
 	if (!handled)
@@ -670,11 +1023,15 @@ CJumpLocation	CCodeGeneratorX64::GenerateOpCode( const STraceEntry& ti, bool bra
 //*****************************************************************************
 void	CCodeGeneratorX64::GenerateGenericR4300( OpCode op_code, CPU_Instruction p_instruction )
 {
-	// XXXX Flush all fp registers before a generic call
+	// The handler reads and writes gCPUState directly
+	FlushAllRegisters( mRegisterCache, true );
 
 	// Call function - __fastcall
 	MOVI(FIRST_PARAM_REG_CODE, op_code._u32);
 	CALL( CCodeLabel( (void*)p_instruction ) );
+
+	// CTC1 and the CVT handlers change the rounding mode
+	mHostRoundingMode = HRM_UNKNOWN;
 }
 
 //*****************************************************************************
@@ -682,7 +1039,10 @@ void	CCodeGeneratorX64::GenerateGenericR4300( OpCode op_code, CPU_Instruction p_
 //*****************************************************************************
 CJumpLocation CCodeGeneratorX64::ExecuteNativeFunction( CCodeLabel speed_hack, bool check_return )
 {
+	FlushAllRegisters( mRegisterCache, true );
+
 	CALL( speed_hack );
+	mHostRoundingMode = HRM_UNKNOWN;
 	if( check_return )
 	{
 		TEST( RAX_CODE, RAX_CODE );
@@ -705,10 +1065,13 @@ void	CCodeGeneratorX64::GenerateCACHE( EN64Reg base, s16 offset, u32 cache_op )
 	// dynarec system can be invalidated
 	if(dwCache == 0 && (dwAction == 0 || dwAction == 4))
 	{
+		FlushAllRegisters( mRegisterCache, true );
+
 		MOV_REG_MEM(FIRST_PARAM_REG_CODE, &gCPUState.CPU[base]._u32_0);
 		MOVI(SECOND_PARAM_REG_CODE, 0x20);
 		ADDI(FIRST_PARAM_REG_CODE, offset);
 		CALL( CCodeLabel( reinterpret_cast< const void * >( CPU_InvalidateICacheRange ) ));
+		mHostRoundingMode = HRM_UNKNOWN;
 	}
 	else
 	{
@@ -716,18 +1079,195 @@ void	CCodeGeneratorX64::GenerateCACHE( EN64Reg base, s16 offset, u32 cache_op )
 	}
 }
 
-void CCodeGeneratorX64::GenerateLoad(EN64Reg base, s16 offset, u8 twiddle, u8 bits)
+
+//*****************************************************************************
+//	Returns false if the instruction should go through the interpreter
+//*****************************************************************************
+bool CCodeGeneratorX64::GenerateLoadStore( OpCode op_code, u32 address )
+{
+	if( mUseFastmem )
+	{
+		GenerateFastmemAccess( op_code, address );
+		return true;
+	}
+
+	const EN64Reg	rt = EN64Reg( op_code.rt );
+	const EN64Reg	base = EN64Reg( op_code.base );
+	const s16		offset = s16( op_code.immediate );
+	const u32		ft = op_code.ft;
+
+	switch( op_code.op )
+	{
+	case OP_LB:		return GenerateLB( rt, base, offset );
+	case OP_LBU:	return GenerateLBU( rt, base, offset );
+	case OP_LH:		return GenerateLH( rt, base, offset );
+	case OP_LW:		return GenerateLW( rt, base, offset );
+	case OP_LWC1:	return GenerateLWC1( ft, base, offset );
+	case OP_SW:		return GenerateSW( rt, base, offset );
+	case OP_SWC1:	return GenerateSWC1( ft, base, offset );
+	}
+
+	return false;
+}
+
+//*****************************************************************************
+//	Accesses the fastmem region directly, with RAM at its N64 address. The
+//	access is a single instruction at a registered site, padded so that the
+//	fault handler can turn it into a jump to the slow path if it ever faults.
+//*****************************************************************************
+void CCodeGeneratorX64::GenerateFastmemAccess( OpCode op_code, u32 address )
 {
-	MOV_REG_MEM(RCX_CODE, &gCPUState.CPU[base]._u32_0);
+	const EN64Reg	rt = EN64Reg( op_code.rt );
+	const EN64Reg	base = EN64Reg( op_code.base );
+	const s16		offset = s16( op_code.immediate );
+	const u32		ft = op_code.ft;
+
+	u8		bits = 32;
+	u8		twiddle = 0;
+	bool	is_store = false;
+
+	switch( op_code.op )
+	{
+	case OP_SB:		is_store = true;	// Fall through
+	case OP_LB:
+	case OP_LBU:	bits = 8;	twiddle = U8_TWIDDLE;	break;
+	case OP_SH:		is_store = true;	// Fall through
+	case OP_LH:
+	case OP_LHU:	bits = 16;	twiddle = U16_TWIDDLE;	break;
+	case OP_SW:
+	case OP_SWC1:	is_store = true;	break;
+	}
+
+	// Get the value in a register first, so nothing but the access needs patching
+	EIntelReg	src_reg = RAX_CODE;
+	if( op_code.op == OP_SWC1 )
+	{
+		MOV_REG_MEM( RAX_CODE, &gCPUState.FPU[ft]._u32 );
+	}
+	else if( is_store )
+	{
+		src_reg = GetRegisterAndLoad32( rt, RAX_CODE );
+	}
+
+	// N64 addresses wrap at 32 bits, so keep the sum in ECX (the top half is cleared)
+	MOV( RCX_CODE, GetRegisterAndLoad32( base, RCX_CODE ) );
+	if( offset != 0 )
+	{
+		ADDI( RCX_CODE, offset );
+	}
+	if( twiddle != 0 )
+	{
+		XORI( RCX_CODE, twiddle );
+	}
+
+	CCodeLabel	site( GetAssemblyBuffer()->GetLabel() );
 
+	if( is_store )
+	{
+		switch( bits )
+		{
+		case 32:	MOV_MEM_BASE_INDEX_REG( R15_CODE, RCX_CODE, src_reg );		break;
+		case 16:	MOV16_MEM_BASE_INDEX_REG( R15_CODE, RCX_CODE, src_reg );	break;
+		case 8:		MOV8_MEM_BASE_INDEX_REG( R15_CODE, RCX_CODE, src_reg );		break;
+		}
+	}
+	else
+	{
+		switch( bits )
+		{
+		case 32:	MOV_REG_MEM_BASE_INDEX( RAX_CODE, R15_CODE, RCX_CODE );		break;
+		case 16:	MOVZX16_REG_MEM_BASE_INDEX( RAX_CODE, R15_CODE, RCX_CODE );	break;
+		case 8:		MOVZX8_REG_MEM_BASE_INDEX( RAX_CODE, R15_CODE, RCX_CODE );	break;
+		}
+	}
+
+	while( GetAssemblyBuffer()->GetLabel().GetTargetU8P() - site.GetTargetU8P() < FASTMEM_SITE_LENGTH )
+	{
+		NOP();
+	}
+
+	// The slow path leaves loaded values in EAX too
+	const u32 *	p_result( nullptr );
+	if( !is_store )
+	{
+		p_result = op_code.op == OP_LWC1 ? &gCPUState.FPU[ft]._u32 : &gCPUState.CPU[rt]._u32_0;
+	}
+	GenerateFastmemSlowPath( op_code, address, site, GetAssemblyBuffer()->GetLabel(), p_result );
+
+	switch( op_code.op )
+	{
+	case OP_LB:		MOVSX( RAX_CODE, RAX_CODE, true );	StoreRegister32s( rt, RAX_CODE );	break;
+	case OP_LH:		MOVSX( RAX_CODE, RAX_CODE, false );	StoreRegister32s( rt, RAX_CODE );	break;
+	// Top bit is clear, so sign extending is the same as zero extending
+	case OP_LBU:
+	case OP_LHU:
+	case OP_LW:		StoreRegister32s( rt, RAX_CODE );	break;
+	// The 32 bit load cleared the top half
+	case OP_LWU:	StoreRegister64( rt, RAX_CODE );	break;
+	case OP_LWC1:	MOV_MEM_REG( &gCPUState.FPU[ft]._u32, RAX_CODE );	break;
+	}
+}
+
+//*****************************************************************************
+//	Generates the slow path for a fastmem site in the second buffer. It's only
+//	reached once the site has faulted and been patched. The registers are
+//	written back but left cached, so the fast path can carry on afterwards.
+//*****************************************************************************
+void CCodeGeneratorX64::GenerateFastmemSlowPath( OpCode op_code, u32 address, CCodeLabel site, CCodeLabel resume, const u32 * p_result )
+{
+	SetAssemblyBuffer( mpSecondary );
+
+	CCodeLabel	slow_path( GetAssemblyBuffer()->GetLabel() );
+
+	CN64RegisterCacheX64	cache( mRegisterCache );
+	FlushAllRegisters( cache, false );
+
+	for( EIntelReg reg : gFastmemSavedRegisters )
+	{
+		PUSH( reg );
+	}
+
+	SetVar( &gCPUState.CurrentPC, address );
+	MOVI( FIRST_PARAM_REG_CODE, op_code._u32 );
+	CALL( CCodeLabel( (void*)R4300_GetInstructionHandler( op_code ) ) );
+
+	for( s32 i = std::size( gFastmemSavedRegisters ) - 1; i >= 0; --i )
+	{
+		POP( gFastmemSavedRegisters[ i ] );
+	}
+
+	mFastmemExceptionJumps.push_back( GenerateBranchIfNotEqual32( const_cast< u32 * >( &gCPUState.StuffToDo ), 0, CCodeLabel() ) );
+
+	if( p_result != nullptr )
+	{
+		MOV_REG_MEM( RAX_CODE, p_result );
+	}
+	JMPLong( resume );
+
+	SetAssemblyBuffer( mpPrimary );
+
+	Fastmem_AddSite( site.GetTargetU8P(), slow_path.GetTargetU8P() );
+}
+
+// Sets RCX to the host address of base's 32 bit value
+void CCodeGeneratorX64::GenerateAddressBase(EN64Reg base)
+{
+	// 32 bit move clears the top half
+	MOV(RCX_CODE, GetRegisterAndLoad32(base, RCX_CODE));
+	ADD(RCX_CODE, R15_CODE, true);
+}
+
+void CCodeGeneratorX64::GenerateLoad(EN64Reg base, s16 offset, u8 twiddle, u8 bits)
+{
 	if (twiddle == 0)
 	{
 		DAEDALUS_ASSERT_Q(bits == 32);
-		ADD(RCX_CODE, R15_CODE, true);
+		GenerateAddressBase(base);
 		MOV_REG_MEM_BASE_OFFSET(RAX_CODE, RCX_CODE, offset);
 	}
 	else
 	{
+		MOV(RCX_CODE, GetRegisterAndLoad32(base, RCX_CODE));
 		ADDI(RCX_CODE, offset, true);
 		XORI(RCX_CODE, twiddle, true);
 		ADD(RCX_CODE, R15_CODE, true);
@@ -751,10 +1291,7 @@ bool CCodeGeneratorX64::GenerateLW( EN64Reg rt, EN64Reg base, s16 offset )
 	if (gDynarecStackOptimisation && base == N64Reg_SP)
 	{
 		GenerateLoad(base, offset, 0, 32);
-
-		MOV_MEM_REG(&gCPUState.CPU[rt]._u32_0, RAX_CODE);
-		CDQ();
-		MOV_MEM_REG(&gCPUState.CPU[rt]._u32_1, RDX_CODE);
+		StoreRegister32s(rt, RAX_CODE);
 
 		return true;
 	}
@@ -766,8 +1303,7 @@ bool CCodeGeneratorX64::GenerateSWC1( u32 ft, EN64Reg base, s16 offset )
 {
 	if (gDynarecStackOptimisation && base == N64Reg_SP)
 	{
-		MOV_REG_MEM(RCX_CODE, &gCPUState.CPU[base]._u32_0);
-		ADD(RCX_CODE, R15_CODE, true);
+		GenerateAddressBase(base);
 
 		MOV_REG_MEM(RAX_CODE, &gCPUState.FPU[ft]._u32);
 		MOV_MEM_BASE_OFFSET_REG(RCX_CODE, offset, RAX_CODE);
@@ -783,10 +1319,9 @@ bool CCodeGeneratorX64::GenerateSW( EN64Reg rt, EN64Reg base, s16 offset )
 {
 	if (gDynarecStackOptimisation && base == N64Reg_SP)
 	{
-		MOV_REG_MEM(RCX_CODE, &gCPUState.CPU[base]._u32_0);
-		ADD(RCX_CODE, R15_CODE, true);
-		MOV_REG_MEM(RAX_CODE, &gCPUState.CPU[rt]._u32_0);
-		MOV_MEM_BASE_OFFSET_REG(RCX_CODE, offset, RAX_CODE);
+		GenerateAddressBase(base);
+		EIntelReg reg_t = GetRegisterAndLoad32(rt, RAX_CODE);
+		MOV_MEM_BASE_OFFSET_REG(RCX_CODE, offset, reg_t);
 		return true;
 	}
 
@@ -799,9 +1334,7 @@ bool CCodeGeneratorX64::GenerateLB( EN64Reg rt, EN64Reg base, s16 offset )
 	{
 		GenerateLoad(base, offset, U8_TWIDDLE, 8);
 		MOVSX(RAX_CODE, RAX_CODE, true);
-		MOV_MEM_REG(&gCPUState.CPU[rt]._u32_0, RAX_CODE);
-		CDQ();
-		MOV_MEM_REG(&gCPUState.CPU[rt]._u32_1, RDX_CODE);
+		StoreRegister32s(rt, RAX_CODE);
 
 		return true;
 	}
@@ -815,9 +1348,8 @@ bool CCodeGeneratorX64::GenerateLBU( EN64Reg rt, EN64Reg base, s16 offset )
 	{
 		GenerateLoad(base, offset, U8_TWIDDLE, 8);
 		MOVZX(RAX_CODE, RAX_CODE, true);
-		MOV_MEM_REG(&gCPUState.CPU[rt]._u32_0, RAX_CODE);
-		XOR(RDX_CODE, RDX_CODE);
-		MOV_MEM_REG(&gCPUState.CPU[rt]._u32_1, RDX_CODE);
+		// Top bit is clear, so sign extending is the same as zero extending
+		StoreRegister32s(rt, RAX_CODE);
 		return true;
 	}
 
@@ -832,9 +1364,7 @@ bool CCodeGeneratorX64::GenerateLH( EN64Reg rt, EN64Reg base, s16 offset )
 		GenerateLoad(base, offset, U16_TWIDDLE, 16);
 
 		MOVSX(RAX_CODE, RAX_CODE, false);
-		MOV_MEM_REG(&gCPUState.CPU[rt]._u32_0, RAX_CODE);
-		CDQ();
-		MOV_MEM_REG(&gCPUState.CPU[rt]._u32_1, RDX_CODE);
+		StoreRegister32s(rt, RAX_CODE);
 		return true;
 	}
 
@@ -846,10 +1376,9 @@ void CCodeGeneratorX64::GenerateLUI( EN64Reg rt, s16 immediate )
 {
 	if (rt == 0) return;
 
-	MOVI(RAX_CODE, s32(immediate) << 16);
-	CDQ();
-	MOV_MEM_REG(&gCPUState.CPU[rt]._u32_0, RAX_CODE);
-	MOV_MEM_REG(&gCPUState.CPU[rt]._u32_1, RDX_CODE);
+	EIntelReg reg_d = GetRegisterNoLoad(rt, RAX_CODE);
+	MOVI(reg_d, s32(immediate) << 16);
+	StoreRegister32s(rt, reg_d);
 }
 
 //gGPR[op_code.rt]._s64 = gGPR[op_code.rs]._s64 + (s32)(s16)op_code.immediate;
@@ -857,9 +1386,11 @@ void CCodeGeneratorX64::GenerateDADDIU( EN64Reg rt, EN64Reg rs, s16 immediate )
 {
 	if (rt == 0) return;
 
-	MOV64_REG_MEM(RAX_CODE, &gCPUState.CPU[rs]._u64);
-	ADDI(RAX_CODE, immediate, true);
-	MOV64_MEM_REG(&gCPUState.CPU[rt]._u64, RAX_CODE);
+	EIntelReg reg_s = GetRegisterAndLoad64(rs, RAX_CODE);
+	EIntelReg reg_d = GetRegisterNoLoad(rt, RAX_CODE);
+	MOV(reg_d, reg_s, true);
+	ADDI(reg_d, immediate, true);
+	StoreRegister64(rt, reg_d);
 }
 
 // gGPR[op_code.rt]._s64 = (s64)(s32)(gGPR[op_code.rs]._s32_0 + (s32)(s16)op_code.immediate);
@@ -867,11 +1398,11 @@ void CCodeGeneratorX64::GenerateADDIU( EN64Reg rt, EN64Reg rs, s16 immediate )
 {
 	if (rt == 0) return;
 
-	MOV_REG_MEM(RAX_CODE, &gCPUState.CPU[rs]._u32_0);
-	ADDI(RAX_CODE, immediate);
-	CDQ();
-	MOV_MEM_REG(&gCPUState.CPU[rt]._u32_0, RAX_CODE);
-	MOV_MEM_REG(&gCPUState.CPU[rt]._u32_1, RDX_CODE);
+	EIntelReg reg_s = GetRegisterAndLoad32(rs, RAX_CODE);
+	EIntelReg reg_d = GetRegisterNoLoad(rt, RAX_CODE);
+	MOV(reg_d, reg_s);
+	ADDI(reg_d, immediate);
+	StoreRegister32s(rt, reg_d);
 }
 
 //gGPR[op_code.rt]._u64 = gGPR[op_code.rs]._u64 & (u64)(u16)op_code.immediate;
@@ -879,9 +1410,12 @@ void CCodeGeneratorX64::GenerateANDI( EN64Reg rt, EN64Reg rs, u16 immediate )
 {
 	if (rt == 0) return;
 
-	MOV64_REG_MEM(RAX_CODE, &gCPUState.CPU[rs]._u64);
-	ANDI(RAX_CODE, immediate, true);
-	MOV64_MEM_REG(&gCPUState.CPU[rt]._u64, RAX_CODE);
+	// The result always fits in 16 bits, so only the low half matters
+	EIntelReg reg_s = GetRegisterAndLoad32(rs, RAX_CODE);
+	EIntelReg reg_d = GetRegisterNoLoad(rt, RAX_CODE);
+	MOV(reg_d, reg_s);
+	ANDI(reg_d, immediate);
+	StoreRegister32s(rt, reg_d);
 }
 
 //gGPR[op_code.rt]._u64 = gGPR[op_code.rs]._u64 | (u64)(u16)op_code.immediate;
@@ -889,9 +1423,14 @@ void CCodeGeneratorX64::GenerateORI( EN64Reg rt, EN64Reg rs, u16 immediate )
 {
 	if (rt == 0) return;
 
-	MOV64_REG_MEM(RAX_CODE, &gCPUState.CPU[rs]._u64);
-	ORI(RAX_CODE, immediate, true);
-	MOV64_MEM_REG(&gCPUState.CPU[rt]._u64, RAX_CODE);
+	// The immediate doesn't touch the sign bit, so a sign extended source gives a sign extended result
+	bool is64 = !IsSignExtended32(rs);
+	EIntelReg reg_s = is64 ? GetRegisterAndLoad64(rs, RAX_CODE) : GetRegisterAndLoad32(rs, RAX_CODE);
+	EIntelReg reg_d = GetRegisterNoLoad(rt, RAX_CODE);
+	MOV(reg_d, reg_s, is64);
+	ORI(reg_d, immediate, is64);
+	if (is64)	StoreRegister64(rt, reg_d);
+	else		StoreRegister32s(rt, reg_d);
 }
 
 // gGPR[op_code.rt]._u64 = gGPR[op_code.rs]._u64 ^ (u64)(u16)op_code.immediate;
@@ -899,9 +1438,13 @@ void CCodeGeneratorX64::GenerateXORI( EN64Reg rt, EN64Reg rs, u16 immediate )
 {
 	if (rt == 0) return;
 
-	MOV64_REG_MEM(RAX_CODE, &gCPUState.CPU[rs]._u64);
-	XORI(RAX_CODE, immediate, true);
-	MOV64_MEM_REG(&gCPUState.CPU[rt]._u64, RAX_CODE);
+	bool is64 = !IsSignExtended32(rs);
+	EIntelReg reg_s = is64 ? GetRegisterAndLoad64(rs, RAX_CODE) : GetRegisterAndLoad32(rs, RAX_CODE);
+	EIntelReg reg_d = GetRegisterNoLoad(rt, RAX_CODE);
+	MOV(reg_d, reg_s, is64);
+	XORI(reg_d, immediate, is64);
+	if (is64)	StoreRegister64(rt, reg_d);
+	else		StoreRegister32s(rt, reg_d);
 }
 
 // gGPR[ op_code.rd ]._s64 = (s64)(s32)( (gGPR[ op_code.rt ]._u32_0 << op_code.sa) & 0xFFFFFFFF );
@@ -910,11 +1453,11 @@ void CCodeGeneratorX64::GenerateSLL( EN64Reg rd, EN64Reg rt, u32 sa )
 	// NOP
 	if (rd == 0) return;
 
-	MOV_REG_MEM(RAX_CODE, &gCPUState.CPU[rt]._u32_0);
-	SHLI(RAX_CODE, sa);
-	CDQ();
-	MOV_MEM_REG(&gCPUState.CPU[rd]._u32_0, RAX_CODE);
-	MOV_MEM_REG(&gCPUState.CPU[rd]._u32_1, RDX_CODE);
+	EIntelReg reg_t = GetRegisterAndLoad32(rt, RAX_CODE);
+	EIntelReg reg_d = GetRegisterNoLoad(rd, RAX_CODE);
+	MOV(reg_d, reg_t);
+	SHLI(reg_d, sa);
+	StoreRegister32s(rd, reg_d);
 }
 
 // gGPR[ op_code.rd ]._s64 = (s64)(s32)( gGPR[ op_code.rt ]._u32_0 >> op_code.sa );
@@ -922,11 +1465,11 @@ void CCodeGeneratorX64::GenerateSRL( EN64Reg rd, EN64Reg rt, u32 sa )
 {
 	if (rd == 0) return;
 
-	MOV_REG_MEM(RAX_CODE, &gCPUState.CPU[rt]._u32_0);
-	SHRI(RAX_CODE, sa);
-	CDQ();
-	MOV_MEM_REG(&gCPUState.CPU[rd]._u32_0, RAX_CODE);
-	MOV_MEM_REG(&gCPUState.CPU[rd]._u32_1, RDX_CODE);
+	EIntelReg reg_t = GetRegisterAndLoad32(rt, RAX_CODE);
+	EIntelReg reg_d = GetRegisterNoLoad(rd, RAX_CODE);
+	MOV(reg_d, reg_t);
+	SHRI(reg_d, sa);
+	StoreRegister32s(rd, reg_d);
 }
 
 //gGPR[ op_code.rd ]._s64 = (s64)(s32)( gGPR[ op_code.rt ]._s32_0 >> op_code.sa );
@@ -934,22 +1477,37 @@ void CCodeGeneratorX64::GenerateSRA( EN64Reg rd, EN64Reg rt, u32 sa )
 {
 	if (rd == 0) return;
 
-	MOV_REG_MEM(RAX_CODE, &gCPUState.CPU[rt]._u32_0);
-	SARI(RAX_CODE, sa);
-	CDQ();
-	MOV_MEM_REG(&gCPUState.CPU[rd]._u32_0, RAX_CODE);
-	MOV_MEM_REG(&gCPUState.CPU[rd]._u32_1, RDX_CODE);
+	EIntelReg reg_t = GetRegisterAndLoad32(rt, RAX_CODE);
+	EIntelReg reg_d = GetRegisterNoLoad(rd, RAX_CODE);
+	MOV(reg_d, reg_t);
+	SARI(reg_d, sa);
+	StoreRegister32s(rd, reg_d);
 }
 
+//
+//	For the logical ops, if both sources are sign extended 32 bit values then
+//	so is the result, and we can leave the top half alone.
+//
+// Also, for all the three operand ops below: if rd is cached in the same
+// register as rt (but not rs), we'd overwrite rt before using it, so the
+// result is built in RAX instead.
+//
+
 //gGPR[ op_code.rd ]._u64 = gGPR[ op_code.rs ]._u64 | gGPR[ op_code.rt ]._u64;
 void CCodeGeneratorX64::GenerateOR( EN64Reg rd, EN64Reg rs, EN64Reg rt )
 {
 	if (rd == 0) return;
 
-	MOV64_REG_MEM(RAX_CODE, &gCPUState.CPU[rs]._u64);
-	MOV64_REG_MEM(RCX_CODE, &gCPUState.CPU[rt]._u64);
-	OR(RAX_CODE, RCX_CODE, true);
-	MOV64_MEM_REG(&gCPUState.CPU[rd]._u64, RAX_CODE);
+	bool is64 = !(IsSignExtended32(rs) && IsSignExtended32(rt));
+	EIntelReg reg_s = is64 ? GetRegisterAndLoad64(rs, RAX_CODE) : GetRegisterAndLoad32(rs, RAX_CODE);
+	EIntelReg reg_t = is64 ? GetRegisterAndLoad64(rt, RCX_CODE) : GetRegisterAndLoad32(rt, RCX_CODE);
+	EIntelReg reg_d = GetRegisterNoLoad(rd, RAX_CODE);
+	if (reg_d == reg_t && reg_d != reg_s) reg_d = RAX_CODE;
+
+	MOV(reg_d, reg_s, is64);
+	OR(reg_d, reg_t, is64);
+	if (is64)	StoreRegister64(rd, reg_d);
+	else		StoreRegister32s(rd, reg_d);
 }
 
 //gGPR[ op_code.rd ]._u64 = gGPR[ op_code.rs ]._u64 & gGPR[ op_code.rt ]._u64;
@@ -957,10 +1515,16 @@ void CCodeGeneratorX64::GenerateAND( EN64Reg rd, EN64Reg rs, EN64Reg rt )
 {
 	if (rd == 0) return;
 
-	MOV64_REG_MEM(RAX_CODE, &gCPUState.CPU[rs]._u64);
-	MOV64_REG_MEM(RCX_CODE, &gCPUState.CPU[rt]._u64);
-	AND(RAX_CODE, RCX_CODE, true);
-	MOV64_MEM_REG(&gCPUState.CPU[rd]._u64, RAX_CODE);
+	bool is64 = !(IsSignExtended32(rs) && IsSignExtended32(rt));
+	EIntelReg reg_s = is64 ? GetRegisterAndLoad64(rs, RAX_CODE) : GetRegisterAndLoad32(rs, RAX_CODE);
+	EIntelReg reg_t = is64 ? GetRegisterAndLoad64(rt, RCX_CODE) : GetRegisterAndLoad32(rt, RCX_CODE);
+	EIntelReg reg_d = GetRegisterNoLoad(rd, RAX_CODE);
+	if (reg_d == reg_t && reg_d != reg_s) reg_d = RAX_CODE;
+
+	MOV(reg_d, reg_s, is64);
+	AND(reg_d, reg_t, is64);
+	if (is64)	StoreRegister64(rd, reg_d);
+	else		StoreRegister32s(rd, reg_d);
 }
 
 //gGPR[ op_code.rd ]._u64 = gGPR[ op_code.rs ]._u64 ^ gGPR[ op_code.rt ]._u64;
@@ -968,10 +1532,16 @@ void CCodeGeneratorX64::GenerateXOR( EN64Reg rd, EN64Reg rs, EN64Reg rt )
 {
 	if (rd == 0) return;
 
-	MOV64_REG_MEM(RAX_CODE, &gCPUState.CPU[rs]._u64);
-	MOV64_REG_MEM(RCX_CODE, &gCPUState.CPU[rt]._u64);
-	XOR(RAX_CODE, RCX_CODE, true);
-	MOV64_MEM_REG(&gCPUState.CPU[rd]._u64, RAX_CODE);
+	bool is64 = !(IsSignExtended32(rs) && IsSignExtended32(rt));
+	EIntelReg reg_s = is64 ? GetRegisterAndLoad64(rs, RAX_CODE) : GetRegisterAndLoad32(rs, RAX_CODE);
+	EIntelReg reg_t = is64 ? GetRegisterAndLoad64(rt, RCX_CODE) : GetRegisterAndLoad32(rt, RCX_CODE);
+	EIntelReg reg_d = GetRegisterNoLoad(rd, RAX_CODE);
+	if (reg_d == reg_t && reg_d != reg_s) reg_d = RAX_CODE;
+
+	MOV(reg_d, reg_s, is64);
+	XOR(reg_d, reg_t, is64);
+	if (is64)	StoreRegister64(rd, reg_d);
+	else		StoreRegister32s(rd, reg_d);
 }
 
 //gGPR[ op_code.rd ]._u64 = ~(gGPR[ op_code.rs ]._u64 | gGPR[ op_code.rt ]._u64);
@@ -979,11 +1549,17 @@ void CCodeGeneratorX64::GenerateNOR( EN64Reg rd, EN64Reg rs, EN64Reg rt )
 {
 	if (rd == 0) return;
 
-	MOV64_REG_MEM(RAX_CODE, &gCPUState.CPU[rs]._u64);
-	MOV64_REG_MEM(RCX_CODE, &gCPUState.CPU[rt]._u64);
-	OR(RAX_CODE, RCX_CODE, true);
-	NOT(RAX_CODE, true);
-	MOV64_MEM_REG(&gCPUState.CPU[rd]._u64, RAX_CODE);
+	bool is64 = !(IsSignExtended32(rs) && IsSignExtended32(rt));
+	EIntelReg reg_s = is64 ? GetRegisterAndLoad64(rs, RAX_CODE) : GetRegisterAndLoad32(rs, RAX_CODE);
+	EIntelReg reg_t = is64 ? GetRegisterAndLoad64(rt, RCX_CODE) : GetRegisterAndLoad32(rt, RCX_CODE);
+	EIntelReg reg_d = GetRegisterNoLoad(rd, RAX_CODE);
+	if (reg_d == reg_t && reg_d != reg_s) reg_d = RAX_CODE;
+
+	MOV(reg_d, reg_s, is64);
+	OR(reg_d, reg_t, is64);
+	NOT(reg_d, is64);
+	if (is64)	StoreRegister64(rd, reg_d);
+	else		StoreRegister32s(rd, reg_d);
 }
 
 // gGPR[ op_code.rd ]._s64 = (s64)(s32)( gGPR[ op_code.rs ]._s32_0 + gGPR[ op_code.rt ]._s32_0 );
@@ -991,12 +1567,14 @@ void CCodeGeneratorX64::GenerateADDU( EN64Reg rd, EN64Reg rs, EN64Reg rt )
 {
 	if (rd == 0) return;
 
-	MOV_REG_MEM(RAX_CODE, &gCPUState.CPU[rs]._u32_0);
-	MOV_REG_MEM(RCX_CODE, &gCPUState.CPU[rt]._u32_0);
-	ADD(RAX_CODE, RCX_CODE);
-	CDQ();
-	MOV_MEM_REG(&gCPUState.CPU[rd]._u32_0, RAX_CODE);
-	MOV_MEM_REG(&gCPUState.CPU[rd]._u32_1, RDX_CODE);
+	EIntelReg reg_s = GetRegisterAndLoad32(rs, RAX_CODE);
+	EIntelReg reg_t = GetRegisterAndLoad32(rt, RCX_CODE);
+	EIntelReg reg_d = GetRegisterNoLoad(rd, RAX_CODE);
+	if (reg_d == reg_t && reg_d != reg_s) reg_d = RAX_CODE;
+
+	MOV(reg_d, reg_s);
+	ADD(reg_d, reg_t);
+	StoreRegister32s(rd, reg_d);
 }
 
 // 	gGPR[ op_code.rd ]._u64 = gGPR[ op_code.rs ]._u64 + gGPR[ op_code.rt ]._u64;
@@ -1004,10 +1582,14 @@ void CCodeGeneratorX64::GenerateDADDU( EN64Reg rd, EN64Reg rs, EN64Reg rt )
 {
 	if (rd == 0) return;
 
-	MOV64_REG_MEM(RAX_CODE, &gCPUState.CPU[rs]._u64);
-	MOV64_REG_MEM(RCX_CODE, &gCPUState.CPU[rt]._u64);
-	ADD(RAX_CODE, RCX_CODE, true);
-	MOV64_MEM_REG(&gCPUState.CPU[rd]._u64, RAX_CODE);
+	EIntelReg reg_s = GetRegisterAndLoad64(rs, RAX_CODE);
+	EIntelReg reg_t = GetRegisterAndLoad64(rt, RCX_CODE);
+	EIntelReg reg_d = GetRegisterNoLoad(rd, RAX_CODE);
+	if (reg_d == reg_t && reg_d != reg_s) reg_d = RAX_CODE;
+
+	MOV(reg_d, reg_s, true);
+	ADD(reg_d, reg_t, true);
+	StoreRegister64(rd, reg_d);
 }
 
 //	gGPR[ op_code.rd ]._s64 = (s64)(s32)( gGPR[ op_code.rs ]._s32_0 - gGPR[ op_code.rt ]._s32_0 );
@@ -1015,12 +1597,14 @@ void CCodeGeneratorX64::GenerateSUBU( EN64Reg rd, EN64Reg rs, EN64Reg rt )
 {
 	if (rd == 0) return;
 
-	MOV_REG_MEM(RAX_CODE, &gCPUState.CPU[rs]._u32_0);
-	MOV_REG_MEM(RCX_CODE, &gCPUState.CPU[rt]._u32_0);
-	SUB(RAX_CODE, RCX_CODE);
-	CDQ();
-	MOV_MEM_REG(&gCPUState.CPU[rd]._u32_0, RAX_CODE);
-	MOV_MEM_REG(&gCPUState.CPU[rd]._u32_1, RDX_CODE);
+	EIntelReg reg_s = GetRegisterAndLoad32(rs, RAX_CODE);
+	EIntelReg reg_t = GetRegisterAndLoad32(rt, RCX_CODE);
+	EIntelReg reg_d = GetRegisterNoLoad(rd, RAX_CODE);
+	if (reg_d == reg_t && reg_d != reg_s) reg_d = RAX_CODE;
+
+	MOV(reg_d, reg_s);
+	SUB(reg_d, reg_t);
+	StoreRegister32s(rd, reg_d);
 }
 
 //gGPR[ op_code.rd ]._u64 = gGPR[ op_code.rs ]._u64 - gGPR[ op_code.rt ]._u64;
@@ -1028,10 +1612,14 @@ void CCodeGeneratorX64::GenerateDSUBU( EN64Reg rd, EN64Reg rs, EN64Reg rt )
 {
 	if (rd == 0) return;
 
-	MOV64_REG_MEM(RAX_CODE, &gCPUState.CPU[rs]._u64);
-	MOV64_REG_MEM(RCX_CODE, &gCPUState.CPU[rt]._u64);
-	SUB(RAX_CODE, RCX_CODE, true);
-	MOV64_MEM_REG(&gCPUState.CPU[rd]._u64, RAX_CODE);
+	EIntelReg reg_s = GetRegisterAndLoad64(rs, RAX_CODE);
+	EIntelReg reg_t = GetRegisterAndLoad64(rt, RCX_CODE);
+	EIntelReg reg_d = GetRegisterNoLoad(rd, RAX_CODE);
+	if (reg_d == reg_t && reg_d != reg_s) reg_d = RAX_CODE;
+
+	MOV(reg_d, reg_s, true);
+	SUB(reg_d, reg_t, true);
+	StoreRegister64(rd, reg_d);
 }
 
 bool CCodeGeneratorX64::GenerateLWC1( u32 ft, EN64Reg base, s16 offset )
@@ -1049,13 +1637,504 @@ bool CCodeGeneratorX64::GenerateLWC1( u32 ft, EN64Reg base, s16 offset )
 
 void	CCodeGeneratorX64::GenerateJAL( u32 address )
 {
-	MOVI(RAX_CODE, address + 8);
-	CDQ();
-	MOV_MEM_REG(&gCPUState.CPU[N64Reg_RA]._u32_0, RAX_CODE);
-	MOV_MEM_REG(&gCPUState.CPU[N64Reg_RA]._u32_1, RDX_CODE);
+	// Push the cache for our return address, for the JR RA at the end of the call
+	SIndirectExitCache *	p_cache( AllocateIndirectExitCache( address + 8 ) );
+
+	MOV_REG_MEM( RAX_CODE, &gReturnAddressStack.Top );
+	ADDI( RAX_CODE, 1 );
+	ANDI( RAX_CODE, SReturnAddressStack::SIZE - 1 );
+	MOV_MEM_REG( &gReturnAddressStack.Top, RAX_CODE );
+	LEA( RCX_CODE, gReturnAddressStack.Entries );
+	MOVI_64( RDX_CODE, reinterpret_cast< uintptr_t >( p_cache ) );
+	MOV64_MEM_BASE_INDEXx8_REG( RCX_CODE, RAX_CODE, RDX_CODE );
+
+	EIntelReg reg_d = GetRegisterNoLoad(N64Reg_RA, RAX_CODE);
+	MOVI(reg_d, address + 8);
+	StoreRegister32s(N64Reg_RA, reg_d);
 }
 
 void	CCodeGeneratorX64::GenerateJR( EN64Reg rs)
 {
 	//TODO
 }
+
+//*****************************************************************************
+//	Makes SSE instructions round the way we want. The interpreter changes the
+//	rounding mode behind our back, so we only know what it is once we've set it
+//	in this fragment, and forget again whenever we call out to C.
+//*****************************************************************************
+void	CCodeGeneratorX64::SetHostRoundingMode( EHostRoundingMode mode )
+{
+	if( mHostRoundingMode == mode )
+	{
+		return;
+	}
+
+	switch( mode )
+	{
+	case HRM_N64:
+		// FCR31 has nearest, zero, up, down where MXCSR has nearest, down, up, zero,
+		// so swap the odd ones with rm ^ ((rm & 1) << 1)
+		MOV_REG_MEM( RAX_CODE, &gCPUState.FPUControl[ 31 ]._u32 );
+		ANDI( RAX_CODE, FPCSR_RM_MASK );
+		MOV( RCX_CODE, RAX_CODE );
+		ANDI( RCX_CODE, 1 );
+		SHLI( RCX_CODE, 1 );
+		XOR( RAX_CODE, RCX_CODE );
+		SHLI( RAX_CODE, MXCSR_RC_SHIFT );
+		ORI( RAX_CODE, MXCSR_DEFAULT );
+		MOV_MEM_REG( &gMXCSR, RAX_CODE );
+		break;
+	case HRM_NEAREST:	MOVI_MEM( &gMXCSR, MXCSR_DEFAULT | (0 << MXCSR_RC_SHIFT) ); break;
+	case HRM_FLOOR:		MOVI_MEM( &gMXCSR, MXCSR_DEFAULT | (1 << MXCSR_RC_SHIFT) ); break;
+	case HRM_CEIL:		MOVI_MEM( &gMXCSR, MXCSR_DEFAULT | (2 << MXCSR_RC_SHIFT) ); break;
+	case HRM_TRUNC:		MOVI_MEM( &gMXCSR, MXCSR_DEFAULT | (3 << MXCSR_RC_SHIFT) ); break;
+	case HRM_UNKNOWN:
+		#ifdef DAEDALUS_ENABLE_ASSERTS
+		DAEDALUS_ERROR( "Can't set an unknown rounding mode" );
+		#endif
+		return;
+	}
+
+	LDMXCSR( &gMXCSR );
+	mHostRoundingMode = mode;
+}
+
+//*****************************************************************************
+//	Returns false if the instruction should go through the interpreter
+//*****************************************************************************
+bool	CCodeGeneratorX64::GenerateCOP1( OpCode op_code )
+{
+	// Indexed by the bottom four bits of the C.cond.fmt function
+	static const EFPUCompare	compares[ 16 ] =
+	{
+		FPU_CMP_F,		// F
+		FPU_CMP_UN,		// UN
+		FPU_CMP_EQ,		// EQ
+		FPU_CMP_UEQ,	// UEQ
+		FPU_CMP_OLT,	// OLT
+		FPU_CMP_ULT,	// ULT
+		FPU_CMP_OLE,	// OLE
+		FPU_CMP_ULE,	// ULE
+		FPU_CMP_F,		// SF
+		FPU_CMP_F,		// NGLE
+		FPU_CMP_EQ,		// SEQ
+		FPU_CMP_EQ,		// NGL
+		FPU_CMP_OLT,	// LT
+		FPU_CMP_OLT,	// NGE
+		FPU_CMP_OLE,	// LE
+		FPU_CMP_OLE,	// NGT
+	};
+
+	const EN64Reg	rt = EN64Reg( op_code.rt );
+	const u32		fd = op_code.fd;
+	const u32		fs = op_code.fs;
+	const u32		ft = op_code.ft;
+
+	switch( op_code.cop1_op )
+	{
+	case Cop1Op_MFC1:	GenerateMFC1( rt, fs ); return true;
+	case Cop1Op_DMFC1:	GenerateDMFC1( rt, fs ); return true;
+	case Cop1Op_CFC1:	GenerateCFC1( rt, fs ); return true;
+	case Cop1Op_MTC1:	GenerateMTC1( fs, rt ); return true;
+	case Cop1Op_DMTC1:	GenerateDMTC1( fs, rt ); return true;
+
+	// CTC1 is left to the interpreter, as it has to update the rounding mode
+
+	case Cop1Op_SInstr:
+	case Cop1Op_DInstr:
+		{
+			const bool	is_double = op_code.cop1_op == Cop1Op_DInstr;
+
+			if( op_code.cop1_funct >= Cop1OpFunc_CMP_F )
+			{
+				GenerateCMP( fs, ft, compares[ op_code.cop1_funct - Cop1OpFunc_CMP_F ], is_double );
+				return true;
+			}
+
+			switch( op_code.cop1_funct )
+			{
+			case Cop1OpFunc_ROUND_L:	GenerateFloatToInt( fd, fs, is_double, true, HRM_NEAREST ); return true;
+			case Cop1OpFunc_TRUNC_L:	GenerateFloatToInt( fd, fs, is_double, true, HRM_TRUNC ); return true;
+			case Cop1OpFunc_CEIL_L:		GenerateFloatToInt( fd, fs, is_double, true, HRM_CEIL ); return true;
+			case Cop1OpFunc_FLOOR_L:	GenerateFloatToInt( fd, fs, is_double, true, HRM_FLOOR ); return true;
+			case Cop1OpFunc_ROUND_W:	GenerateFloatToInt( fd, fs, is_double, false, HRM_NEAREST ); return true;
+			case Cop1OpFunc_TRUNC_W:	GenerateFloatToInt( fd, fs, is_double, false, HRM_TRUNC ); return true;
+			case Cop1OpFunc_CEIL_W:		GenerateFloatToInt( fd, fs, is_double, false, HRM_CEIL ); return true;
+			case Cop1OpFunc_FLOOR_W:	GenerateFloatToInt( fd, fs, is_double, false, HRM_FLOOR ); return true;
+			case Cop1OpFunc_CVT_W:		GenerateFloatToInt( fd, fs, is_double, false, HRM_N64 ); return true;
+			case Cop1OpFunc_CVT_L:		GenerateFloatToInt( fd, fs, is_double, true, HRM_N64 ); return true;
+			}
+
+			if( is_double )
+			{
+				switch( op_code.cop1_funct )
+				{
+				case Cop1OpFunc_ADD:	GenerateADD_D( fd, fs, ft ); return true;
+				case Cop1OpFunc_SUB:	GenerateSUB_D( fd, fs, ft ); return true;
+				case Cop1OpFunc_MUL:	GenerateMUL_D( fd, fs, ft ); return true;
+				case Cop1OpFunc_DIV:	GenerateDIV_D( fd, fs, ft ); return true;
+				case Cop1OpFunc_SQRT:	GenerateSQRT_D( fd, fs ); return true;
+				case Cop1OpFunc_ABS:	GenerateABS_D( fd, fs ); return true;
+				case Cop1OpFunc_MOV:	GenerateMOV_D( fd, fs ); return true;
+				case Cop1OpFunc_NEG:	GenerateNEG_D( fd, fs ); return true;
+				case Cop1OpFunc_CVT_S:	GenerateCVT_S_D( fd, fs ); return true;
+				}
+			}
+			else
+			{
+				switch( op_code.cop1_funct )
+				{
+				case Cop1OpFunc_ADD:	GenerateADD_S( fd, fs, ft ); return true;
+				case Cop1OpFunc_SUB:	GenerateSUB_S( fd, fs, ft ); return true;
+				case Cop1OpFunc_MUL:	GenerateMUL_S( fd, fs, ft ); return true;
+				case Cop1OpFunc_DIV:	GenerateDIV_S( fd, fs, ft ); return true;
+				case Cop1OpFunc_SQRT:	GenerateSQRT_S( fd, fs ); return true;
+				case Cop1OpFunc_ABS:	GenerateABS_S( fd, fs ); return true;
+				case Cop1OpFunc_MOV:	GenerateMOV_S( fd, fs ); return true;
+				case Cop1OpFunc_NEG:	GenerateNEG_S( fd, fs ); return true;
+				case Cop1OpFunc_CVT_D:	GenerateCVT_D_S( fd, fs ); return true;
+				}
+			}
+		}
+		break;
+
+	case Cop1Op_WInstr:
+	case Cop1Op_LInstr:
+		{
+			const bool	is_long = op_code.cop1_op == Cop1Op_LInstr;
+
+			switch( op_code.cop1_funct )
+			{
+			case Cop1OpFunc_CVT_S:	GenerateIntToFloat( fd, fs, is_long, false ); return true;
+			case Cop1OpFunc_CVT_D:	GenerateIntToFloat( fd, fs, is_long, true ); return true;
+			}
+		}
+		break;
+	}
+
+	return false;
+}
+
+// gGPR[op_code.rt]._s64 = (s64)(s32)gCPUState.FPU[op_code.fs]._s32;
+void	CCodeGeneratorX64::GenerateMFC1( EN64Reg rt, u32 fs )
+{
+	if (rt == 0) return;
+
+	EIntelReg reg_d = GetRegisterNoLoad(rt, RAX_CODE);
+	MOV_REG_MEM(reg_d, FPRWord(fs));
+	StoreRegister32s(rt, reg_d);
+}
+
+// gGPR[op_code.rt]._s64 = LoadFPR_Long(op_code.fs);
+void	CCodeGeneratorX64::GenerateDMFC1( EN64Reg rt, u32 fs )
+{
+	if (rt == 0) return;
+
+	EIntelReg reg_d = GetRegisterNoLoad(rt, RAX_CODE);
+	MOV64_REG_MEM(reg_d, FPRLong(fs));
+	StoreRegister64(rt, reg_d);
+}
+
+// gCPUState.FPU[op_code.fs]._u32 = gGPR[op_code.rt]._u32_0;
+void	CCodeGeneratorX64::GenerateMTC1( u32 fs, EN64Reg rt )
+{
+	EIntelReg reg_t = GetRegisterAndLoad32(rt, RAX_CODE);
+	MOV_MEM_REG(FPRWord(fs), reg_t);
+}
+
+// StoreFPR_Long(op_code.fs, gGPR[op_code.rt]._u64);
+void	CCodeGeneratorX64::GenerateDMTC1( u32 fs, EN64Reg rt )
+{
+	EIntelReg reg_t = GetRegisterAndLoad64(rt, RAX_CODE);
+	MOV64_MEM_REG(FPRLong(fs), reg_t);
+}
+
+// gGPR[op_code.rt]._s64 = (s64)gCPUState.FPUControl[op_code.fs]._s32;
+void	CCodeGeneratorX64::GenerateCFC1( EN64Reg rt, u32 fs )
+{
+	// Only defined for reg 0 or 31
+	if (rt == 0 || (fs != 0 && fs != 31)) return;
+
+	EIntelReg reg_d = GetRegisterNoLoad(rt, RAX_CODE);
+	MOV_REG_MEM(reg_d, &gCPUState.FPUControl[fs]._u32);
+	StoreRegister32s(rt, reg_d);
+}
+
+//*****************************************************************************
+//	Single precision
+//*****************************************************************************
+void	CCodeGeneratorX64::GenerateADD_S( u32 fd, u32 fs, u32 ft )
+{
+	SetHostRoundingMode( HRM_N64 );
+	MOVSS_REG_MEM( XMM0_CODE, FPRWord(fs) );
+	MOVSS_REG_MEM( XMM1_CODE, FPRWord(ft) );
+	ADDSS( XMM0_CODE, XMM1_CODE );
+	MOVSS_MEM_REG( FPRWord(fd), XMM0_CODE );
+}
+
+void	CCodeGeneratorX64::GenerateSUB_S( u32 fd, u32 fs, u32 ft )
+{
+	SetHostRoundingMode( HRM_N64 );
+	MOVSS_REG_MEM( XMM0_CODE, FPRWord(fs) );
+	MOVSS_REG_MEM( XMM1_CODE, FPRWord(ft) );
+	SUBSS( XMM0_CODE, XMM1_CODE );
+	MOVSS_MEM_REG( FPRWord(fd), XMM0_CODE );
+}
+
+void	CCodeGeneratorX64::GenerateMUL_S( u32 fd, u32 fs, u32 ft )
+{
+	SetHostRoundingMode( HRM_N64 );
+	MOVSS_REG_MEM( XMM0_CODE, FPRWord(fs) );
+	MOVSS_REG_MEM( XMM1_CODE, FPRWord(ft) );
+	MULSS( XMM0_CODE, XMM1_CODE );
+	MOVSS_MEM_REG( FPRWord(fd), XMM0_CODE );
+}
+
+void	CCodeGeneratorX64::GenerateDIV_S( u32 fd, u32 fs, u32 ft )
+{
+	SetHostRoundingMode( HRM_N64 );
+	MOVSS_REG_MEM( XMM0_CODE, FPRWord(fs) );
+	MOVSS_REG_MEM( XMM1_CODE, FPRWord(ft) );
+	DIVSS( XMM0_CODE, XMM1_CODE );
+	MOVSS_MEM_REG( FPRWord(fd), XMM0_CODE );
+}
+
+void	CCodeGeneratorX64::GenerateSQRT_S( u32 fd, u32 fs )
+{
+	SetHostRoundingMode( HRM_N64 );
+	MOVSS_REG_MEM( XMM0_CODE, FPRWord(fs) );
+	SQRTSS( XMM0_CODE, XMM0_CODE );
+	MOVSS_MEM_REG( FPRWord(fd), XMM0_CODE );
+}
+
+// ABS, MOV and NEG only touch the sign bit, so there's no need to go near the SSE unit
+void	CCodeGeneratorX64::GenerateABS_S( u32 fd, u32 fs )
+{
+	MOV_REG_MEM( RAX_CODE, FPRWord(fs) );
+	ANDI( RAX_CODE, 0x7fffffff );
+	MOV_MEM_REG( FPRWord(fd), RAX_CODE );
+}
+
+void	CCodeGeneratorX64::GenerateMOV_S( u32 fd, u32 fs )
+{
+	MOV_REG_MEM( RAX_CODE, FPRWord(fs) );
+	MOV_MEM_REG( FPRWord(fd), RAX_CODE );
+}
+
+void	CCodeGeneratorX64::GenerateNEG_S( u32 fd, u32 fs )
+{
+	MOV_REG_MEM( RAX_CODE, FPRWord(fs) );
+	XORI( RAX_CODE, 0x80000000 );
+	MOV_MEM_REG( FPRWord(fd), RAX_CODE );
+}
+
+// Every single is exactly representable as a double
+void	CCodeGeneratorX64::GenerateCVT_D_S( u32 fd, u32 fs )
+{
+	MOVSS_REG_MEM( XMM0_CODE, FPRWord(fs) );
+	CVTSS2SD( XMM0_CODE, XMM0_CODE );
+	MOVSD_MEM_REG( FPRLong(fd), XMM0_CODE );
+}
+
+//*****************************************************************************
+//	Double precision
+//*****************************************************************************
+void	CCodeGeneratorX64::GenerateADD_D( u32 fd, u32 fs, u32 ft )
+{
+	SetHostRoundingMode( HRM_N64 );
+	MOVSD_REG_MEM( XMM0_CODE, FPRLong(fs) );
+	MOVSD_REG_MEM( XMM1_CODE, FPRLong(ft) );
+	ADDSD( XMM0_CODE, XMM1_CODE );
+	MOVSD_MEM_REG( FPRLong(fd), XMM0_CODE );
+}
+
+void	CCodeGeneratorX64::GenerateSUB_D( u32 fd, u32 fs, u32 ft )
+{
+	SetHostRoundingMode( HRM_N64 );
+	MOVSD_REG_MEM( XMM0_CODE, FPRLong(fs) );
+	MOVSD_REG_MEM( XMM1_CODE, FPRLong(ft) );
+	SUBSD( XMM0_CODE, XMM1_CODE );
+	MOVSD_MEM_REG( FPRLong(fd), XMM0_CODE );
+}
+
+void	CCodeGeneratorX64::GenerateMUL_D( u32 fd, u32 fs, u32 ft )
+{
+	SetHostRoundingMode( HRM_N64 );
+	MOVSD_REG_MEM( XMM0_CODE, FPRLong(fs) );
+	MOVSD_REG_MEM( XMM1_CODE, FPRLong(ft) );
+	MULSD( XMM0_CODE, XMM1_CODE );
+	MOVSD_MEM_REG( FPRLong(fd), XMM0_CODE );
+}
+
+void	CCodeGeneratorX64::GenerateDIV_D( u32 fd, u32 fs, u32 ft )
+{
+	SetHostRoundingMode( HRM_N64 );
+	MOVSD_REG_MEM( XMM0_CODE, FPRLong(fs) );
+	MOVSD_REG_MEM( XMM1_CODE, FPRLong(ft) );
+	DIVSD( XMM0_CODE, XMM1_CODE );
+	MOVSD_MEM_REG( FPRLong(fd), XMM0_CODE );
+}
+
+void	CCodeGeneratorX64::GenerateSQRT_D( u32 fd, u32 fs )
+{
+	SetHostRoundingMode( HRM_N64 );
+	MOVSD_REG_MEM( XMM0_CODE, FPRLong(fs) );
+	SQRTSD( XMM0_CODE, XMM0_CODE );
+	MOVSD_MEM_REG( FPRLong(fd), XMM0_CODE );
+}
+
+void	CCodeGeneratorX64::GenerateABS_D( u32 fd, u32 fs )
+{
+	MOV64_REG_MEM( RAX_CODE, FPRLong(fs) );
+	MOVI_64( RCX_CODE, 0x7fffffffffffffffULL );
+	AND( RAX_CODE, RCX_CODE, true );
+	MOV64_MEM_REG( FPRLong(fd), RAX_CODE );
+}
+
+void	CCodeGeneratorX64::GenerateMOV_D( u32 fd, u32 fs )
+{
+	MOV64_REG_MEM( RAX_CODE, FPRLong(fs) );
+	MOV64_MEM_REG( FPRLong(fd), RAX_CODE );
+}
+
+void	CCodeGeneratorX64::GenerateNEG_D( u32 fd, u32 fs )
+{
+	MOV64_REG_MEM( RAX_CODE, FPRLong(fs) );
+	MOVI_64( RCX_CODE, 0x8000000000000000ULL );
+	XOR( RAX_CODE, RCX_CODE, true );
+	MOV64_MEM_REG( FPRLong(fd), RAX_CODE );
+}
+
+void	CCodeGeneratorX64::GenerateCVT_S_D( u32 fd, u32 fs )
+{
+	SetHostRoundingMode( HRM_N64 );
+	MOVSD_REG_MEM( XMM0_CODE, FPRLong(fs) );
+	CVTSD2SS( XMM0_CODE, XMM0_CODE );
+	MOVSS_MEM_REG( FPRWord(fd), XMM0_CODE );
+}
+
+//*****************************************************************************
+//	ROUND, TRUNC, CEIL, FLOOR and CVT to W or L. Out of range values and NaNs
+//	come out as 0x80000000 (or 0x8000000000000000), as they do in the interpreter.
+//*****************************************************************************
+void	CCodeGeneratorX64::GenerateFloatToInt( u32 fd, u32 fs, bool double_src, bool long_dst, EHostRoundingMode mode )
+{
+	// Truncating doesn't need MXCSR
+	const bool	truncate = mode == HRM_TRUNC;
+	if( !truncate )
+	{
+		SetHostRoundingMode( mode );
+	}
+
+	if( double_src )
+	{
+		MOVSD_REG_MEM( XMM0_CODE, FPRLong(fs) );
+		if( truncate )	CVTTSD2SI( RAX_CODE, XMM0_CODE, long_dst );
+		else			CVTSD2SI( RAX_CODE, XMM0_CODE, long_dst );
+	}
+	else
+	{
+		MOVSS_REG_MEM( XMM0_CODE, FPRWord(fs) );
+		if( truncate )	CVTTSS2SI( RAX_CODE, XMM0_CODE, long_dst );
+		else			CVTSS2SI( RAX_CODE, XMM0_CODE, long_dst );
+	}
+
+	if( long_dst )
+	{
+		MOV64_MEM_REG( FPRLong(fd), RAX_CODE );
+	}
+	else
+	{
+		MOV_MEM_REG( FPRWord(fd), RAX_CODE );
+	}
+}
+
+//*****************************************************************************
+//	CVT.S/D from W or L
+//*****************************************************************************
+void	CCodeGeneratorX64::GenerateIntToFloat( u32 fd, u32 fs, bool long_src, bool double_dst )
+{
+	// Only a W to D conversion is always exact
+	if( long_src || !double_dst )
+	{
+		SetHostRoundingMode( HRM_N64 );
+	}
+
+	if( long_src )
+	{
+		MOV64_REG_MEM( RAX_CODE, FPRLong(fs) );
+	}
+	else
+	{
+		MOV_REG_MEM( RAX_CODE, FPRWord(fs) );
+	}
+
+	if( double_dst )
+	{
+		CVTSI2SD( XMM0_CODE, RAX_CODE, long_src );
+		MOVSD_MEM_REG( FPRLong(fd), XMM0_CODE );
+	}
+	else
+	{
+		CVTSI2SS( XMM0_CODE, RAX_CODE, long_src );
+		MOVSS_MEM_REG( FPRWord(fd), XMM0_CODE );
+	}
+}
+
+//*****************************************************************************
+//	C.cond.S/D - sets or clears the condition bit in FCR31
+//*****************************************************************************
+void	CCodeGeneratorX64::GenerateCMP( u32 fs, u32 ft, EFPUCompare cond, bool is_double )
+{
+	u32 *	p_fcr31( &gCPUState.FPUControl[ 31 ]._u32 );
+
+	if( cond != FPU_CMP_F )
+	{
+		// UCOMIS sets ZF, PF and CF for unordered. Comparing the other way round
+		// for the ordered less than tests means unordered clears the flag we test
+		const bool	swap = cond == FPU_CMP_OLT || cond == FPU_CMP_OLE;
+		const u32	first = swap ? ft : fs;
+		const u32	second = swap ? fs : ft;
+
+		// SETcc only writes the bottom byte
+		XOR( RAX_CODE, RAX_CODE );
+		XOR( RCX_CODE, RCX_CODE );
+
+		if( is_double )
+		{
+			MOVSD_REG_MEM( XMM0_CODE, FPRLong(first) );
+			MOVSD_REG_MEM( XMM1_CODE, FPRLong(second) );
+			UCOMISD( XMM0_CODE, XMM1_CODE );
+		}
+		else
+		{
+			MOVSS_REG_MEM( XMM0_CODE, FPRWord(first) );
+			MOVSS_REG_MEM( XMM1_CODE, FPRWord(second) );
+			UCOMISS( XMM0_CODE, XMM1_CODE );
+		}
+
+		switch( cond )
+		{
+		case FPU_CMP_UN:	SETP( RAX_CODE ); break;
+		case FPU_CMP_EQ:	SETE( RAX_CODE ); SETNP( RCX_CODE ); AND( RAX_CODE, RCX_CODE ); break;
+		case FPU_CMP_UEQ:	SETE( RAX_CODE ); break;
+		case FPU_CMP_OLT:	SETA( RAX_CODE ); break;		// ft > fs
+		case FPU_CMP_ULT:	SETB( RAX_CODE ); break;
+		case FPU_CMP_OLE:	SETAE( RAX_CODE ); break;		// ft >= fs
+		case FPU_CMP_ULE:	SETBE( RAX_CODE ); break;
+		case FPU_CMP_F:		break;
+		}
+
+		static_assert( FPCSR_C == (1 << 23), "Shift doesn't match FPCSR_C" );
+		SHLI( RAX_CODE, 23 );
+	}
+
+	MOV_REG_MEM( RCX_CODE, p_fcr31 );
+	ANDI( RCX_CODE, ~FPCSR_C );
+	if( cond != FPU_CMP_F )
+	{
+		OR( RCX_CODE, RAX_CODE );
+	}
+	MOV_MEM_REG( p_fcr31, RCX_CODE );
+}
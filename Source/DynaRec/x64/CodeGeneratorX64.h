@@ -23,10 +23,18 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define SYSW32_DYNAREC_X64_CODEGENERATORX64_H_
 
 #include "DynaRec/CodeGenerator.h"
+#include "DynaRec/N64RegisterCache.h"
 #include "DynaRec/TraceRecorder.h"
 #include "AssemblyWriterX64.h"
 #include "DynarecTargetX64.h"
 
+#include <stack>
+
+struct SIndirectExitCache;
+
+// Registers are held whole in a single native register, so only the lo entry is used
+using CN64RegisterCacheX64 = CN64RegisterCache<EIntelReg>;
+
 // XXXX For GenerateCompare_S/D
 #define FLAG_SWAP			0x100
 #define FLAG_C_LT		(0x41)					// jne-   le
@@ -83,7 +91,27 @@ class CCodeGeneratorX64 : public CCodeGenerator, public CAssemblyWriterX64
 
 				void				GenerateGenericR4300( OpCode op_code, CPU_Instruction p_instruction );
 
+				SIndirectExitCache *	AllocateIndirectExitCache( u32 address );
+
 				void				GenerateExceptionHander( ExceptionHandlerFn p_exception_handler_fn, const std::vector< CJumpLocation > & exception_handler_jumps, const std::vector<RegisterSnapshotHandle>& exception_handler_snapshots );
+
+				void				SetRegisterSpanList( const SRegisterUsageInfo & register_usage );
+				void				ExpireOldIntervals( u32 instruction_idx );
+				void				SpillAtInterval( const SRegisterSpan & live_span );
+
+				const CN64RegisterCacheX64 &	GetRegisterCacheFromHandle( RegisterSnapshotHandle snapshot ) const;
+
+				bool				HasDirtyRegisters( const CN64RegisterCacheX64 & cache ) const;
+				void				FlushRegister( CN64RegisterCacheX64 & cache, EN64Reg n64_reg, bool invalidate );
+				void				FlushAllRegisters( CN64RegisterCacheX64 & cache, bool invalidate );
+
+				bool				IsSignExtended32( EN64Reg n64_reg ) const;
+				EIntelReg			GetRegisterAndLoad32( EN64Reg n64_reg, EIntelReg scratch_reg );
+				EIntelReg			GetRegisterAndLoad64( EN64Reg n64_reg, EIntelReg scratch_reg );
+				EIntelReg			GetRegisterNoLoad( EN64Reg n64_reg, EIntelReg scratch_reg );
+				void				StoreRegister32s( EN64Reg n64_reg, EIntelReg src_reg );
+				void				StoreRegister64( EN64Reg n64_reg, EIntelReg src_reg );
+
 	private:
 				bool				mSpCachedInESI;		// Is sp cached in ESI?
 				u32					mSetSpPostUpdate;	// Set Sp base counter after this update
@@ -91,9 +119,53 @@ class CCodeGeneratorX64 : public CCodeGenerator, public CAssemblyWriterX64
 				CAssemblyBuffer *	mpPrimary;
 				CAssemblyBuffer *	mpSecondary;
 
+				RegisterSpanList	mRegisterSpanList;
+
+				// For register allocation
+				RegisterSpanList	mActiveIntervals;
+				std::stack<EIntelReg>	mAvailableRegisters;
+
+				std::vector< CN64RegisterCacheX64 >	mRegisterSnapshots;
+				CN64RegisterCacheX64	mRegisterCache;
+
+				// Jumps from fastmem slow paths, to be pointed at the exception handler
+				bool						mUseFastmem;
+				std::vector< CJumpLocation >	mFastmemExceptionJumps;
+
+				// What MXCSR is known to be rounding with at this point in the fragment.
+				// HRM_N64 means it matches the rounding mode bits of FCR31.
+				enum EHostRoundingMode
+				{
+					HRM_UNKNOWN,
+					HRM_N64,
+					HRM_NEAREST,
+					HRM_TRUNC,
+					HRM_CEIL,
+					HRM_FLOOR,
+				};
+				EHostRoundingMode			mHostRoundingMode;
+
+				// The distinct C.cond.fmt tests. The signalling forms test the same as their quiet ones
+				enum EFPUCompare
+				{
+					FPU_CMP_F,			// false
+					FPU_CMP_UN,			// unordered
+					FPU_CMP_EQ,			// ordered and equal
+					FPU_CMP_UEQ,		// unordered or equal
+					FPU_CMP_OLT,		// ordered and less than
+					FPU_CMP_ULT,		// unordered or less than
+					FPU_CMP_OLE,		// ordered and less than or equal
+					FPU_CMP_ULE,		// unordered or less than or equal
+				};
+
 	private:
+				void	GenerateAddressBase(EN64Reg base);
 				void	GenerateLoad(EN64Reg base, s16 offset, u8 twiddle, u8 bits);
 				void	GenerateCACHE( EN64Reg base, s16 offset, u32 cache_op );
+
+				bool	GenerateLoadStore( OpCode op_code, u32 address );
+				void	GenerateFastmemAccess( OpCode op_code, u32 address );
+				void	GenerateFastmemSlowPath( OpCode op_code, u32 address, CCodeLabel site, CCodeLabel resume, const u32 * p_result );
 				bool	GenerateLW(EN64Reg rt, EN64Reg base, s16 offset );
 				bool	GenerateSW(EN64Reg rt, EN64Reg base, s16 offset );
 				bool	GenerateSWC1( u32 ft, EN64Reg base, s16 offset );
@@ -127,6 +199,40 @@ class CCodeGeneratorX64 : public CCodeGenerator, public CAssemblyWriterX64
 
 				void 	GenerateDADDU( EN64Reg rd, EN64Reg rs, EN64Reg rt );
 				void	GenerateDSUBU( EN64Reg rd, EN64Reg rs, EN64Reg rt );
+
+				void	SetHostRoundingMode( EHostRoundingMode mode );
+
+				bool	GenerateCOP1( OpCode op_code );
+
+				void	GenerateMFC1( EN64Reg rt, u32 fs );
+				void	GenerateDMFC1( EN64Reg rt, u32 fs );
+				void	GenerateMTC1( u32 fs, EN64Reg rt );
+				void	GenerateDMTC1( u32 fs, EN64Reg rt );
+				void	GenerateCFC1( EN64Reg rt, u32 fs );
+
+				void	GenerateADD_S( u32 fd, u32 fs, u32 ft );
+				void	GenerateSUB_S( u32 fd, u32 fs, u32 ft );
+				void	GenerateMUL_S( u32 fd, u32 fs, u32 ft );
+				void	GenerateDIV_S( u32 fd, u32 fs, u32 ft );
+				void	GenerateSQRT_S( u32 fd, u32 fs );
+				void	GenerateABS_S( u32 fd, u32 fs );
+				void	GenerateMOV_S( u32 fd, u32 fs );
+				void	GenerateNEG_S( u32 fd, u32 fs );
+				void	GenerateCVT_D_S( u32 fd, u32 fs );
+
+				void	GenerateADD_D( u32 fd, u32 fs, u32 ft );
+				void	GenerateSUB_D( u32 fd, u32 fs, u32 ft );
+				void	GenerateMUL_D( u32 fd, u32 fs, u32 ft );
+				void	GenerateDIV_D( u32 fd, u32 fs, u32 ft );
+				void	GenerateSQRT_D( u32 fd, u32 fs );
+				void	GenerateABS_D( u32 fd, u32 fs );
+				void	GenerateMOV_D( u32 fd, u32 fs );
+				void	GenerateNEG_D( u32 fd, u32 fs );
+				void	GenerateCVT_S_D( u32 fd, u32 fs );
+
+				void	GenerateFloatToInt( u32 fd, u32 fs, bool double_src, bool long_dst, EHostRoundingMode mode );
+				void	GenerateIntToFloat( u32 fd, u32 fs, bool long_src, bool double_dst );
+				void	GenerateCMP( u32 fs, u32 ft, EFPUCompare cond, bool is_double );
 };
 
 #endif // SYSW32_DYNAREC_X64_CODEGENERATORX64_H_
@@ -11,6 +11,14 @@ _EnterDynaRec PROC FRAME
 .PUSHREG R15
     push r14
 .PUSHREG R14
+    push r13
+.PUSHREG R13
+    push r12
+.PUSHREG R12
+    push rsi
+.PUSHREG RSI
+    push rdi
+.PUSHREG RDI
     sub rsp, 32
 .allocstack 32
 .ENDPROLOG
@@ -22,6 +30,10 @@ _EnterDynaRec PROC FRAME
     call rax
 
     add rsp, 32
+    pop rdi
+    pop rsi
+    pop r12
+    pop r13
     pop r14
     pop r15
     pop rbx
@@ -46,5 +46,26 @@ enum EIntelReg {
     NUM_X64_REGISTERS = 16,
 };
 
+// SSE register codes
+enum EXmmReg {
+    XMM0_CODE = 0,
+    XMM1_CODE = 1,
+    XMM2_CODE = 2,
+    XMM3_CODE = 3,
+    XMM4_CODE = 4,
+    XMM5_CODE = 5,
+    XMM6_CODE = 6,
+    XMM7_CODE = 7,
+
+    XMM8_CODE = 8,
+    XMM9_CODE = 9,
+    XMM10_CODE = 10,
+    XMM11_CODE = 11,
+    XMM12_CODE = 12,
+    XMM13_CODE = 13,
+    XMM14_CODE = 14,
+    XMM15_CODE = 15,
+};
+
 
 #endif // SYSW32_DYNAREC_X64_DYNARECTARGETX64_H_
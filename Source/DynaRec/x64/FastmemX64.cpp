@@ -0,0 +1,311 @@
+/*
+Copyright (C) 2007 StrmnNrmn
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+
+#include "Base/Types.h"
+
+#include "FastmemX64.h"
+
+#ifdef DAEDALUS_FASTMEM
+
+#include <signal.h>
+#include <string.h>
+#include <ucontext.h>
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "Core/Memory.h"
+#include "Core/RamWatch.h"
+#include "Debug/DBGConsole.h"
+#include "DynaRec/AssemblyUtils.h"
+
+#if defined(__APPLE__)
+#define CONTEXT_PC( context )	( (context)->uc_mcontext->__ss.__rip )
+#elif defined(__FreeBSD__)
+#define CONTEXT_PC( context )	( (context)->uc_mcontext.mc_rip )
+#else
+#define CONTEXT_PC( context )	( (context)->uc_mcontext.gregs[ REG_RIP ] )
+#endif
+
+namespace
+{
+	// The fault handler can't take locks or allocate, so sites live in a fixed
+	// size open addressed table which it only ever reads.
+	// Sites are added from both the emulation thread and the background compiler,
+	// under gSitesMutex. An entry is published by writing its site last, so the
+	// handler never sees a site without its slow path. Entries are only removed
+	// by Fastmem_RemoveSites, which the emulation thread calls when no generated
+	// code is running, so it can't race with the handler.
+	struct SSite
+	{
+		std::atomic< const u8 * >	Site;
+		std::atomic< const u8 * >	SlowPath;		// Null once the site has been patched
+	};
+
+	const u32							SITE_TABLE_BITS = 18;
+	const u32							SITE_TABLE_SIZE = 1 << SITE_TABLE_BITS;
+	const u32							SITE_TABLE_MASK = SITE_TABLE_SIZE - 1;
+	const u32							MAX_SITES = SITE_TABLE_SIZE / 4 * 3;	// Keep probe chains short
+
+	std::mutex							gSitesMutex;
+	std::array< SSite, SITE_TABLE_SIZE >	gSites;
+	u32									gNumSites = 0;		// Including patched sites, until they're reclaimed
+
+	bool								gHandlerInstalled = false;
+	struct sigaction					gPreviousSegvAction;
+	struct sigaction					gPreviousBusAction;
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+static inline u32 Fastmem_HashSite( const u8 * p_site )
+{
+	return u32( ( u64( reinterpret_cast< uintptr_t >( p_site ) ) * 0x9E3779B97F4A7C15ull ) >> ( 64 - SITE_TABLE_BITS ) );
+}
+
+//*****************************************************************************
+//	Turn the access into a jump to its slow path
+//*****************************************************************************
+static bool Fastmem_JumpToSlowPath( u8 * p_site, const u8 * p_slow_path )
+{
+	p_site[ 0 ] = 0xe9;
+	return AssemblyUtils::PatchJumpLong( CJumpLocation( p_site ), CCodeLabel( p_slow_path ) );
+}
+
+//*****************************************************************************
+//	Must hold gSitesMutex
+//*****************************************************************************
+static bool Fastmem_InsertSite( const u8 * p_site, const u8 * p_slow_path )
+{
+	for( u32 i = Fastmem_HashSite( p_site ); ; i = ( i + 1 ) & SITE_TABLE_MASK )
+	{
+		SSite &		entry( gSites[ i ] );
+		const u8 *	p_existing( entry.Site.load( std::memory_order_relaxed ) );
+
+		if( p_existing == p_site )
+		{
+			entry.SlowPath.store( p_slow_path, std::memory_order_release );
+			return true;
+		}
+
+		if( p_existing == nullptr )
+		{
+			if( gNumSites >= MAX_SITES )
+				return false;
+
+			entry.SlowPath.store( p_slow_path, std::memory_order_relaxed );
+			entry.Site.store( p_site, std::memory_order_release );
+			gNumSites++;
+			return true;
+		}
+	}
+}
+
+//*****************************************************************************
+//	Called from the fault handler, so this only reads the table, and marks
+//	the site as patched rather than removing it
+//*****************************************************************************
+static bool Fastmem_PatchSite( u8 * p_site )
+{
+	for( u32 i = Fastmem_HashSite( p_site ); ; i = ( i + 1 ) & SITE_TABLE_MASK )
+	{
+		SSite &		entry( gSites[ i ] );
+		const u8 *	p_existing( entry.Site.load( std::memory_order_acquire ) );
+
+		if( p_existing == nullptr )
+			return false;
+
+		if( p_existing == p_site )
+		{
+			const u8 *	p_slow_path( entry.SlowPath.exchange( nullptr, std::memory_order_acquire ) );
+			if( p_slow_path == nullptr )
+				return false;
+
+			// Carry on from the jump
+			return Fastmem_JumpToSlowPath( p_site, p_slow_path );
+		}
+	}
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+static void Fastmem_SignalHandler( int sig, siginfo_t * p_info, void * p_context )
+{
+	ucontext_t *	context( static_cast< ucontext_t * >( p_context ) );
+	const u8 *		fault_address( static_cast< const u8 * >( p_info->si_addr ) );
+
+	if( g_pFastmemBase != nullptr && fault_address >= g_pFastmemBase && fault_address < g_pFastmemBase + FASTMEM_REGION_SIZE )
+	{
+		// A store to a page that's being watched for writes - let it through and retry
+		if( RamWatch_HandleFault( fault_address ) )
+			return;
+
+		if( Fastmem_PatchSite( reinterpret_cast< u8 * >( CONTEXT_PC( context ) ) ) )
+			return;
+	}
+
+	// Not one of ours - pass it on
+	const struct sigaction &	previous( sig == SIGBUS ? gPreviousBusAction : gPreviousSegvAction );
+
+	if( previous.sa_flags & SA_SIGINFO )
+	{
+		previous.sa_sigaction( sig, p_info, p_context );
+	}
+	else if( previous.sa_handler == SIG_DFL || previous.sa_handler == SIG_IGN )
+	{
+		// Restore the default action and let the instruction fault again
+		signal( sig, SIG_DFL );
+	}
+	else
+	{
+		previous.sa_handler( sig );
+	}
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+bool Fastmem_Init()
+{
+	if( gHandlerInstalled )
+	{
+		RamWatch_Enable( true );
+		return true;
+	}
+
+	if( g_pFastmemBase == nullptr )
+		return false;
+
+	struct sigaction	action;
+	memset( &action, 0, sizeof( action ) );
+	action.sa_sigaction = Fastmem_SignalHandler;
+	action.sa_flags = SA_SIGINFO;
+	sigemptyset( &action.sa_mask );
+
+	if( sigaction( SIGSEGV, &action, &gPreviousSegvAction ) != 0 )
+		return false;
+
+	// Darwin reports some protection faults as SIGBUS
+	if( sigaction( SIGBUS, &action, &gPreviousBusAction ) != 0 )
+	{
+		sigaction( SIGSEGV, &gPreviousSegvAction, nullptr );
+		return false;
+	}
+
+	gHandlerInstalled = true;
+
+	DBGConsole_Msg( 0, "Dynarec fastmem enabled" );
+
+	// The same handler deals with stores to watched pages
+	RamWatch_Enable( true );
+	return true;
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void Fastmem_Fini()
+{
+	if( !gHandlerInstalled )
+		return;
+
+	RamWatch_Enable( false );
+
+	sigaction( SIGSEGV, &gPreviousSegvAction, nullptr );
+	sigaction( SIGBUS, &gPreviousBusAction, nullptr );
+	gHandlerInstalled = false;
+
+	std::lock_guard< std::mutex >	lock( gSitesMutex );
+	for( SSite & entry : gSites )
+	{
+		entry.Site.store( nullptr, std::memory_order_relaxed );
+		entry.SlowPath.store( nullptr, std::memory_order_relaxed );
+	}
+	gNumSites = 0;
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+bool Fastmem_IsEnabled()
+{
+	return gHandlerInstalled;
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void Fastmem_AddSite( const u8 * p_site, const u8 * p_slow_path )
+{
+	std::lock_guard< std::mutex >	lock( gSitesMutex );
+
+	// No room to track it, so it always takes the slow path. It hasn't run yet
+	if( !Fastmem_InsertSite( p_site, p_slow_path ) )
+	{
+		Fastmem_JumpToSlowPath( const_cast< u8 * >( p_site ), p_slow_path );
+	}
+}
+
+//*****************************************************************************
+//	Forget any sites in the given range of the code buffer, as it's being reused.
+//	Sites which have been patched are reclaimed here too. The table is rebuilt,
+//	as open addressing can't just clear entries out of the middle of a chain.
+//*****************************************************************************
+void Fastmem_RemoveSites( const u8 * p_begin, const u8 * p_end )
+{
+	std::lock_guard< std::mutex >	lock( gSitesMutex );
+
+	std::vector< std::pair< const u8 *, const u8 * > >	keep;
+	keep.reserve( gNumSites );
+
+	for( SSite & entry : gSites )
+	{
+		const u8 *	p_site( entry.Site.load( std::memory_order_relaxed ) );
+		const u8 *	p_slow_path( entry.SlowPath.load( std::memory_order_relaxed ) );
+
+		if( p_site != nullptr && p_slow_path != nullptr && ( p_site < p_begin || p_site >= p_end ) )
+		{
+			keep.emplace_back( p_site, p_slow_path );
+		}
+
+		entry.Site.store( nullptr, std::memory_order_relaxed );
+		entry.SlowPath.store( nullptr, std::memory_order_relaxed );
+	}
+	gNumSites = 0;
+
+	for( const auto & site : keep )
+	{
+		Fastmem_InsertSite( site.first, site.second );
+	}
+}
+
+#else
+
+bool Fastmem_Init()											{ return false; }
+void Fastmem_Fini()											{}
+bool Fastmem_IsEnabled()									{ return false; }
+void Fastmem_AddSite( const u8 * p_site, const u8 * p_slow_path )	{}
+void Fastmem_RemoveSites( const u8 * p_begin, const u8 * p_end )	{}
+
+#endif // DAEDALUS_FASTMEM
@@ -0,0 +1,48 @@
+/*
+Copyright (C) 2007 StrmnNrmn
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#pragma once
+
+#ifndef SYSW32_DYNAREC_X64_FASTMEMX64_H_
+#define SYSW32_DYNAREC_X64_FASTMEMX64_H_
+
+#include "Base/Types.h"
+
+//*****************************************************************************
+//	Loads and stores are compiled as a single access into the fastmem region
+//	(see Core/Memory.h). Anything other than RDRAM faults, and the fault handler
+//	overwrites the access with a jump to the slow path generated alongside it,
+//	so that site goes through the memory handlers from then on.
+//*****************************************************************************
+
+// Each access site is padded to this, so there's room for a JMP rel32
+static const u32	FASTMEM_SITE_LENGTH = 5;
+
+// Sites are tracked in a fixed size table. If it's full, a new site is patched
+// to its slow path straight away. Fastmem_RemoveSites must only be called when
+// no generated code is running.
+
+bool	Fastmem_Init();
+void	Fastmem_Fini();
+bool	Fastmem_IsEnabled();
+
+void	Fastmem_AddSite( const u8 * p_site, const u8 * p_slow_path );
+void	Fastmem_RemoveSites( const u8 * p_begin, const u8 * p_end );
+
+#endif // SYSW32_DYNAREC_X64_FASTMEMX64_H_
@@ -71,4 +71,24 @@ bool	PatchJumpLongAndFlush( CJumpLocation jump, CCodeLabel target )
 	return PatchJumpLong( jump, target );
 }
 
+//*****************************************************************************
+//	Decode the location a long jump currently targets
+//*****************************************************************************
+CCodeLabel	GetJumpTarget( CJumpLocation jump )
+{
+	const u8 *	p_jump_addr( jump.GetTargetU8P() );
+
+	if( *p_jump_addr == 0xe8 || *p_jump_addr == 0xe9 )
+	{
+		return CCodeLabel( p_jump_addr + 5 + *reinterpret_cast< const s32 * >( p_jump_addr + 1 ) );
+	}
+	else if( *p_jump_addr == 0x0f )
+	{
+		return CCodeLabel( p_jump_addr + 6 + *reinterpret_cast< const s32 * >( p_jump_addr + 2 ) );
+	}
+
+	DAEDALUS_ERROR( "Unhandled jump type" );
+	return CCodeLabel( nullptr );
+}
+
 }
@@ -66,7 +66,7 @@ class CNativeTexture
 		inline const void *				GetData() const					{ return mpData; }
 		inline void *					GetData()						{ return mpData; }
 
-#if defined(DAEDALUS_CTR)
+#if defined(DAEDALUS_GL) || defined(DAEDALUS_CTR)
 		inline GLuint					GetTextureId() const				{ return mTextureId; }
 
 #endif
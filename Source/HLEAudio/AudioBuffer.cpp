@@ -24,6 +24,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "Debug/DBGConsole.h"
 #include "HLEAudio/AudioBuffer.h"
 #include "System/Thread.h"
+#include <algorithm>
 #include <cstring>
 #include <fstream>
 
@@ -31,27 +32,47 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "SysPSP/Utility/CacheUtil.h"
 #endif
 
+namespace {
+// The most rate control will speed up or slow down the output, i.e. 0.5%
+const s32 kMaxRateAdjustDivisor = 200;
+} // namespace
+
 CAudioBuffer::CAudioBuffer(u32 buffer_size)
-    : mBufferBegin(new Sample[buffer_size]),
-      mBufferEnd(mBufferBegin + buffer_size), mReadPtr(mBufferBegin),
-      mWritePtr(mBufferBegin) {}
+    : mBuffer(new Sample[buffer_size]), mBufferSize(buffer_size), mReadIdx(0),
+      mWriteIdx(0), mTargetLatency(0), mAverageFill(0), mUnderruns(0),
+      mOverruns(0) {}
+
+CAudioBuffer::~CAudioBuffer() { delete[] mBuffer; }
 
-CAudioBuffer::~CAudioBuffer() { delete[] mBufferBegin; }
+void CAudioBuffer::SetTargetLatency(u32 num_samples) {
+#ifdef DAEDALUS_ENABLE_ASSERTS
+  DAEDALUS_ASSERT(num_samples < mBufferSize, "Target latency is larger than the buffer");
+#endif
+  mTargetLatency = num_samples;
+  mAverageFill = num_samples;
+}
 
 u32 CAudioBuffer::GetNumBufferedSamples() const {
-  // Todo: Check Cache Routines
-  // #ifdef DAEDALUS_PSP
-  // 	dcache_wbinv_all();
-  // #endif
+  u32 write_idx = mWriteIdx.load(std::memory_order_acquire);
+  u32 read_idx = mReadIdx.load(std::memory_order_acquire);
 
-  // Safe? What if we read mWrite, and then mRead moves to start of buffer?
-  s32 diff = mWritePtr - mReadPtr;
+  return write_idx >= read_idx ? write_idx - read_idx
+                               : write_idx + mBufferSize - read_idx;
+}
 
-  if (diff < 0) {
-    diff += (mBufferEnd - mBufferBegin); // Add on buffer length
-  }
+//	Nudge the output frequency up if we're running low, and down if samples are
+//	backing up. The fill level is smoothed, as Drain() takes big bites out of it.
+u32 CAudioBuffer::GetAdjustedFrequency(u32 output_freq) {
+  if (mTargetLatency == 0)
+    return output_freq;
+
+  s32 fill = GetNumBufferedSamples();
+  mAverageFill += (fill - mAverageFill) / 8;
 
-  return diff;
+  s32 target = mTargetLatency;
+  s32 error = std::clamp(target - mAverageFill, -target, target);
+
+  return output_freq + s32((s64(output_freq) * error) / (s64(target) * kMaxRateAdjustDivisor));
 }
 
 void CAudioBuffer::AddSamples(const Sample *samples, u32 num_samples,
@@ -70,13 +91,13 @@ fh.write(reinterpret_cast<const char*>(samples), sizeof(Sample) * num_samples);
 fh.flush();
  }
 #endif 
-// clear the Cache
-#ifdef DAEDALUS_PSP
-// sceKernelDcacheWritebackInvalidateAll();
-#endif
-  const Sample *read_ptr(
-      mReadPtr); // No need to invalidate, as this is uncached/volatile
-  Sample *write_ptr(mWritePtr);
+  // Need at least two samples to interpolate between
+  if (num_samples < 2 || frequency == 0)
+    return;
+
+  u32 read_idx(mReadIdx.load(std::memory_order_acquire));
+  u32 write_idx(mWriteIdx.load(std::memory_order_relaxed));
+  bool waited(false);
 
   //
   //	'r' is the number of input samples we progress through for each output
@@ -86,10 +107,11 @@ fh.flush();
   //reduce s by 1.0 (to keep it in the range 0.0 .. 1.0) 	Principle is the same
   //but rewritten to integer mode (faster & less ASM) //Corn
 
-  const s32 r = (frequency << 12) / output_freq;
+  const u32 adjusted_freq = GetAdjustedFrequency(output_freq);
+  const s32 r = (frequency << 12) / adjusted_freq;
   s32 s = 0;
   u32 in_idx = 0;
-  u32 output_samples = ((num_samples * output_freq) / frequency) - 1;
+  u32 output_samples = ((num_samples * adjusted_freq) / frequency) - 1;
 
   for (u32 i = output_samples; i != 0; i--) {
 #ifdef DAEDALUS_ENABLE_ASSERTS
@@ -97,22 +119,6 @@ fh.flush();
                     "Input index out of range - %d / %d", in_idx + 1,
                     num_samples);
 #endif
-    //#if 0 // 1->Sine tone, 0->Normal
-    // static float c= 0.0f;
-    // c += 100.0f / 44100.0f;
-    // if( c >= 1.0f )
-    //  c-=1.f;
-    // s16 v( s16( SHRT_MAX * sinf( c * 3.141f*2 ) ) );
-    // Sample	out;
-    // s16 v = WriteCounter++;
-    // if( WriteCounter >= MAX_COUNTER )
-    // {
-    // 	printf( "Loop write\n" );
-    // 	WriteCounter = 0;
-    // }
-    // out.L = out.R = v;
-    //
-    // #else
     // Resample in integer mode (faster & less ASM code) //Corn
     Sample out;
 
@@ -124,61 +130,52 @@ fh.flush();
     s += r;
     in_idx += s >> 12;
     s &= 4095;
-    // #endif
-
-    write_ptr++;
-    if (write_ptr >= mBufferEnd)
-      write_ptr = mBufferBegin;
-
-    while (write_ptr == read_ptr) {
-      // The buffer is full - spin until the read pointer advances.
-      //    Note - spends a lot of time here if program is running
-      //    fast. This loop locks the speed to the playback rate
-      //    as the program winds up waiting for the buffer to empty.
-      // ToDo: Adjust Audio Frequency/ Look at Turok in this regard.
-      // We might want to put a Sleep in when executing on the SC?
-      // Give time to other threads when using SYNC mode.
-      // ThreadYield();
-
-      read_ptr = mReadPtr;
+
+    u32 next_idx = write_idx + 1;
+    if (next_idx >= mBufferSize)
+      next_idx = 0;
+
+    while (next_idx == read_idx) {
+      // The buffer is full - wait until the reader catches up.
+      // This locks the speed to the playback rate if the emulator is
+      // running fast. Make what we've written so far visible first.
+      if (!waited) {
+        waited = true;
+        mOverruns.fetch_add(1, std::memory_order_relaxed);
+        mWriteIdx.store(write_idx, std::memory_order_release);
+      }
+      ThreadYield();
+
+      read_idx = mReadIdx.load(std::memory_order_acquire);
     }
 
-    *write_ptr = out;
+    mBuffer[write_idx] = out;
+    write_idx = next_idx;
   }
 
-  // Todo: Check Cache Routines
-  //  Ensure samples array is written back before mWritePtr
-  // dcache_wbinv_range_unaligned( mBufferBegin, mBufferEnd );
-
-  mWritePtr = write_ptr; // Needs cache wbinv
+  mWriteIdx.store(write_idx, std::memory_order_release);
 }
 
 u32 CAudioBuffer::Drain(Sample *samples, u32 num_samples) {
-// Todo: Check Cache Routines
-//  Ideally we could just invalidate this range?
-// clear the Cache
-#ifdef DAEDALUS_PSP
-// sceKernelDcacheWritebackInvalidateAll();
-#endif
-
-  const Sample *read_ptr(mReadPtr); // No need to invalidate, as this is uncached/volatile
-  const Sample *write_ptr(mWritePtr); //
+  u32 read_idx(mReadIdx.load(std::memory_order_relaxed));
+  u32 write_idx(mWriteIdx.load(std::memory_order_acquire));
 
-  Sample *out_ptr(samples);
-  u32 samples_required(num_samples);
+  u32 available = write_idx >= read_idx ? write_idx - read_idx
+                                        : write_idx + mBufferSize - read_idx;
+  u32 samples_to_copy = std::min(num_samples, available);
 
-  while (samples_required > 0) {
-    // Check if empty
-    if (read_ptr == write_ptr)
-      break;
+  // At most two copies, either side of the wrap
+  u32 first_copy = std::min(samples_to_copy, mBufferSize - read_idx);
+  memcpy(samples, mBuffer + read_idx, first_copy * sizeof(Sample));
+  memcpy(samples + first_copy, mBuffer, (samples_to_copy - first_copy) * sizeof(Sample));
 
-    *out_ptr++ = *read_ptr++;
+  read_idx += samples_to_copy;
+  if (read_idx >= mBufferSize)
+    read_idx -= mBufferSize;
 
-    if (read_ptr >= mBufferEnd)
-      read_ptr = mBufferBegin;
+  mReadIdx.store(read_idx, std::memory_order_release);
 
-    samples_required--;
-  }
+  u32 samples_required(num_samples - samples_to_copy);
 
 #ifdef DAEDALUS_DEBUG_AUDIO
 std::ofstream fh;
@@ -186,25 +183,19 @@ std::ofstream fh;
  if (!fh.is_open())
  {
   fh.open("audio_out.raw",  std::ios::binary);
-  fh.write(reinterpret_cast<const char*>(samples), sizeof(Sample) * num_samples - samples_required);
+  fh.write(reinterpret_cast<const char*>(samples), sizeof(Sample) * samples_to_copy);
   fh.flush();
  }
 #endif 
-  mReadPtr = read_ptr; // No need to invalidate, as this is uncached
-// clear the Cache
-#ifdef DAEDALUS_PSP
-// sceKernelDcacheWritebackInvalidateAll();
-#endif
   //
   //	If there weren't enough samples, zero out the buffer
   //	FIXME(strmnnrmn): Unnecessary on OSX...
   //
   if (samples_required > 0) {
-    // DBGConsole_Msg( 0, "Buffer underflow (%d samples)\n", samples_required );
-    // printf( "Buffer underflow (%d samples)\n", samples_required );
-    memset(out_ptr, 0, samples_required * sizeof(Sample));
+    mUnderruns.fetch_add(1, std::memory_order_relaxed);
+    memset(samples + samples_to_copy, 0, samples_required * sizeof(Sample));
   }
 
   // Return the number of samples written
-  return num_samples - samples_required;
+  return samples_to_copy;
 }
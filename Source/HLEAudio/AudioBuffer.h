@@ -22,6 +22,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #ifndef HLEAUDIO_AUDIOBUFFER_H_
 #define HLEAUDIO_AUDIOBUFFER_H_
 
+#include <atomic>
+
 #include "Base/Types.h"
 
 struct Sample {
@@ -32,25 +34,48 @@ struct Sample {
 // A utility class for buffering up samples, upsampling to the desired
 // output frequency and copying them to the desired output buffer.
 //
-// N.B. This class currently does no synchronisation - it's assumed that
-// the calling code will handle this
+// It's a single producer/single consumer ring buffer - one thread calls
+// AddSamples() while another calls Drain(), with no further locking.
+//
+// If a target latency is set, AddSamples() stretches or squashes its output
+// very slightly to steer the number of buffered samples towards it. This
+// soaks up the difference between the emulated and real output clocks,
+// rather than letting the buffer drain or fill up.
 class CAudioBuffer {
 public:
   CAudioBuffer(u32 buffer_size);
   ~CAudioBuffer();
 
+  // Number of output samples to try to keep buffered, 0 disables rate control
+  void SetTargetLatency(u32 num_samples);
+
   void AddSamples(const Sample *samples, u32 num_samples, u32 frequency,
                   u32 output_freq);
   u32 Drain(Sample *samples, u32 num_samples);
 
   u32 GetNumBufferedSamples() const;
 
+  u32 GetUnderrunCount() const { return mUnderruns.load(std::memory_order_relaxed); }
+  u32 GetOverrunCount() const { return mOverruns.load(std::memory_order_relaxed); }
+
 private:
-  Sample *mBufferBegin;
-  Sample *mBufferEnd;
+  u32 GetAdjustedFrequency(u32 output_freq);
+
+private:
+  Sample *mBuffer;
+  u32 mBufferSize;
+
+  // Each index is only written by one side. One slot is always left empty,
+  // so read == write means the buffer is empty.
+  std::atomic<u32> mReadIdx;
+  std::atomic<u32> mWriteIdx;
+
+  // Rate control, only touched by the producer
+  u32 mTargetLatency;
+  s32 mAverageFill;
 
-  const Sample *volatile mReadPtr;
-  Sample *volatile mWritePtr;
+  std::atomic<u32> mUnderruns; // Drain() calls that ran out of samples
+  std::atomic<u32> mOverruns;  // AddSamples() calls that had to wait for space
 };
 
 #endif // HLEAUDIO_AUDIOBUFFER_H_
@@ -43,6 +43,10 @@ public:
   virtual u32 ReadLength() = 0;
   virtual EProcessResult ProcessAList() = 0;
 
+  // Blocks until any alist started asynchronously has been processed.
+  // Called before the task is reported as done to the game.
+  virtual void WaitForAList() {}
+
 };
 
 //
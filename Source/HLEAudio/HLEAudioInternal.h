@@ -422,6 +422,7 @@ void UNKNOWN(AudioHLECommand command);
 
 // These must be defined...
 #include "Core/Memory.h"
+#include "Ultra/ultra_sptask.h"
 
 // MMmm, why not use the defines from Memory.h?
 // ToDo : remove these and use the ones already provided by the core?
@@ -431,6 +432,7 @@ void UNKNOWN(AudioHLECommand command);
 
 // Use these functions to interface with the HLE Audio...
 void Audio_Ucode();
+void Audio_Ucode(const OSTask &task);
 void Audio_Reset();
 
 #endif // HLEAUDIO_AUDIOHLE_H_
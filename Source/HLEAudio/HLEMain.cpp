@@ -95,7 +95,7 @@ void Audio_Reset() {
 //*****************************************************************************
 //
 //*****************************************************************************
-inline void Audio_Ucode_Detect(OSTask *pTask) {
+inline void Audio_Ucode_Detect(const OSTask *pTask) {
   u8 *p_base = g_pu8RamBase + (uintptr_t)pTask->t.ucode_data;
   if (*(u32 *)(p_base + 0) != 0x01) {
     if (*(u32 *)(p_base + 0x10) == 0x00000001)
@@ -114,10 +114,18 @@ inline void Audio_Ucode_Detect(OSTask *pTask) {
 //
 //*****************************************************************************
 void Audio_Ucode() {
+  Audio_Ucode(*(const OSTask *)(g_pu8SpMemBase + 0x0FC0));
+}
+
+//*****************************************************************************
+//	Process a copy of the task, so it can be run after the task in DMEM has
+//	been replaced
+//*****************************************************************************
+void Audio_Ucode(const OSTask &task) {
 #ifdef DAEDALUS_PROFILE
   DAEDALUS_PROFILE("HLEMain::Audio_Ucode");
 #endif
-  OSTask *pTask = (OSTask *)(g_pu8SpMemBase + 0x0FC0);
+  const OSTask *pTask = &task;
 
   // Only detect ABI once per game
   if (!bAudioChanged) {
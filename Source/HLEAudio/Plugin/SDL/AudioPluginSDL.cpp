@@ -1,30 +1,29 @@
 #include <SDL2/SDL.h>
 
+#include <atomic>
+
 #include "Base/Types.h"
 #include "Interface/ConfigOptions.h"
 #include "Utility/FramerateLimiter.h"
+#include "Core/CPU.h"
 #include "Core/Memory.h"
 #include "Debug/DBGConsole.h"
+#include "HLEAudio/AudioBuffer.h"
 #include "HLEAudio/AudioPlugin.h"
 #include "HLEAudio/HLEAudioInternal.h"
+#include "System/SPSCQueue.h"
 #include "System/Timing.h"
 
 EAudioPluginMode gAudioPluginEnabled = APM_ENABLED_ASYNC;
 
-SDL_Thread* Asyncthread = nullptr;
-int Asyncthreadreturn;
-
-void* Audio_UcodeEntry(void* arg) {
-    Audio_Ucode();
-    return nullptr;
-}
+// How long the RSP appears to take over an alist when it's processed asynchronously.
+// The worker has until then to finish before the emulation thread has to wait for it.
+#define RSP_AUDIO_INTR_CYCLES     20000
 
-SDL_AudioDeviceID audio_device = 0;
-
-struct Sample {
-    s16 L;
-    s16 R;
-};
+static const u32 kOutputFrequency = 48000;
+static const u32 kAudioBufferSize = 16 * 1024;     // Circular buffer length, in output samples (~340ms)
+static const u32 kDeviceBufferSize = 1024;         // Samples SDL asks for in each callback
+static const u32 kTargetLatency = 3 * kDeviceBufferSize;  // What rate control steers the buffer towards (~64ms)
 
 class AudioPluginSDL : public CAudioPlugin
 {
@@ -39,25 +38,47 @@ public:
     virtual void            LenChanged();
     virtual u32             ReadLength()            { return 0; }
     virtual EProcessResult  ProcessAList();
+    virtual void            WaitForAList();
 
     void                    AddBuffer(void * ptr, u32 length);   // Uploads a new buffer and returns status
     void                    StopAudio();                        // Stops the Audio PlayBack (as if paused)
     void                    StartAudio();                       // Starts the Audio PlayBack (as if unpaused)
 
     static void             AudioSyncFunction(void * arg);
-    static int              AudioThread(void * arg);
+    static void             AudioCallback(void * arg, Uint8 * stream, int len);
+
+private:
+    bool                    StartWorker();
+    void                    StopWorker();
+    static int              WorkerThread(void * arg);
 
 private:
     u32                     mFrequency;
-    SDL_Thread*             mAudioThread;
+    SDL_AudioDeviceID       mAudioDevice;
+    CAudioBuffer            mAudioBuffer;               // Filled by the emulation thread, drained by SDL's callback
+
+    // Alists are processed in order on a single long lived worker. Only the
+    // emulation thread pushes tasks, and only the worker pops them.
+    static const u32        MAX_PENDING_TASKS = 8;
+
+    CSPSCQueue<OSTask, MAX_PENDING_TASKS>   mTasks;
+    SDL_Thread*             mWorkerThread;
+    SDL_sem*                mTaskQueued;
+    SDL_sem*                mTaskDone;
+    std::atomic<bool>       mWorkerQuit;
+    u32                     mTasksQueued;               // Only touched by the emulation thread
+    std::atomic<u32>        mTasksDone;
 };
 
 AudioPluginSDL::AudioPluginSDL()
-:   mFrequency(44100), mAudioThread(nullptr)
+:   mFrequency(44100), mAudioDevice(0), mAudioBuffer(kAudioBufferSize)
+,   mWorkerThread(nullptr), mTaskQueued(nullptr), mTaskDone(nullptr)
+,   mWorkerQuit(false), mTasksQueued(0), mTasksDone(0)
 {}
 
 AudioPluginSDL::~AudioPluginSDL()
 {
+    StopWorker();
     StopAudio();
 }
 
@@ -68,6 +89,7 @@ bool AudioPluginSDL::StartEmulation()
 
 void AudioPluginSDL::StopEmulation()
 {
+    StopWorker();
     Audio_Reset();
     StopAudio();
 }
@@ -104,15 +126,30 @@ EProcessResult AudioPluginSDL::ProcessAList()
             result = PR_COMPLETED;
             break;
         case APM_ENABLED_ASYNC:
-            Asyncthread = SDL_CreateThread((SDL_ThreadFunction)Audio_UcodeEntry, "Audio_UcodeThread", nullptr);
-            if (Asyncthread == nullptr) {
-                DBGConsole_Msg(0, "Failed to create Async thread", SDL_GetError());
-            } else {
-                SDL_DetachThread(Asyncthread);
+            if (StartWorker())
+            {
+                // Copy the task, DMEM will have moved on by the time the worker gets to it
+                const OSTask & task = *(const OSTask *)(g_pu8SpMemBase + 0x0FC0);
+
+                while (!mTasks.Push(task))
+                {
+                    // The worker is a long way behind, wait for it to catch up
+                    SDL_SemWait(mTaskDone);
+                }
+                mTasksQueued++;
+                SDL_SemPost(mTaskQueued);
+
+                CPU_AddEvent(RSP_AUDIO_INTR_CYCLES, CPU_EVENT_AUDIO);
+                result = PR_STARTED;
+            }
+            else
+            {
+                Audio_Ucode();
+                result = PR_COMPLETED;
             }
-            result = PR_COMPLETED;
             break;
         case APM_ENABLED_SYNC:
+            WaitForAList();     // In case we've just switched from async
             Audio_Ucode();
             result = PR_COMPLETED;
             break;
@@ -121,80 +158,156 @@ EProcessResult AudioPluginSDL::ProcessAList()
     return result;
 }
 
-void AudioPluginSDL::AddBuffer(void * ptr, u32 length)
+void AudioPluginSDL::WaitForAList()
 {
-    if (length == 0)
-        return;
+    while (mTasksDone.load(std::memory_order_acquire) != mTasksQueued)
+    {
+        SDL_SemWait(mTaskDone);
+    }
+}
 
-    if (mAudioThread == nullptr)
-        StartAudio();
+bool AudioPluginSDL::StartWorker()
+{
+    if (mWorkerThread != nullptr)
+        return true;
 
-    if (audio_device == 0) {
-        DBGConsole_Msg(0, "Audio device not initialized");
-        return;
+    mTaskQueued = SDL_CreateSemaphore(0);
+    mTaskDone = SDL_CreateSemaphore(0);
+    mWorkerQuit = false;
+    mTasksQueued = 0;
+    mTasksDone = 0;
+
+    if (mTaskQueued != nullptr && mTaskDone != nullptr)
+    {
+        mWorkerThread = SDL_CreateThread(&WorkerThread, "AudioWorker", this);
     }
 
-    u32 num_samples = length / sizeof(Sample);
+    if (mWorkerThread == nullptr)
+    {
+        DBGConsole_Msg(0, "Failed to start the audio worker: %s", SDL_GetError());
+        gAudioPluginEnabled = APM_ENABLED_SYNC;
+        StopWorker();
+        return false;
+    }
 
-    // Queue the samples into SDL's audio buffer
-    if (SDL_QueueAudio(audio_device, ptr, num_samples * sizeof(Sample)) != 0) {
-        DBGConsole_Msg(0, "SDL_QueueAudio error: %s", SDL_GetError());
-        return;
+    return true;
+}
+
+void AudioPluginSDL::StopWorker()
+{
+    if (mWorkerThread != nullptr)
+    {
+        // Let it finish whatever is queued first
+        mWorkerQuit = true;
+        SDL_SemPost(mTaskQueued);
+        SDL_WaitThread(mWorkerThread, nullptr);
+        mWorkerThread = nullptr;
+    }
+
+    if (mTaskQueued != nullptr)
+    {
+        SDL_DestroySemaphore(mTaskQueued);
+        mTaskQueued = nullptr;
+    }
+    if (mTaskDone != nullptr)
+    {
+        SDL_DestroySemaphore(mTaskDone);
+        mTaskDone = nullptr;
     }
 }
 
-int AudioPluginSDL::AudioThread(void * arg)
+int AudioPluginSDL::WorkerThread(void * arg)
 {
     AudioPluginSDL * plugin = static_cast<AudioPluginSDL *>(arg);
+    OSTask task;
 
-    SDL_AudioSpec audio_spec;
-    SDL_zero(audio_spec);
-    audio_spec.freq = plugin->mFrequency;
-    audio_spec.format = AUDIO_S16SYS;
-    audio_spec.channels = 2;
-    audio_spec.samples = 4096;
-    audio_spec.callback = NULL;
-    audio_spec.userdata = plugin;
+    for (;;)
+    {
+        SDL_SemWait(plugin->mTaskQueued);
 
-    audio_device = SDL_OpenAudioDevice(NULL, 0, &audio_spec, NULL, 0);
-    if (audio_device == 0) {
-        DBGConsole_Msg(0, "Failed to open audio: %s", SDL_GetError());
-        return -1;
-    }
+        while (plugin->mTasks.Pop(task))
+        {
+            Audio_Ucode(task);
 
-    SDL_PauseAudioDevice(audio_device, 0);
+            plugin->mTasksDone.fetch_add(1, std::memory_order_release);
+            SDL_SemPost(plugin->mTaskDone);
+        }
+
+        if (plugin->mWorkerQuit)
+            break;
+    }
 
     return 0;
 }
 
-void AudioPluginSDL::StartAudio()
+void AudioPluginSDL::AddBuffer(void * ptr, u32 length)
 {
-    mAudioThread = SDL_CreateThread(&AudioThread, "Audio", this);
+    if (length == 0)
+        return;
 
-    if (mAudioThread == nullptr)
+    if (mAudioDevice == 0)
     {
-        DBGConsole_Msg(0, "Failed to start the audio thread!");
-        FramerateLimiter_SetAuxillarySyncFunction(nullptr, nullptr);
+        StartAudio();
+        if (mAudioDevice == 0)
+            return;
     }
+
+    u32 num_samples = length / sizeof(Sample);
+
+    mAudioBuffer.AddSamples(reinterpret_cast<const Sample *>(ptr), num_samples, mFrequency, kOutputFrequency);
 }
 
-void AudioPluginSDL::StopAudio()
+void AudioPluginSDL::AudioCallback(void * arg, Uint8 * stream, int len)
+{
+    AudioPluginSDL * plugin = static_cast<AudioPluginSDL *>(arg);
+
+    // Pads with silence if we've run dry
+    plugin->mAudioBuffer.Drain(reinterpret_cast<Sample *>(stream), len / sizeof(Sample));
+}
+
+void AudioPluginSDL::StartAudio()
 {
-    if (mAudioThread == nullptr)
+    if (mAudioDevice != 0)
         return;
 
-    if (mAudioThread != nullptr)
+    SDL_AudioSpec audio_spec;
+    SDL_zero(audio_spec);
+    audio_spec.freq = kOutputFrequency;
+    audio_spec.format = AUDIO_S16SYS;
+    audio_spec.channels = 2;
+    audio_spec.samples = kDeviceBufferSize;
+    audio_spec.callback = &AudioCallback;
+    audio_spec.userdata = this;
+
+    mAudioBuffer.SetTargetLatency(kTargetLatency);
+
+    mAudioDevice = SDL_OpenAudioDevice(NULL, 0, &audio_spec, NULL, 0);
+    if (mAudioDevice == 0)
     {
-        int threadReturnValue;
-        SDL_WaitThread(mAudioThread, &threadReturnValue);
-        mAudioThread = nullptr;
+        DBGConsole_Msg(0, "Failed to open audio: %s", SDL_GetError());
+        return;
     }
 
-    // Clear the remaining audio data in SDL's audio buffer
-    if (audio_device != 0) {
-        SDL_ClearQueuedAudio(audio_device);
-        SDL_CloseAudioDevice(audio_device);
-        audio_device = 0;
+    SDL_PauseAudioDevice(mAudioDevice, 0);
+}
+
+void AudioPluginSDL::StopAudio()
+{
+    if (mAudioDevice == 0)
+        return;
+
+    // Closing the device waits for any callback in progress
+    SDL_CloseAudioDevice(mAudioDevice);
+    mAudioDevice = 0;
+
+    #ifdef DAEDALUS_DEBUG_CONSOLE
+    DBGConsole_Msg(0, "Audio: %d underruns, %d overruns", mAudioBuffer.GetUnderrunCount(), mAudioBuffer.GetOverrunCount());
+    #endif
+
+    // Throw away anything left over
+    Sample discard[kDeviceBufferSize];
+    while (mAudioBuffer.Drain(discard, kDeviceBufferSize) > 0)
+    {
     }
 }
 
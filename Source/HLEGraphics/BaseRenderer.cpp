@@ -31,6 +31,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "HLEGraphics/TextureCache.h"
 #include "HLEGraphics/RDPStateManager.h"
 #include "HLEGraphics/DLDebug.h"
+#include "HLEGraphics/TnLSIMD.h"
 
 #include "Utility/MathUtil.h"
 #include "Ultra/ultra_gbi.h"
@@ -46,6 +47,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "SysPSP/Math/Math.h"
 #endif 
 
+#ifdef DAEDALUS_GL
+#include "SysGL/HLEGraphics/RenderThreadGL.h"
+#endif
+
 #ifdef DAEDALUS_CTR
 struct ScePspFMatrix4
 {
@@ -65,14 +70,14 @@ struct TempVerts
 	TempVerts()
 	:	Verts(NULL)
 	,	Count(0)
+	,	Owned(false)
 	{
 	}
 
 	~TempVerts()
 	{
-#if defined(DAEDALUS_GL) || defined(DAEDALUS_CTR) || defined(DAEDALUS_GLES)
-		free(Verts);
-#endif
+		if (Owned)
+			free(Verts);
 	}
 
 	DaedalusVtx * Alloc(u32 count)
@@ -82,7 +87,13 @@ struct TempVerts
 		Verts = static_cast<DaedalusVtx*>(sceGuGetMemory(bytes));
 #endif
 #if defined(DAEDALUS_GL) || defined(DAEDALUS_CTR) || defined(DAEDALUS_GLES)
-		Verts = static_cast<DaedalusVtx*>(malloc(bytes));
+		// Write straight into the renderer's vertex buffer if it has one
+		Verts = gRenderer->AllocVertices(count);
+		if (Verts == NULL)
+		{
+			Verts = static_cast<DaedalusVtx*>(malloc(bytes));
+			Owned = true;
+		}
 #endif
 
 		Count = count;
@@ -91,6 +102,7 @@ struct TempVerts
 
 	DaedalusVtx *	Verts;
 	u32				Count;
+	bool			Owned;
 };
 
 
@@ -404,7 +416,13 @@ void BaseRenderer::UpdateViewport()
 	sceGuOffset(vx - (vp_w/2),vy - (vp_h/2));
 	sceGuViewport(vx + vp_x, vy + vp_y, vp_w, vp_h);
 #elif defined(DAEDALUS_GL) || defined(DAEDALUS_CTR) || defined(DAEDALUS_GLES)
+#ifdef DAEDALUS_GL
+	// This has to stay in order with the draws, which may be played back on the render thread
+	const s32 vp_gl_y = (s32)mScreenHeight - (vp_h + vp_y);
+	RenderThreadGL_Run([vp_x, vp_gl_y, vp_w, vp_h]() { glViewport(vp_x, vp_gl_y, vp_w, vp_h); });
+#else
 	glViewport(vp_x, (s32)mScreenHeight - (vp_h + vp_y), vp_w, vp_h);
+#endif
 #ifdef DAEDALUS_ENABLE_ASSERTS
 #else
 
@@ -1066,6 +1084,21 @@ void BaseRenderer::SetNewVertexInfo(u32 address, u32 v0, u32 n)
 		//Point light for Zelda MM
 		_TnLVFPU_Plight( &mat_world, &mat_world_project, pVtxBase, &mVtxProjected[v0], n, &mTnL );
 	}
+#elif defined(DAEDALUS_TNL_SIMD)
+	TnLSIMDInput in;
+	TnLSIMD_UnpackVertices( &in, pVtxBase, n, mTnL.Flags.Light );
+
+	TnLSIMDParams params;
+	params.World		= &mat_world;
+	params.Project		= &mat_world_project;
+	params.TexGenMatrix	= &mat_world_project;	// See the FPU path below
+	params.TnL			= &mTnL;
+	params.ProjectWorld	= false;
+	params.Light		= mTnL.Flags.Light;
+	params.PointLight	= mTnL.Flags.PointLight;
+	params.TexGen		= mTnL.Flags.TexGen;
+	params.TexGenMode	= mTnL.Flags.TexGenLin ? TNL_TEXGEN_LINEAR : TNL_TEXGEN_ACOS_ABS;
+	TnLSIMD_TransformVertices( params, in, &mVtxProjected[v0], n );
 #else
 	// Transform and Project + Lighting or Transform and Project with Colour
 	//
@@ -1445,6 +1478,22 @@ void BaseRenderer::SetNewVertexInfoPD(u32 address, u32 v0, u32 n)
 
 #ifdef DAEDALUS_PSP_USE_VFPU	
 	_TnLVFPUPD( &mat_world, &mat_project, pVtxBase, &mVtxProjected[v0], n, &mTnL, mn );
+#elif defined(DAEDALUS_TNL_SIMD)
+	TnLSIMDInput in;
+	TnLSIMD_UnpackVerticesPD( &in, pVtxBase, mn, n, mTnL.Flags.Light );
+
+	// PD has no point lights, env maps with the lit normal, and has linear/spherical the other way round
+	TnLSIMDParams params;
+	params.World		= &mat_world;
+	params.Project		= &mat_project;
+	params.TexGenMatrix	= NULL;
+	params.TnL			= &mTnL;
+	params.ProjectWorld	= true;
+	params.Light		= mTnL.Flags.Light;
+	params.PointLight	= false;
+	params.TexGen		= mTnL.Flags.TexGen;
+	params.TexGenMode	= mTnL.Flags.TexGenLin ? TNL_TEXGEN_ACOS : TNL_TEXGEN_LINEAR;
+	TnLSIMD_TransformVertices( params, in, &mVtxProjected[v0], n );
 #else
 	for (u32 i = v0; i < v0 + n; i++)
 	{
@@ -1958,7 +2007,12 @@ void BaseRenderer::SetScissor( u32 x0, u32 y0, u32 x1, u32 y1 )
 	// NB: OpenGL is x,y,w,h. Errors if width or height is negative, so clamp this.
 	s32 w = std::max<s32>( r - l, 0 );
 	s32 h = std::max<s32>( b - t, 0 );
+#ifdef DAEDALUS_GL
+	const s32 gl_y = (s32)mScreenHeight - (t + h);
+	RenderThreadGL_Run([l, gl_y, w, h]() { glScissor( l, gl_y, w, h ); });
+#else
 	glScissor( l, (s32)mScreenHeight - (t + h), w, h );
+#endif
 	#ifdef DAEDALUS_DEBUG_CONSOLE
 #else
 
@@ -240,6 +240,10 @@ public:
 	void				SetVIScales();
 	void				Reset();
 
+	// Memory the renderer can draw straight from, for the vertices passed to RenderTriangles.
+	// Returns NULL if the renderer has nowhere better than a temporary buffer.
+	virtual DaedalusVtx *	AllocVertices( u32 num_vertices [[maybe_unused]] )	{ return NULL; }
+
 	// Various rendering states
 	// Don't think we need to updateshademodel, it breaks tiger's honey hunt
 #ifdef DAEDALUS_PSP
@@ -24,6 +24,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <random>
 
 #include "Interface/ConfigOptions.h"
+#include "Core/RamWatch.h"
 #include "Core/ROM.h"
 #include "Debug/DBGConsole.h"
 #include "Debug/Dump.h"
@@ -53,13 +54,34 @@ static NativePf8888			gPaletteBuffer[ 256 ];
 // updating the native texture. This avoids some expensive work where possible.
 // On other platforms (e.g. OSX) updating textures is relatively inexpensive, so
 // we just skip the hashing process entirely, and update textures every frame
-// regardless of whether they've actually changed.
+// regardless of whether they've actually changed - unless RDRAM write watching
+// is available, in which case we update them exactly when their RDRAM is written.
 #if defined (DAEDALUS_PSP) || defined(DAEDALUS_CTR)
 static const bool kUpdateTexturesEveryFrame = false;
 #else
 static const bool kUpdateTexturesEveryFrame = true;
 #endif
 
+// The RDRAM a texture is converted from: its texels, and the palette for CI textures.
+// 512 bytes covers the largest TLUT.
+static u32 WatchTextureRam( const TextureInfo & ti )
+{
+	u32 stamp = RamWatch_Arm( ti.GetLoadAddress(), ti.GetHeight() * ti.GetPitch() );
+	if (ti.GetFormat() == G_IM_FMT_CI)
+	{
+		RamWatch_Arm( ti.GetTlutAddress(), 512 );
+	}
+	return stamp;
+}
+
+static bool HasTextureRamBeenWritten( const TextureInfo & ti, u32 stamp )
+{
+	if (RamWatch_HasWritten( ti.GetLoadAddress(), ti.GetHeight() * ti.GetPitch(), stamp ))
+		return true;
+
+	return ti.GetFormat() == G_IM_FMT_CI && RamWatch_HasWritten( ti.GetTlutAddress(), 512, stamp );
+}
+
 
 #if defined(DAEDALUS_GL) || defined(DAEDALUS_ACCURATE_TMEM) || defined(DAEDALUS_CTR) || defined(DAEDALUS_GLES)
 static ETextureFormat SelectNativeFormat(const TextureInfo & ti [[maybe_unused]])
@@ -223,6 +245,7 @@ CachedTexture::CachedTexture( const TextureInfo & ti )
 :	mTextureInfo( ti )
 ,	mpTexture(nullptr)
 ,	mTextureContentsHash( 0 )
+,	mWriteStamp( 0 )
 ,	mFrameLastUpToDate( gRDPFrame )
 ,	mFrameLastUsed( gRDPFrame )
 {
@@ -255,7 +278,14 @@ bool CachedTexture::Initialise()
 		{
 			mFrameLastUpToDate = gRDPFrame + (FastRand() & (gCheckTextureHashFrequency - 1));
 		}
-		UpdateTextureHash();
+		if (RamWatch_IsEnabled())
+		{
+			mWriteStamp = WatchTextureRam( mTextureInfo );
+		}
+		else
+		{
+			UpdateTextureHash();
+		}
 		UpdateTexture( mTextureInfo, mpTexture );
 	}
 
@@ -265,6 +295,17 @@ bool CachedTexture::Initialise()
 // Update the hash of the texture. Returns true if the texture should be updated.
 bool CachedTexture::UpdateTextureHash()
 {
+	// We know exactly when the RDRAM has been written, so there's nothing to sample.
+	// Watch it again before the texture is converted, so no later write is missed.
+	if (RamWatch_IsEnabled())
+	{
+		if (!HasTextureRamBeenWritten( mTextureInfo, mWriteStamp ))
+			return false;
+
+		mWriteStamp = WatchTextureRam( mTextureInfo );
+		return true;
+	}
+
 	if (kUpdateTexturesEveryFrame)
 	{
 		// NB always assume we need updating.
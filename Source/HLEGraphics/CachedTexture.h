@@ -58,6 +58,7 @@ class CachedTexture
 		std::shared_ptr<CNativeTexture>			mpTexture;
 
 		u32								mTextureContentsHash;
+		u32								mWriteStamp;		// From RamWatch_Arm, when RDRAM write watching is enabled
 		u32								mFrameLastUpToDate;	// Frame # that this was last updated
 		u32								mFrameLastUsed;		// Frame # that this was last used
 };
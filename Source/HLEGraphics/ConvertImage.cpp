@@ -26,11 +26,15 @@ Copyright (C) 2001 StrmnNrmn
 #include "Graphics/NativePixelFormat.h"
 #include "HLEGraphics/ConvertFormats.h"
 #include "HLEGraphics/ConvertImage.h"
+#include "HLEGraphics/ConvertTileSIMD.h"
 #include "HLEGraphics/N64PixelFormat.h"
 #include "HLEGraphics/RDP.h"
 #include "HLEGraphics/TextureInfo.h"
 #include "Utility/MathUtil.h"
 #include "Ultra/ultra_gbi.h"
+#include "System/Endian.h"
+
+#include <string.h>
 
 namespace
 {
@@ -491,39 +495,127 @@ static  void ConvertCI8_Row_To_8888( NativePf8888 * dst, const u8 * src, u32 src
 	}
 }
 
+#ifdef DAEDALUS_CONVERT_TILE_SIMD
+//*****************************************************************************
+//	8888 textures go through the ConvertTile row converters. Each row is
+//	copied out of RDRAM into big endian order first, with the words swapped
+//	back on odd lines of swapped textures. word_swap is that swap in bytes,
+//	and odd_width is how many texels the scalar code writes on those lines.
+//	Returns false if the scalar converter should be used.
+//*****************************************************************************
+static bool ConvertRowsSIMD( const TextureDestInfo & dsti, const TextureInfo & ti,
+							 ConvertTileRowFn row_fn, const NativePf8888 * palette,
+							 u32 bits_per_texel, u32 src_pitch, u32 odd_width, u32 word_swap )
+{
+	alignas(16) u8 row[ 4096 ];
+
+	const u32 width     = ti.GetWidth();
+	const u32 height    = ti.GetHeight();
+	const u32 row_bytes = AlignPow2( ( odd_width * bits_per_texel + 7 ) / 8, 16 );
+	u32 src_offset      = ti.GetLoadAddress();
+
+	if( dsti.Format != TexFmt_8888 || row_fn == nullptr || row_bytes > sizeof( row ) || height == 0 )
+		return false;
+
+	// Rows are moved a word at a time, and the swap on odd lines must stay within the row
+	if( ( src_offset | src_pitch ) & 7 || src_offset + ( height - 1 ) * src_pitch + row_bytes > gRamSize )
+		return false;
+
+	u8 * dst = static_cast< u8 * >( dsti.Data );
+	for( u32 y = 0; y < height; ++y )
+	{
+		const bool swap = ti.IsSwapped() && ( y & 1 );
+		const u32 word_xor = swap ? word_swap : 0;
+
+		for( u32 i = 0; i < row_bytes; i += 4 )
+		{
+			u32 word;
+			memcpy( &word, g_pu8RamBase + src_offset + ( i ^ word_xor ), sizeof( word ) );
+			word = BSWAP32( word );
+			memcpy( &row[ i ], &word, sizeof( word ) );
+		}
+
+		row_fn( reinterpret_cast< u32 * >( dst ), row, swap ? odd_width : width, reinterpret_cast< const u32 * >( palette ) );
+
+		src_offset += src_pitch;
+		dst += dsti.Pitch;
+	}
+	return true;
+}
+
+// SConvert swaps odd lines as it writes them, and rounds their width up to the swizzle
+template < typename InT >
+static bool ConvertRowsSIMD( const TextureDestInfo & dsti, const TextureInfo & ti, ConvertTileRowFn row_fn )
+{
+	const u32 swizzle = SConvert< InT >::Swizzle;
+	return ConvertRowsSIMD( dsti, ti, row_fn, nullptr, sizeof( InT ) * 8, ti.GetPitch(),
+							AlignPow2( ti.GetWidth(), 1 << swizzle ), swizzle * sizeof( InT ) );
+}
+#endif
+
 static void ConvertRGBA16(const TextureDestInfo & dsti, const TextureInfo & ti)
 {
+#ifdef DAEDALUS_CONVERT_TILE_SIMD
+	if( ConvertRowsSIMD< N64Pf5551 >( dsti, ti, ConvertTileSIMD_GetRowConverters().RGBA16Replicated ) )
+		return;
+#endif
 	SConvert< N64Pf5551 >::ConvertTexture( dsti, ti );
 }
 
 static void ConvertRGBA32(const TextureDestInfo & dsti, const TextureInfo & ti)
 {
+#ifdef DAEDALUS_CONVERT_TILE_SIMD
+	if( ConvertRowsSIMD< N64Pf8888 >( dsti, ti, ConvertTileSIMD_GetRowConverters().RGBA32 ) )
+		return;
+#endif
 	// Did have Fiddle of 8 here, pretty sure this was wrong (should have been 4)
 	SConvert< N64Pf8888 >::ConvertTexture( dsti, ti );
 }
 
 static void ConvertIA4(const TextureDestInfo & dsti, const TextureInfo & ti)
 {
+#ifdef DAEDALUS_CONVERT_TILE_SIMD
+	// The scalar version picks up the wrong texel for the last one of an odd width row, so leave those to it
+	if( ( ti.GetWidth() & 1 ) == 0 &&
+		ConvertRowsSIMD( dsti, ti, ConvertTileSIMD_GetRowConverters().IA4Replicated, nullptr, 4, ti.GetPitch(), ti.GetWidth(), 0x4 ) )
+		return;
+#endif
 	SConvertIA4::ConvertTexture( dsti, ti );
 }
 
 static void ConvertIA8(const TextureDestInfo & dsti, const TextureInfo & ti)
 {
+#ifdef DAEDALUS_CONVERT_TILE_SIMD
+	if( ConvertRowsSIMD< N64PfIA8 >( dsti, ti, ConvertTileSIMD_GetRowConverters().IA8 ) )
+		return;
+#endif
 	SConvert< N64PfIA8 >::ConvertTexture( dsti, ti );
 }
 
 static void ConvertIA16(const TextureDestInfo & dsti, const TextureInfo & ti)
 {
+#ifdef DAEDALUS_CONVERT_TILE_SIMD
+	if( ConvertRowsSIMD< N64PfIA16 >( dsti, ti, ConvertTileSIMD_GetRowConverters().IA16 ) )
+		return;
+#endif
 	SConvert< N64PfIA16 >::ConvertTexture( dsti, ti );
 }
 
 static void ConvertI4(const TextureDestInfo & dsti, const TextureInfo & ti)
 {
+#ifdef DAEDALUS_CONVERT_TILE_SIMD
+	if( ConvertRowsSIMD( dsti, ti, ConvertTileSIMD_GetRowConverters().I4, nullptr, 4, ti.GetPitch(), ti.GetWidth(), 0x4 ) )
+		return;
+#endif
 	SConvertI4::ConvertTexture( dsti, ti );
 }
 
 static void ConvertI8(const TextureDestInfo & dsti, const TextureInfo & ti)
 {
+#ifdef DAEDALUS_CONVERT_TILE_SIMD
+	if( ConvertRowsSIMD< N64PfI8 >( dsti, ti, ConvertTileSIMD_GetRowConverters().I8 ) )
+		return;
+#endif
 	SConvert< N64PfI8 >::ConvertTexture( dsti, ti );
 }
 
@@ -540,6 +632,10 @@ static void ConvertCI8(const TextureDestInfo & dsti, const TextureInfo & ti)
 	switch( dsti.Format )
 	{
 	case TexFmt_8888:
+#ifdef DAEDALUS_CONVERT_TILE_SIMD
+		if( ConvertRowsSIMD( dsti, ti, ConvertTileSIMD_GetRowConverters().CI8, dst_palette, 8, ti.GetPitch(), ti.GetWidth(), 0x4 ) )
+			break;
+#endif
 		ConvertPalettisedTo8888( dsti, ti, dst_palette,
 								 ConvertCI8_Row_To_8888< 0x4 | 0x3 >,
 								 ConvertCI8_Row_To_8888< 0x3 > );
@@ -573,6 +669,12 @@ static void ConvertYUV16(const TextureDestInfo & dsti, const TextureInfo & ti)
 	// NB! YUV/16 line needs to be doubled.
 	src_row_stride *= 2;
 
+#ifdef DAEDALUS_CONVERT_TILE_SIMD
+	if( !ti.IsSwapped() && ( width & 1 ) == 0 &&
+		ConvertRowsSIMD( dsti, ti, ConvertTileSIMD_GetRowConverters().YUV16, nullptr, 16, src_row_stride, width, 0 ) )
+		return;
+#endif
+
 	if (ti.IsSwapped())
 	{
 		//TODO: This should be easy to implement but I would like to find first a game that uses it
@@ -617,6 +719,10 @@ static void ConvertCI4(const TextureDestInfo & dsti, const TextureInfo & ti)
 	switch( dsti.Format )
 	{
 	case TexFmt_8888:
+#ifdef DAEDALUS_CONVERT_TILE_SIMD
+		if( ConvertRowsSIMD( dsti, ti, ConvertTileSIMD_GetRowConverters().CI4, dst_palette, 4, ti.GetPitch(), ti.GetWidth(), 0x4 ) )
+			break;
+#endif
 		ConvertPalettisedTo8888( dsti, ti, dst_palette,
 								 ConvertCI4_Row_To_8888< 0x4 | 0x3 >,
 								 ConvertCI4_Row_To_8888< 0x3 > );
@@ -5,11 +5,13 @@
 #include "Core/ROM.h"
 #include "HLEGraphics/ConvertFormats.h"
 #include "HLEGraphics/ConvertTile.h"
+#include "HLEGraphics/ConvertTileSIMD.h"
 #include "HLEGraphics/RDP.h"
 #include "HLEGraphics/TextureInfo.h"
 #include "Graphics/NativePixelFormat.h"
 #include "System/Endian.h"
 
+#include <string.h>
 #include <vector>
 
 struct TileDestInfo
@@ -34,6 +36,52 @@ struct TileDestInfo
 
 extern u8 gTMEM[4096];
 
+#ifdef DAEDALUS_CONVERT_TILE_SIMD
+// Copies a row out of TMEM with the swizzle on odd lines and the wrap at the
+// end of TMEM undone, so the row converters can read it straight through.
+// Rows always start on a qword boundary, so each qword can be moved whole.
+static void UnswizzleRow(u8 * dst, u32 src_offset, u32 row_swizzle, u32 num_bytes)
+{
+	for (u32 i = 0; i < num_bytes; i += 8)
+	{
+		u64 qword;
+		memcpy(&qword, &gTMEM[((src_offset+i)^(row_swizzle&0x8))&0xfff], sizeof(qword));
+		if (row_swizzle & 0x4)
+		{
+			qword = (qword >> 32) | (qword << 32);
+		}
+		memcpy(&dst[i], &qword, sizeof(qword));
+	}
+}
+
+// Returns false if there's no SIMD converter for this format, and the scalar one should be used
+static bool ConvertRowsSIMD(const TileDestInfo & dsti, const TextureInfo & ti,
+							ConvertTileRowFn row_fn, const u32 * palette,
+							u32 width, u32 src_row_bytes, u32 src_row_stride, u32 swizzle)
+{
+	alignas(16) u8 row[4096];
+	src_row_bytes = (src_row_bytes + 7) & ~7;
+	if (row_fn == nullptr || src_row_bytes > sizeof(row))
+		return false;
+
+	u8 * dst = static_cast<u8*>(dsti.Data);
+	u32 src_row_offset = ti.GetTmemAddress()<<3;
+
+	u32 row_swizzle = 0;
+	for (u32 y = 0; y < dsti.Height; ++y)
+	{
+		UnswizzleRow(row, src_row_offset, row_swizzle, src_row_bytes);
+		row_fn(reinterpret_cast<u32*>(dst), row, width, palette);
+
+		src_row_offset += src_row_stride;
+		dst += dsti.Pitch;
+
+		row_swizzle ^= swizzle;
+	}
+	return true;
+}
+#endif
+
 
 static void ConvertRGBA32(const TileDestInfo & dsti, const TextureInfo & ti)
 {
@@ -51,6 +99,11 @@ static void ConvertRGBA32(const TileDestInfo & dsti, const TextureInfo & ti)
 	// NB! RGBA/32 line needs to be doubled.
 	src_row_stride *= 2;
 
+#ifdef DAEDALUS_CONVERT_TILE_SIMD
+	if (ConvertRowsSIMD(dsti, ti, ConvertTileSIMD_GetRowConverters().RGBA32, nullptr, width, width*4, src_row_stride, 0x8))
+		return;
+#endif
+
 	u32 row_swizzle = 0;
 	for (u32 y = 0; y < height; ++y)
 	{
@@ -89,6 +142,11 @@ static void ConvertRGBA16(const TileDestInfo & dsti, const TextureInfo & ti)
 	u32 src_row_stride = ti.GetLine()<<3;
 	u32 src_row_offset = ti.GetTmemAddress()<<3;
 
+#ifdef DAEDALUS_CONVERT_TILE_SIMD
+	if (ConvertRowsSIMD(dsti, ti, ConvertTileSIMD_GetRowConverters().RGBA16, nullptr, width, width*2, src_row_stride, 0x4))
+		return;
+#endif
+
 	u32 row_swizzle = 0;
 	for (u32 y = 0; y < height; ++y)
 	{
@@ -137,6 +195,11 @@ static void ConvertCI8T(const TileDestInfo & dsti, const TextureInfo & ti)
 		palette[i] = PalConvertFn(src_pixel);
 	}
 
+#ifdef DAEDALUS_CONVERT_TILE_SIMD
+	if (ConvertRowsSIMD(dsti, ti, ConvertTileSIMD_GetRowConverters().CI8, palette, width, width, src_row_stride, 0x4))
+		return;
+#endif
+
 	u32 row_swizzle = 0;
 	for (u32 y = 0; y < height; ++y)
 	{
@@ -184,6 +247,11 @@ static void ConvertCI4T(const TileDestInfo & dsti, const TextureInfo & ti)
 		palette[i] = PalConvertFn(src_pixel);
 	}
 
+#ifdef DAEDALUS_CONVERT_TILE_SIMD
+	if (ConvertRowsSIMD(dsti, ti, ConvertTileSIMD_GetRowConverters().CI4, palette, width, (width+1)/2, src_row_stride, 0x4))
+		return;
+#endif
+
 	u32 row_swizzle = 0;
 	for (u32 y = 0; y < height; ++y)
 	{
@@ -267,6 +335,11 @@ static void ConvertIA16(const TileDestInfo & dsti, const TextureInfo & ti)
 	u32 src_row_stride = ti.GetLine()<<3;
 	u32 src_row_offset = ti.GetTmemAddress()<<3;
 
+#ifdef DAEDALUS_CONVERT_TILE_SIMD
+	if (ConvertRowsSIMD(dsti, ti, ConvertTileSIMD_GetRowConverters().IA16, nullptr, width, width*2, src_row_stride, 0x4))
+		return;
+#endif
+
 	u32 row_swizzle = 0;
 	for (u32 y = 0; y < height; ++y)
 	{
@@ -304,6 +377,11 @@ static void ConvertIA8(const TileDestInfo & dsti, const TextureInfo & ti)
 	u32 src_row_stride = ti.GetLine()<<3;
 	u32 src_row_offset = ti.GetTmemAddress()<<3;
 
+#ifdef DAEDALUS_CONVERT_TILE_SIMD
+	if (ConvertRowsSIMD(dsti, ti, ConvertTileSIMD_GetRowConverters().IA8, nullptr, width, width, src_row_stride, 0x4))
+		return;
+#endif
+
 	u32 row_swizzle = 0;
 	for (u32 y = 0; y < height; ++y)
 	{
@@ -345,6 +423,11 @@ static void ConvertIA4(const TileDestInfo & dsti, const TextureInfo & ti)
 	u32 src_row_stride = ti.GetLine()<<3;
 	u32 src_row_offset = ti.GetTmemAddress()<<3;
 
+#ifdef DAEDALUS_CONVERT_TILE_SIMD
+	if (ConvertRowsSIMD(dsti, ti, ConvertTileSIMD_GetRowConverters().IA4, nullptr, width, (width+1)/2, src_row_stride, 0x4))
+		return;
+#endif
+
 	u32 row_swizzle = 0;
 	for (u32 y = 0; y < height; ++y)
 	{
@@ -396,6 +479,11 @@ static void ConvertI8(const TileDestInfo & dsti, const TextureInfo & ti)
 	u32 src_row_stride = ti.GetLine()<<3;
 	u32 src_row_offset = ti.GetTmemAddress()<<3;
 
+#ifdef DAEDALUS_CONVERT_TILE_SIMD
+	if (ConvertRowsSIMD(dsti, ti, ConvertTileSIMD_GetRowConverters().I8, nullptr, width, width, src_row_stride, 0x4))
+		return;
+#endif
+
 	u32 row_swizzle = 0;
 	for (u32 y = 0; y < height; ++y)
 	{
@@ -435,6 +523,11 @@ static void ConvertI4(const TileDestInfo & dsti, const TextureInfo & ti)
 	u32 src_row_stride = ti.GetLine()<<3;
 	u32 src_row_offset = ti.GetTmemAddress()<<3;
 
+#ifdef DAEDALUS_CONVERT_TILE_SIMD
+	if (ConvertRowsSIMD(dsti, ti, ConvertTileSIMD_GetRowConverters().I4, nullptr, width, (width+1)/2, src_row_stride, 0x4))
+		return;
+#endif
+
 	u32 row_swizzle = 0;
 	for (u32 y = 0; y < height; ++y)
 	{
@@ -488,6 +581,14 @@ static void ConvertYUV16(const TileDestInfo & dsti, const TextureInfo & ti)
 
 	// NB! YUV/16 line needs to be doubled.
 	src_row_stride *= 2;
+
+#ifdef DAEDALUS_CONVERT_TILE_SIMD
+	// Texels come in pairs, and the scalar loop below always writes both
+	u32 even_width = (width+1)&~1;
+	if (ConvertRowsSIMD(dsti, ti, ConvertTileSIMD_GetRowConverters().YUV16, nullptr, even_width, even_width*2, src_row_stride, 0x4))
+		return;
+#endif
+
 	u32 row_swizzle = 0;
 
 	for (u32 y = 0; y < height; ++y)
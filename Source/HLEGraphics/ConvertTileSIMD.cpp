@@ -0,0 +1,116 @@
+/*
+Copyright (C) 2007 StrmnNrmn
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+
+#include "Base/Types.h"
+
+#include "HLEGraphics/ConvertTileSIMD.h"
+
+#ifdef DAEDALUS_CONVERT_TILE_SIMD
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+#include "Debug/DBGConsole.h"
+
+static bool gConvertTileSIMDEnabled = true;
+
+//*****************************************************************************
+//
+//*****************************************************************************
+static bool CPUHasSSSE3()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid( info, 1 );
+	return ( info[2] & ( 1 << 9 ) ) != 0;
+#else
+	return __builtin_cpu_supports( "ssse3" );
+#endif
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+#ifdef DAEDALUS_CONVERT_TILE_AVX2
+static bool CPUHasAVX2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid( info, 1 );
+	const bool has_osxsave = ( info[2] & ( 1 << 27 ) ) != 0;
+
+	__cpuidex( info, 7, 0 );
+	const bool has_avx2 = ( info[1] & ( 1 << 5 ) ) != 0;
+
+	// The OS has to save the upper halves of the registers too
+	return has_avx2 && has_osxsave && ( _xgetbv( 0 ) & 6 ) == 6;
+#else
+	return __builtin_cpu_supports( "avx2" );
+#endif
+}
+#endif
+
+//*****************************************************************************
+//
+//*****************************************************************************
+static STileRowConverters SelectRowConverters()
+{
+	STileRowConverters rows = {};
+
+	if( !CPUHasSSSE3() )
+	{
+		DBGConsole_Msg( 0, "Texture conversion: using scalar" );
+		return rows;
+	}
+	ConvertTileSIMD_InitSSSE3( rows );
+
+#ifdef DAEDALUS_CONVERT_TILE_AVX2
+	if( CPUHasAVX2() )
+	{
+		ConvertTileSIMD_InitAVX2( rows );
+		DBGConsole_Msg( 0, "Texture conversion: using AVX2" );
+		return rows;
+	}
+#endif
+	DBGConsole_Msg( 0, "Texture conversion: using SSSE3" );
+	return rows;
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+const STileRowConverters & ConvertTileSIMD_GetRowConverters()
+{
+	static const STileRowConverters rows = SelectRowConverters();
+	static const STileRowConverters scalar = {};
+	return gConvertTileSIMDEnabled ? rows : scalar;
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void ConvertTileSIMD_SetEnabled( bool enabled )
+{
+	gConvertTileSIMDEnabled = enabled;
+}
+
+#endif // DAEDALUS_CONVERT_TILE_SIMD
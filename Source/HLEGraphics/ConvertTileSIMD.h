@@ -0,0 +1,72 @@
+/*
+Copyright (C) 2007 StrmnNrmn
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef HLEGRAPHICS_CONVERTTILESIMD_H_
+#define HLEGRAPHICS_CONVERTTILESIMD_H_
+
+#include "Base/Types.h"
+
+//*****************************************************************************
+//	SSSE3 and AVX2 row converters for ConvertTile and ConvertImage, picked
+//	once the CPU has been checked. Each one takes a single row of texels in
+//	big endian order (as they sit in TMEM, with the swizzle on odd lines
+//	already undone) and writes width RGBA 8888 texels, exactly as the scalar
+//	converters do.
+//	Any entry left as nullptr means the scalar converter should be used.
+//*****************************************************************************
+
+#if (defined(__x86_64__) || defined(_M_X64)) && !defined(DAEDALUS_PSP)
+#define DAEDALUS_CONVERT_TILE_SIMD
+#endif
+
+#ifdef DAEDALUS_CONVERT_TILE_SIMD
+
+// palette is only used by the CI formats, and has 16 or 256 entries
+using ConvertTileRowFn = void (*)( u32 * dst, const u8 * src, u32 width, const u32 * palette );
+
+struct STileRowConverters
+{
+	ConvertTileRowFn	RGBA16;
+	ConvertTileRowFn	RGBA32;
+	ConvertTileRowFn	YUV16;			// width must be even
+	ConvertTileRowFn	CI4;
+	ConvertTileRowFn	CI8;
+	ConvertTileRowFn	IA4;
+	ConvertTileRowFn	IA8;
+	ConvertTileRowFn	IA16;
+	ConvertTileRowFn	I4;
+	ConvertTileRowFn	I8;
+
+	// ConvertImage expands these by bit replication, as the N64 pixel formats do
+	ConvertTileRowFn	RGBA16Replicated;
+	ConvertTileRowFn	IA4Replicated;
+};
+
+const STileRowConverters &	ConvertTileSIMD_GetRowConverters();
+void						ConvertTileSIMD_SetEnabled( bool enabled );		// Lets the tests compare against the scalar converters
+
+// Each of these is built separately with its instruction set enabled. Only call them if the CPU supports it
+void						ConvertTileSIMD_InitSSSE3( STileRowConverters & rows );
+#ifdef DAEDALUS_CONVERT_TILE_AVX2
+void						ConvertTileSIMD_InitAVX2( STileRowConverters & rows );
+#endif
+
+#endif // DAEDALUS_CONVERT_TILE_SIMD
+
+#endif // HLEGRAPHICS_CONVERTTILESIMD_H_
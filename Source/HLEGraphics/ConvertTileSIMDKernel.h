@@ -0,0 +1,188 @@
+/*
+Copyright (C) 2007 StrmnNrmn
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef HLEGRAPHICS_CONVERTTILESIMDKERNEL_H_
+#define HLEGRAPHICS_CONVERTTILESIMDKERNEL_H_
+
+//*****************************************************************************
+//	Shared by the SSSE3 and AVX2 row converters. The lookup tables are built
+//	from the scalar helpers in ConvertFormats.h, so the shuffles can't give a
+//	different answer to them, and the texels left over at the end of a row
+//	go through those same helpers. The Replicated tables are for ConvertImage,
+//	which expands RGBA16 and IA4 by bit replication rather than by scaling.
+//*****************************************************************************
+
+#include "Base/Types.h"
+
+#include "HLEGraphics/ConvertFormats.h"
+
+namespace
+{
+
+struct STileTables
+{
+	STileTables()
+	{
+		for( u32 i = 0; i < 32; ++i )
+		{
+			FiveToEight[ i ]           = u8( RGBA16( u16( i << 11 ) ) );
+			FiveToEightReplicated[ i ] = ::FiveToEight[ i ];
+		}
+		for( u32 i = 0; i < 16; ++i )
+		{
+			FourToEight[ i ]    = ::FourToEight[ i ];
+			I4[ i ]             = u8( ::I4( u8( i ) ) );
+			IA4I[ i ]           = u8( ::IA4( u8( i ) ) );
+			IA4A[ i ]           = u8( ::IA4( u8( i ) ) >> 24 );
+			IA4ReplicatedI[ i ] = ThreeToEight[ i >> 1 ];
+			IA4ReplicatedA[ i ] = OneToEight[ i & 1 ];
+		}
+	}
+
+	alignas(16) u8		FiveToEight[ 32 ];		// RGBA16 channels
+	alignas(16) u8		FiveToEightReplicated[ 32 ];
+	alignas(16) u8		FourToEight[ 16 ];		// IA8
+	alignas(16) u8		I4[ 16 ];
+	alignas(16) u8		IA4I[ 16 ];
+	alignas(16) u8		IA4A[ 16 ];
+	alignas(16) u8		IA4ReplicatedI[ 16 ];
+	alignas(16) u8		IA4ReplicatedA[ 16 ];
+};
+
+const STileTables & TileTables()
+{
+	static const STileTables tables;
+	return tables;
+}
+
+// The rest of a row, from texel x on
+inline void RowTailRGBA16( u32 * dst, const u8 * src, u32 x, u32 width )
+{
+	for( ; x < width; ++x )
+	{
+		dst[ x ] = RGBA16( u16( ( src[ x*2+0 ] << 8 ) | src[ x*2+1 ] ) );
+	}
+}
+
+inline void RowTailRGBA16Replicated( u32 * dst, const u8 * src, u32 x, u32 width )
+{
+	for( ; x < width; ++x )
+	{
+		u16 v = u16( ( src[ x*2+0 ] << 8 ) | src[ x*2+1 ] );
+		dst[ x ] = RGBA32( OneToEight[ v & 1 ], FiveToEight[ ( v >> 1 ) & 0x1f ], FiveToEight[ ( v >> 6 ) & 0x1f ], FiveToEight[ v >> 11 ] );
+	}
+}
+
+inline void RowTailIA16( u32 * dst, const u8 * src, u32 x, u32 width )
+{
+	for( ; x < width; ++x )
+	{
+		dst[ x ] = IA16( u16( ( src[ x*2+0 ] << 8 ) | src[ x*2+1 ] ) );
+	}
+}
+
+inline void RowTailYUV16( u32 * dst, const u8 * src, u32 x, u32 width )
+{
+	for( ; x < width; x += 2 )
+	{
+		const u8 * p = &src[ x*2 ];
+		dst[ x+0 ] = YUV16( p[1], p[0], p[2] );
+		dst[ x+1 ] = YUV16( p[3], p[0], p[2] );
+	}
+}
+
+inline void RowTailCI8( u32 * dst, const u8 * src, u32 x, u32 width, const u32 * palette )
+{
+	for( ; x < width; ++x )
+	{
+		dst[ x ] = palette[ src[ x ] ];
+	}
+}
+
+inline u8 Nibble( const u8 * src, u32 x )
+{
+	return ( x & 1 ) ? ( src[ x>>1 ] & 0xf ) : ( src[ x>>1 ] >> 4 );
+}
+
+inline void RowTailCI4( u32 * dst, const u8 * src, u32 x, u32 width, const u32 * palette )
+{
+	for( ; x < width; ++x )
+	{
+		dst[ x ] = palette[ Nibble( src, x ) ];
+	}
+}
+
+inline void RowTailIA4( u32 * dst, const u8 * src, u32 x, u32 width )
+{
+	for( ; x < width; ++x )
+	{
+		dst[ x ] = IA4( Nibble( src, x ) );
+	}
+}
+
+inline void RowTailIA4Replicated( u32 * dst, const u8 * src, u32 x, u32 width )
+{
+	for( ; x < width; ++x )
+	{
+		u8 n = Nibble( src, x );
+		u8 i = ThreeToEight[ n >> 1 ];
+		dst[ x ] = RGBA32( OneToEight[ n & 1 ], i, i, i );
+	}
+}
+
+inline void RowTailI4( u32 * dst, const u8 * src, u32 x, u32 width )
+{
+	for( ; x < width; ++x )
+	{
+		dst[ x ] = I4( Nibble( src, x ) );
+	}
+}
+
+inline void RowTailIA8( u32 * dst, const u8 * src, u32 x, u32 width )
+{
+	u8 * dst8 = reinterpret_cast< u8 * >( dst );
+	for( ; x < width; ++x )
+	{
+		u8 i = FourToEight[ ( src[ x ] >> 4 ) & 0xf ];
+		u8 a = FourToEight[ ( src[ x ]      ) & 0xf ];
+
+		dst8[ x*4+0 ] = i;
+		dst8[ x*4+1 ] = i;
+		dst8[ x*4+2 ] = i;
+		dst8[ x*4+3 ] = a;
+	}
+}
+
+inline void RowTailI8( u32 * dst, const u8 * src, u32 x, u32 width )
+{
+	u8 * dst8 = reinterpret_cast< u8 * >( dst );
+	for( ; x < width; ++x )
+	{
+		u8 i = src[ x ];
+
+		dst8[ x*4+0 ] = i;
+		dst8[ x*4+1 ] = i;
+		dst8[ x*4+2 ] = i;
+		dst8[ x*4+3 ] = i;
+	}
+}
+
+}
+
+#endif // HLEGRAPHICS_CONVERTTILESIMDKERNEL_H_
@@ -0,0 +1,178 @@
+/*
+Copyright (C) 2007 StrmnNrmn
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+//*****************************************************************************
+//	This file is built with AVX2 enabled, and is only called into once
+//	ConvertTileSIMD.cpp has checked the CPU supports it. It only replaces
+//	the SSSE3 converters where the wider registers or the gather help: CI8
+//	and the common 16 bit and 8 bit formats.
+//*****************************************************************************
+
+#include "Base/Types.h"
+
+#include "HLEGraphics/ConvertTileSIMD.h"
+
+#if defined(DAEDALUS_CONVERT_TILE_SIMD) && defined(DAEDALUS_CONVERT_TILE_AVX2)
+
+#include <immintrin.h>
+
+#include "HLEGraphics/ConvertTileSIMDKernel.h"
+
+namespace
+{
+
+inline __m256i Load( const u8 * p )				{ return _mm256_loadu_si256( reinterpret_cast< const __m256i * >( p ) ); }
+inline void Store( u32 * p, __m256i v )			{ _mm256_storeu_si256( reinterpret_cast< __m256i * >( p ), v ); }
+
+// Both lanes hold the same 16 bytes, so in-lane shuffles can reach all of them
+inline __m256i LoadBroadcast( const u8 * p )
+{
+	return _mm256_broadcastsi128_si256( _mm_loadu_si128( reinterpret_cast< const __m128i * >( p ) ) );
+}
+
+// 32 entry byte lookup, for idx in [0,32). pshufb gives 0 for any index with the top bit set
+inline __m256i Lookup32( __m256i lo, __m256i hi, __m256i idx )
+{
+	return _mm256_or_si256( _mm256_shuffle_epi8( lo, _mm256_add_epi8( idx, _mm256_set1_epi8( 0x70 ) ) ),
+							_mm256_shuffle_epi8( hi, _mm256_sub_epi8( idx, _mm256_set1_epi8( 0x10 ) ) ) );
+}
+
+//*****************************************************************************
+//	As the SSSE3 version, but each lane does 8 texels. The lanes come out as
+//	texels 0-3,8-11 and 4-7,12-15, so they're swapped back before storing.
+//*****************************************************************************
+template< void (*RowTail)( u32 *, const u8 *, u32, u32 ) >
+inline void ConvertRowRGBA16T( u32 * dst, const u8 * src, u32 width, const u8 * five_to_eight )
+{
+	const __m256i five_lo = _mm256_broadcastsi128_si256( _mm_load_si128( reinterpret_cast< const __m128i * >( &five_to_eight[ 0 ] ) ) );
+	const __m256i five_hi = _mm256_broadcastsi128_si256( _mm_load_si128( reinterpret_cast< const __m128i * >( &five_to_eight[ 16 ] ) ) );
+	const __m256i swap    = _mm256_setr_epi8( 1,0, 3,2, 5,4, 7,6, 9,8, 11,10, 13,12, 15,14,
+											  1,0, 3,2, 5,4, 7,6, 9,8, 11,10, 13,12, 15,14 );
+	const __m256i mask5   = _mm256_set1_epi16( 0x1f );
+	const __m256i one     = _mm256_set1_epi16( 0x01 );
+	const __m256i ff      = _mm256_set1_epi16( 0xff );
+
+	u32 x = 0;
+	for( ; x + 16 <= width; x += 16 )
+	{
+		__m256i v = _mm256_shuffle_epi8( Load( &src[ x*2 ] ), swap );
+
+		__m256i r = _mm256_srli_epi16( v, 11 );
+		__m256i g = _mm256_and_si256( _mm256_srli_epi16( v, 6 ), mask5 );
+		__m256i b = _mm256_and_si256( _mm256_srli_epi16( v, 1 ), mask5 );
+		__m256i a = _mm256_and_si256( _mm256_cmpeq_epi16( _mm256_and_si256( v, one ), one ), ff );
+
+		__m256i rg = Lookup32( five_lo, five_hi, _mm256_packus_epi16( r, g ) );
+		__m256i ba = _mm256_unpacklo_epi64( Lookup32( five_lo, five_hi, _mm256_packus_epi16( b, b ) ), _mm256_packus_epi16( a, a ) );
+
+		rg = _mm256_unpacklo_epi8( rg, _mm256_srli_si256( rg, 8 ) );
+		ba = _mm256_unpacklo_epi8( ba, _mm256_srli_si256( ba, 8 ) );
+
+		__m256i lo = _mm256_unpacklo_epi16( rg, ba );
+		__m256i hi = _mm256_unpackhi_epi16( rg, ba );
+
+		Store( &dst[ x+0 ], _mm256_permute2x128_si256( lo, hi, 0x20 ) );
+		Store( &dst[ x+8 ], _mm256_permute2x128_si256( lo, hi, 0x31 ) );
+	}
+
+	RowTail( dst, src, x, width );
+}
+
+void ConvertRowRGBA16( u32 * dst, const u8 * src, u32 width, const u32 * )
+{
+	ConvertRowRGBA16T< RowTailRGBA16 >( dst, src, width, TileTables().FiveToEight );
+}
+
+void ConvertRowRGBA16Replicated( u32 * dst, const u8 * src, u32 width, const u32 * )
+{
+	ConvertRowRGBA16T< RowTailRGBA16Replicated >( dst, src, width, TileTables().FiveToEightReplicated );
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void ConvertRowCI8( u32 * dst, const u8 * src, u32 width, const u32 * palette )
+{
+	const int * table = reinterpret_cast< const int * >( palette );
+
+	u32 x = 0;
+	for( ; x + 8 <= width; x += 8 )
+	{
+		__m256i idx = _mm256_cvtepu8_epi32( _mm_loadl_epi64( reinterpret_cast< const __m128i * >( &src[ x ] ) ) );
+
+		Store( &dst[ x ], _mm256_i32gather_epi32( table, idx, 4 ) );
+	}
+
+	RowTailCI8( dst, src, x, width, palette );
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void ConvertRowIA16( u32 * dst, const u8 * src, u32 width, const u32 * )
+{
+	const __m256i expand = _mm256_setr_epi8( 0,0,0,1, 2,2,2,3, 4,4,4,5, 6,6,6,7,
+											 8,8,8,9, 10,10,10,11, 12,12,12,13, 14,14,14,15 );
+
+	u32 x = 0;
+	for( ; x + 8 <= width; x += 8 )
+	{
+		Store( &dst[ x ], _mm256_shuffle_epi8( LoadBroadcast( &src[ x*2 ] ), expand ) );
+	}
+
+	RowTailIA16( dst, src, x, width );
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void ConvertRowI8( u32 * dst, const u8 * src, u32 width, const u32 * )
+{
+	const __m256i expand_lo = _mm256_setr_epi8( 0,0,0,0, 1,1,1,1, 2,2,2,2, 3,3,3,3,
+												4,4,4,4, 5,5,5,5, 6,6,6,6, 7,7,7,7 );
+	const __m256i expand_hi = _mm256_add_epi8( expand_lo, _mm256_set1_epi8( 8 ) );
+
+	u32 x = 0;
+	for( ; x + 16 <= width; x += 16 )
+	{
+		__m256i v = LoadBroadcast( &src[ x ] );
+
+		Store( &dst[ x+0 ], _mm256_shuffle_epi8( v, expand_lo ) );
+		Store( &dst[ x+8 ], _mm256_shuffle_epi8( v, expand_hi ) );
+	}
+
+	RowTailI8( dst, src, x, width );
+}
+
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void ConvertTileSIMD_InitAVX2( STileRowConverters & rows )
+{
+	rows.RGBA16 = ConvertRowRGBA16;
+	rows.CI8    = ConvertRowCI8;
+	rows.IA16   = ConvertRowIA16;
+	rows.I8     = ConvertRowI8;
+
+	rows.RGBA16Replicated = ConvertRowRGBA16Replicated;
+}
+
+#endif // DAEDALUS_CONVERT_TILE_SIMD && DAEDALUS_CONVERT_TILE_AVX2
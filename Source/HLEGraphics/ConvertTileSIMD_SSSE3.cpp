@@ -0,0 +1,368 @@
+/*
+Copyright (C) 2007 StrmnNrmn
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+//*****************************************************************************
+//	This file is built with SSSE3 enabled, and is only called into once
+//	ConvertTileSIMD.cpp has checked the CPU supports it.
+//	Most of the work is done with pshufb: byte swaps, the 4 and 5 bit to
+//	8 bit lookups, and splitting the 16 entry CI4 palette into byte planes.
+//*****************************************************************************
+
+#include "Base/Types.h"
+
+#include "HLEGraphics/ConvertTileSIMD.h"
+
+#ifdef DAEDALUS_CONVERT_TILE_SIMD
+
+#include <string.h>
+
+#include <tmmintrin.h>
+
+#include "HLEGraphics/ConvertTileSIMDKernel.h"
+
+namespace
+{
+
+inline __m128i Load( const u8 * p )				{ return _mm_loadu_si128( reinterpret_cast< const __m128i * >( p ) ); }
+inline void Store( u32 * p, __m128i v )			{ _mm_storeu_si128( reinterpret_cast< __m128i * >( p ), v ); }
+
+// 32 entry byte lookup, for idx in [0,32). pshufb gives 0 for any index with the top bit set
+inline __m128i Lookup32( __m128i lo, __m128i hi, __m128i idx )
+{
+	return _mm_or_si128( _mm_shuffle_epi8( lo, _mm_add_epi8( idx, _mm_set1_epi8( 0x70 ) ) ),
+						 _mm_shuffle_epi8( hi, _mm_sub_epi8( idx, _mm_set1_epi8( 0x10 ) ) ) );
+}
+
+// Splits 16 packed bytes into 32 nibbles, high nibble first
+inline void SplitNibbles( __m128i v, __m128i * p_lo, __m128i * p_hi )
+{
+	const __m128i mask = _mm_set1_epi8( 0x0f );
+	__m128i hi_nibbles = _mm_and_si128( _mm_srli_epi16( v, 4 ), mask );
+	__m128i lo_nibbles = _mm_and_si128( v, mask );
+
+	*p_lo = _mm_unpacklo_epi8( hi_nibbles, lo_nibbles );
+	*p_hi = _mm_unpackhi_epi8( hi_nibbles, lo_nibbles );
+}
+
+// 8 (intensity, alpha) byte pairs -> 8 IIIA texels
+inline void StoreIA( u32 * dst, __m128i ia )
+{
+	const __m128i expand_lo = _mm_setr_epi8( 0,0,0,1, 2,2,2,3, 4,4,4,5, 6,6,6,7 );
+	const __m128i expand_hi = _mm_setr_epi8( 8,8,8,9, 10,10,10,11, 12,12,12,13, 14,14,14,15 );
+
+	Store( dst+0, _mm_shuffle_epi8( ia, expand_lo ) );
+	Store( dst+4, _mm_shuffle_epi8( ia, expand_hi ) );
+}
+
+// 16 intensities -> 16 IIII texels
+inline void StoreI( u32 * dst, __m128i i )
+{
+	const __m128i expand = _mm_setr_epi8( 0,0,0,0, 1,1,1,1, 2,2,2,2, 3,3,3,3 );
+	const __m128i step   = _mm_set1_epi8( 4 );
+
+	__m128i e = expand;
+	for( u32 k = 0; k < 4; ++k )
+	{
+		Store( dst + k*4, _mm_shuffle_epi8( i, e ) );
+		e = _mm_add_epi8( e, step );
+	}
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+template< void (*RowTail)( u32 *, const u8 *, u32, u32 ) >
+inline void ConvertRowRGBA16T( u32 * dst, const u8 * src, u32 width, const u8 * five_to_eight )
+{
+	const __m128i five_lo = _mm_load_si128( reinterpret_cast< const __m128i * >( &five_to_eight[ 0 ] ) );
+	const __m128i five_hi = _mm_load_si128( reinterpret_cast< const __m128i * >( &five_to_eight[ 16 ] ) );
+	const __m128i swap    = _mm_setr_epi8( 1,0, 3,2, 5,4, 7,6, 9,8, 11,10, 13,12, 15,14 );
+	const __m128i mask5   = _mm_set1_epi16( 0x1f );
+	const __m128i one     = _mm_set1_epi16( 0x01 );
+	const __m128i ff      = _mm_set1_epi16( 0xff );
+
+	u32 x = 0;
+	for( ; x + 8 <= width; x += 8 )
+	{
+		__m128i v = _mm_shuffle_epi8( Load( &src[ x*2 ] ), swap );
+
+		__m128i r = _mm_srli_epi16( v, 11 );
+		__m128i g = _mm_and_si128( _mm_srli_epi16( v, 6 ), mask5 );
+		__m128i b = _mm_and_si128( _mm_srli_epi16( v, 1 ), mask5 );
+		__m128i a = _mm_and_si128( _mm_cmpeq_epi16( _mm_and_si128( v, one ), one ), ff );
+
+		// Bytes are r0..r7 g0..g7 and b0..b7 a0..a7
+		__m128i rg = Lookup32( five_lo, five_hi, _mm_packus_epi16( r, g ) );
+		__m128i ba = _mm_unpacklo_epi64( Lookup32( five_lo, five_hi, _mm_packus_epi16( b, b ) ), _mm_packus_epi16( a, a ) );
+
+		rg = _mm_unpacklo_epi8( rg, _mm_srli_si128( rg, 8 ) );
+		ba = _mm_unpacklo_epi8( ba, _mm_srli_si128( ba, 8 ) );
+
+		Store( &dst[ x+0 ], _mm_unpacklo_epi16( rg, ba ) );
+		Store( &dst[ x+4 ], _mm_unpackhi_epi16( rg, ba ) );
+	}
+
+	RowTail( dst, src, x, width );
+}
+
+void ConvertRowRGBA16( u32 * dst, const u8 * src, u32 width, const u32 * )
+{
+	ConvertRowRGBA16T< RowTailRGBA16 >( dst, src, width, TileTables().FiveToEight );
+}
+
+void ConvertRowRGBA16Replicated( u32 * dst, const u8 * src, u32 width, const u32 * )
+{
+	ConvertRowRGBA16T< RowTailRGBA16Replicated >( dst, src, width, TileTables().FiveToEightReplicated );
+}
+
+//*****************************************************************************
+//	The texels are already in the right byte order for RGBA 8888
+//*****************************************************************************
+void ConvertRowRGBA32( u32 * dst, const u8 * src, u32 width, const u32 * )
+{
+	memcpy( dst, src, width * sizeof( u32 ) );
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void ConvertRowYUV16( u32 * dst, const u8 * src, u32 width, const u32 * )
+{
+	// Each 8 bytes is u0 y0 v0 y1 u1 y2 v1 y3 - pick them out into 32 bit lanes
+	const __m128i pick_y = _mm_setr_epi8( 1,-1,-1,-1, 3,-1,-1,-1, 5,-1,-1,-1, 7,-1,-1,-1 );
+	const __m128i pick_u = _mm_setr_epi8( 0,-1,-1,-1, 0,-1,-1,-1, 4,-1,-1,-1, 4,-1,-1,-1 );
+	const __m128i pick_v = _mm_setr_epi8( 2,-1,-1,-1, 2,-1,-1,-1, 6,-1,-1,-1, 6,-1,-1,-1 );
+	const __m128i bias   = _mm_set1_epi32( 128 );
+	const __m128i alpha  = _mm_set1_epi32( 255 );
+
+	// The sums are done in the same order as YUV16, so the rounding matches
+	const __m128 kRV = _mm_set1_ps( 1.370705f );
+	const __m128 kGV = _mm_set1_ps( 0.698001f );
+	const __m128 kGU = _mm_set1_ps( 0.337633f );
+	const __m128 kBU = _mm_set1_ps( 1.732446f );
+
+	// r0..r3 g0..g3 b0..b3 a0..a3 -> rgba0..rgba3
+	const __m128i interleave = _mm_setr_epi8( 0,4,8,12, 1,5,9,13, 2,6,10,14, 3,7,11,15 );
+
+	u32 x = 0;
+	for( ; x + 4 <= width; x += 4 )
+	{
+		__m128i v8 = _mm_loadl_epi64( reinterpret_cast< const __m128i * >( &src[ x*2 ] ) );
+
+		__m128 y = _mm_cvtepi32_ps( _mm_shuffle_epi8( v8, pick_y ) );
+		__m128 u = _mm_cvtepi32_ps( _mm_sub_epi32( _mm_shuffle_epi8( v8, pick_u ), bias ) );
+		__m128 v = _mm_cvtepi32_ps( _mm_sub_epi32( _mm_shuffle_epi8( v8, pick_v ), bias ) );
+
+		__m128i r = _mm_cvttps_epi32( _mm_add_ps( y, _mm_mul_ps( kRV, v ) ) );
+		__m128i g = _mm_cvttps_epi32( _mm_sub_ps( _mm_sub_ps( y, _mm_mul_ps( kGV, v ) ), _mm_mul_ps( kGU, u ) ) );
+		__m128i b = _mm_cvttps_epi32( _mm_add_ps( y, _mm_mul_ps( kBU, u ) ) );
+
+		// The saturating packs do the clamping to [0,255]
+		__m128i rgba = _mm_packus_epi16( _mm_packs_epi32( r, g ), _mm_packs_epi32( b, alpha ) );
+
+		Store( &dst[ x ], _mm_shuffle_epi8( rgba, interleave ) );
+	}
+
+	RowTailYUV16( dst, src, x, width );
+}
+
+//*****************************************************************************
+//	The 16 palette entries are split into 4 byte planes, so each plane can be
+//	looked up 16 texels at a time
+//*****************************************************************************
+void ConvertRowCI4( u32 * dst, const u8 * src, u32 width, const u32 * palette )
+{
+	alignas(16) u8 planes[ 4 ][ 16 ];
+	for( u32 i = 0; i < 16; ++i )
+	{
+		planes[ 0 ][ i ] = u8( palette[ i ]       );
+		planes[ 1 ][ i ] = u8( palette[ i ] >>  8 );
+		planes[ 2 ][ i ] = u8( palette[ i ] >> 16 );
+		planes[ 3 ][ i ] = u8( palette[ i ] >> 24 );
+	}
+
+	const __m128i p0 = _mm_load_si128( reinterpret_cast< const __m128i * >( planes[ 0 ] ) );
+	const __m128i p1 = _mm_load_si128( reinterpret_cast< const __m128i * >( planes[ 1 ] ) );
+	const __m128i p2 = _mm_load_si128( reinterpret_cast< const __m128i * >( planes[ 2 ] ) );
+	const __m128i p3 = _mm_load_si128( reinterpret_cast< const __m128i * >( planes[ 3 ] ) );
+
+	u32 x = 0;
+	for( ; x + 32 <= width; x += 32 )
+	{
+		__m128i n[ 2 ];
+		SplitNibbles( Load( &src[ x/2 ] ), &n[ 0 ], &n[ 1 ] );
+
+		for( u32 k = 0; k < 2; ++k )
+		{
+			__m128i c0 = _mm_shuffle_epi8( p0, n[ k ] );
+			__m128i c1 = _mm_shuffle_epi8( p1, n[ k ] );
+			__m128i c2 = _mm_shuffle_epi8( p2, n[ k ] );
+			__m128i c3 = _mm_shuffle_epi8( p3, n[ k ] );
+
+			__m128i c01_lo = _mm_unpacklo_epi8( c0, c1 );
+			__m128i c01_hi = _mm_unpackhi_epi8( c0, c1 );
+			__m128i c23_lo = _mm_unpacklo_epi8( c2, c3 );
+			__m128i c23_hi = _mm_unpackhi_epi8( c2, c3 );
+
+			u32 * out = &dst[ x + k*16 ];
+			Store( out+ 0, _mm_unpacklo_epi16( c01_lo, c23_lo ) );
+			Store( out+ 4, _mm_unpackhi_epi16( c01_lo, c23_lo ) );
+			Store( out+ 8, _mm_unpacklo_epi16( c01_hi, c23_hi ) );
+			Store( out+12, _mm_unpackhi_epi16( c01_hi, c23_hi ) );
+		}
+	}
+
+	RowTailCI4( dst, src, x, width, palette );
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+template< void (*RowTail)( u32 *, const u8 *, u32, u32 ) >
+inline void ConvertRowIA4T( u32 * dst, const u8 * src, u32 width, const u8 * table_i, const u8 * table_a )
+{
+	const __m128i ia4_i = _mm_load_si128( reinterpret_cast< const __m128i * >( table_i ) );
+	const __m128i ia4_a = _mm_load_si128( reinterpret_cast< const __m128i * >( table_a ) );
+
+	u32 x = 0;
+	for( ; x + 32 <= width; x += 32 )
+	{
+		__m128i n[ 2 ];
+		SplitNibbles( Load( &src[ x/2 ] ), &n[ 0 ], &n[ 1 ] );
+
+		for( u32 k = 0; k < 2; ++k )
+		{
+			__m128i i = _mm_shuffle_epi8( ia4_i, n[ k ] );
+			__m128i a = _mm_shuffle_epi8( ia4_a, n[ k ] );
+
+			StoreIA( &dst[ x + k*16 + 0 ], _mm_unpacklo_epi8( i, a ) );
+			StoreIA( &dst[ x + k*16 + 8 ], _mm_unpackhi_epi8( i, a ) );
+		}
+	}
+
+	RowTail( dst, src, x, width );
+}
+
+void ConvertRowIA4( u32 * dst, const u8 * src, u32 width, const u32 * )
+{
+	const STileTables & tables = TileTables();
+	ConvertRowIA4T< RowTailIA4 >( dst, src, width, tables.IA4I, tables.IA4A );
+}
+
+void ConvertRowIA4Replicated( u32 * dst, const u8 * src, u32 width, const u32 * )
+{
+	const STileTables & tables = TileTables();
+	ConvertRowIA4T< RowTailIA4Replicated >( dst, src, width, tables.IA4ReplicatedI, tables.IA4ReplicatedA );
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void ConvertRowIA8( u32 * dst, const u8 * src, u32 width, const u32 * )
+{
+	const STileTables & tables = TileTables();
+	const __m128i four = _mm_load_si128( reinterpret_cast< const __m128i * >( tables.FourToEight ) );
+	const __m128i mask = _mm_set1_epi8( 0x0f );
+
+	u32 x = 0;
+	for( ; x + 16 <= width; x += 16 )
+	{
+		__m128i v = Load( &src[ x ] );
+		__m128i i = _mm_shuffle_epi8( four, _mm_and_si128( _mm_srli_epi16( v, 4 ), mask ) );
+		__m128i a = _mm_shuffle_epi8( four, _mm_and_si128( v, mask ) );
+
+		StoreIA( &dst[ x+0 ], _mm_unpacklo_epi8( i, a ) );
+		StoreIA( &dst[ x+8 ], _mm_unpackhi_epi8( i, a ) );
+	}
+
+	RowTailIA8( dst, src, x, width );
+}
+
+//*****************************************************************************
+//	The texels are already (intensity, alpha) pairs
+//*****************************************************************************
+void ConvertRowIA16( u32 * dst, const u8 * src, u32 width, const u32 * )
+{
+	u32 x = 0;
+	for( ; x + 8 <= width; x += 8 )
+	{
+		StoreIA( &dst[ x ], Load( &src[ x*2 ] ) );
+	}
+
+	RowTailIA16( dst, src, x, width );
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void ConvertRowI4( u32 * dst, const u8 * src, u32 width, const u32 * )
+{
+	const STileTables & tables = TileTables();
+	const __m128i i4 = _mm_load_si128( reinterpret_cast< const __m128i * >( tables.I4 ) );
+
+	u32 x = 0;
+	for( ; x + 32 <= width; x += 32 )
+	{
+		__m128i n[ 2 ];
+		SplitNibbles( Load( &src[ x/2 ] ), &n[ 0 ], &n[ 1 ] );
+
+		StoreI( &dst[ x+ 0 ], _mm_shuffle_epi8( i4, n[ 0 ] ) );
+		StoreI( &dst[ x+16 ], _mm_shuffle_epi8( i4, n[ 1 ] ) );
+	}
+
+	RowTailI4( dst, src, x, width );
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void ConvertRowI8( u32 * dst, const u8 * src, u32 width, const u32 * )
+{
+	u32 x = 0;
+	for( ; x + 16 <= width; x += 16 )
+	{
+		StoreI( &dst[ x ], Load( &src[ x ] ) );
+	}
+
+	RowTailI8( dst, src, x, width );
+}
+
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void ConvertTileSIMD_InitSSSE3( STileRowConverters & rows )
+{
+	rows.RGBA16 = ConvertRowRGBA16;
+	rows.RGBA32 = ConvertRowRGBA32;
+	rows.YUV16  = ConvertRowYUV16;
+	rows.CI4    = ConvertRowCI4;
+	// CI8 stays scalar - there's nothing to gain over it without a gather
+	rows.IA4    = ConvertRowIA4;
+	rows.IA8    = ConvertRowIA8;
+	rows.IA16   = ConvertRowIA16;
+	rows.I4     = ConvertRowI4;
+	rows.I8     = ConvertRowI8;
+
+	rows.RGBA16Replicated = ConvertRowRGBA16Replicated;
+	rows.IA4Replicated    = ConvertRowIA4Replicated;
+}
+
+#endif // DAEDALUS_CONVERT_TILE_SIMD
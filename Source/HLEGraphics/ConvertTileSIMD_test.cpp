@@ -0,0 +1,248 @@
+#include "Base/Types.h"
+#include "HLEGraphics/ConvertTileSIMD.h"
+
+#include <string.h>
+#include <tuple>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#ifdef DAEDALUS_CONVERT_TILE_SIMD
+
+#include "Core/Memory.h"
+#include "Graphics/NativePixelFormat.h"
+#include "HLEGraphics/ConvertImage.h"
+#include "HLEGraphics/ConvertTile.h"
+#include "HLEGraphics/ConvertTileSIMDKernel.h"
+#include "HLEGraphics/TextureInfo.h"
+#include "Ultra/ultra_gbi.h"
+
+extern u8 gTMEM[4096];
+
+static u32 NextRandom( u32 & seed )
+{
+	seed = seed * 1664525 + 1013904223;
+	return seed >> 8;
+}
+
+//*****************************************************************************
+//	Row converters: each ISA level against the scalar helpers they fall back on
+//*****************************************************************************
+struct SRowFormat
+{
+	const char *							Name;
+	ConvertTileRowFn STileRowConverters::*	Row;
+	ConvertTileRowFn						Scalar;
+	u32										BitsPerTexel;
+};
+
+static const SRowFormat kRowFormats[] =
+{
+	{ "RGBA16",				&STileRowConverters::RGBA16,			[]( u32 * d, const u8 * s, u32 w, const u32 * ) { RowTailRGBA16( d, s, 0, w ); },				16 },
+	{ "RGBA16Replicated",	&STileRowConverters::RGBA16Replicated,	[]( u32 * d, const u8 * s, u32 w, const u32 * ) { RowTailRGBA16Replicated( d, s, 0, w ); },	16 },
+	{ "RGBA32",				&STileRowConverters::RGBA32,			[]( u32 * d, const u8 * s, u32 w, const u32 * ) { memcpy( d, s, w * 4 ); },						32 },
+	{ "YUV16",				&STileRowConverters::YUV16,				[]( u32 * d, const u8 * s, u32 w, const u32 * ) { RowTailYUV16( d, s, 0, w ); },				16 },
+	{ "CI4",				&STileRowConverters::CI4,				[]( u32 * d, const u8 * s, u32 w, const u32 * p ) { RowTailCI4( d, s, 0, w, p ); },				4 },
+	{ "CI8",				&STileRowConverters::CI8,				[]( u32 * d, const u8 * s, u32 w, const u32 * p ) { RowTailCI8( d, s, 0, w, p ); },				8 },
+	{ "IA4",				&STileRowConverters::IA4,				[]( u32 * d, const u8 * s, u32 w, const u32 * ) { RowTailIA4( d, s, 0, w ); },					4 },
+	{ "IA4Replicated",		&STileRowConverters::IA4Replicated,		[]( u32 * d, const u8 * s, u32 w, const u32 * ) { RowTailIA4Replicated( d, s, 0, w ); },		4 },
+	{ "IA8",				&STileRowConverters::IA8,				[]( u32 * d, const u8 * s, u32 w, const u32 * ) { RowTailIA8( d, s, 0, w ); },					8 },
+	{ "IA16",				&STileRowConverters::IA16,				[]( u32 * d, const u8 * s, u32 w, const u32 * ) { RowTailIA16( d, s, 0, w ); },					16 },
+	{ "I4",					&STileRowConverters::I4,				[]( u32 * d, const u8 * s, u32 w, const u32 * ) { RowTailI4( d, s, 0, w ); },					4 },
+	{ "I8",					&STileRowConverters::I8,				[]( u32 * d, const u8 * s, u32 w, const u32 * ) { RowTailI8( d, s, 0, w ); },					8 },
+};
+
+class ConvertTileRowTest : public ::testing::TestWithParam< ::std::tuple<u32, u32> >
+{
+protected:
+	virtual void SetUp()
+	{
+		u32 seed = 0x2468ace0;
+		for( u32 i = 0; i < sizeof( mSrc ); ++i )
+			mSrc[i] = u8( NextRandom( seed ) );
+		for( u32 i = 0; i < 256; ++i )
+			mPalette[i] = NextRandom( seed ) ^ ( NextRandom( seed ) << 24 );
+	}
+
+	// Anything written past the end of the row shows up as a change to the guard bytes
+	void Check( ConvertTileRowFn row_fn, const SRowFormat & format, u32 width )
+	{
+		memset( mExpected, 0xcd, sizeof( mExpected ) );
+		memset( mDst, 0xcd, sizeof( mDst ) );
+
+		format.Scalar( mExpected, mSrc, width, mPalette );
+		row_fn( mDst, mSrc, width, mPalette );
+		EXPECT_EQ( 0, memcmp( mExpected, mDst, sizeof( mDst ) ) ) << format.Name << " width " << width;
+	}
+
+	alignas(16) u8	mSrc[ 4096 ];
+	u32				mPalette[ 256 ];
+	u32				mExpected[ 1024 + 64 ];
+	u32				mDst[ 1024 + 64 ];
+};
+
+TEST_P(ConvertTileRowTest, MatchesScalar)
+{
+	const SRowFormat & format = kRowFormats[ ::std::get<0>(GetParam()) ];
+	u32 width = ::std::get<1>(GetParam());
+
+	// YUV16 texels come in pairs
+	if( format.Row == &STileRowConverters::YUV16 && ( width & 1 ) )
+		return;
+
+	if( __builtin_cpu_supports( "ssse3" ) )
+	{
+		STileRowConverters rows = {};
+		ConvertTileSIMD_InitSSSE3( rows );
+		if( rows.*format.Row != nullptr )
+			Check( rows.*format.Row, format, width );
+	}
+
+#ifdef DAEDALUS_CONVERT_TILE_AVX2
+	if( __builtin_cpu_supports( "avx2" ) )
+	{
+		STileRowConverters rows = {};
+		ConvertTileSIMD_InitAVX2( rows );
+		if( rows.*format.Row != nullptr )
+			Check( rows.*format.Row, format, width );
+	}
+#endif
+}
+
+INSTANTIATE_TEST_SUITE_P(X, ConvertTileRowTest, ::testing::Combine(::testing::Range(0u, u32(sizeof(kRowFormats) / sizeof(kRowFormats[0]))),
+																   ::testing::Values(1,2,3,7,8,9,15,16,17,31,32,33,63,64,65,100,255,256,1023,1024)));
+
+//*****************************************************************************
+//	Whole textures: ConvertTexture and ConvertTile with and without the row
+//	converters, over odd sizes, padded pitches and swapped lines
+//*****************************************************************************
+struct SImageFormat
+{
+	u32		Format;
+	u32		Size;
+	u32		BitsPerTexel;
+};
+
+static const SImageFormat kImageFormats[] =
+{
+	{ G_IM_FMT_RGBA,	G_IM_SIZ_16b,	16 },
+	{ G_IM_FMT_RGBA,	G_IM_SIZ_32b,	32 },
+	{ G_IM_FMT_YUV,		G_IM_SIZ_16b,	16 },
+	{ G_IM_FMT_CI,		G_IM_SIZ_4b,	4 },
+	{ G_IM_FMT_CI,		G_IM_SIZ_8b,	8 },
+	{ G_IM_FMT_IA,		G_IM_SIZ_4b,	4 },
+	{ G_IM_FMT_IA,		G_IM_SIZ_8b,	8 },
+	{ G_IM_FMT_IA,		G_IM_SIZ_16b,	16 },
+	{ G_IM_FMT_I,		G_IM_SIZ_4b,	4 },
+	{ G_IM_FMT_I,		G_IM_SIZ_8b,	8 },
+};
+
+class ConvertTextureSIMDTest : public ::testing::TestWithParam< ::std::tuple<u32, u32, u32, u32, bool> >
+{
+protected:
+	static const u32 kRamSize = 256 * 1024;
+
+	virtual void SetUp()
+	{
+		u32 seed = 0x13579bdf;
+		mRam.resize( kRamSize );
+		for( u32 i = 0; i < kRamSize; ++i )
+			mRam[i] = u8( NextRandom( seed ) );
+		for( u32 i = 0; i < sizeof( gTMEM ); ++i )
+			gTMEM[i] = u8( NextRandom( seed ) );
+
+		mOldRam     = g_pMemoryBuffers[ MEM_RD_RAM ];
+		mOldRamSize = gRamSize;
+		g_pMemoryBuffers[ MEM_RD_RAM ] = &mRam[0];
+		gRamSize = kRamSize;
+	}
+
+	virtual void TearDown()
+	{
+		g_pMemoryBuffers[ MEM_RD_RAM ] = mOldRam;
+		gRamSize = mOldRamSize;
+		ConvertTileSIMD_SetEnabled( true );
+	}
+
+	// Odd lines of swapped textures write up to 16 texels past the width, so leave room for that
+	template< typename ConvertFn >
+	void Check( ConvertFn convert, const TextureInfo & ti )
+	{
+		const u32 pitch = ( ti.GetWidth() + 32 ) * sizeof( u32 );
+		std::vector< u8 > expected( pitch * ti.GetHeight(), 0xcd );
+		std::vector< u8 > actual( pitch * ti.GetHeight(), 0xcd );
+		NativePf8888 expected_palette[ 256 ];
+		NativePf8888 actual_palette[ 256 ];
+
+		ConvertTileSIMD_SetEnabled( false );
+		bool expected_ok = convert( ti, &expected[0], expected_palette, TexFmt_8888, pitch );
+		ConvertTileSIMD_SetEnabled( true );
+		bool actual_ok = convert( ti, &actual[0], actual_palette, TexFmt_8888, pitch );
+
+		EXPECT_EQ( expected_ok, actual_ok );
+		EXPECT_EQ( 0, memcmp( &expected[0], &actual[0], expected.size() ) );
+	}
+
+	TextureInfo MakeTextureInfo() const
+	{
+		const SImageFormat & format = kImageFormats[ ::std::get<0>(GetParam()) ];
+		u32 width  = ::std::get<1>(GetParam());
+		u32 height = ::std::get<2>(GetParam());
+		u32 pad    = ::std::get<3>(GetParam());
+
+		TextureInfo ti;
+		memset( &ti, 0, sizeof( ti ) );
+		ti.SetFormat( format.Format );
+		ti.SetSize( format.Size );
+		ti.SetWidth( width );
+		ti.SetHeight( height );
+		ti.SetSwapped( ::std::get<4>(GetParam()) );
+		ti.SetTLutFormat( kTT_RGBA16 );
+		ti.SetTlutAddress( 0x100 );
+		ti.SetPalette( 3 );
+
+		// Pitch is in bytes for ConvertImage, Line in qwords for ConvertTile
+		const u32 row_bytes = ( ( width * format.BitsPerTexel + 7 ) / 8 + 7 ) & ~7;
+		ti.SetPitch( row_bytes + pad );
+		ti.SetLine( ( row_bytes + pad ) / 8 );
+		ti.SetLoadAddress( 0x1000 + pad / 2 );
+		ti.SetTmemAddress( pad / 8 );
+		return ti;
+	}
+
+	std::vector< u8 >	mRam;
+	void *				mOldRam;
+	u32					mOldRamSize;
+};
+
+TEST_P(ConvertTextureSIMDTest, ConvertImageMatchesScalar)
+{
+	const TextureInfo ti = MakeTextureInfo();
+
+	// Neither version handles these
+	if( ti.GetFormat() == G_IM_FMT_YUV && ( ti.IsSwapped() || ( ti.GetWidth() & 1 ) ) )
+		return;
+
+	Check( ConvertTexture, ti );
+}
+
+#ifdef DAEDALUS_ACCURATE_TMEM
+TEST_P(ConvertTextureSIMDTest, ConvertTileMatchesScalar)
+{
+	const TextureInfo ti = MakeTextureInfo();
+
+	if( ti.GetFormat() == G_IM_FMT_YUV && ( ti.GetWidth() & 1 ) )
+		return;
+
+	Check( ConvertTile, ti );
+}
+#endif
+
+// A pad of 4 leaves the rows misaligned, which has to go through the scalar code
+INSTANTIATE_TEST_SUITE_P(X, ConvertTextureSIMDTest, ::testing::Combine(::testing::Range(0u, u32(sizeof(kImageFormats) / sizeof(kImageFormats[0]))),
+																	   ::testing::Values(1,2,3,8,13,32,33,64,100),
+																	   ::testing::Values(1,2,5),
+																	   ::testing::Values(0,4,8,24),
+																	   ::testing::Bool()));
+
+#endif // DAEDALUS_CONVERT_TILE_SIMD
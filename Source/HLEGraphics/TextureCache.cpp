@@ -28,12 +28,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "HLEGraphics/TextureCache.h"
 #include "HLEGraphics/TextureInfo.h"
 
+#include "Utility/Hash.h"
 #include "Utility/Profiler.h"
 
 #include <vector>
-#include <algorithm>
-
-//#define PROFILE_TEXTURE_CACHE
 
 template<> bool CSingleton< CTextureCache >::Create()
 {
@@ -45,11 +43,17 @@ template<> bool CSingleton< CTextureCache >::Create()
 }
 
 CTextureCache::CTextureCache()
+:	mEntries( INITIAL_TABLE_SIZE )
+,	mNumTextures( 0 )
 #ifdef DAEDALUS_DEBUG_DISPLAYLIST
-:	mDebugMutex()
+,	mDebugMutex()
 #endif
 {
-	memset( mpCacheHashTable, 0, sizeof(mpCacheHashTable) );
+	for( STextureEntry & entry : mEntries )
+	{
+		entry.Texture = nullptr;
+	}
+	memset( &mStats, 0, sizeof( mStats ) );
 }
 
 CTextureCache::~CTextureCache()
@@ -57,115 +61,134 @@ CTextureCache::~CTextureCache()
 	DropTextures();
 }
 
-inline u32 CTextureCache::MakeHashIdxA( const TextureInfo & ti )
+inline u32 CTextureCache::MakeHash( const TextureInfo & ti )
 {
-	u32 address = ti.GetLoadAddress();
-	u32 hash = (address >> (HASH_TABLE_BITS*2)) ^ (address >> HASH_TABLE_BITS) ^ address;
-
-	hash ^= ti.GetPalette() >> 2;			// Useful for palettised fonts, e.g in Starfox
-
-	return hash & (HASH_TABLE_SIZE-1);
+	// GetHashCode() only mixes in 10 bits at a time, which clusters badly for a linear probe
+	return murmur2_hash( &ti, sizeof( TextureInfo ), 0 );
 }
 
-inline u32 CTextureCache::MakeHashIdxB( const TextureInfo & ti )
+// Returns the slot holding ti, or the free slot where it should go
+inline u32 CTextureCache::FindSlot( const TextureInfo & ti, u32 hash )
 {
-	return ti.GetHashCode() & (HASH_TABLE_SIZE-1);
+	const u32	mask( mEntries.size() - 1 );
+	u32			slot( hash & mask );
+	u32			probes( 1 );
+
+	while( mEntries[slot].Texture != nullptr )
+	{
+		if( mEntries[slot].Hash == hash && mEntries[slot].Info == ti )
+			break;
+
+		slot = (slot + 1) & mask;
+		++probes;
+	}
+
+	mStats.TotalProbes += probes;
+	if( probes > mStats.MaxProbeLength )
+	{
+		mStats.MaxProbeLength = probes;
+	}
+
+	return slot;
 }
 
-// Purge any textures that haven't been used recently
-void CTextureCache::PurgeOldTextures()
+void CTextureCache::EraseSlot( u32 slot )
 {
-	#ifdef DAEDALUS_DEBUG_DISPLAYLIST
-	MutexLock lock(GetDebugMutex());
-	#endif
+	const u32	mask( mEntries.size() - 1 );
+	u32			hole( slot );
+
 	//
-	//	Erase expired textures in reverse order, which should require less
-	//	copying when large clumps of textures are released simultaneously.
+	//	Move back any entry later in the run that would still be reachable
+	//	from its home slot, so the run stays unbroken.
 	//
-	for( s32 i = mTextures.size() - 1; i >= 0; --i )
+	for( u32 i = (slot + 1) & mask; mEntries[i].Texture != nullptr; i = (i + 1) & mask )
 	{
-		CachedTexture * texture = mTextures[ i ];
-		if ( texture->HasExpired() )
+		u32 home( mEntries[i].Hash & mask );
+		if( ((i - home) & mask) >= ((i - hole) & mask) )
 		{
-			u32	ixa = MakeHashIdxA( texture->GetTextureInfo() );
-			u32 ixb = MakeHashIdxB( texture->GetTextureInfo() );
-
-			if( mpCacheHashTable[ixa] == texture )
-			{
-				mpCacheHashTable[ixa] = nullptr;
-			}
-			if( mpCacheHashTable[ixb] == texture )
-			{
-				mpCacheHashTable[ixb] = nullptr;
-			}
-
-			mTextures.erase( mTextures.begin() + i );
-
-			delete texture;
+			mEntries[hole] = mEntries[i];
+			hole = i;
 		}
 	}
+
+	mEntries[hole].Texture = nullptr;
+	--mNumTextures;
 }
 
-void CTextureCache::DropTextures()
+void CTextureCache::Grow()
 {
-	#ifdef DAEDALUS_DEBUG_DISPLAYLIST
-	MutexLock lock(GetDebugMutex());
-	#endif
+	std::vector< STextureEntry >	old_entries( mEntries.size() * 2 );
+	old_entries.swap( mEntries );
 
-	for( u32 i = 0; i < mTextures.size(); ++i)
+	const u32	mask( mEntries.size() - 1 );
+	for( STextureEntry & entry : mEntries )
 	{
-		delete mTextures[i];
+		entry.Texture = nullptr;
 	}
-	mTextures.clear();
-	for( u32 i = 0; i < HASH_TABLE_SIZE; ++i )
+
+	for( const STextureEntry & entry : old_entries )
 	{
-		mpCacheHashTable[i] = nullptr;
+		if( entry.Texture != nullptr )
+		{
+			u32 slot( entry.Hash & mask );
+			while( mEntries[slot].Texture != nullptr )
+			{
+				slot = (slot + 1) & mask;
+			}
+			mEntries[slot] = entry;
+		}
 	}
 }
 
-#ifdef PROFILE_TEXTURE_CACHE
-#define RECORD_CACHE_HIT( a, b )		TextureCacheStat( a, b, mTextures.size() )
-
-static void TextureCacheStat( u32 l1_hit, u32 l2_hit, u32 size )
+// Purge any textures that haven't been used recently
+void CTextureCache::PurgeOldTextures()
 {
-	static u32 total_lookups = 0, total_l1_hits = 0, total_l2_hits = 0;
+	#ifdef DAEDALUS_DEBUG_DISPLAYLIST
+	MutexLock lock(GetDebugMutex());
+	#endif
 
-	total_l1_hits += l1_hit;
-	total_l2_hits += l2_hit;
-	++total_lookups;
+#ifdef DAEDALUS_ENABLE_PROFILING
+	CProfiler::Get()->SetCounter( "Texture cache hits", mStats.Hits );
+	CProfiler::Get()->SetCounter( "Texture cache misses", mStats.Misses );
+	CProfiler::Get()->SetCounter( "Texture cache probes", mStats.TotalProbes );
+	CProfiler::Get()->SetCounter( "Texture cache max probe length", mStats.MaxProbeLength );
+	CProfiler::Get()->SetCounter( "Texture cache entries", mNumTextures );
+#endif
+	memset( &mStats, 0, sizeof( mStats ) );
 
-	if( total_lookups == 1000 )
+	//
+	//	Erasing shifts a later entry into this slot, so only move on when we
+	//	keep what's here.
+	//
+	for( u32 i = 0; i < mEntries.size(); )
 	{
-		printf( "L1 hits[%d] L2 hits[%d] Miss[%d] (%d entries)\n", total_l1_hits, total_l2_hits, total_lookups - (total_l1_hits+total_l2_hits), size );
-		total_lookups = total_l1_hits = total_l2_hits = 0;
+		CachedTexture * texture = mEntries[i].Texture;
+		if ( texture != nullptr && texture->HasExpired() )
+		{
+			EraseSlot( i );
+
+			delete texture;
+		}
+		else
+		{
+			++i;
+		}
 	}
 }
-#else
-
-#define RECORD_CACHE_HIT( a, b )
 
-#endif
-
-struct SSortTextureEntries
+void CTextureCache::DropTextures()
 {
-public:
-	bool operator()( const TextureInfo & a, const TextureInfo & b ) const
-	{
-		return a < b;
-	}
-	bool operator()( const CachedTexture * a, const TextureInfo & b ) const
-	{
-		return a->GetTextureInfo() < b;
-	}
-	bool operator()( const TextureInfo & a, const CachedTexture * b ) const
-	{
-		return a < b->GetTextureInfo();
-	}
-	bool operator()( const CachedTexture * a, const CachedTexture * b ) const
+	#ifdef DAEDALUS_DEBUG_DISPLAYLIST
+	MutexLock lock(GetDebugMutex());
+	#endif
+
+	for( STextureEntry & entry : mEntries )
 	{
-		return a->GetTextureInfo() < b->GetTextureInfo();
+		delete entry.Texture;
+		entry.Texture = nullptr;
 	}
-};
+	mNumTextures = 0;
+}
 
 // If already in table, return cached copy
 // Otherwise, create surfaces, and load texture into memory
@@ -186,50 +209,36 @@ CachedTexture * CTextureCache::GetOrCreateCachedTexture(const TextureInfo & ti)
 	//
 	// Retrieve the texture from the cache (if it already exists)
 	//
-	u32	ixa = MakeHashIdxA( ti );
-	if( mpCacheHashTable[ixa] && mpCacheHashTable[ixa]->GetTextureInfo() == ti )
-	{
-		RECORD_CACHE_HIT( 1, 0 );
-		mpCacheHashTable[ixa]->UpdateIfNecessary();
-
-		return mpCacheHashTable[ixa];
-	}
-
-	u32 ixb = MakeHashIdxB( ti );
-	if( mpCacheHashTable[ixb] && mpCacheHashTable[ixb]->GetTextureInfo() == ti )
-	{
-		RECORD_CACHE_HIT( 1, 0 );
-		mpCacheHashTable[ixb]->UpdateIfNecessary();
-
-		return mpCacheHashTable[ixb];
-	}
+	u32 hash = MakeHash( ti );
+	u32 slot = FindSlot( ti, hash );
 
-	CachedTexture *	texture = nullptr;
-	TextureVec::iterator	it = std::lower_bound( mTextures.begin(), mTextures.end(), ti, SSortTextureEntries() );
-	if( it != mTextures.end() && (*it)->GetTextureInfo() == ti )
+	CachedTexture *	texture = mEntries[slot].Texture;
+	if( texture != nullptr )
 	{
-		texture = *it;
-		RECORD_CACHE_HIT( 0, 1 );
+		mStats.Hits++;
 	}
 	else
 	{
+		mStats.Misses++;
+
 		texture = CachedTexture::Create( ti );
-		if (texture != nullptr)
+		if (texture == nullptr)
+			return nullptr;
+
+		// Keep the load factor under a half so runs stay short
+		if( (mNumTextures + 1) * 2 > mEntries.size() )
 		{
-			mTextures.insert( it, texture );
+			Grow();
+			slot = FindSlot( ti, hash );
 		}
 
-		RECORD_CACHE_HIT( 0, 0 );
+		mEntries[slot].Info = ti;
+		mEntries[slot].Hash = hash;
+		mEntries[slot].Texture = texture;
+		++mNumTextures;
 	}
 
-	// Update the hashtable
-	if( texture )
-	{
-		texture->UpdateIfNecessary();
-
-		mpCacheHashTable[ixa] = texture;
-		mpCacheHashTable[ixb] = texture;
-	}
+	texture->UpdateIfNecessary();
 
 	return texture;
 }
@@ -250,10 +259,13 @@ void CTextureCache::Snapshot(const MutexLock & lock, std::vector< STextureInfoSn
 
 	snapshot.erase( snapshot.begin(), snapshot.end() );
 
-	for( TextureVec::const_iterator it = mTextures.begin(); it != mTextures.end(); ++it )
+	for( const STextureEntry & entry : mEntries )
 	{
-		STextureInfoSnapshot	info( (*it)->GetTextureInfo(), (*it)->GetTexture() );
-		snapshot.push_back( info );
+		if( entry.Texture != nullptr )
+		{
+			STextureInfoSnapshot	info( entry.Info, entry.Texture->GetTexture() );
+			snapshot.push_back( info );
+		}
 	}
 }
 #endif // DAEDALUS_DEBUG_DISPLAYLIST
@@ -21,6 +21,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define HLEGRAPHICS_TEXTURECACHE_H_
 
 #include "HLEGraphics/CachedTexture.h"
+#include "HLEGraphics/TextureInfo.h"
 
 #include "Base/Singleton.h"
 
@@ -28,8 +29,6 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include <vector>
 
-struct TextureInfo;
-
 
 class CTextureCache : public CSingleton< CTextureCache >
 {
@@ -42,6 +41,17 @@ public:
 	void		PurgeOldTextures();
 	void		DropTextures();
 
+	// Lookup stats, reset each time PurgeOldTextures() is called (i.e. once per frame)
+	struct SStats
+	{
+		u32		Hits;
+		u32		Misses;
+		u32		TotalProbes;		// Slots examined, across all lookups
+		u32		MaxProbeLength;
+	};
+
+	const SStats &	GetStats() const	{ return mStats; }
+
 
 #ifdef DAEDALUS_DEBUG_DISPLAYLIST
 	Mutex * 	GetDebugMutex()		{ return &mDebugMutex; }
@@ -67,20 +77,28 @@ private:
 	CachedTexture * GetOrCreateCachedTexture(const TextureInfo & ti);
 
 	//
-	//	We implement a 2-way skewed associative cache.
-	//	Each TextureInfo is hashed using two different methods, to reduce the chance of collisions
+	//	Textures are kept in an open addressed hash table with linear probing.
+	//	The TextureInfo is stored inline, so a lookup only touches the
+	//	CachedTexture once it's found the right entry. Entries are removed by
+	//	shifting the rest of the run back, so there are no tombstones.
 	//
-	static const u32 HASH_TABLE_BITS = 9;
-	static const u32 HASH_TABLE_SIZE = 1<<HASH_TABLE_BITS;
+	struct STextureEntry
+	{
+		TextureInfo			Info;
+		u32					Hash;
+		CachedTexture *		Texture;		// nullptr if the slot is free
+	};
+
+	static const u32 INITIAL_TABLE_SIZE = 512;
 
-	inline static u32 MakeHashIdxA( const TextureInfo & ti );
-	inline static u32 MakeHashIdxB( const TextureInfo & ti );
+	inline static u32 MakeHash( const TextureInfo & ti );
+	inline u32			FindSlot( const TextureInfo & ti, u32 hash );
+	void				EraseSlot( u32 slot );
+	void				Grow();
 
-	// FIXME(strmnnrmn): we should have a struct of TextureInfo+CachedTexture instead -
-	// doing binary search on this array needs a memory indirect for every probe.
-	using TextureVec = std::vector < CachedTexture * >;
-	TextureVec			mTextures;
-	CachedTexture *		mpCacheHashTable[HASH_TABLE_SIZE];
+	std::vector< STextureEntry >	mEntries;		// Size is always a power of two
+	u32					mNumTextures;
+	SStats				mStats;
 #ifdef DAEDALUS_DEBUG_DISPLAYLIST
 	Mutex				mDebugMutex;
 #endif
@@ -0,0 +1,184 @@
+/*
+Copyright (C) 2007 StrmnNrmn
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+
+#include "Base/Types.h"
+
+#include "HLEGraphics/TnLSIMD.h"
+
+#ifdef DAEDALUS_TNL_SIMD
+
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+#include "Debug/DBGConsole.h"
+#include "HLEGraphics/TnLSIMDKernel.h"
+
+namespace
+{
+	using TransformVerticesFn = void (*)( const TnLSIMDParams & params, const TnLSIMDInput & in, DaedalusVtx4 * p_out, u32 num_vertices );
+
+	inline u32 PaddedCount( u32 num_vertices )
+	{
+		return ( num_vertices + kTnLSIMDMaxWidth - 1 ) & ~( kTnLSIMDMaxWidth - 1 );
+	}
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+#ifdef DAEDALUS_TNL_AVX
+static bool CPUHasAVX()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid( info, 1 );
+
+	const bool has_avx     = ( info[2] & ( 1 << 28 ) ) != 0;
+	const bool has_osxsave = ( info[2] & ( 1 << 27 ) ) != 0;
+
+	// The OS has to save the upper halves of the registers too
+	return has_avx && has_osxsave && ( _xgetbv( 0 ) & 6 ) == 6;
+#else
+	return __builtin_cpu_supports( "avx" );
+#endif
+}
+#endif
+
+//*****************************************************************************
+//
+//*****************************************************************************
+static TransformVerticesFn SelectTransformVertices()
+{
+#ifdef DAEDALUS_TNL_AVX
+	if( CPUHasAVX() )
+	{
+		DBGConsole_Msg( 0, "T&L: using AVX" );
+		return TnLSIMD_TransformVerticesAVX;
+	}
+#endif
+	DBGConsole_Msg( 0, "T&L: using SSE" );
+	return TransformVertices< SSEOps >;
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void TnLSIMD_TransformVertices( const TnLSIMDParams & params, const TnLSIMDInput & in, DaedalusVtx4 * p_out, u32 num_vertices )
+{
+	#ifdef DAEDALUS_ENABLE_ASSERTS
+	DAEDALUS_ASSERT( num_vertices <= kMaxN64Vertices, "Too many vertices for one batch" );
+	#endif
+
+	static const TransformVerticesFn transform_vertices = SelectTransformVertices();
+	transform_vertices( params, in, p_out, num_vertices );
+}
+
+//*****************************************************************************
+//	The kernel always reads whole batches, so the tail is zeroed rather than
+//	left as whatever the last load put there.
+//*****************************************************************************
+static void ClearTail( TnLSIMDInput * p_in, u32 num_vertices )
+{
+	const u32 padded = PaddedCount( num_vertices );
+	if( padded == num_vertices )
+		return;
+
+	const size_t bytes = ( padded - num_vertices ) * sizeof( f32 );
+	f32 * arrays[] = { p_in->X, p_in->Y, p_in->Z, p_in->NX, p_in->NY, p_in->NZ, p_in->R, p_in->G, p_in->B, p_in->A, p_in->U, p_in->V };
+	for( f32 * p : arrays )
+	{
+		memset( p + num_vertices, 0, bytes );
+	}
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void TnLSIMD_UnpackVertices( TnLSIMDInput * p_in, const FiddledVtx * p_vtx, u32 num_vertices, bool light )
+{
+	for( u32 i = 0; i < num_vertices; ++i )
+	{
+		const FiddledVtx & vert = p_vtx[ i ];
+
+		p_in->X[ i ] = f32( vert.x );
+		p_in->Y[ i ] = f32( vert.y );
+		p_in->Z[ i ] = f32( vert.z );
+		p_in->A[ i ] = f32( vert.rgba_a );
+		p_in->U[ i ] = f32( vert.tu );
+		p_in->V[ i ] = f32( vert.tv );
+
+		// The normal and the colour share the same bytes
+		if( light )
+		{
+			p_in->NX[ i ] = f32( vert.norm_x );
+			p_in->NY[ i ] = f32( vert.norm_y );
+			p_in->NZ[ i ] = f32( vert.norm_z );
+		}
+		else
+		{
+			p_in->R[ i ] = f32( vert.rgba_r );
+			p_in->G[ i ] = f32( vert.rgba_g );
+			p_in->B[ i ] = f32( vert.rgba_b );
+		}
+	}
+
+	ClearTail( p_in, num_vertices );
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void TnLSIMD_UnpackVerticesPD( TnLSIMDInput * p_in, const FiddledVtxPD * p_vtx, const u8 * model_norm, u32 num_vertices, bool light )
+{
+	for( u32 i = 0; i < num_vertices; ++i )
+	{
+		const FiddledVtxPD & vert = p_vtx[ i ];
+		const u8 * mn = &model_norm[ vert.cidx ];
+
+		p_in->X[ i ] = f32( vert.x );
+		p_in->Y[ i ] = f32( vert.y );
+		p_in->Z[ i ] = f32( vert.z );
+		p_in->A[ i ] = f32( mn[0] );
+		p_in->U[ i ] = f32( vert.tu );
+		p_in->V[ i ] = f32( vert.tv );
+
+		// Normals and colours both come from the aux buffer
+		if( light )
+		{
+			p_in->NX[ i ] = f32( mn[3] );
+			p_in->NY[ i ] = f32( mn[2] );
+			p_in->NZ[ i ] = f32( mn[1] );
+		}
+		else
+		{
+			p_in->R[ i ] = f32( mn[3] );
+			p_in->G[ i ] = f32( mn[2] );
+			p_in->B[ i ] = f32( mn[1] );
+		}
+	}
+
+	ClearTail( p_in, num_vertices );
+}
+
+#endif // DAEDALUS_TNL_SIMD
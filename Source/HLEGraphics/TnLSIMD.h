@@ -0,0 +1,93 @@
+/*
+Copyright (C) 2007 StrmnNrmn
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef HLEGRAPHICS_TNLSIMD_H_
+#define HLEGRAPHICS_TNLSIMD_H_
+
+#include "Base/Types.h"
+#include "HLEGraphics/BaseRenderer.h"
+
+//*****************************************************************************
+//	Batched transform and lighting for x86-64, doing 4 (SSE) or 8 (AVX)
+//	vertices at a time. This is the desktop counterpart of the PSP's VFPU
+//	code, and gives the same results as the FPU paths in BaseRenderer.
+//	Vertices are unpacked from the ucode's own layout into TnLSIMDInput
+//	first, so the same kernel serves more than one vertex format.
+//*****************************************************************************
+
+#if (defined(__x86_64__) || defined(_M_X64)) && !defined(DAEDALUS_PSP)
+#define DAEDALUS_TNL_SIMD
+#endif
+
+#ifdef DAEDALUS_TNL_SIMD
+
+static const u32 kTnLSIMDMaxWidth = 8;
+
+// Each array is padded up to a whole number of batches, so there's never a partial one to deal with
+struct alignas(32) TnLSIMDInput
+{
+	f32		X[ kMaxN64Vertices ];
+	f32		Y[ kMaxN64Vertices ];
+	f32		Z[ kMaxN64Vertices ];
+	f32		NX[ kMaxN64Vertices ];		// Only filled in if lighting
+	f32		NY[ kMaxN64Vertices ];
+	f32		NZ[ kMaxN64Vertices ];
+	f32		R[ kMaxN64Vertices ];		// 0..255. Only filled in if not lighting
+	f32		G[ kMaxN64Vertices ];
+	f32		B[ kMaxN64Vertices ];
+	f32		A[ kMaxN64Vertices ];		// 0..255
+	f32		U[ kMaxN64Vertices ];
+	f32		V[ kMaxN64Vertices ];
+};
+DAEDALUS_STATIC_ASSERT( kMaxN64Vertices % kTnLSIMDMaxWidth == 0 );
+
+// The ucodes don't all agree on how environment mapping works
+enum ETnLSIMDTexGen
+{
+	TNL_TEXGEN_LINEAR,			// 0.5 * (1 + n)
+	TNL_TEXGEN_ACOS,			// Cheap approximation of acos(n)/pi
+	TNL_TEXGEN_ACOS_ABS,		// As above, but of |n|
+};
+
+struct TnLSIMDParams
+{
+	const glm::mat4 *	World;
+	const glm::mat4 *	Project;		// Applied to the model space position, or the world space one if ProjectWorld is set
+	const glm::mat4 *	TexGenMatrix;	// Normals for env mapping go through this. NULL to use the lit normal
+	const TnLParams *	TnL;			// Lights and texture scale
+	bool				ProjectWorld;
+	bool				Light;
+	bool				PointLight;
+	bool				TexGen;
+	ETnLSIMDTexGen		TexGenMode;
+};
+
+void	TnLSIMD_UnpackVertices( TnLSIMDInput * p_in, const FiddledVtx * p_vtx, u32 num_vertices, bool light );
+void	TnLSIMD_UnpackVerticesPD( TnLSIMDInput * p_in, const FiddledVtxPD * p_vtx, const u8 * model_norm, u32 num_vertices, bool light );
+
+void	TnLSIMD_TransformVertices( const TnLSIMDParams & params, const TnLSIMDInput & in, DaedalusVtx4 * p_out, u32 num_vertices );
+
+#ifdef DAEDALUS_TNL_AVX
+// Built separately with AVX enabled - see TnLSIMD_AVX.cpp. Only call this if the CPU supports AVX
+void	TnLSIMD_TransformVerticesAVX( const TnLSIMDParams & params, const TnLSIMDInput & in, DaedalusVtx4 * p_out, u32 num_vertices );
+#endif
+
+#endif // DAEDALUS_TNL_SIMD
+
+#endif // HLEGRAPHICS_TNLSIMD_H_
@@ -0,0 +1,327 @@
+/*
+Copyright (C) 2007 StrmnNrmn
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef HLEGRAPHICS_TNLSIMDKERNEL_H_
+#define HLEGRAPHICS_TNLSIMDKERNEL_H_
+
+//*****************************************************************************
+//	The kernel itself, written once against a small set of vector ops.
+//	Only TnLSIMD.cpp (SSE) and TnLSIMD_AVX.cpp (AVX) include this. The AVX
+//	file is built with AVX enabled, so everything in here lives in an
+//	anonymous namespace to keep the two builds of it apart - and nothing in
+//	here calls an inline function from elsewhere, for the same reason.
+//*****************************************************************************
+
+#include "HLEGraphics/TnLSIMD.h"
+
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+namespace
+{
+
+//*****************************************************************************
+//	Writes out up to 4 vertices' worth of results, transposing from SoA
+//*****************************************************************************
+inline void StoreVtx4( DaedalusVtx4 * p_out, u32 count, const __m128 (&transformed)[4], const __m128 (&projected)[4],
+					   const __m128 (&colour)[4], __m128 u, __m128 v, __m128 flags )
+{
+	__m128 t0 = transformed[0], t1 = transformed[1], t2 = transformed[2], t3 = transformed[3];
+	__m128 p0 = projected[0],   p1 = projected[1],   p2 = projected[2],   p3 = projected[3];
+	__m128 c0 = colour[0],      c1 = colour[1],      c2 = colour[2],      c3 = colour[3];
+	_MM_TRANSPOSE4_PS( t0, t1, t2, t3 );
+	_MM_TRANSPOSE4_PS( p0, p1, p2, p3 );
+	_MM_TRANSPOSE4_PS( c0, c1, c2, c3 );
+
+	const __m128 t[4] = { t0, t1, t2, t3 };
+	const __m128 p[4] = { p0, p1, p2, p3 };
+	const __m128 c[4] = { c0, c1, c2, c3 };
+
+	alignas(16) f32 us[4];
+	alignas(16) f32 vs[4];
+	alignas(16) u32 fs[4];
+	_mm_store_ps( us, u );
+	_mm_store_ps( vs, v );
+	_mm_store_si128( reinterpret_cast< __m128i * >( fs ), _mm_castps_si128( flags ) );
+
+	for( u32 i = 0; i < count; ++i )
+	{
+		DaedalusVtx4 & out = p_out[ i ];
+		_mm_store_ps( &out.TransformedPos.x, t[ i ] );
+		_mm_store_ps( &out.ProjectedPos.x, p[ i ] );
+		_mm_store_ps( &out.Colour.x, c[ i ] );
+		out.Texture.x = us[ i ];
+		out.Texture.y = vs[ i ];
+		out.ClipFlags = fs[ i ];
+	}
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+struct SSEOps
+{
+	using F = __m128;
+	static constexpr u32 kWidth = 4;
+
+	static F		Load( const f32 * p )			{ return _mm_load_ps( p ); }
+	static F		Set1( f32 v )					{ return _mm_set1_ps( v ); }
+	static F		Bits( u32 v )					{ return _mm_castsi128_ps( _mm_set1_epi32( v ) ); }
+	static F		Add( F a, F b )					{ return _mm_add_ps( a, b ); }
+	static F		Sub( F a, F b )					{ return _mm_sub_ps( a, b ); }
+	static F		Mul( F a, F b )					{ return _mm_mul_ps( a, b ); }
+	static F		Div( F a, F b )					{ return _mm_div_ps( a, b ); }
+	static F		Sqrt( F a )						{ return _mm_sqrt_ps( a ); }
+	static F		Min( F a, F b )					{ return _mm_min_ps( a, b ); }
+	static F		Max( F a, F b )					{ return _mm_max_ps( a, b ); }
+	static F		And( F a, F b )					{ return _mm_and_ps( a, b ); }
+	static F		AndNot( F a, F b )				{ return _mm_andnot_ps( a, b ); }		// ~a & b
+	static F		Or( F a, F b )					{ return _mm_or_ps( a, b ); }
+	static F		CmpLT( F a, F b )				{ return _mm_cmplt_ps( a, b ); }
+	static F		CmpGT( F a, F b )				{ return _mm_cmpgt_ps( a, b ); }
+
+	static void		Store( DaedalusVtx4 * p_out, u32 count, const F (&transformed)[4], const F (&projected)[4],
+						   const F (&colour)[4], F u, F v, F flags )
+	{
+		StoreVtx4( p_out, count, transformed, projected, colour, u, v, flags );
+	}
+};
+
+//*****************************************************************************
+//	result = mat * (x, y, z, 1), summed in the same order as glm, so the
+//	results match the FPU path exactly.
+//*****************************************************************************
+template< typename Ops >
+inline void TransformPoint( typename Ops::F (&result)[4], const typename Ops::F (&mat)[16],
+							typename Ops::F x, typename Ops::F y, typename Ops::F z )
+{
+	for( u32 r = 0; r < 4; ++r )
+	{
+		result[ r ] = Ops::Add( Ops::Add( Ops::Mul( mat[ 0 + r ], x ), Ops::Mul( mat[ 4 + r ], y ) ),
+								Ops::Add( Ops::Mul( mat[ 8 + r ], z ), mat[ 12 + r ] ) );
+	}
+}
+
+template< typename Ops >
+inline void TransformVec4( typename Ops::F (&result)[4], const typename Ops::F (&mat)[16], const typename Ops::F (&v)[4] )
+{
+	for( u32 r = 0; r < 4; ++r )
+	{
+		result[ r ] = Ops::Add( Ops::Add( Ops::Mul( mat[ 0 + r ], v[0] ), Ops::Mul( mat[ 4 + r ], v[1] ) ),
+								Ops::Add( Ops::Mul( mat[ 8 + r ], v[2] ), Ops::Mul( mat[ 12 + r ], v[3] ) ) );
+	}
+}
+
+// normalize( mat3( mat ) * n )
+template< typename Ops >
+inline void TransformNormal( typename Ops::F (&result)[3], const typename Ops::F (&mat)[16],
+							 typename Ops::F x, typename Ops::F y, typename Ops::F z )
+{
+	typename Ops::F n[3];
+	for( u32 r = 0; r < 3; ++r )
+	{
+		n[ r ] = Ops::Add( Ops::Add( Ops::Mul( mat[ 0 + r ], x ), Ops::Mul( mat[ 4 + r ], y ) ), Ops::Mul( mat[ 8 + r ], z ) );
+	}
+
+	typename Ops::F len_sq = Ops::Add( Ops::Add( Ops::Mul( n[0], n[0] ), Ops::Mul( n[1], n[1] ) ), Ops::Mul( n[2], n[2] ) );
+	typename Ops::F inv_len = Ops::Div( Ops::Set1( 1.0f ), Ops::Sqrt( len_sq ) );
+	for( u32 r = 0; r < 3; ++r )
+	{
+		result[ r ] = Ops::Mul( n[ r ], inv_len );
+	}
+}
+
+template< typename Ops >
+inline typename Ops::F TexGenCoord( typename Ops::F n, ETnLSIMDTexGen mode )
+{
+	const typename Ops::F half    = Ops::Set1( 0.5f );
+	const typename Ops::F quarter = Ops::Set1( 0.25f );
+
+	if( mode == TNL_TEXGEN_LINEAR )
+		return Ops::Mul( half, Ops::Add( Ops::Set1( 1.0f ), n ) );
+
+	if( mode == TNL_TEXGEN_ACOS_ABS )
+		n = Ops::AndNot( Ops::Set1( -0.0f ), n );
+
+	// 0.5 - 0.25 * n - 0.25 * n * n * n
+	typename Ops::F n3 = Ops::Mul( Ops::Mul( Ops::Mul( quarter, n ), n ), n );
+	return Ops::Sub( Ops::Sub( half, Ops::Mul( quarter, n ) ), n3 );
+}
+
+template< typename Ops >
+inline typename Ops::F ClipFlags( const typename Ops::F (&projected)[4] )
+{
+	const typename Ops::F w     = projected[3];
+	const typename Ops::F neg_w = Ops::Sub( Ops::Set1( 0.0f ), w );
+
+	static const u32 kPosBits[3] = { X_POS, Y_POS, Z_POS };
+	static const u32 kNegBits[3] = { X_NEG, Y_NEG, Z_NEG };
+
+	typename Ops::F flags = Ops::Set1( 0.0f );
+	for( u32 c = 0; c < 3; ++c )
+	{
+		// As set_clip_flags - if both sides are out (w < 0) only the positive flag is set
+		typename Ops::F pos = Ops::CmpLT( projected[ c ], neg_w );
+		typename Ops::F neg = Ops::AndNot( pos, Ops::CmpGT( projected[ c ], w ) );
+		flags = Ops::Or( flags, Ops::Or( Ops::And( pos, Ops::Bits( kPosBits[ c ] ) ), Ops::And( neg, Ops::Bits( kNegBits[ c ] ) ) ) );
+	}
+	return flags;
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+template< typename Ops >
+void TransformVertices( const TnLSIMDParams & params, const TnLSIMDInput & in, DaedalusVtx4 * p_out, u32 num_vertices )
+{
+	using F = typename Ops::F;
+
+	const TnLParams & tnl = *params.TnL;
+
+	F world[16];
+	F project[16];
+	F texgen[16];
+	const f32 * p_world   = reinterpret_cast< const f32 * >( params.World );
+	const f32 * p_project = reinterpret_cast< const f32 * >( params.Project );
+	const f32 * p_texgen  = reinterpret_cast< const f32 * >( params.TexGenMatrix ? params.TexGenMatrix : params.World );
+	for( u32 i = 0; i < 16; ++i )
+	{
+		world[ i ]   = Ops::Set1( p_world[ i ] );
+		project[ i ] = Ops::Set1( p_project[ i ] );
+		texgen[ i ]  = Ops::Set1( p_texgen[ i ] );
+	}
+
+	const F one       = Ops::Set1( 1.0f );
+	const F zero      = Ops::Set1( 0.0f );
+	const F inv_255   = Ops::Set1( 1.0f / 255.0f );
+	const F scale_u   = Ops::Set1( tnl.TextureScaleX );
+	const F scale_v   = Ops::Set1( tnl.TextureScaleY );
+	const DaedalusLight & ambient = tnl.Lights[ tnl.NumLights ];
+
+	for( u32 base = 0; base < num_vertices; base += Ops::kWidth )
+	{
+		const F x = Ops::Load( &in.X[ base ] );
+		const F y = Ops::Load( &in.Y[ base ] );
+		const F z = Ops::Load( &in.Z[ base ] );
+
+		F transformed[4];
+		F projected[4];
+		TransformPoint< Ops >( transformed, world, x, y, z );
+		if( params.ProjectWorld )
+			TransformVec4< Ops >( projected, project, transformed );
+		else
+			TransformPoint< Ops >( projected, project, x, y, z );
+
+		const F flags = ClipFlags< Ops >( projected );
+
+		F colour[4];
+		F u, v;
+		colour[3] = Ops::Mul( Ops::Load( &in.A[ base ] ), inv_255 );
+
+		if( params.Light )
+		{
+			const F nx = Ops::Load( &in.NX[ base ] );
+			const F ny = Ops::Load( &in.NY[ base ] );
+			const F nz = Ops::Load( &in.NZ[ base ] );
+
+			F norm[3];
+			TransformNormal< Ops >( norm, world, nx, ny, nz );
+
+			F r = Ops::Set1( ambient.Colour.x );
+			F g = Ops::Set1( ambient.Colour.y );
+			F b = Ops::Set1( ambient.Colour.z );
+
+			if( params.PointLight )
+			{
+				for( u32 l = 0; l < tnl.NumLights; ++l )
+				{
+					const DaedalusLight & light = tnl.Lights[ l ];
+					if( !light.SkipIfZero )
+						continue;
+
+					// Point lights are positioned in model space
+					F dx = Ops::Sub( Ops::Set1( light.Position.x ), x );
+					F dy = Ops::Sub( Ops::Set1( light.Position.y ), y );
+					F dz = Ops::Sub( Ops::Set1( light.Position.z ), z );
+					F qlen = Ops::Add( Ops::Add( Ops::Mul( dx, dx ), Ops::Mul( dy, dy ) ), Ops::Mul( dz, dz ) );
+					F llen = Ops::Sqrt( qlen );
+
+					F at = Ops::Add( Ops::Add( Ops::Set1( light.ca ), Ops::Mul( Ops::Set1( light.la ), llen ) ), Ops::Mul( Ops::Set1( light.qa ), qlen ) );
+					F cos_t = Ops::And( Ops::CmpGT( at, zero ), Ops::Div( one, at ) );
+
+					r = Ops::Add( r, Ops::Mul( Ops::Set1( light.Colour.x ), cos_t ) );
+					g = Ops::Add( g, Ops::Mul( Ops::Set1( light.Colour.y ), cos_t ) );
+					b = Ops::Add( b, Ops::Mul( Ops::Set1( light.Colour.z ), cos_t ) );
+				}
+			}
+			else
+			{
+				for( u32 l = 0; l < tnl.NumLights; ++l )
+				{
+					const DaedalusLight & light = tnl.Lights[ l ];
+
+					F cos_t = Ops::Add( Ops::Add( Ops::Mul( Ops::Set1( light.Direction.x ), norm[0] ),
+												  Ops::Mul( Ops::Set1( light.Direction.y ), norm[1] ) ),
+												  Ops::Mul( Ops::Set1( light.Direction.z ), norm[2] ) );
+					cos_t = Ops::Max( cos_t, zero );
+
+					r = Ops::Add( r, Ops::Mul( Ops::Set1( light.Colour.x ), cos_t ) );
+					g = Ops::Add( g, Ops::Mul( Ops::Set1( light.Colour.y ), cos_t ) );
+					b = Ops::Add( b, Ops::Mul( Ops::Set1( light.Colour.z ), cos_t ) );
+				}
+			}
+
+			colour[0] = Ops::Min( r, one );
+			colour[1] = Ops::Min( g, one );
+			colour[2] = Ops::Min( b, one );
+
+			if( params.TexGen )
+			{
+				F env_norm[3] = { norm[0], norm[1], norm[2] };
+				if( params.TexGenMatrix != NULL )
+				{
+					TransformNormal< Ops >( env_norm, texgen, nx, ny, nz );
+				}
+				u = TexGenCoord< Ops >( env_norm[0], params.TexGenMode );
+				v = TexGenCoord< Ops >( env_norm[1], params.TexGenMode );
+			}
+			else
+			{
+				u = Ops::Mul( Ops::Load( &in.U[ base ] ), scale_u );
+				v = Ops::Mul( Ops::Load( &in.V[ base ] ), scale_v );
+			}
+		}
+		else
+		{
+			colour[0] = Ops::Mul( Ops::Load( &in.R[ base ] ), inv_255 );
+			colour[1] = Ops::Mul( Ops::Load( &in.G[ base ] ), inv_255 );
+			colour[2] = Ops::Mul( Ops::Load( &in.B[ base ] ), inv_255 );
+
+			u = Ops::Mul( Ops::Load( &in.U[ base ] ), scale_u );
+			v = Ops::Mul( Ops::Load( &in.V[ base ] ), scale_v );
+		}
+
+		const u32 count = num_vertices - base < Ops::kWidth ? num_vertices - base : Ops::kWidth;
+		Ops::Store( p_out + base, count, transformed, projected, colour, u, v, flags );
+	}
+}
+
+}
+
+#endif // HLEGRAPHICS_TNLSIMDKERNEL_H_
@@ -0,0 +1,93 @@
+/*
+Copyright (C) 2007 StrmnNrmn
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+//*****************************************************************************
+//	This file is built with AVX enabled, and is only called into once
+//	TnLSIMD.cpp has checked the CPU supports it. Keep it to the kernel.
+//*****************************************************************************
+
+#include "Base/Types.h"
+
+#include "HLEGraphics/TnLSIMD.h"
+
+#if defined(DAEDALUS_TNL_SIMD) && defined(DAEDALUS_TNL_AVX)
+
+#include <immintrin.h>
+
+#include "HLEGraphics/TnLSIMDKernel.h"
+
+namespace
+{
+
+struct AVXOps
+{
+	using F = __m256;
+	static constexpr u32 kWidth = 8;
+
+	static F		Load( const f32 * p )			{ return _mm256_load_ps( p ); }
+	static F		Set1( f32 v )					{ return _mm256_set1_ps( v ); }
+	static F		Bits( u32 v )					{ return _mm256_castsi256_ps( _mm256_set1_epi32( v ) ); }
+	static F		Add( F a, F b )					{ return _mm256_add_ps( a, b ); }
+	static F		Sub( F a, F b )					{ return _mm256_sub_ps( a, b ); }
+	static F		Mul( F a, F b )					{ return _mm256_mul_ps( a, b ); }
+	static F		Div( F a, F b )					{ return _mm256_div_ps( a, b ); }
+	static F		Sqrt( F a )						{ return _mm256_sqrt_ps( a ); }
+	static F		Min( F a, F b )					{ return _mm256_min_ps( a, b ); }
+	static F		Max( F a, F b )					{ return _mm256_max_ps( a, b ); }
+	static F		And( F a, F b )					{ return _mm256_and_ps( a, b ); }
+	static F		AndNot( F a, F b )				{ return _mm256_andnot_ps( a, b ); }		// ~a & b
+	static F		Or( F a, F b )					{ return _mm256_or_ps( a, b ); }
+	static F		CmpLT( F a, F b )				{ return _mm256_cmp_ps( a, b, _CMP_LT_OS ); }
+	static F		CmpGT( F a, F b )				{ return _mm256_cmp_ps( a, b, _CMP_GT_OS ); }
+
+	static void		Store( DaedalusVtx4 * p_out, u32 count, const F (&transformed)[4], const F (&projected)[4],
+						   const F (&colour)[4], F u, F v, F flags )
+	{
+		__m128 t_lo[4], t_hi[4], p_lo[4], p_hi[4], c_lo[4], c_hi[4];
+		for( u32 i = 0; i < 4; ++i )
+		{
+			t_lo[ i ] = _mm256_castps256_ps128( transformed[ i ] );
+			t_hi[ i ] = _mm256_extractf128_ps( transformed[ i ], 1 );
+			p_lo[ i ] = _mm256_castps256_ps128( projected[ i ] );
+			p_hi[ i ] = _mm256_extractf128_ps( projected[ i ], 1 );
+			c_lo[ i ] = _mm256_castps256_ps128( colour[ i ] );
+			c_hi[ i ] = _mm256_extractf128_ps( colour[ i ], 1 );
+		}
+
+		StoreVtx4( p_out, count < 4 ? count : 4, t_lo, p_lo, c_lo,
+				   _mm256_castps256_ps128( u ), _mm256_castps256_ps128( v ), _mm256_castps256_ps128( flags ) );
+		if( count > 4 )
+		{
+			StoreVtx4( p_out + 4, count - 4, t_hi, p_hi, c_hi,
+					   _mm256_extractf128_ps( u, 1 ), _mm256_extractf128_ps( v, 1 ), _mm256_extractf128_ps( flags, 1 ) );
+		}
+	}
+};
+
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void TnLSIMD_TransformVerticesAVX( const TnLSIMDParams & params, const TnLSIMDInput & in, DaedalusVtx4 * p_out, u32 num_vertices )
+{
+	TransformVertices< AVXOps >( params, in, p_out, num_vertices );
+}
+
+#endif // DAEDALUS_TNL_SIMD && DAEDALUS_TNL_AVX
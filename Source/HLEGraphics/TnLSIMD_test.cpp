@@ -0,0 +1,272 @@
+#include "Base/Types.h"
+#include "HLEGraphics/TnLSIMD.h"
+
+#include <string.h>
+#include <tuple>
+
+#include <gtest/gtest.h>
+
+#ifdef DAEDALUS_TNL_SIMD
+
+#include "HLEGraphics/TnLSIMDKernel.h"
+
+//*****************************************************************************
+//	The FPU path from BaseRenderer::SetNewVertexInfo, summed in the same order.
+//	Fog isn't done per vertex off the PSP, so TNL_FOG must leave alpha alone.
+//*****************************************************************************
+static glm::vec4 transform_reference( const glm::mat4 & mat, f32 x, f32 y, f32 z, f32 w )
+{
+	glm::vec4 r;
+	for( u32 i = 0; i < 4; ++i )
+	{
+		r[ i ] = ( mat[0][ i ] * x + mat[1][ i ] * y ) + ( mat[2][ i ] * z + mat[3][ i ] * w );
+	}
+	return r;
+}
+
+static glm::vec3 normal_reference( const glm::mat4 & mat, f32 x, f32 y, f32 z )
+{
+	glm::vec3 n;
+	for( u32 i = 0; i < 3; ++i )
+	{
+		n[ i ] = ( mat[0][ i ] * x + mat[1][ i ] * y ) + mat[2][ i ] * z;
+	}
+	f32 inv_len = 1.0f / sqrtf( ( n.x * n.x + n.y * n.y ) + n.z * n.z );
+	return glm::vec3( n.x * inv_len, n.y * inv_len, n.z * inv_len );
+}
+
+static u32 clip_flags_reference( const glm::vec4 & projected )
+{
+	u32 clip_flags = 0;
+	if		(projected.x < -projected.w)	clip_flags |= X_POS;
+	else if (projected.x > projected.w)		clip_flags |= X_NEG;
+
+	if		(projected.y < -projected.w)	clip_flags |= Y_POS;
+	else if (projected.y > projected.w)		clip_flags |= Y_NEG;
+
+	if		(projected.z < -projected.w)	clip_flags |= Z_POS;
+	else if (projected.z > projected.w)		clip_flags |= Z_NEG;
+
+	return clip_flags;
+}
+
+static void tnl_reference( const glm::mat4 & world, const glm::mat4 & world_project, const TnLParams & tnl,
+						   const FiddledVtx * p_vtx, DaedalusVtx4 * p_out, u32 num_vertices )
+{
+	const DaedalusLight & ambient = tnl.Lights[ tnl.NumLights ];
+
+	for( u32 i = 0; i < num_vertices; ++i )
+	{
+		const FiddledVtx & vert = p_vtx[ i ];
+		DaedalusVtx4 & out = p_out[ i ];
+		const f32 x = f32( vert.x ), y = f32( vert.y ), z = f32( vert.z );
+
+		out.TransformedPos = transform_reference( world, x, y, z, 1.0f );
+		out.ProjectedPos   = transform_reference( world_project, x, y, z, 1.0f );
+		out.ClipFlags      = clip_flags_reference( out.ProjectedPos );
+
+		if( tnl.Flags.Light )
+		{
+			const f32 nx = f32( vert.norm_x ), ny = f32( vert.norm_y ), nz = f32( vert.norm_z );
+			const glm::vec3 norm = normal_reference( world, nx, ny, nz );
+
+			glm::vec3 col( ambient.Colour.x, ambient.Colour.y, ambient.Colour.z );
+			for( u32 l = 0; l < tnl.NumLights; ++l )
+			{
+				const DaedalusLight & light = tnl.Lights[ l ];
+				f32 cos_t = 0.0f;
+				if( tnl.Flags.PointLight )
+				{
+					if( !light.SkipIfZero )
+						continue;
+
+					f32 dx = light.Position.x - x, dy = light.Position.y - y, dz = light.Position.z - z;
+					f32 qlen = ( dx * dx + dy * dy ) + dz * dz;
+					f32 at = ( light.ca + light.la * sqrtf( qlen ) ) + light.qa * qlen;
+					if( at > 0.0f )
+						cos_t = 1.0f / at;
+				}
+				else
+				{
+					cos_t = ( light.Direction.x * norm.x + light.Direction.y * norm.y ) + light.Direction.z * norm.z;
+					if( cos_t < 0.0f )
+						cos_t = 0.0f;
+				}
+				col.x += light.Colour.x * cos_t;
+				col.y += light.Colour.y * cos_t;
+				col.z += light.Colour.z * cos_t;
+			}
+			out.Colour = glm::vec4( col.x < 1.0f ? col.x : 1.0f, col.y < 1.0f ? col.y : 1.0f, col.z < 1.0f ? col.z : 1.0f,
+									vert.rgba_a * (1.0f / 255.0f) );
+
+			if( tnl.Flags.TexGen )
+			{
+				const glm::vec3 env = normal_reference( world_project, nx, ny, nz );
+				if( tnl.Flags.TexGenLin )
+				{
+					out.Texture.x = 0.5f * ( 1.0f + env.x );
+					out.Texture.y = 0.5f * ( 1.0f + env.y );
+				}
+				else
+				{
+					f32 nx_abs = fabsf( env.x );
+					f32 ny_abs = fabsf( env.y );
+					out.Texture.x = ( 0.5f - 0.25f * nx_abs ) - 0.25f * nx_abs * nx_abs * nx_abs;
+					out.Texture.y = ( 0.5f - 0.25f * ny_abs ) - 0.25f * ny_abs * ny_abs * ny_abs;
+				}
+			}
+			else
+			{
+				out.Texture.x = f32( vert.tu ) * tnl.TextureScaleX;
+				out.Texture.y = f32( vert.tv ) * tnl.TextureScaleY;
+			}
+		}
+		else
+		{
+			out.Colour = glm::vec4( vert.rgba_r * (1.0f / 255.0f), vert.rgba_g * (1.0f / 255.0f),
+									vert.rgba_b * (1.0f / 255.0f), vert.rgba_a * (1.0f / 255.0f) );
+			out.Texture.x = f32( vert.tu ) * tnl.TextureScaleX;
+			out.Texture.y = f32( vert.tv ) * tnl.TextureScaleY;
+		}
+	}
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+class TnLSIMDTest : public ::testing::TestWithParam< ::std::tuple<u32, u32> >
+{
+protected:
+	virtual void SetUp()
+	{
+		u32 seed = 0x12345678;
+		auto rand = [ &seed ]() { seed = seed * 1664525 + 1013904223; return seed >> 8; };
+		auto rand_f32 = [ &rand ]( f32 lo, f32 hi ) { return lo + ( hi - lo ) * f32( rand() & 0xffff ) / 65535.0f; };
+
+		// Some vertices land outside the frustum, so the clip flags get exercised too
+		for( u32 i = 0; i < kMaxN64Vertices; ++i )
+		{
+			FiddledVtx & vert = mVtx[ i ];
+			vert.x = s16( rand() % 4000 ) - 2000;
+			vert.y = s16( rand() % 4000 ) - 2000;
+			vert.z = s16( rand() % 4000 ) - 2000;
+			vert.flag = 0;
+			vert.tu = s16( rand() );
+			vert.tv = s16( rand() );
+			vert.rgba_r = u8( rand() );
+			vert.rgba_g = u8( rand() );
+			vert.rgba_b = u8( rand() );
+			vert.rgba_a = u8( rand() );
+		}
+
+		for( u32 c = 0; c < 4; ++c )
+		{
+			for( u32 r = 0; r < 4; ++r )
+			{
+				mWorld[ c ][ r ]   = r == 3 ? ( c == 3 ? 1.0f : 0.0f ) : rand_f32( -1.0f, 1.0f ) * ( c == 3 ? 50.0f : 1.0f );
+				mProject[ c ][ r ] = rand_f32( -0.00005f, 0.00005f ) + ( c == r ? 0.001f : 0.0f );
+			}
+		}
+		mProject[3][3] = 1.0f;
+		mWorldProject = mProject * mWorld;
+
+		memset( &mTnL, 0, sizeof( mTnL ) );
+		mTnL.NumLights = 3;
+		mTnL.TextureScaleX = 1.0f / 32.0f;
+		mTnL.TextureScaleY = 1.0f / 64.0f;
+		mTnL.FogMult = 4.0f;
+		mTnL.FogOffs = -3.0f;
+		for( u32 l = 0; l <= mTnL.NumLights; ++l )
+		{
+			DaedalusLight & light = mTnL.Lights[ l ];
+			light.Direction = normal_reference( glm::mat4( 1.0f ), rand_f32( -1.0f, 1.0f ), rand_f32( -1.0f, 1.0f ), rand_f32( -1.0f, 1.0f ) );
+			light.Colour = glm::vec3( rand_f32( 0.0f, 0.8f ), rand_f32( 0.0f, 0.8f ), rand_f32( 0.0f, 0.8f ) );
+			light.Position = glm::vec4( rand_f32( -2000.0f, 2000.0f ), rand_f32( -2000.0f, 2000.0f ), rand_f32( -2000.0f, 2000.0f ), 1.0f );
+			light.SkipIfZero = l != 1;
+			light.ca = rand_f32( 0.0f, 2.0f );
+			light.la = rand_f32( 0.0f, 0.01f );
+			light.qa = rand_f32( 0.0f, 0.0001f );
+		}
+		// Bright enough that some vertices saturate
+		mTnL.Lights[ mTnL.NumLights ].Colour = glm::vec3( 0.5f, 0.4f, 0.3f );
+
+		memset( mExpected, 0, sizeof( mExpected ) );
+		memset( mSSE, 0, sizeof( mSSE ) );
+		memset( mAVX, 0, sizeof( mAVX ) );
+	}
+
+	// As BaseRenderer::SetNewVertexInfo
+	TnLSIMDParams GetParams() const
+	{
+		TnLSIMDParams params;
+		params.World		= &mWorld;
+		params.Project		= &mWorldProject;
+		params.TexGenMatrix	= &mWorldProject;
+		params.TnL			= &mTnL;
+		params.ProjectWorld	= false;
+		params.Light		= mTnL.Flags.Light;
+		params.PointLight	= mTnL.Flags.PointLight;
+		params.TexGen		= mTnL.Flags.TexGen;
+		params.TexGenMode	= mTnL.Flags.TexGenLin ? TNL_TEXGEN_LINEAR : TNL_TEXGEN_ACOS_ABS;
+		return params;
+	}
+
+	FiddledVtx		mVtx[ kMaxN64Vertices ];
+	glm::mat4		mWorld;
+	glm::mat4		mProject;
+	glm::mat4		mWorldProject;
+	TnLParams		mTnL;
+	TnLSIMDInput	mIn;
+	DaedalusVtx4	mExpected[ kMaxN64Vertices ];
+	DaedalusVtx4	mSSE[ kMaxN64Vertices ];
+	DaedalusVtx4	mAVX[ kMaxN64Vertices ];
+};
+
+static void ExpectVtxEq( const DaedalusVtx4 & expected, const DaedalusVtx4 & actual, u32 i )
+{
+	for( u32 c = 0; c < 4; ++c )
+	{
+		EXPECT_FLOAT_EQ( expected.TransformedPos[ c ], actual.TransformedPos[ c ] ) << "vertex " << i;
+		EXPECT_FLOAT_EQ( expected.ProjectedPos[ c ], actual.ProjectedPos[ c ] ) << "vertex " << i;
+		EXPECT_FLOAT_EQ( expected.Colour[ c ], actual.Colour[ c ] ) << "vertex " << i;
+	}
+	EXPECT_FLOAT_EQ( expected.Texture.x, actual.Texture.x ) << "vertex " << i;
+	EXPECT_FLOAT_EQ( expected.Texture.y, actual.Texture.y ) << "vertex " << i;
+	EXPECT_EQ( expected.ClipFlags, actual.ClipFlags ) << "vertex " << i;
+}
+
+TEST_P(TnLSIMDTest, MatchesFPU)
+{
+	mTnL.Flags._u32 = ::std::get<0>(GetParam());
+	u32 num_vertices = ::std::get<1>(GetParam());
+
+	TnLSIMD_UnpackVertices( &mIn, mVtx, num_vertices, mTnL.Flags.Light );
+	const TnLSIMDParams params = GetParams();
+
+	tnl_reference( mWorld, mWorldProject, mTnL, mVtx, mExpected, num_vertices );
+
+	TransformVertices< SSEOps >( params, mIn, mSSE, num_vertices );
+	for( u32 i = 0; i < num_vertices; ++i )
+		ExpectVtxEq( mExpected[ i ], mSSE[ i ], i );
+
+#ifdef DAEDALUS_TNL_AVX
+	if( !__builtin_cpu_supports( "avx" ) )
+		GTEST_SKIP() << "No AVX on this CPU";
+
+	// Same operations, just wider, so this should match bit for bit - nothing is written past the batch either
+	TnLSIMD_TransformVerticesAVX( params, mIn, mAVX, num_vertices );
+	EXPECT_EQ( 0, memcmp( mSSE, mAVX, sizeof( mSSE ) ) );
+#endif
+}
+
+INSTANTIATE_TEST_SUITE_P(X, TnLSIMDTest, ::testing::Combine(::testing::Values(0,
+																			  TNL_LIGHT,
+																			  TNL_LIGHT|TNL_POINTLIGHT,
+																			  TNL_LIGHT|TNL_TEXGEN,
+																			  TNL_LIGHT|TNL_TEXGEN|TNL_TEXGENLIN,
+																			  TNL_FOG,
+																			  TNL_LIGHT|TNL_FOG,
+																			  TNL_LIGHT|TNL_TEXGEN|TNL_FOG),
+															::testing::Values(1,3,4,5,7,8,9,16,31,kMaxN64Vertices)));
+
+#endif // DAEDALUS_TNL_SIMD
@@ -33,6 +33,10 @@ u32		gSpeedSyncEnabled			= 0;		// Enable to limit frame rate.
 bool	gDynarecEnabled				= true;		// Use dynamic recompilation
 bool	gDynarecLoopOptimisation	= false;	// Enable the dynarec loop optmisation
 bool	gDynarecDoublesOptimisation	= false;	// Enable the dynarec Doubles optmisation
+bool	gDynarecPersistentCache		= false;	// Save recorded traces to disk and reuse them next session
+bool	gDynarecBackgroundCompile	= false;	// Compile traces on a worker thread (x64 only)
+bool	gCachedInterpreterEnabled	= true;		// Run pre-decoded blocks when not using the dynarec
+bool	gAsyncPIDMAEnabled			= true;		// Time large PI transfers and stream the rom in the background
 bool	gOSHooksEnabled				= true;		// Apply os-hooks
 u32		gCheckTextureHashFrequency	= 0;		// How often to check textures for updates (every N frames, 0 to disable)
 bool	gDoubleDisplayEnabled		= true;		// Workaround for games that have shaking issues
@@ -31,6 +31,10 @@
 extern bool gDynarecEnabled;			// Use dynamic recompilation
 extern bool gDynarecLoopOptimisation;	// Enable the dynarec loop optmisation
 extern bool gDynarecDoublesOptimisation;	// Enable the dynarec loop optmisation
+extern bool gDynarecPersistentCache;	// Save recorded traces to disk and reuse them next session
+extern bool gDynarecBackgroundCompile;	// Compile traces on a worker thread (x64 only)
+extern bool gCachedInterpreterEnabled;	// Run pre-decoded blocks when not using the dynarec
+extern bool gAsyncPIDMAEnabled;			// Time large PI transfers and stream the rom in the background
 extern bool gOSHooksEnabled;			// Apply os-hooks
 extern u32	gSpeedSyncEnabled;
 extern bool gDoubleDisplayEnabled;
@@ -62,7 +62,11 @@ struct SGlobalPreferences
 #endif
 	bool						BatteryWarning;
 	bool						LargeROMBuffer;
+	bool						MemoryMapROMs;				// Map uncompressed roms from disk rather than reading them in
+	u32							RomCacheChunkKB;			// Size of the chunks roms are streamed in, or 0 for the default
+	u32							RomCacheSizeKB;				// Memory used to cache streamed roms, or 0 for the default
 	bool						ForceLinearFilter;
+	bool						ThreadedRenderer;			// Play the renderer's GL calls back on their own thread
 	bool						RumblePak;
 
 	EGuiColor					GuiColor;
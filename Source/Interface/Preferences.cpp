@@ -167,6 +167,7 @@ bool IPreferences::OpenPreferencesFile( const std::filesystem::path  &filename )
 
 		BOOL_SETTING( gGlobalPreferences, DisplayFramerate, defaults );
 		BOOL_SETTING( gGlobalPreferences, ForceLinearFilter, defaults );
+		BOOL_SETTING( gGlobalPreferences, ThreadedRenderer, defaults );
 		BOOL_SETTING( gGlobalPreferences, RumblePak, defaults );
 #ifdef DAEDALUS_DEBUG_DISPLAYLIST
 		BOOL_SETTING( gGlobalPreferences, HighlightInexactBlendModes, defaults );
@@ -174,6 +175,9 @@ bool IPreferences::OpenPreferencesFile( const std::filesystem::path  &filename )
 #endif
 		BOOL_SETTING( gGlobalPreferences, BatteryWarning, defaults );
 		BOOL_SETTING( gGlobalPreferences, LargeROMBuffer, defaults );
+		BOOL_SETTING( gGlobalPreferences, MemoryMapROMs, defaults );
+		INT_SETTING( gGlobalPreferences, RomCacheChunkKB, defaults );
+		INT_SETTING( gGlobalPreferences, RomCacheSizeKB, defaults );
 		FLOAT_SETTING( gGlobalPreferences, StickMinDeadzone, defaults );
 		FLOAT_SETTING( gGlobalPreferences, StickMaxDeadzone, defaults );
 //		INT_SETTING( gGlobalPreferences, Language, defaults );
@@ -235,6 +239,22 @@ bool IPreferences::OpenPreferencesFile( const std::filesystem::path  &filename )
 		{
 			preferences.DynarecLoopOptimisation = property->GetBooleanValue( false );
 		}
+		if( section->FindProperty( "DynarecPersistentCache", &property ) )
+		{
+			preferences.DynarecPersistentCache = property->GetBooleanValue( false );
+		}
+		if( section->FindProperty( "DynarecBackgroundCompile", &property ) )
+		{
+			preferences.DynarecBackgroundCompile = property->GetBooleanValue( false );
+		}
+		if( section->FindProperty( "CachedInterpreterEnabled", &property ) )
+		{
+			preferences.CachedInterpreterEnabled = property->GetBooleanValue( true );
+		}
+		if( section->FindProperty( "AsyncPIDMAEnabled", &property ) )
+		{
+			preferences.AsyncPIDMAEnabled = property->GetBooleanValue( true );
+		}
 		if( section->FindProperty( "DynarecDoublesOptimisation", &property ) )
 		{
 			preferences.DynarecDoublesOptimisation = property->GetBooleanValue( false );
@@ -322,6 +342,10 @@ fh << "SpeedSyncEnabled=" << preferences.SpeedSyncEnabled << "\n";
 fh << "DynarecEnabled=" << preferences.DynarecEnabled << "\n";
 fh << "DynarecLoopOptimisation=" << preferences.DynarecLoopOptimisation << "\n";
 fh << "DynarecDoublesOptimisation=" << preferences.DynarecDoublesOptimisation << "\n";
+fh << "DynarecPersistentCache=" << preferences.DynarecPersistentCache << "\n";
+fh << "DynarecBackgroundCompile=" << preferences.DynarecBackgroundCompile << "\n";
+fh << "CachedInterpreterEnabled=" << preferences.CachedInterpreterEnabled << "\n";
+fh << "AsyncPIDMAEnabled=" << preferences.AsyncPIDMAEnabled << "\n";
 fh << "DoubleDisplayEnabled=" << preferences.DoubleDisplayEnabled << "\n";
 fh << "CleanSceneEnabled=" << preferences.CleanSceneEnabled << "\n";
 fh << "ClearDepthFrameBuffer=" << preferences.ClearDepthFrameBuffer << "\n";
@@ -353,6 +377,7 @@ void IPreferences::Commit()
 
 		OUTPUT_BOOL( gGlobalPreferences, DisplayFramerate, defaults );
 		OUTPUT_BOOL( gGlobalPreferences, ForceLinearFilter, defaults );
+		OUTPUT_BOOL( gGlobalPreferences, ThreadedRenderer, defaults );
 		OUTPUT_BOOL( gGlobalPreferences, RumblePak, defaults );
 #ifdef DAEDALUS_DEBUG_DISPLAYLIST
 		OUTPUT_BOOL( gGlobalPreferences, HighlightInexactBlendModes, defaults );
@@ -360,6 +385,9 @@ void IPreferences::Commit()
 #endif
 		OUTPUT_BOOL( gGlobalPreferences, BatteryWarning, defaults );
 		OUTPUT_BOOL( gGlobalPreferences, LargeROMBuffer, defaults );
+		OUTPUT_BOOL( gGlobalPreferences, MemoryMapROMs, defaults );
+		OUTPUT_INT( gGlobalPreferences, RomCacheChunkKB, defaults );
+		OUTPUT_INT( gGlobalPreferences, RomCacheSizeKB, defaults );
 		OUTPUT_INT( gGlobalPreferences, GuiColor, defaults );
 		OUTPUT_FLOAT( gGlobalPreferences, StickMinDeadzone, defaults );
 		OUTPUT_FLOAT( gGlobalPreferences, StickMaxDeadzone, defaults );
@@ -420,7 +448,11 @@ SGlobalPreferences::SGlobalPreferences()
 #endif
 ,	BatteryWarning( false )
 ,	LargeROMBuffer( true )
+,	MemoryMapROMs( true )
+,	RomCacheChunkKB( 0 )
+,	RomCacheSizeKB( 0 )
 ,	ForceLinearFilter( false )
+,	ThreadedRenderer( false )
 ,	RumblePak ( false )
 ,	GuiColor( BLACK )
 ,	StickMinDeadzone( 0.28f )
@@ -443,6 +475,10 @@ SRomPreferences::SRomPreferences()
 	,	DynarecEnabled( true )
 	,	DynarecLoopOptimisation( true )
 	,	DynarecDoublesOptimisation( true )
+	,	DynarecPersistentCache( false )
+	,	DynarecBackgroundCompile( false )
+	,	CachedInterpreterEnabled( true )
+	,	AsyncPIDMAEnabled( true )
 	,	DoubleDisplayEnabled( true )
 	,	CleanSceneEnabled( false )
 	,	ClearDepthFrameBuffer( false )
@@ -468,6 +504,10 @@ void SRomPreferences::Reset()
 	DynarecEnabled             = true;
 	DynarecLoopOptimisation    = true;
 	DynarecDoublesOptimisation = true;
+	DynarecPersistentCache     = false;
+	DynarecBackgroundCompile   = false;
+	CachedInterpreterEnabled   = true;
+	AsyncPIDMAEnabled          = true;
 	DoubleDisplayEnabled       = true;
 	CleanSceneEnabled          = false;
 	ClearDepthFrameBuffer	   = false;
@@ -491,6 +531,10 @@ void SRomPreferences::Apply() const
 	gDynarecEnabled             = g_ROM.settings.DynarecSupported && DynarecEnabled;
 	gDynarecLoopOptimisation	= DynarecLoopOptimisation;	// && g_ROM.settings.DynarecLoopOptimisation;
 	gDynarecDoublesOptimisation	= g_ROM.settings.DynarecDoublesOptimisation || DynarecDoublesOptimisation;
+	gDynarecPersistentCache		= DynarecPersistentCache;
+	gDynarecBackgroundCompile	= DynarecBackgroundCompile;
+	gCachedInterpreterEnabled	= CachedInterpreterEnabled;
+	gAsyncPIDMAEnabled			= AsyncPIDMAEnabled;
 	gDoubleDisplayEnabled       = g_ROM.settings.DoubleDisplayEnabled && DoubleDisplayEnabled; // I don't know why DD won't disabled if we set ||
 	gCleanSceneEnabled          = g_ROM.settings.CleanSceneEnabled || CleanSceneEnabled;
 	gClearDepthFrameBuffer      = g_ROM.settings.ClearDepthFrameBuffer || ClearDepthFrameBuffer;
@@ -79,6 +79,10 @@ struct SRomPreferences
 	bool						DynarecEnabled;				// Requires DynarceSupported in RomSettings
 	bool						DynarecLoopOptimisation;
 	bool						DynarecDoublesOptimisation;
+	bool						DynarecPersistentCache;
+	bool						DynarecBackgroundCompile;
+	bool						CachedInterpreterEnabled;
+	bool						AsyncPIDMAEnabled;
 	bool						DoubleDisplayEnabled;
 	bool						CleanSceneEnabled;
 	bool						ClearDepthFrameBuffer;
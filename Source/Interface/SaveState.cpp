@@ -22,6 +22,9 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include <stdio.h>
 #include <cstring>
+#include <deque>
+#include <thread>
+#include <vector>
 
 #include "Interface/SaveState.h"
 #include "Core/Memory.h"
@@ -73,6 +76,11 @@ public:
 			skip(size - MemoryRegionSizes[buffernum]);
 	}
 
+	inline void write_rdram()
+	{
+		write(g_pMemoryBuffers[MEM_RD_RAM], gRamSize);
+	}
+
 	bool IsValid() const
 	{
 		return mStream.IsOpen();
@@ -156,6 +164,11 @@ public:
 		}
 	}
 
+	inline void read_rdram()
+	{
+		read(g_pMemoryBuffers[MEM_RD_RAM], gRamSize);
+	}
+
 	void skip( size_t size )
 	{
 		if( mStream.IsOpen() )
@@ -189,13 +202,126 @@ private:
 };
 
 
-bool SaveState_SaveToFile( const std::filesystem::path &filename )
+//
+//	Same format as above, but to and from memory. RDRAM can be left out, so
+//	in-memory snapshots can handle it separately.
+//
+class SaveState_ostream_mem
 {
-	SaveState_ostream_gzip stream( filename );
+public:
+	SaveState_ostream_mem( std::vector<u8> & buffer, bool include_rdram )
+		: mBuffer( buffer )
+		, mIncludeRDRam( include_rdram )
+	{
+	}
 
-	if( !stream.IsValid() )
-		return false;
+	template<typename T>
+	inline SaveState_ostream_mem& operator << (const T& data)
+	{
+		write(&data, sizeof(T));
+		return *this;
+	}
+
+	inline void write_memory_buffer(int buffernum, u32 size = 0)
+	{
+		write(g_pMemoryBuffers[buffernum], size ? std::min(MemoryRegionSizes[buffernum], size) : MemoryRegionSizes[buffernum]);
+		if(size > MemoryRegionSizes[buffernum])
+			skip(size - MemoryRegionSizes[buffernum]);
+	}
+
+	inline void write_rdram()
+	{
+		if( mIncludeRDRam )
+			write(g_pMemoryBuffers[MEM_RD_RAM], gRamSize);
+	}
+
+	void skip( size_t size )
+	{
+		mBuffer.insert( mBuffer.end(), size, 0 );
+	}
+
+	size_t write( const void * data, size_t size )
+	{
+		const u8 * p_data( reinterpret_cast< const u8 * >( data ) );
+		mBuffer.insert( mBuffer.end(), p_data, p_data + size );
+		return size;
+	}
+
+private:
+	std::vector<u8> &	mBuffer;
+	bool				mIncludeRDRam;
+};
+
+class SaveState_istream_mem
+{
+public:
+	SaveState_istream_mem( const u8 * data, u32 size, bool include_rdram )
+		: mData( data )
+		, mSize( size )
+		, mOffset( 0 )
+		, mIncludeRDRam( include_rdram )
+	{
+	}
+
+	template<typename T>
+	inline SaveState_istream_mem& operator >> (T& data)
+	{
+		if (read(&data, sizeof(data)) != sizeof(data))
+		{
+			memset(&data, 0, sizeof(data));
+		}
+		return *this;
+	}
+
+	inline void read_memory_buffer(int buffernum, u32 size = 0)
+	{
+		read(g_pMemoryBuffers[buffernum], size ? std::min(MemoryRegionSizes[buffernum], size) : MemoryRegionSizes[buffernum]);
+		if(size > MemoryRegionSizes[buffernum])
+			skip(size - MemoryRegionSizes[buffernum]);
+	}
+
+	inline void read_memory_buffer_write_value(int buffernum, int address)
+	{
+		for( u32 i = 0; i < MemoryRegionSizes[buffernum]; i += 4 )
+		{
+			u32 value;
+			*this >> value;
+			Write32Bits(address + i, value);
+		}
+	}
+
+	inline void read_rdram()
+	{
+		if( mIncludeRDRam )
+			read(g_pMemoryBuffers[MEM_RD_RAM], gRamSize);
+	}
 
+	void skip( size_t size )
+	{
+		mOffset = std::min< size_t >( mOffset + size, mSize );
+	}
+
+	size_t read(void* data, size_t size)
+	{
+		if( mOffset + size > mSize )
+			return 0;
+
+		memcpy( data, mData + mOffset, size );
+		mOffset += size;
+		return size;
+	}
+
+private:
+	const u8 *			mData;
+	size_t				mSize;
+	size_t				mOffset;
+	bool				mIncludeRDRam;
+};
+
+
+template< typename Stream >
+static void SaveState_WriteState( Stream & stream )
+{
 	stream << SAVESTATE_PROJECT64_MAGIC_NUMBER;
 	stream << gRamSize;
 	ROMHeader rom_header;
@@ -247,18 +373,13 @@ bool SaveState_SaveToFile( const std::filesystem::path &filename )
 	}
 
 	stream.write( g_pMemoryBuffers[MEM_PIF_RAM], 0x40);
-	stream.write( g_pMemoryBuffers[MEM_RD_RAM], gRamSize);
+	stream.write_rdram();
 	stream.write_memory_buffer(MEM_SP_MEM);
-	return true;
 }
 
-bool SaveState_LoadFromFile( const std::filesystem::path &filename )
+template< typename Stream >
+static bool SaveState_ReadState( Stream & stream )
 {
-	SaveState_istream_gzip stream( filename );
-
-	if( !stream.IsValid() )
-		return false;
-
 	u32 value;
 	stream >> value;
 	if(value != SAVESTATE_PROJECT64_MAGIC_NUMBER)
@@ -365,7 +486,7 @@ bool SaveState_LoadFromFile( const std::filesystem::path &filename )
 	//stream.skip(0x40);
 
 	stream.read(g_pMemoryBuffers[MEM_PIF_RAM], 0x40);
-	stream.read(g_pMemoryBuffers[MEM_RD_RAM], gRamSize);
+	stream.read_rdram();
 	stream.read_memory_buffer(MEM_SP_MEM); //, 0x84000000);
 
 #ifdef DAEDALUS_ENABLE_OS_HOOKS
@@ -375,8 +496,303 @@ bool SaveState_LoadFromFile( const std::filesystem::path &filename )
 	return true;
 }
 
+bool SaveState_SaveToFile( const std::filesystem::path &filename )
+{
+	SaveState_WaitForPendingWrites();
+
+	SaveState_ostream_gzip stream( filename );
+
+	if( !stream.IsValid() )
+		return false;
+
+	SaveState_WriteState( stream );
+	return true;
+}
+
+bool SaveState_LoadFromFile( const std::filesystem::path &filename )
+{
+	SaveState_WaitForPendingWrites();
+
+	SaveState_istream_gzip stream( filename );
+
+	if( !stream.IsValid() )
+		return false;
+
+	return SaveState_ReadState( stream );
+}
+
+//
+//	Asynchronous saving. The state is copied into memory straight away, and
+//	compressed and written out on a worker thread. Only one write is in
+//	flight at a time, so the buffer is reused from one save to the next.
+//
+namespace
+{
+	std::vector<u8>		gPendingWriteBuffer;
+	std::thread			gPendingWriteThread;
+
+	// Make sure the last save makes it to disk if we exit straight after
+	struct SPendingWriteJoiner
+	{
+		~SPendingWriteJoiner()	{ SaveState_WaitForPendingWrites(); }
+	} gPendingWriteJoiner;
+
+	void WriteSaveStateBuffer( std::filesystem::path filename )
+	{
+		COutStream	stream( filename );
+
+		if( !stream.IsOpen() || !stream.WriteData( gPendingWriteBuffer.data(), gPendingWriteBuffer.size() ) || !stream.Flush() )
+		{
+			DBGConsole_Msg(0, "Failed to write savestate '%s'", filename.string().c_str());
+		}
+	}
+}
+
+bool SaveState_SaveToFileAsync( const std::filesystem::path &filename )
+{
+	SaveState_WaitForPendingWrites();
+
+	gPendingWriteBuffer.clear();
+	gPendingWriteBuffer.reserve( gRamSize + 64 * 1024 );
+
+	SaveState_ostream_mem stream( gPendingWriteBuffer, true );
+	SaveState_WriteState( stream );
+
+	gPendingWriteThread = std::thread( &WriteSaveStateBuffer, filename );
+	return true;
+}
+
+void SaveState_WaitForPendingWrites()
+{
+	if( gPendingWriteThread.joinable() )
+	{
+		gPendingWriteThread.join();
+	}
+}
+
+//
+//	In-memory snapshots for checkpointing and rewind.
+//
+//	Everything but RDRAM is small, so it's stored in full each time. For RDRAM
+//	we keep a shadow copy of the most recent snapshot. Taking a snapshot
+//	compares RDRAM against the shadow a page at a time, and records the old
+//	contents of each page that changed before updating the shadow. Rewinding
+//	applies those records to the shadow in reverse.
+//
+//	Records are allocated from a fixed arena used as a ring buffer, so the
+//	oldest snapshots are dropped as new ones are taken.
+//
+namespace
+{
+	const u32 SNAPSHOT_PAGE_SIZE = 4096;
+	const u32 DEFAULT_SNAPSHOT_ARENA_SIZE = 32 * 1024 * 1024;
+
+	class CSnapshotBuffer
+	{
+	public:
+		CSnapshotBuffer() : mHead( 0 ) {}
+
+		void	Init( u32 arena_size );
+		void	Fini();
+		bool	Take();
+		bool	Restore( u32 steps_back );
+
+		u32		GetCount() const		{ return mRecords.size(); }
+
+	private:
+		struct SRecord
+		{
+			u32		Offset;
+			u32		Size;
+			u32		StateSize;
+			u32		NumPages;
+		};
+
+		u8 *	Allocate( SRecord & record );
+
+	private:
+		std::vector<u8>		mArena;
+		std::vector<u8>		mShadow;		// RDRAM as of the most recent snapshot
+		std::deque<SRecord>	mRecords;		// Oldest first
+		u32					mHead;			// Where the next record goes
+
+		std::vector<u8>		mState;			// Scratch space, reused to avoid allocations
+		std::vector<u32>	mDirtyPages;
+	};
+
+	CSnapshotBuffer		gSnapshotBuffer;
+}
+
+void CSnapshotBuffer::Init( u32 arena_size )
+{
+	mArena.assign( arena_size, 0 );
+	mShadow.clear();
+	mRecords.clear();
+	mHead = 0;
+}
+
+void CSnapshotBuffer::Fini()
+{
+	std::vector<u8>().swap( mArena );
+	std::vector<u8>().swap( mShadow );
+	mRecords.clear();
+	mHead = 0;
+}
+
+u8 * CSnapshotBuffer::Allocate( SRecord & record )
+{
+	if( record.Size > mArena.size() )
+		return nullptr;
+
+	u32 offset( mRecords.empty() ? 0 : mHead );
+	if( offset + record.Size > mArena.size() )
+	{
+		// Wrap around. Everything from here to the end of the arena is older than what's at the start
+		while( !mRecords.empty() && mRecords.front().Offset >= mHead )
+		{
+			mRecords.pop_front();
+		}
+		offset = 0;
+	}
+
+	while( !mRecords.empty() && mRecords.front().Offset < offset + record.Size && offset < mRecords.front().Offset + mRecords.front().Size )
+	{
+		mRecords.pop_front();
+	}
+
+	record.Offset = offset;
+	mHead = offset + record.Size;
+	return mArena.data() + offset;
+}
+
+bool CSnapshotBuffer::Take()
+{
+	if( mArena.empty() )
+	{
+		Init( DEFAULT_SNAPSHOT_ARENA_SIZE );
+	}
+
+	mState.clear();
+	SaveState_ostream_mem stream( mState, false );
+	SaveState_WriteState( stream );
+
+	const u8 *	p_ram( static_cast< const u8 * >( g_pMemoryBuffers[MEM_RD_RAM] ) );
+	u32			num_pages( gRamSize / SNAPSHOT_PAGE_SIZE );
+	bool		keyframe( mRecords.empty() || mShadow.size() != gRamSize );
+
+	mDirtyPages.clear();
+	if( !keyframe )
+	{
+		for( u32 page = 0; page < num_pages; ++page )
+		{
+			u32 offset( page * SNAPSHOT_PAGE_SIZE );
+			if( memcmp( p_ram + offset, mShadow.data() + offset, SNAPSHOT_PAGE_SIZE ) != 0 )
+			{
+				mDirtyPages.push_back( page );
+			}
+		}
+	}
+
+	SRecord record;
+	record.StateSize = AlignPow2( u32( mState.size() ), 4 );
+	record.NumPages = mDirtyPages.size();
+	record.Size = record.StateSize + record.NumPages * ( sizeof( u32 ) + SNAPSHOT_PAGE_SIZE );
+
+	if( keyframe )
+	{
+		// Nothing to rewind to before this one
+		mRecords.clear();
+		mHead = 0;
+	}
+
+	u8 * p_record( Allocate( record ) );
+	if( p_record == nullptr )
+		return false;
+
+	memcpy( p_record, mState.data(), mState.size() );
+
+	u32 *	p_pages( reinterpret_cast< u32 * >( p_record + record.StateSize ) );
+	u8 *	p_page_data( p_record + record.StateSize + record.NumPages * sizeof( u32 ) );
+	for( u32 page : mDirtyPages )
+	{
+		u32 offset( page * SNAPSHOT_PAGE_SIZE );
+
+		*p_pages++ = page;
+		memcpy( p_page_data, mShadow.data() + offset, SNAPSHOT_PAGE_SIZE );
+		memcpy( mShadow.data() + offset, p_ram + offset, SNAPSHOT_PAGE_SIZE );
+		p_page_data += SNAPSHOT_PAGE_SIZE;
+	}
+
+	if( keyframe )
+	{
+		mShadow.assign( p_ram, p_ram + gRamSize );
+	}
+
+	mRecords.push_back( record );
+	return true;
+}
+
+bool CSnapshotBuffer::Restore( u32 steps_back )
+{
+	if( steps_back >= mRecords.size() )
+		return false;
+
+	for( u32 i = 0; i < steps_back; ++i )
+	{
+		const SRecord	record( mRecords.back() );
+		const u8 *		p_record( mArena.data() + record.Offset );
+		const u32 *		p_pages( reinterpret_cast< const u32 * >( p_record + record.StateSize ) );
+		const u8 *		p_page_data( p_record + record.StateSize + record.NumPages * sizeof( u32 ) );
+
+		for( u32 p = 0; p < record.NumPages; ++p )
+		{
+			memcpy( mShadow.data() + p_pages[ p ] * SNAPSHOT_PAGE_SIZE, p_page_data, SNAPSHOT_PAGE_SIZE );
+			p_page_data += SNAPSHOT_PAGE_SIZE;
+		}
+
+		mRecords.pop_back();
+		mHead = record.Offset;
+	}
+
+	const SRecord & record( mRecords.back() );
+
+	SaveState_istream_mem stream( mArena.data() + record.Offset, record.StateSize, false );
+	if( !SaveState_ReadState( stream ) )
+		return false;
+
+	memcpy( g_pMemoryBuffers[MEM_RD_RAM], mShadow.data(), gRamSize );
+	return true;
+}
+
+void SaveState_InitSnapshots( u32 arena_size )
+{
+	gSnapshotBuffer.Init( arena_size );
+}
+
+void SaveState_FiniSnapshots()
+{
+	gSnapshotBuffer.Fini();
+}
+
+bool SaveState_TakeSnapshot()
+{
+	return gSnapshotBuffer.Take();
+}
+
+bool SaveState_RestoreSnapshot( u32 steps_back )
+{
+	return gSnapshotBuffer.Restore( steps_back );
+}
+
+u32 SaveState_GetNumSnapshots()
+{
+	return gSnapshotBuffer.GetCount();
+}
+
 RomID SaveState_GetRomID( const std::filesystem::path &filename )
 {
+	SaveState_WaitForPendingWrites();
+
 	SaveState_istream_gzip stream( filename );
 
 	if( !stream.IsValid() )
@@ -399,6 +815,8 @@ RomID SaveState_GetRomID( const std::filesystem::path &filename )
 
 const std::string SaveState_GetRom( const std::filesystem::path &filename )
 {
+	SaveState_WaitForPendingWrites();
+
 	SaveState_istream_gzip stream( filename );
 
 	// if( !stream.IsValid() )
@@ -32,4 +32,17 @@ bool SaveState_SaveToFile( const std::filesystem::path &filename );
 RomID SaveState_GetRomID( const std::filesystem::path &filename );
 const std::string SaveState_GetRom(const std::filesystem::path &filename);
 
+// Copies the state now, and compresses and writes it out in the background
+bool SaveState_SaveToFileAsync( const std::filesystem::path &filename );
+void SaveState_WaitForPendingWrites();
+
+// In-memory snapshots, for frequent checkpoints and rewind. Only RDRAM pages
+// changed since the previous snapshot are stored. The arena is allocated on
+// the first snapshot if SaveState_InitSnapshots() hasn't been called.
+void SaveState_InitSnapshots( u32 arena_size );
+void SaveState_FiniSnapshots();
+bool SaveState_TakeSnapshot();
+bool SaveState_RestoreSnapshot( u32 steps_back );	// 0 is the most recent snapshot
+u32 SaveState_GetNumSnapshots();
+
 #endif // CORE_SAVESTATE_H_
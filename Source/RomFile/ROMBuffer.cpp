@@ -32,8 +32,21 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "Utility/Stream.h"
 
 
+#include <algorithm>
 #include <cstring> 
 
+#ifdef DAEDALUS_POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "Utility/Paths.h"
+#endif
+
 #ifdef DAEDALUS_PSP
 #include "Graphics/GraphicsContext.h"
 #ifdef INTRAFONT
@@ -53,13 +66,14 @@ namespace
 	u8 *			spRomData	= nullptr;
 	u32				sRomSize [[maybe_unused]]	= 0;
 	bool			sRomFixed	= false;
+	bool			sRomMapped	= false;
 	bool			sRomWritten	= false;
 	u32				sRomValue	= 0;
 	std::shared_ptr<ROMFileCache> spRomFileCache	= nullptr;
 
-#ifdef DAEDALUS_COMPRESSED_ROM_SUPPORT
-	static bool		DECOMPRESS_ROMS	= true;
-#endif
+	// Largest rom cache (or chunk) we'll take from the preferences. No cart is bigger
+	const u32		MAX_ROM_CACHE_KB = 64 * 1024;
+
 	// Maximum read length is 8 bytes (i.e. double, u64)
 	const u32		SCRATCH_BUFFER_LENGTH = 16;
 	u8				sScratchBuffer[ SCRATCH_BUFFER_LENGTH ];
@@ -81,7 +95,8 @@ namespace
 #endif
 	}
 
-#ifdef DAEDALUS_COMPRESSED_ROM_SUPPORT
+#ifdef DAEDALUS_POSIX
+	// Writes out byteswapped roms in our native layout, so they can be mapped
 	std::shared_ptr<ROMFile> DecompressRom( std::shared_ptr<ROMFile> p_rom_file, const std::filesystem::path &temp_filename, COutputStream & messages )
 	{
 
@@ -166,6 +181,120 @@ namespace
 		return p_new_file;
 	}
 #endif
+
+#ifdef DAEDALUS_POSIX
+	// Map the file with copy-on-write pages. Nothing is read until it's touched,
+	// clean pages are shared with anything else mapping the same file, and the
+	// odd write to rom (see PutRomBytesRaw) only copies the page it lands in.
+	u8 *	MapRomFile( const std::filesystem::path & filename, u32 rom_size )
+	{
+		int		fd( open( filename.c_str(), O_RDONLY ) );
+		if( fd < 0 )
+			return nullptr;
+
+		void *	p_mapping( mmap( nullptr, rom_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 ) );
+		close( fd );
+
+		if( p_mapping == MAP_FAILED )
+			return nullptr;
+
+		madvise( p_mapping, rom_size, MADV_WILLNEED );
+		return reinterpret_cast< u8 * >( p_mapping );
+	}
+
+	bool	IsRomImageUpToDate( const std::filesystem::path & image_filename, const std::filesystem::path & filename, u32 rom_size, const ROMHeader & header )
+	{
+		std::error_code		ec;
+
+		if( std::filesystem::file_size( image_filename, ec ) != rom_size || ec )
+			return false;
+
+		auto	image_time( std::filesystem::last_write_time( image_filename, ec ) );
+		if( ec )
+			return false;
+
+		auto	rom_time( std::filesystem::last_write_time( filename, ec ) );
+		if( ec || image_time < rom_time )
+			return false;
+
+		// A different dump of the same game can't have the same header
+		ROMHeader			image_header;
+		std::ifstream		fp( image_filename, std::ios::in | std::ios::binary );
+		fp.read( reinterpret_cast< char * >( &image_header ), sizeof( image_header ) );
+
+		return fp.good() && memcmp( &image_header, &header, sizeof( header ) ) == 0;
+	}
+
+	// Roms that are already in the layout we use in memory are mapped directly.
+	// Anything else is converted once into SaveGames/Cache and that is mapped instead.
+	// The converted image is named after the rom's CRCs, like the other per rom caches,
+	// so roms with the same filename in different directories don't share one.
+	u8 *	MapRomImage( std::shared_ptr<ROMFile> p_rom_file, const std::filesystem::path & filename, COutputStream & messages )
+	{
+		u32						rom_size( p_rom_file->GetRomSize() );
+		std::filesystem::path	image_filename( filename );
+
+		// The header as it should appear in memory
+		ROMHeader				header;
+		if( rom_size < sizeof( header ) || !p_rom_file->ReadChunk( 0, reinterpret_cast< u8 * >( &header ), sizeof( header ) ) )
+			return nullptr;
+
+		if( p_rom_file->RequiresSwapping() )
+		{
+			ROMHeader			native_header( header );
+			ROMFile::ByteSwap_3210( &native_header, sizeof( native_header ) );
+
+			RomID				rom_id( native_header );
+			std::ostringstream	name;
+			name << std::hex << std::setfill( '0' )
+				 << std::setw( 8 ) << rom_id.CRC[0] << std::setw( 8 ) << rom_id.CRC[1]
+				 << "-" << std::setw( 2 ) << static_cast< int >( rom_id.CountryID ) << ".img";
+
+			std::filesystem::path	cache_path( setBasePath( "SaveGames/Cache" ) );
+			image_filename = cache_path / name.str();
+
+			if( !IsRomImageUpToDate( image_filename, filename, rom_size, header ) )
+			{
+				std::error_code			ec;
+				std::filesystem::path	temp_filename( image_filename );
+				temp_filename += ".tmp";
+
+				std::filesystem::create_directories( cache_path, ec );
+
+				#ifdef DAEDALUS_DEBUG_CONSOLE
+				DBGConsole_Msg( 0, "Rom is [Mbyteswapped], writing [C%s] (only done once)", image_filename.string().c_str() );
+				#endif
+				if( DecompressRom( p_rom_file, temp_filename, messages ) == nullptr )
+				{
+					std::filesystem::remove( temp_filename, ec );
+					return nullptr;
+				}
+
+				// Write under a temporary name so another instance never maps a partial file
+				std::filesystem::rename( temp_filename, image_filename, ec );
+				if( ec )
+				{
+					std::filesystem::remove( temp_filename, ec );
+					return nullptr;
+				}
+			}
+		}
+
+		u8 *	p_rom( MapRomFile( image_filename, rom_size ) );
+
+		// Another instance may have replaced the image since we checked it
+		if( p_rom != nullptr && memcmp( p_rom, &header, sizeof( header ) ) != 0 )
+		{
+			#ifdef DAEDALUS_DEBUG_CONSOLE
+			DBGConsole_Msg( 0, "Rom image [C%s] doesn't match the rom, not mapping it", image_filename.string().c_str() );
+			#endif
+			munmap( p_rom, rom_size );
+			return nullptr;
+		}
+
+		return p_rom;
+	}
+#endif
 }
 
 
@@ -204,7 +333,22 @@ bool RomBuffer::Open()
 
 	sRomSize = p_rom_file->GetRomSize();
 
-	if( ShouldLoadAsFixed( sRomSize ) )
+#ifdef DAEDALUS_POSIX
+	if( gGlobalPreferences.MemoryMapROMs && ShouldLoadAsFixed( sRomSize ) && !p_rom_file->IsCompressed() && (sRomSize & 3) == 0 )
+	{
+		spRomData = MapRomImage( p_rom_file, filename, messages );
+		sRomMapped = spRomData != nullptr;
+	}
+#endif
+
+	if( sRomMapped )
+	{
+		#ifdef DAEDALUS_DEBUG_CONSOLE
+		DBGConsole_Msg(0, "Mapped [C%s]\n", filename.string().c_str());
+		#endif
+		sRomFixed = true;
+	}
+	else if( ShouldLoadAsFixed( sRomSize ) )
 	{
 		// Now, allocate memory for rom - round up to a 4 byte boundry
 		u32		size_aligned =  AlignPow2( sRomSize, 4 );
@@ -257,55 +401,10 @@ bool RomBuffer::Open()
 	}
 	else
 	{
-#ifdef DAEDALUS_COMPRESSED_ROM_SUPPORT
-		if(DECOMPRESS_ROMS)
-		{
-			bool	compressed( p_rom_file->IsCompressed() );
-			bool	byteswapped( p_rom_file->RequiresSwapping() );
-			if(compressed)// || byteswapped)
-			{
-				const char * temp_filename( "daedrom.tmp" );
-
-				#ifdef DAEDALUS_DEBUG_CONSOLE
-				if(compressed && byteswapped)
-				{
-					DBGConsole_Msg( 0, "Rom is [Mcompressed] and [Mbyteswapped]" );
-				}
-				else if(compressed)
-				{
-					DBGConsole_Msg( 0, "Rom is [Mcompressed]" );
-				}
-				else
-				{
-					DBGConsole_Msg( 0, "Rom is [Mbyteswapped]" );
-				}
-				DBGConsole_Msg( 0, "Decompressing rom to [C%s] (this may take some time)", temp_filename );
-				#endif
-				CNullOutputStream		local_messages;
-
-				auto p_new_file = DecompressRom( p_rom_file, temp_filename, local_messages );
-				#ifdef DAEDALUS_DEBUG_CONSOLE
-				DBGConsole_Msg( 0, "messages:\n%s", local_messages.c_str() );
-				#endif
-				messages << local_messages;
-
-				if(p_new_file != nullptr)
-				{
-					#ifdef DAEDALUS_DEBUG_CONSOLE
-					DBGConsole_Msg( 0, "Decompression [gsuccessful]. Booting using decompressed rom" );
-					#endif
-					p_rom_file = p_new_file;
-				}
-				#ifdef DAEDALUS_DEBUG_CONSOLE
-				else
-				{
-					DBGConsole_Msg( 0, "Decompression [rfailed]. Booting using original rom" );
-				}
-				#endif
-			}
-		}
-#endif
-		spRomFileCache = std::make_unique<ROMFileCache>();
+		// Clamp before converting to bytes, so a large setting can't wrap to a tiny cache
+		u32 chunk_kb = std::min( gGlobalPreferences.RomCacheChunkKB, MAX_ROM_CACHE_KB );
+		u32 cache_kb = std::min( gGlobalPreferences.RomCacheSizeKB, MAX_ROM_CACHE_KB );
+		spRomFileCache = std::make_unique<ROMFileCache>( chunk_kb * 1024, cache_kb * 1024 );
 		spRomFileCache->Open(std::move(p_rom_file ));
 		sRomFixed = false;
 	}
@@ -320,7 +419,16 @@ void	RomBuffer::Close()
 {
 	if (spRomData)
 	{
-		CROMFileMemory::Get()->Free( spRomData );
+#ifdef DAEDALUS_POSIX
+		if (sRomMapped)
+		{
+			munmap( spRomData, sRomSize );
+		}
+		else
+#endif
+		{
+			CROMFileMemory::Get()->Free( spRomData );
+		}
 		spRomData = nullptr;
 	}
 
@@ -332,6 +440,7 @@ void	RomBuffer::Close()
 	sRomSize   = 0;
 	sRomLoaded = false;
 	sRomFixed  = false;
+	sRomMapped = false;
 	sRomWritten = false;
 	sRomValue	= 0;
 }
@@ -348,6 +457,7 @@ namespace
 		u32		src_offset( rom_offset );
 
 		// Similar algorithm to below - we don't care about byte swapping though
+		auto	lock( p_cache->Lock() );
 		while(length > 0)
 		{
 			u8 *	p_chunk_base = 0;
@@ -448,6 +558,7 @@ bool RomBuffer::CopyToRam( u8 * p_dst, u32 dst_offset, u32 dst_size, u32 src_off
 	}
 	else
 	{
+		auto	lock( spRomFileCache->Lock() );
 		while(length > 0)
 		{
 			u8 *	p_chunk_base = 0;
@@ -500,6 +611,24 @@ bool RomBuffer::CopyFromRam( u32 dst_offset, const u8 * p_src, u32 src_offset, u
 }
 
 
+void RomBuffer::Prefetch( u32 rom_start, u32 length )
+{
+	if( !sRomFixed && spRomFileCache )
+	{
+		spRomFileCache->Prefetch( rom_start, length );
+	}
+}
+
+
+void RomBuffer::WaitForPrefetch()
+{
+	if( !sRomFixed && spRomFileCache )
+	{
+		spRomFileCache->WaitForPrefetch();
+	}
+}
+
+
 bool RomBuffer::IsRomAddressFixed()
 {
 	return sRomFixed;
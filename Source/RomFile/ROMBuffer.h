@@ -67,6 +67,10 @@ class RomBuffer
 		static void	SaveRomValue( u32 value );
 		static bool CopyToRam( u8 * p_dst, u32 dst_offset, u32 dst_size, u32 src_offset, u32 length );
 		static bool CopyFromRam( u32 dst_offset, const u8 * p_src, u32 src_offset, u32 src_size, u32 length );
+
+		/// Start loading a range of the rom in the background, if it isn't all in memory
+		static void	Prefetch( u32 rom_start, u32 length );
+		static void	WaitForPrefetch();
 		static bool IsRomAddressFixed();
 		static const void * GetFixedRomBaseAddress();
 };
@@ -20,6 +20,9 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "Base/Types.h"
 
+#include <algorithm>
+#include <cstring>
+
 #include "Debug/DBGConsole.h"
 #include "Utility/MathUtil.h"
 #include "RomFile/RomFile.h"
@@ -33,22 +36,21 @@ extern bool PSP_IS_SLIM;
 
 namespace
 {
-	static  u32	CACHE_SIZE;
-	static  u32 CHUNK_SIZE;
-	static  u32	STORAGE_BYTES;
-
 	static const u32	INVALID_ADDRESS = u32( ~0 );
+
+	static const u32	MIN_CHUNK_SIZE = 1024;
+	static const u32	MAX_CHUNK_SIZE = 256 * 1024;
+	static const u32	MIN_CACHE_CHUNKS = 16;
+
+	// How many chunks to keep queued ahead of a sequential read
+	static const u32	READ_AHEAD_CHUNKS = 8;
 }
 
 struct SChunkInfo
 {
 	u32				StartOffset;
-	mutable u32		LastUseIdx;
-
-	bool		ContainsAddress( u32 address ) const
-	{
-		return address >= StartOffset && address < StartOffset + CHUNK_SIZE;
-	}
+	u16				Prev;				// Towards the most recently used chunk
+	u16				Next;				// Towards the least recently used chunk
 
 	bool		InUse() const
 	{
@@ -61,35 +63,47 @@ struct SChunkInfo
 //*****************************************************************************
 //
 //*****************************************************************************
-ROMFileCache::ROMFileCache()
+ROMFileCache::ROMFileCache( u32 chunk_size, u32 cache_size )
 :	mpROMFile( nullptr )
 ,	mChunkMapEntries( 0 )
 ,	mpChunkMap( NULL )
-,	mMRUIdx( 0 )
+,	mLRUHead( INVALID_IDX )
+,	mLRUTail( INVALID_IDX )
+,	mLastChunkMapIdx( INVALID_ADDRESS )
+,	mReadAheadEnd( 0 )
+,	mIOBusy( false )
+,	mIOQuit( false )
 {
 #ifdef DAEDALUS_PSP
-	CHUNK_SIZE = 8 * 1024;
-	if( PSP_IS_SLIM )
-	{
-		//32MB cache(SLIM)
-		CACHE_SIZE = 1024;
-	}
-	else
-	{
-		//2MB cache(PHAT)
-		CACHE_SIZE = 256;
-	}
+	u32	default_chunk_size = 8 * 1024;
+	//32MB cache(SLIM) or 2MB cache(PHAT)
+	u32	default_cache_size = default_chunk_size * ( PSP_IS_SLIM ? 1024 : 256 );
 #else
-	CHUNK_SIZE = 2 * 1024;
-	CACHE_SIZE = 1024;
+	u32	default_chunk_size = 2 * 1024;
+	u32	default_cache_size = default_chunk_size * 1024;
 #endif
 
-	STORAGE_BYTES = CACHE_SIZE * CHUNK_SIZE;
-#ifdef DAEDALUS_ENABLE_ASSERTS
-	DAEDALUS_ASSERT( (1<<(sizeof(CacheIdx)*8)) > CACHE_SIZE, "Need to increase size of CacheIdx typedef to allow sufficient entries to be indexed" );
-#endif
-	mpStorage   = (u8*)CROMFileMemory::Get()->Alloc( STORAGE_BYTES );
-	mpChunkInfo = new SChunkInfo[ CACHE_SIZE ];
+	if( chunk_size == 0 )
+		chunk_size = default_chunk_size;
+	if( cache_size == 0 )
+		cache_size = default_cache_size;
+
+	mChunkSize = GetNextPowerOf2( std::clamp( chunk_size, MIN_CHUNK_SIZE, MAX_CHUNK_SIZE ) );
+	mChunkShift = 0;
+	while( (1u << mChunkShift) < mChunkSize )
+	{
+		mChunkShift++;
+	}
+
+	// Leave INVALID_IDX free
+	mNumCacheChunks = std::clamp( cache_size / mChunkSize, MIN_CACHE_CHUNKS, u32( INVALID_IDX ) );
+	mStorageBytes = mNumCacheChunks * mChunkSize;
+
+	mpStorage   = (u8*)CROMFileMemory::Get()->Alloc( mStorageBytes );
+	mpChunkInfo = new SChunkInfo[ mNumCacheChunks ];
+	mpIOBuffer  = new u8[ mChunkSize ];
+
+	memset( &mStats, 0, sizeof( mStats ) );
 }
 
 //*****************************************************************************
@@ -97,9 +111,13 @@ ROMFileCache::ROMFileCache()
 //*****************************************************************************
 ROMFileCache::~ROMFileCache()
 {
+	StopIOThread();
+
 	CROMFileMemory::Get()->Free( mpStorage );
 
 	delete [] mpChunkInfo;
+	delete [] mpIOBuffer;
+	delete [] mpChunkMap;
 }
 
 //*****************************************************************************
@@ -110,7 +128,7 @@ bool	ROMFileCache::Open( std::shared_ptr<ROMFile> p_rom_file )
 	mpROMFile = p_rom_file;
 
 	u32		rom_size( p_rom_file->GetRomSize() );
-	u32		rom_chunks( AlignPow2( rom_size, CHUNK_SIZE ) / CHUNK_SIZE );
+	u32		rom_chunks( AlignPow2( rom_size, mChunkSize ) / mChunkSize );
 
 	mChunkMapEntries = rom_chunks;
 	mpChunkMap = new CacheIdx[ rom_chunks ];
@@ -121,12 +139,22 @@ bool	ROMFileCache::Open( std::shared_ptr<ROMFile> p_rom_file )
 		mpChunkMap[ i ] = INVALID_IDX;
 	}
 
-	for(u32 i = 0; i < CACHE_SIZE; ++i)
+	// All the chunks start off free, in the LRU list
+	mLRUHead = INVALID_IDX;
+	mLRUTail = INVALID_IDX;
+	for(u32 i = 0; i < mNumCacheChunks; ++i)
 	{
 		mpChunkInfo[ i ].StartOffset = INVALID_ADDRESS;
-		mpChunkInfo[ i ].LastUseIdx = 0;
+		LinkChunk( CacheIdx( i ) );
 	}
 
+	mLastChunkMapIdx = INVALID_ADDRESS;
+	mReadAheadEnd = 0;
+	memset( &mStats, 0, sizeof( mStats ) );
+
+	DBGConsole_Msg( 0, "Rom cache: %dKB in %d chunks of %dKB", mStorageBytes / 1024, mNumCacheChunks, mChunkSize / 1024 );
+
+	StartIOThread();
 	return true;
 }
 
@@ -135,6 +163,13 @@ bool	ROMFileCache::Open( std::shared_ptr<ROMFile> p_rom_file )
 //*****************************************************************************
 void	ROMFileCache::Close()
 {
+	StopIOThread();
+
+	if( mpROMFile != nullptr )
+	{
+		DumpStats();
+	}
+
 	delete [] mpChunkMap;
 	mpChunkMap = NULL;
 	mChunkMapEntries = 0;
@@ -142,21 +177,55 @@ void	ROMFileCache::Close()
 }
 
 //*****************************************************************************
-//
+//	Insert the chunk at the most recently used end of the list
 //*****************************************************************************
-inline u32 AddressToChunkMapIndex( u32 address )
+void	ROMFileCache::LinkChunk( CacheIdx cache_idx )
 {
-	return address / CHUNK_SIZE;
+	SChunkInfo &	chunk_info( mpChunkInfo[ cache_idx ] );
+
+	chunk_info.Prev = INVALID_IDX;
+	chunk_info.Next = mLRUHead;
+
+	if( mLRUHead != INVALID_IDX )
+	{
+		mpChunkInfo[ mLRUHead ].Prev = cache_idx;
+	}
+	else
+	{
+		mLRUTail = cache_idx;
+	}
+	mLRUHead = cache_idx;
 }
 
 //*****************************************************************************
 //
 //*****************************************************************************
-inline u32 GetChunkStartAddress( u32 address )
+void	ROMFileCache::UnlinkChunk( CacheIdx cache_idx )
 {
-	return ( address / CHUNK_SIZE ) * CHUNK_SIZE;
+	SChunkInfo &	chunk_info( mpChunkInfo[ cache_idx ] );
+
+	if( chunk_info.Prev != INVALID_IDX )
+		mpChunkInfo[ chunk_info.Prev ].Next = chunk_info.Next;
+	else
+		mLRUHead = chunk_info.Next;
+
+	if( chunk_info.Next != INVALID_IDX )
+		mpChunkInfo[ chunk_info.Next ].Prev = chunk_info.Prev;
+	else
+		mLRUTail = chunk_info.Prev;
 }
 
+//*****************************************************************************
+//
+//*****************************************************************************
+void	ROMFileCache::TouchChunk( CacheIdx cache_idx )
+{
+	if( cache_idx != mLRUHead )
+	{
+		UnlinkChunk( cache_idx );
+		LinkChunk( cache_idx );
+	}
+}
 
 //*****************************************************************************
 //
@@ -164,14 +233,14 @@ inline u32 GetChunkStartAddress( u32 address )
 void	ROMFileCache::PurgeChunk( CacheIdx cache_idx )
 {
 	#ifdef DAEDALUS_ENABLE_ASSERTS
-	DAEDALUS_ASSERT( cache_idx < CACHE_SIZE, "Invalid chunk index" );
+	DAEDALUS_ASSERT( cache_idx < mNumCacheChunks, "Invalid chunk index" );
 	#endif
 
 	SChunkInfo &		chunk_info( mpChunkInfo[ cache_idx ] );
 	u32		current_chunk_address( chunk_info.StartOffset );
 	if( chunk_info.InUse() )
 	{
-		//DBGConsole_Msg( 0, "[CRomCache - purging %02x %08x-%08x", cache_idx, chunk_info.StartOffset, chunk_info.StartOffset + CHUNK_SIZE );
+		//DBGConsole_Msg( 0, "[CRomCache - purging %02x %08x-%08x", cache_idx, chunk_info.StartOffset, chunk_info.StartOffset + mChunkSize );
 		u32		chunk_map_idx( AddressToChunkMapIndex( current_chunk_address ) );
 		#ifdef DAEDALUS_ENABLE_ASSERTS
 		DAEDALUS_ASSERT( chunk_map_idx < mChunkMapEntries, "Chunk address is out of range?" );
@@ -179,6 +248,7 @@ void	ROMFileCache::PurgeChunk( CacheIdx cache_idx )
 		#endif
 		// Scrub down the chunk map to show it's no longer cached
 		mpChunkMap[ chunk_map_idx ] = INVALID_IDX;
+		mStats.Evictions++;
 	}
 	else
 	{
@@ -187,11 +257,38 @@ void	ROMFileCache::PurgeChunk( CacheIdx cache_idx )
 
 	// Scrub these down
 	chunk_info.StartOffset = INVALID_ADDRESS;
-	chunk_info.LastUseIdx = 0;
 }
 
 //*****************************************************************************
-//
+//	Evict the least recently used chunk and give its storage to address.
+//	Must be called with the cache locked
+//*****************************************************************************
+ROMFileCache::CacheIdx	ROMFileCache::AllocateChunk( u32 address )
+{
+	u32		chunk_map_idx( AddressToChunkMapIndex( address ) );
+
+	CacheIdx	selected_idx( mLRUTail );
+
+	//
+	//	Purge the current chunk
+	//
+	PurgeChunk( selected_idx );
+
+	SChunkInfo &		chunk_info( mpChunkInfo[ selected_idx ] );
+	chunk_info.StartOffset = GetChunkStartAddress( address );
+	TouchChunk( selected_idx );
+
+	#ifdef DAEDALUS_ENABLE_ASSERTS
+	DAEDALUS_ASSERT( chunk_map_idx < mChunkMapEntries, "Chunk address is out of range?" );
+	#endif
+
+	mpChunkMap[ chunk_map_idx ] = selected_idx;
+
+	return selected_idx;
+}
+
+//*****************************************************************************
+//	Must be called with the cache locked
 //*****************************************************************************
 ROMFileCache::CacheIdx	ROMFileCache::GetCacheIndex( u32 address )
 {
@@ -205,47 +302,51 @@ ROMFileCache::CacheIdx	ROMFileCache::GetCacheIndex( u32 address )
 	CacheIdx	idx( mpChunkMap[ chunk_map_idx ] );
 	if(idx == INVALID_IDX)
 	{
-		CacheIdx	selected_idx( 0 );
-		u32			oldest_timestamp( mpChunkInfo[ 0 ].LastUseIdx );
+		idx = AllocateChunk( address );
 
-		for(CacheIdx i = 1; i < CACHE_SIZE; ++i)
-		{
-			u32		timestamp( mpChunkInfo[ i ].LastUseIdx );
-			if(timestamp < oldest_timestamp)
-			{
-				oldest_timestamp = timestamp;
-				selected_idx = i;
-			}
-		}
+		u32		storage_offset( idx * mChunkSize );
+		u8 *	p_dst( mpStorage + storage_offset );
 
-		//
-		//	Purge the current chunk
-		//
-		PurgeChunk( selected_idx );
+		//DBGConsole_Msg( 0, "[CRomCache - loading %02x, %08x-%08x", idx, mpChunkInfo[ idx ].StartOffset, mpChunkInfo[ idx ].StartOffset + mChunkSize );
+		std::lock_guard< std::mutex >	file_lock( mFileMutex );
+		mpROMFile->ReadChunk( mpChunkInfo[ idx ].StartOffset, p_dst, mChunkSize );
 
-		//
-		//	And load up the new one
-		//
-		SChunkInfo &		chunk_info( mpChunkInfo[ selected_idx ] );
-		chunk_info.StartOffset = GetChunkStartAddress( address );
-		chunk_info.LastUseIdx = ++mMRUIdx;
+		mStats.Misses++;
+		mStats.BytesRead += mChunkSize;
+	}
+	else
+	{
+		TouchChunk( idx );
+		mStats.Hits++;
+	}
 
-		#ifdef DAEDALUS_ENABLE_ASSERTS
-		DAEDALUS_ASSERT( chunk_map_idx < mChunkMapEntries, "Chunk address is out of range?" );
-		#endif
+	return idx;
+}
 
-		mpChunkMap[ chunk_map_idx ] = selected_idx;
+//*****************************************************************************
+//	If we've moved on to the next chunk, keep the I/O thread a few chunks
+//	ahead of us. Must be called with the cache locked
+//*****************************************************************************
+void	ROMFileCache::ReadAhead( u32 chunk_map_idx )
+{
+	bool	sequential( chunk_map_idx == mLastChunkMapIdx + 1 );
+	mLastChunkMapIdx = chunk_map_idx;
 
-		u32		storage_offset( selected_idx * CHUNK_SIZE );
-		u8 *	p_dst( mpStorage + storage_offset );
+	if( !sequential )
+	{
+		mReadAheadEnd = 0;
+		return;
+	}
 
-		//DBGConsole_Msg( 0, "[CRomCache - loading %02x, %08x-%08x", selected_idx, chunk_info.StartOffset, chunk_info.StartOffset + CHUNK_SIZE );
-		mpROMFile->ReadChunk( chunk_info.StartOffset, p_dst, CHUNK_SIZE );
+	u32		start_idx( std::max( mReadAheadEnd, chunk_map_idx + 1 ) );
+	u32		end_idx( std::min( chunk_map_idx + 1 + READ_AHEAD_CHUNKS, mChunkMapEntries ) );
 
-		idx = selected_idx;
-	}
+	// Wait until half the window has been used before queueing more
+	if( start_idx >= end_idx || end_idx - start_idx < READ_AHEAD_CHUNKS / 2 )
+		return;
 
-	return idx;
+	mReadAheadEnd = end_idx;
+	Prefetch( start_idx << mChunkShift, (end_idx - start_idx) << mChunkShift );
 }
 
 //*****************************************************************************
@@ -259,23 +360,25 @@ bool	ROMFileCache::GetChunk( u32 rom_offset, u8 ** p_p_chunk_base, u32 * p_chunk
 	{
 		CacheIdx	idx( GetCacheIndex( rom_offset ) );
 		#ifdef DAEDALUS_ENABLE_ASSERTS
-		DAEDALUS_ASSERT( idx < CACHE_SIZE, "Invalid chunk index!" );
+		DAEDALUS_ASSERT( idx < mNumCacheChunks, "Invalid chunk index!" );
 		#endif
 
 		const SChunkInfo &	chunk_info( mpChunkInfo[ idx ] );
 
 		#ifdef DAEDALUS_ENABLE_ASSERTS
 		DAEDALUS_ASSERT( AddressToChunkMapIndex( chunk_info.StartOffset ) == chunk_map_idx, "Inconsistant map indices" );
-		DAEDALUS_ASSERT( chunk_info.ContainsAddress( rom_offset ), "Address is out of range for chunk" );
 		#endif
 
-		u32		storage_offset( idx * CHUNK_SIZE );
+		u32		storage_offset( idx * mChunkSize );
 
 		*p_p_chunk_base = mpStorage + storage_offset;
 		*p_chunk_offset = chunk_info.StartOffset;
-		*p_chunk_size = CHUNK_SIZE;					// XXXX if last chunk, adjust this?
+		*p_chunk_size = mChunkSize;					// XXXX if last chunk, adjust this?
 
-		chunk_info.LastUseIdx = ++mMRUIdx;
+		if( chunk_map_idx != mLastChunkMapIdx )
+		{
+			ReadAhead( chunk_map_idx );
+		}
 		return true;
 	}
 	else
@@ -284,3 +387,145 @@ bool	ROMFileCache::GetChunk( u32 rom_offset, u8 ** p_p_chunk_base, u32 * p_chunk
 		return false;
 	}
 }
+
+//*****************************************************************************
+//	Queue the chunks covering the range to be loaded on the I/O thread
+//*****************************************************************************
+void	ROMFileCache::Prefetch( u32 rom_offset, u32 length )
+{
+	if( length == 0 )
+		return;
+
+	// Don't let a big transfer evict the start of itself
+	length = std::min( length, mStorageBytes / 2 );
+
+	{
+		std::lock_guard< std::mutex >	io_lock( mIOMutex );
+		if( !mIOThread.joinable() )
+			return;
+
+		SPrefetchRequest	request = { rom_offset, length };
+		mPrefetchQueue.push_back( request );
+	}
+	mIOWorkAvailable.notify_one();
+}
+
+//*****************************************************************************
+//	Block until all the queued prefetches have been loaded
+//*****************************************************************************
+void	ROMFileCache::WaitForPrefetch()
+{
+	std::unique_lock< std::mutex >	io_lock( mIOMutex );
+	mIOWorkDone.wait( io_lock, [this]() { return mPrefetchQueue.empty() && !mIOBusy; } );
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+ROMFileCache::SStats	ROMFileCache::GetStats()
+{
+	std::lock_guard< std::mutex >	lock( mMutex );
+	return mStats;
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void	ROMFileCache::DumpStats()
+{
+	SStats	stats( GetStats() );
+	u32		accesses( stats.Hits + stats.Misses );
+
+	DBGConsole_Msg( 0, "Rom cache: %d hits, %d misses (%d%% hit rate), %d chunks prefetched, %d evictions, %lluKB read",
+		stats.Hits, stats.Misses, accesses > 0 ? u32( u64( stats.Hits ) * 100 / accesses ) : 0,
+		stats.ChunksPrefetched, stats.Evictions, (unsigned long long)( stats.BytesRead / 1024 ) );
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void	ROMFileCache::StartIOThread()
+{
+	if( mIOThread.joinable() )
+		return;
+
+	mIOQuit = false;
+	mIOBusy = false;
+	mIOThread = std::thread( &ROMFileCache::IOThreadLoop, this );
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void	ROMFileCache::StopIOThread()
+{
+	if( !mIOThread.joinable() )
+		return;
+
+	{
+		std::lock_guard< std::mutex >	io_lock( mIOMutex );
+		mIOQuit = true;
+		mPrefetchQueue.clear();
+	}
+	mIOWorkAvailable.notify_all();
+	mIOThread.join();
+
+	mIOBusy = false;
+	mIOWorkDone.notify_all();
+}
+
+//*****************************************************************************
+//	The file is read into mpIOBuffer without the cache locked, so the
+//	emulation thread only waits for the copy into the cache
+//*****************************************************************************
+void	ROMFileCache::IOThreadLoop()
+{
+	std::unique_lock< std::mutex >	io_lock( mIOMutex );
+
+	for( ;; )
+	{
+		mIOWorkAvailable.wait( io_lock, [this]() { return mIOQuit || !mPrefetchQueue.empty(); } );
+		if( mIOQuit )
+			break;
+
+		SPrefetchRequest	request( mPrefetchQueue.front() );
+		mPrefetchQueue.pop_front();
+		mIOBusy = true;
+		io_lock.unlock();
+
+		u32		end_address( request.StartOffset + request.Length );
+		for( u32 address = GetChunkStartAddress( request.StartOffset ); address < end_address; address += mChunkSize )
+		{
+			u32		chunk_map_idx( AddressToChunkMapIndex( address ) );
+			if( chunk_map_idx >= mChunkMapEntries )
+				break;
+
+			{
+				std::lock_guard< std::mutex >	lock( mMutex );
+				if( mpChunkMap[ chunk_map_idx ] != INVALID_IDX )
+					continue;
+			}
+
+			{
+				std::lock_guard< std::mutex >	file_lock( mFileMutex );
+				mpROMFile->ReadChunk( address, mpIOBuffer, mChunkSize );
+			}
+
+			std::lock_guard< std::mutex >	lock( mMutex );
+
+			// The emulation thread may have needed it in the meantime
+			if( mpChunkMap[ chunk_map_idx ] == INVALID_IDX )
+			{
+				CacheIdx	idx( AllocateChunk( address ) );
+				memcpy( mpStorage + idx * mChunkSize, mpIOBuffer, mChunkSize );
+
+				mStats.ChunksPrefetched++;
+				mStats.BytesRead += mChunkSize;
+			}
+		}
+
+		io_lock.lock();
+		mIOBusy = false;
+		mIOWorkDone.notify_all();
+	}
+}
@@ -24,36 +24,110 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "Base/Types.h"
 
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
 class ROMFile;
 struct SChunkInfo;
 
+//
+//	The rom is cached in fixed size chunks, and the least recently used
+//	chunk is evicted when another is needed. Chunks can be loaded ahead of
+//	time by Prefetch(), and sequential reads are detected and read ahead
+//	automatically; both are serviced by an I/O thread. The cache must be
+//	locked with Lock() around calls to GetChunk(), and for as long as the
+//	chunk is being read from.
+//
 class ROMFileCache
 {	using CacheIdx = u16;
 
 	public:
-		ROMFileCache();
+		struct SStats
+		{
+			u32				Hits;
+			u32				Misses;				// Chunks the emulation thread had to wait to read
+			u32				ChunksPrefetched;	// Chunks read by the I/O thread
+			u32				Evictions;
+			u64				BytesRead;
+		};
+
+		// Passing 0 for either size uses the platform's default
+		ROMFileCache( u32 chunk_size = 0, u32 cache_size = 0 );
 		~ROMFileCache();
 
 		bool				Open( std::shared_ptr<ROMFile> p_rom_file );
 		void				Close();
 
+		std::unique_lock< std::mutex >	Lock()		{ return std::unique_lock< std::mutex >( mMutex ); }
+
 		bool				GetChunk( u32 rom_offset, u8 ** p_p_chunk_base, u32 * p_chunk_offset, u32 * p_chunk_size );
 
+		void				Prefetch( u32 rom_offset, u32 length );
+		void				WaitForPrefetch();
+
+		SStats				GetStats();
+		void				DumpStats();
+
 	private:
+		struct SPrefetchRequest
+		{
+			u32				StartOffset;
+			u32				Length;
+		};
+
+		u32					AddressToChunkMapIndex( u32 address ) const	{ return address >> mChunkShift; }
+		u32					GetChunkStartAddress( u32 address ) const	{ return address & ~(mChunkSize - 1); }
+
 		void				PurgeChunk( CacheIdx cache_idx );
 
 		CacheIdx			GetCacheIndex( u32 address );
+		CacheIdx			AllocateChunk( u32 address );
+		void				ReadAhead( u32 chunk_map_idx );
+
+		void				LinkChunk( CacheIdx cache_idx );
+		void				UnlinkChunk( CacheIdx cache_idx );
+		void				TouchChunk( CacheIdx cache_idx );
+
+		void				StartIOThread();
+		void				StopIOThread();
+		void				IOThreadLoop();
 
 	private:
 		std::shared_ptr<ROMFile> 		mpROMFile;
 
+		u32					mChunkSize;			// Always a power of 2
+		u32					mChunkShift;
+		u32					mNumCacheChunks;
+		u32					mStorageBytes;
+
 		u8 *				mpStorage;			// Underlying storage. This is carved up between different chunks
 		SChunkInfo *		mpChunkInfo;		// Info about which region a chunk is allocated to
 
 		u32					mChunkMapEntries;	// i.e. Number of chunks in the rom
 		CacheIdx *			mpChunkMap;			// Map allowing quick lookups from address -> chunkidx
 
-		u32					mMRUIdx;			// Most recently used index
+		CacheIdx			mLRUHead;			// Most recently used chunk
+		CacheIdx			mLRUTail;			// Least recently used chunk, evicted next
+
+		u32					mLastChunkMapIdx;	// For detecting sequential reads
+		u32					mReadAheadEnd;		// Chunk map index the read ahead has been queued up to
+
+		SStats				mStats;
+
+		std::mutex			mMutex;				// Guards everything above
+		std::mutex			mFileMutex;			// Guards reads from mpROMFile
+
+		std::thread			mIOThread;
+		std::mutex			mIOMutex;			// Guards the fields below
+		std::condition_variable	mIOWorkAvailable;
+		std::condition_variable	mIOWorkDone;
+		std::deque< SPrefetchRequest >	mPrefetchQueue;
+		bool				mIOBusy;
+		bool				mIOQuit;
+		u8 *				mpIOBuffer;			// The I/O thread reads here before copying into the cache
 
 		static const CacheIdx	INVALID_IDX = CacheIdx(-1);
 };
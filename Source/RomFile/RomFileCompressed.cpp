@@ -22,6 +22,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "RomFile/RomFileCompressed.h"
 
 #ifdef DAEDALUS_COMPRESSED_ROM_SUPPORT
+#include <atomic>
+#include <thread>
 #include <vector>
 #include "Utility/MathUtil.h"
 
@@ -29,6 +31,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 
 #include "Base/Macros.h"
+#include "RomFile/RomFileInflateIndex.h"
 #include "Utility/Stream.h"
 //*****************************************************************************
 //
@@ -38,6 +41,10 @@ ROMFileCompressed::ROMFileCompressed( const std::filesystem::path filename )
 ,	mZipFile( NULL )
 ,	mFoundRom( false )
 ,	mRomSize( 0 )
+,	mDataOffset( 0 )
+,	mCompressedSize( 0 )
+,	mCRC( 0 )
+,	mIndexSaved( false )
 {
 }
 
@@ -146,11 +153,44 @@ bool ROMFileCompressed::Open( COutputStream & messages )
 		{
 			mFoundRom = false;
 		}
+		else
+		{
+			OpenStream( file_info );
+		}
 	}
 
 	return mFoundRom;
 }
 
+//*****************************************************************************
+//	Set up direct access to the deflate stream. If this fails we just carry on
+//	reading through minizip.
+//*****************************************************************************
+void ROMFileCompressed::OpenStream( const unz_file_info & file_info )
+{
+	if( file_info.compression_method != Z_DEFLATED )
+		return;
+
+	mDataOffset = u32( unzGetCurrentFileZStreamPos64( mZipFile ) );
+	mCompressedSize = file_info.compressed_size;
+	mCRC = file_info.crc;
+
+	auto p_stream = std::make_unique<CInflateStream>( mFilename, mDataOffset, mCompressedSize, mRomSize );
+	if( !p_stream->IsOpen() )
+		return;
+
+	mIndexFilename = setBasePath( "SaveGames/Cache" ) / mFilename.filename();
+	mIndexFilename += ".idx";
+
+	mpIndex = std::make_unique<CInflateIndex>( mRomSize, mCompressedSize, mCRC );
+	mIndexSaved = mpIndex->Load( mIndexFilename );
+	mpStream = std::move( p_stream );
+
+	#ifdef DAEDALUS_DEBUG_CONSOLE
+	DBGConsole_Msg( 0, "Streaming [C%s], %s", mFilename.string().c_str(), mIndexSaved ? "using saved inflate index" : "building inflate index" );
+	#endif
+}
+
 //*****************************************************************************
 //
 //*****************************************************************************
@@ -166,6 +206,11 @@ bool ROMFileCompressed::LoadRawData( u32 bytes_to_read, u8 *p_bytes, COutputStre
         return false;
     }
 
+	if( mpStream != nullptr )
+	{
+		return LoadStream( bytes_to_read, p_bytes, messages );
+	}
+
 	//
 	//	It is assumed that the file is already openened and ready for reading here
 	//
@@ -211,6 +256,143 @@ bool ROMFileCompressed::LoadRawData( u32 bytes_to_read, u8 *p_bytes, COutputStre
     return true;
 }
 
+//*****************************************************************************
+//	Inflate the whole rom. Once we have an index the spans between access
+//	points are independent, so they're inflated in parallel.
+//*****************************************************************************
+bool ROMFileCompressed::LoadStream( u32 bytes_to_read, u8 * p_bytes, COutputStream & messages )
+{
+	u32		crc( 0 );
+	bool	ok( false );
+
+	if( mpIndex->IsComplete() && mpIndex->GetNumPoints() > 0 && std::thread::hardware_concurrency() > 1 )
+	{
+		ok = LoadStreamParallel( bytes_to_read, p_bytes, &crc );
+	}
+	else
+	{
+		ok = mpStream->Reset( nullptr ) && mpStream->Read( p_bytes, bytes_to_read, mpIndex.get() );
+		if( ok )
+		{
+			crc = crc32( 0, p_bytes, bytes_to_read );
+		}
+		SaveIndex();
+	}
+
+	if( !ok )
+	{
+		messages << "Error inflating rom from zipfile";
+		return false;
+	}
+
+	if( bytes_to_read == mRomSize && crc != mCRC )
+	{
+		messages << "CRC Error in ZipFile";
+		return false;
+	}
+
+	CorrectSwap( p_bytes, bytes_to_read );
+	return true;
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+bool ROMFileCompressed::LoadStreamParallel( u32 bytes_to_read, u8 * p_bytes, u32 * p_crc )
+{
+	const CInflateIndex &	index( *mpIndex );
+
+	u32		num_spans( index.GetNumPoints() + 1 );
+	u32		num_threads( std::min( std::thread::hardware_concurrency(), num_spans ) );
+
+	std::vector<u32>	span_crcs( num_spans, 0 );
+	std::atomic<u32>	next_span( 0 );
+	std::atomic<bool>	failed( false );
+
+	auto	span_start = [&]( u32 span ) { return span == 0 ? 0 : std::min( index.GetPoint( span - 1 ).Offset, bytes_to_read ); };
+
+	auto	worker = [&]()
+	{
+		CInflateStream	stream( mFilename, mDataOffset, mCompressedSize, mRomSize );
+
+		for( u32 span = next_span++; span < num_spans && !failed; span = next_span++ )
+		{
+			u32		start( span_start( span ) );
+			u32		end( span + 1 < num_spans ? span_start( span + 1 ) : bytes_to_read );
+			if( start >= end )
+				continue;
+
+			if( !stream.Reset( span == 0 ? nullptr : &index.GetPoint( span - 1 ) ) ||
+				!stream.Read( p_bytes + start, end - start, nullptr ) )
+			{
+				failed = true;
+				break;
+			}
+
+			span_crcs[ span ] = crc32( 0, p_bytes + start, end - start );
+		}
+	};
+
+	std::vector<std::thread>	threads;
+	for( u32 i = 1; i < num_threads; ++i )
+	{
+		threads.emplace_back( worker );
+	}
+	worker();
+
+	for( std::thread & thread : threads )
+	{
+		thread.join();
+	}
+
+	if( failed )
+		return false;
+
+	u32		crc( 0 );
+	for( u32 span = 0; span < num_spans; ++span )
+	{
+		u32		start( span_start( span ) );
+		u32		end( span + 1 < num_spans ? span_start( span + 1 ) : bytes_to_read );
+		crc = crc32_combine( crc, span_crcs[ span ], end - start );
+	}
+
+	*p_crc = crc;
+	return true;
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void ROMFileCompressed::SaveIndex()
+{
+	if( !mIndexSaved && mpIndex->IsComplete() )
+	{
+		mpIndex->Save( mIndexFilename );
+		mIndexSaved = true;
+	}
+}
+
+//*****************************************************************************
+//	Move the stream to the specified offset. Carry on from where we are if
+//	that's no further than restarting from the nearest access point.
+//*****************************************************************************
+bool	ROMFileCompressed::SeekStream( u32 offset )
+{
+	const CInflateIndex::SAccessPoint *	p_point( mpIndex->FindPoint( offset ) );
+	u32		restart_offset( p_point != nullptr ? p_point->Offset : 0 );
+	u32		current_offset( mpStream->GetOffset() );
+
+	if( current_offset > offset || current_offset < restart_offset )
+	{
+		if( !mpStream->Reset( p_point ) )
+		{
+			return false;
+		}
+	}
+
+	return mpStream->Skip( offset - mpStream->GetOffset(), mpIndex.get() );
+}
+
 //*****************************************************************************
 //	Utility function to seek to the specified location in the zipfile
 //	Uses the specified buffer as a scratch pad to temporarilly decompress data.
@@ -271,6 +453,18 @@ bool	ROMFileCompressed::ReadChunk( u32 offset, u8 * p_dst, u32 length )
 	DAEDALUS_ASSERT( mZipFile != NULL, "No open zipfile?" );
 	DAEDALUS_ASSERT( mFoundRom, "Why are we loading data when no rom was found?" );
 	#endif
+	if( mpStream != nullptr )
+	{
+		if( !SeekStream( offset ) || !mpStream->Read( p_dst, length, mpIndex.get() ) )
+		{
+			return false;
+		}
+
+		SaveIndex();
+		CorrectSwap( p_dst, length );
+		return true;
+	}
+
 	if( !Seek( offset, p_dst, length ) )
 	{
 		return false;
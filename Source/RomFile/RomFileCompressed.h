@@ -27,8 +27,13 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 //This should be pulled from the system's include directory..
 #include <minizip/unzip.h>
 
+#include <memory>
+
 #include "RomFile/RomFile.h"
 
+class CInflateIndex;
+class CInflateStream;
+
 class ROMFileCompressed : public ROMFile
 {
 public:
@@ -45,14 +50,27 @@ public:
 	virtual bool		ReadChunk( u32 offset, u8 * p_dst, u32 length );
 
 private:
+			void		OpenStream( const unz_file_info & file_info );
 			bool		Seek( u32 offset, u8 * p_scratch_block, u32 block_size );
-
+			bool		SeekStream( u32 offset );
+			bool		LoadStream( u32 bytes_to_read, u8 * p_bytes, COutputStream & messages );
+			bool		LoadStreamParallel( u32 bytes_to_read, u8 * p_bytes, u32 * p_crc );
+			void		SaveIndex();
 
 private:
 	unzFile				mZipFile;
 	bool				mFoundRom;
 	u32					mRomSize;
 
+	// Deflated roms are read directly with zlib rather than through minizip, so we can seek
+	u32					mDataOffset;
+	u32					mCompressedSize;
+	u32					mCRC;
+	std::filesystem::path			mIndexFilename;
+	std::unique_ptr<CInflateIndex>	mpIndex;
+	std::unique_ptr<CInflateStream>	mpStream;
+	bool				mIndexSaved;
+
 };
 
 #endif // DAEDALUS_COMPRESSED_ROM_SUPPORT
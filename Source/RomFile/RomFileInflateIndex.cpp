@@ -0,0 +1,416 @@
+/*
+Copyright (C) 2007 StrmnNrmn
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+
+#include "Base/Types.h"
+#include "RomFile/RomFileInflateIndex.h"
+
+#ifdef DAEDALUS_COMPRESSED_ROM_SUPPORT
+
+#include <algorithm>
+#include <cstring>
+
+#include "Debug/DBGConsole.h"
+
+namespace
+{
+	const u32 MAGIC_HEADER = 0x80000155;
+	const u32 INDEX_VERSION = 1;
+
+	bool	WriteU32( FILE * fh, u32 data )
+	{
+		return fwrite( &data, sizeof( data ), 1, fh ) == 1;
+	}
+
+	bool	ReadU32( FILE * fh, u32 & data )
+	{
+		return fread( &data, sizeof( data ), 1, fh ) == 1;
+	}
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+CInflateIndex::CInflateIndex( u32 rom_size, u32 compressed_size, u32 crc )
+:	mRomSize( rom_size )
+,	mCompressedSize( compressed_size )
+,	mCRC( crc )
+,	mComplete( false )
+{
+}
+
+//*****************************************************************************
+//	Each point costs 32KB, so keep them sparse where memory is tight
+//*****************************************************************************
+u32	CInflateIndex::GetSpan()
+{
+#if defined(DAEDALUS_PSP) || defined(DAEDALUS_CTR)
+	return 4 * 1024 * 1024;
+#else
+	return 1 * 1024 * 1024;
+#endif
+}
+
+//*****************************************************************************
+//	Returns the last point at or before the specified offset, or nullptr if
+//	inflation has to start from the beginning of the stream.
+//*****************************************************************************
+const CInflateIndex::SAccessPoint *	CInflateIndex::FindPoint( u32 offset ) const
+{
+	auto it = std::upper_bound( mPoints.begin(), mPoints.end(), offset,
+		[]( u32 value, const SAccessPoint & point ) { return value < point.Offset; } );
+
+	if( it == mPoints.begin() )
+		return nullptr;
+
+	return &*( it - 1 );
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+bool	CInflateIndex::WantsPoint( u32 offset ) const
+{
+	if( mComplete || offset >= mRomSize )
+		return false;
+
+	u32		last_offset( mPoints.empty() ? 0 : mPoints.back().Offset );
+	return offset >= last_offset + GetSpan();
+}
+
+//*****************************************************************************
+//	p_window is circular, with the oldest byte at window_pos
+//*****************************************************************************
+void	CInflateIndex::AddPoint( u32 offset, u32 compressed_offset, u32 bits, const u8 * p_window, u32 window_pos )
+{
+	#ifdef DAEDALUS_ENABLE_ASSERTS
+	DAEDALUS_ASSERT( WantsPoint( offset ), "Adding an access point out of order" );
+	DAEDALUS_ASSERT( window_pos <= WINDOW_SIZE, "Invalid window position" );
+	#endif
+
+	SAccessPoint	point;
+	point.Offset = offset;
+	point.CompressedOffset = compressed_offset;
+	point.Bits = bits;
+	point.Window.resize( WINDOW_SIZE );
+
+	memcpy( point.Window.data(), p_window + window_pos, WINDOW_SIZE - window_pos );
+	memcpy( point.Window.data() + WINDOW_SIZE - window_pos, p_window, window_pos );
+
+	mPoints.push_back( std::move( point ) );
+}
+
+//*****************************************************************************
+//	Only complete indices are ever saved, so anything else in the file is
+//	treated as corrupt.
+//*****************************************************************************
+bool	CInflateIndex::Load( const std::filesystem::path & filename )
+{
+	FILE *	fh( fopen( filename.string().c_str(), "rb" ) );
+	if( fh == nullptr )
+		return false;
+
+	bool	ok( true );
+	u32		data( 0 );
+	u32		num_points( 0 );
+
+	ok = ok && ReadU32( fh, data ) && data == MAGIC_HEADER;
+	ok = ok && ReadU32( fh, data ) && data == INDEX_VERSION;
+	ok = ok && ReadU32( fh, data ) && data == mRomSize;
+	ok = ok && ReadU32( fh, data ) && data == mCompressedSize;
+	ok = ok && ReadU32( fh, data ) && data == mCRC;
+	ok = ok && ReadU32( fh, data ) && data == GetSpan();
+	ok = ok && ReadU32( fh, num_points ) && num_points <= mRomSize / GetSpan();
+
+	std::vector<SAccessPoint>	points;
+	for( u32 i = 0; ok && i < num_points; ++i )
+	{
+		SAccessPoint	point;
+		point.Window.resize( WINDOW_SIZE );
+
+		ok = ReadU32( fh, point.Offset ) &&
+			 ReadU32( fh, point.CompressedOffset ) &&
+			 ReadU32( fh, point.Bits ) &&
+			 fread( point.Window.data(), 1, WINDOW_SIZE, fh ) == WINDOW_SIZE;
+
+		ok = ok && point.Offset < mRomSize && point.CompressedOffset <= mCompressedSize && point.Bits < 8;
+		ok = ok && ( points.empty() || point.Offset > points.back().Offset );
+
+		if( ok )
+		{
+			points.push_back( std::move( point ) );
+		}
+	}
+
+	fclose( fh );
+
+	if( !ok )
+	{
+		#ifdef DAEDALUS_DEBUG_CONSOLE
+		DBGConsole_Msg( 0, "Ignoring stale inflate index [C%s]", filename.string().c_str() );
+		#endif
+		return false;
+	}
+
+	mPoints = std::move( points );
+	mComplete = true;
+	return true;
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void	CInflateIndex::Save( const std::filesystem::path & filename ) const
+{
+	#ifdef DAEDALUS_ENABLE_ASSERTS
+	DAEDALUS_ASSERT( mComplete, "Saving an incomplete index" );
+	#endif
+
+	std::error_code		ec;
+	std::filesystem::create_directories( filename.parent_path(), ec );
+
+	FILE *	fh( fopen( filename.string().c_str(), "wb" ) );
+	if( fh == nullptr )
+		return;
+
+	bool	ok( true );
+
+	ok = ok && WriteU32( fh, MAGIC_HEADER );
+	ok = ok && WriteU32( fh, INDEX_VERSION );
+	ok = ok && WriteU32( fh, mRomSize );
+	ok = ok && WriteU32( fh, mCompressedSize );
+	ok = ok && WriteU32( fh, mCRC );
+	ok = ok && WriteU32( fh, GetSpan() );
+	ok = ok && WriteU32( fh, mPoints.size() );
+
+	for( const SAccessPoint & point : mPoints )
+	{
+		ok = ok && WriteU32( fh, point.Offset );
+		ok = ok && WriteU32( fh, point.CompressedOffset );
+		ok = ok && WriteU32( fh, point.Bits );
+		ok = ok && fwrite( point.Window.data(), 1, WINDOW_SIZE, fh ) == WINDOW_SIZE;
+	}
+
+	fclose( fh );
+
+	if( !ok )
+	{
+		std::filesystem::remove( filename, ec );
+		return;
+	}
+
+	#ifdef DAEDALUS_DEBUG_CONSOLE
+	DBGConsole_Msg( 0, "Wrote inflate index [C%s] (%d points)", filename.string().c_str(), u32( mPoints.size() ) );
+	#endif
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+CInflateStream::CInflateStream( const std::filesystem::path & filename, u32 data_offset, u32 compressed_size, u32 rom_size )
+:	mFile( fopen( filename.string().c_str(), "rb" ) )
+,	mInitialised( false )
+,	mDataOffset( data_offset )
+,	mCompressedSize( compressed_size )
+,	mRomSize( rom_size )
+,	mOffset( 0 )
+,	mCompressedRead( 0 )
+,	mInput( INPUT_BUFFER_SIZE )
+,	mWindow( CInflateIndex::WINDOW_SIZE )
+,	mWindowPos( 0 )
+{
+	memset( &mStream, 0, sizeof( mStream ) );
+
+	if( mFile != nullptr )
+	{
+		Reset( nullptr );
+	}
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+CInflateStream::~CInflateStream()
+{
+	if( mInitialised )
+	{
+		inflateEnd( &mStream );
+	}
+
+	if( mFile != nullptr )
+	{
+		fclose( mFile );
+	}
+}
+
+//*****************************************************************************
+//	Restart from the specified point, or the start of the stream if nullptr
+//*****************************************************************************
+bool	CInflateStream::Reset( const CInflateIndex::SAccessPoint * p_point )
+{
+	if( mInitialised )
+	{
+		inflateEnd( &mStream );
+		mInitialised = false;
+	}
+
+	memset( &mStream, 0, sizeof( mStream ) );
+	if( inflateInit2( &mStream, -MAX_WBITS ) != Z_OK )
+		return false;
+
+	mInitialised = true;
+	mWindowPos = 0;
+
+	u32		compressed_offset( 0 );
+	if( p_point != nullptr )
+	{
+		compressed_offset = p_point->CompressedOffset - ( p_point->Bits ? 1 : 0 );
+	}
+
+	if( fseek( mFile, mDataOffset + compressed_offset, SEEK_SET ) != 0 )
+		return false;
+
+	mCompressedRead = compressed_offset;
+
+	if( p_point == nullptr )
+	{
+		mOffset = 0;
+		std::fill( mWindow.begin(), mWindow.end(), 0 );
+		return true;
+	}
+
+	if( p_point->Bits )
+	{
+		int		c( getc( mFile ) );
+		if( c == EOF )
+			return false;
+
+		mCompressedRead++;
+		inflatePrime( &mStream, p_point->Bits, c >> ( 8 - p_point->Bits ) );
+	}
+
+	if( inflateSetDictionary( &mStream, p_point->Window.data(), CInflateIndex::WINDOW_SIZE ) != Z_OK )
+		return false;
+
+	// Keep our copy of the window in step, in case we add points from here
+	memcpy( mWindow.data(), p_point->Window.data(), CInflateIndex::WINDOW_SIZE );
+	mOffset = p_point->Offset;
+	return true;
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+bool	CInflateStream::Read( u8 * p_dst, u32 length, CInflateIndex * p_index )
+{
+	#ifdef DAEDALUS_ENABLE_ASSERTS
+	DAEDALUS_ASSERT( p_dst != nullptr, "No destination buffer" );
+	#endif
+	return Inflate( p_dst, length, p_index );
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+bool	CInflateStream::Skip( u32 length, CInflateIndex * p_index )
+{
+	return Inflate( nullptr, length, p_index );
+}
+
+//*****************************************************************************
+//	Output always goes through mWindow, so when we pass a block boundary we
+//	have the last 32KB to hand for a new access point.
+//*****************************************************************************
+bool	CInflateStream::Inflate( u8 * p_dst, u32 length, CInflateIndex * p_index )
+{
+	if( !IsOpen() )
+		return false;
+
+	// Z_BLOCK stops at every block boundary, which is slower, so only use it while there are points to add
+	bool	building( p_index != nullptr && !p_index->IsComplete() );
+
+	while( length > 0 )
+	{
+		if( mStream.avail_in == 0 )
+		{
+			u32		bytes_remaining( mCompressedSize - mCompressedRead );
+			u32		bytes_to_read( std::min( bytes_remaining, INPUT_BUFFER_SIZE ) );
+			if( bytes_to_read == 0 || fread( mInput.data(), 1, bytes_to_read, mFile ) != bytes_to_read )
+				return false;
+
+			mCompressedRead += bytes_to_read;
+			mStream.next_in = mInput.data();
+			mStream.avail_in = bytes_to_read;
+		}
+
+		if( mWindowPos == CInflateIndex::WINDOW_SIZE )
+		{
+			mWindowPos = 0;
+		}
+
+		u32		bytes_to_inflate( std::min( length, CInflateIndex::WINDOW_SIZE - mWindowPos ) );
+		u8 *	p_out( mWindow.data() + mWindowPos );
+
+		mStream.next_out = p_out;
+		mStream.avail_out = bytes_to_inflate;
+
+		int		ret( inflate( &mStream, building ? Z_BLOCK : Z_NO_FLUSH ) );
+		if( ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR || ret == Z_STREAM_ERROR )
+		{
+			#ifdef DAEDALUS_DEBUG_CONSOLE
+			DBGConsole_Msg( 0, "Inflate error %d at offset %08x", ret, mOffset );
+			#endif
+			return false;
+		}
+
+		u32		bytes_inflated( bytes_to_inflate - mStream.avail_out );
+		if( p_dst != nullptr )
+		{
+			memcpy( p_dst, p_out, bytes_inflated );
+			p_dst += bytes_inflated;
+		}
+
+		mWindowPos += bytes_inflated;
+		mOffset += bytes_inflated;
+		length -= bytes_inflated;
+
+		if( building )
+		{
+			// Bit 7 of data_type is set at the end of a block, bit 6 if it was the last one
+			bool	block_boundary( ( mStream.data_type & 128 ) != 0 && ( mStream.data_type & 64 ) == 0 );
+			if( block_boundary && p_index->WantsPoint( mOffset ) )
+			{
+				p_index->AddPoint( mOffset, mCompressedRead - mStream.avail_in, mStream.data_type & 7, mWindow.data(), mWindowPos );
+			}
+
+			if( mOffset >= mRomSize )
+			{
+				p_index->SetComplete();
+				building = false;
+			}
+		}
+
+		if( ret == Z_STREAM_END )
+			return length == 0;
+	}
+
+	return true;
+}
+
+#endif // DAEDALUS_COMPRESSED_ROM_SUPPORT
@@ -0,0 +1,124 @@
+/*
+Copyright (C) 2007 StrmnNrmn
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#pragma once
+
+#ifndef UTILITY_ROMFILEINFLATEINDEX_H_
+#define UTILITY_ROMFILEINFLATEINDEX_H_
+
+#ifdef DAEDALUS_COMPRESSED_ROM_SUPPORT
+
+#include <stdio.h>
+#include <zlib.h>
+
+#include <filesystem>
+#include <vector>
+
+#include "Base/Types.h"
+
+//*****************************************************************************
+//	A list of points in a deflate stream that inflation can be restarted from.
+//	Each point holds the bit position in the compressed data and the 32KB of
+//	output preceding it, which is all inflate needs to carry on from there.
+//
+//	Points are added in order as the stream is inflated for the first time,
+//	one every GetSpan() bytes, and the finished index is saved out so later
+//	boots can seek (and inflate spans in parallel) straight away.
+//*****************************************************************************
+class CInflateIndex
+{
+public:
+	static const u32	WINDOW_SIZE = 32 * 1024;
+
+	struct SAccessPoint
+	{
+		u32				Offset;				// Uncompressed offset
+		u32				CompressedOffset;	// Offset of the first full byte of input, from the start of the data
+		u32				Bits;				// Number of bits to use from the byte before CompressedOffset
+		std::vector<u8>	Window;
+	};
+
+	CInflateIndex( u32 rom_size, u32 compressed_size, u32 crc );
+
+	static u32			GetSpan();
+
+	bool				Load( const std::filesystem::path & filename );
+	void				Save( const std::filesystem::path & filename ) const;
+
+	bool				IsComplete() const						{ return mComplete; }
+	void				SetComplete()							{ mComplete = true; }
+
+	u32					GetNumPoints() const					{ return mPoints.size(); }
+	const SAccessPoint &	GetPoint( u32 idx ) const			{ return mPoints[ idx ]; }
+	const SAccessPoint *	FindPoint( u32 offset ) const;
+
+	bool				WantsPoint( u32 offset ) const;
+	void				AddPoint( u32 offset, u32 compressed_offset, u32 bits, const u8 * p_window, u32 window_pos );
+
+private:
+	u32							mRomSize;
+	u32							mCompressedSize;
+	u32							mCRC;
+	bool						mComplete;
+	std::vector<SAccessPoint>	mPoints;
+};
+
+//*****************************************************************************
+//	Raw deflate reader over one zip entry. Reads are sequential, Reset() moves
+//	back to the start or to an access point. If given an index that isn't
+//	complete, points are added to it as the stream passes them.
+//*****************************************************************************
+class CInflateStream
+{
+public:
+	CInflateStream( const std::filesystem::path & filename, u32 data_offset, u32 compressed_size, u32 rom_size );
+	~CInflateStream();
+
+	bool				IsOpen() const							{ return mFile != nullptr && mInitialised; }
+	u32					GetOffset() const						{ return mOffset; }
+
+	bool				Reset( const CInflateIndex::SAccessPoint * p_point );
+	bool				Read( u8 * p_dst, u32 length, CInflateIndex * p_index );
+	bool				Skip( u32 length, CInflateIndex * p_index );
+
+private:
+	bool				Inflate( u8 * p_dst, u32 length, CInflateIndex * p_index );
+
+private:
+	static const u32	INPUT_BUFFER_SIZE = 16 * 1024;
+
+	FILE *				mFile;
+	z_stream			mStream;
+	bool				mInitialised;
+
+	u32					mDataOffset;
+	u32					mCompressedSize;
+	u32					mRomSize;
+
+	u32					mOffset;			// Uncompressed bytes produced so far
+	u32					mCompressedRead;	// Compressed bytes read from the file so far
+
+	std::vector<u8>		mInput;
+	std::vector<u8>		mWindow;			// Output is inflated into here first, so we always have the last 32KB
+	u32					mWindowPos;
+};
+
+#endif // DAEDALUS_COMPRESSED_ROM_SUPPORT
+
+#endif // UTILITY_ROMFILEINFLATEINDEX_H_
@@ -11,6 +11,7 @@
 #include "Graphics/GraphicsContext.h"
 
 #include "Graphics/ColourValue.h"
+#include "SysGL/HLEGraphics/RenderThreadGL.h"
 #include "UI/DrawText.h"
 
 #include "UI/Menu.h"
@@ -42,6 +43,8 @@ public:
 	virtual void GetScreenSize(u32 * width, u32 * height) const;
 	virtual void ViewportType(u32 * width, u32 * height) const;
 
+	virtual void SwitchToLcdDisplay();
+
 	virtual void SetDebugScreenTarget( ETargetSurface buffer [[maybe_unused]] ) {}
 	virtual void DumpNextScreen() {}
 	virtual void DumpScreenShot() {}
@@ -66,6 +69,7 @@ GraphicsContextGL::~GraphicsContextGL()
 
 
 extern bool initgl();
+extern void endframegl();
 bool GraphicsContextGL::Initialise()
 {
 
@@ -175,31 +179,45 @@ void GraphicsContextGL::ClearAllSurfaces()
 
 void GraphicsContextGL::ClearToBlack()
 {
-	glDepthMask(GL_TRUE);
-	glClearDepth( 1.0f );
-	glClearColor( 0.0f, 0.0f, 0.0f, 0.0f );
-	glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+	RenderThreadGL_Run([]()
+	{
+		glDepthMask(GL_TRUE);
+		glClearDepth( 1.0f );
+		glClearColor( 0.0f, 0.0f, 0.0f, 0.0f );
+		glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+	});
 }
 
 void GraphicsContextGL::ClearZBuffer()
 {
-	glDepthMask(GL_TRUE);
-	glClearDepth( 1.0f );
-	glClear( GL_DEPTH_BUFFER_BIT );
+	RenderThreadGL_Run([]()
+	{
+		glDepthMask(GL_TRUE);
+		glClearDepth( 1.0f );
+		glClear( GL_DEPTH_BUFFER_BIT );
+	});
 }
 
 void GraphicsContextGL::ClearColBuffer(const c32 & colour)
 {
-	glClearColor( colour.GetRf(), colour.GetGf(), colour.GetBf(), colour.GetAf() );
-	glClear( GL_COLOR_BUFFER_BIT );
+	const c32 col( colour );
+	RenderThreadGL_Run([col]()
+	{
+		glClearColor( col.GetRf(), col.GetGf(), col.GetBf(), col.GetAf() );
+		glClear( GL_COLOR_BUFFER_BIT );
+	});
 }
 
 void GraphicsContextGL::ClearColBufferAndDepth(const c32 & colour)
 {
-	glDepthMask(GL_TRUE);
-	glClearDepth( 1.0f );
-	glClearColor( colour.GetRf(), colour.GetGf(), colour.GetBf(), colour.GetAf() );
-	glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+	const c32 col( colour );
+	RenderThreadGL_Run([col]()
+	{
+		glDepthMask(GL_TRUE);
+		glClearDepth( 1.0f );
+		glClearColor( col.GetRf(), col.GetGf(), col.GetBf(), col.GetAf() );
+		glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+	});
 }
 
 void GraphicsContextGL::BeginFrame()
@@ -211,8 +229,11 @@ void GraphicsContextGL::BeginFrame()
 	// Special case: avoid division by zero below
 	height = height > 0 ? height : 1;
 
-	glViewport( 0, 0, width, height );
-	glScissor( 0, 0, width, height );
+	RenderThreadGL_Run([width, height]()
+	{
+		glViewport( 0, 0, width, height );
+		glScissor( 0, 0, width, height );
+	});
 }
 
 void GraphicsContextGL::EndFrame()
@@ -220,13 +241,27 @@ void GraphicsContextGL::EndFrame()
 	HandleEndOfFrame();
 }
 
+void GraphicsContextGL::SwitchToLcdDisplay()
+{
+	// The UI draws from this thread, so it needs the context back
+	RenderThreadGL_Stop();
+}
+
 void GraphicsContextGL::UpdateFrame( bool wait_for_vbl [[maybe_unused]] )
 {
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	RenderThreadGL_Run([]()
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-	if (gSdlRenderer == nullptr) {
-		SDL_GL_SwapWindow(gWindow);
-	}
+		endframegl();
+
+		if (gSdlRenderer == nullptr) {
+			SDL_GL_SwapWindow(gWindow);
+		}
+	});
+
+	// Nothing more goes into this frame, so the render thread can get on with it
+	RenderThreadGL_Submit();
 
 	
 //	if( gCleanSceneEnabled ) //TODO: This should be optional
@@ -23,6 +23,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "Graphics/ColourValue.h"
 #include "Graphics/NativePixelFormat.h"
 
+#include "SysGL/HLEGraphics/RenderThreadGL.h"
 #include "Utility/MathUtil.h"
 
 #include <stdlib.h>
@@ -68,7 +69,14 @@ CNativeTexture::CNativeTexture( u32 w, u32 h, ETextureFormat texture_format )
 ,	mpPalette( NULL )
 ,	mTextureId( 0 )
 {
-	glGenTextures( 1, &mTextureId );
+	if (RenderThreadGL_IsRecording())
+	{
+		mTextureId = RenderThreadGL_AllocTextureName();
+	}
+	else
+	{
+		glGenTextures( 1, &mTextureId );
+	}
 
 	size_t data_len = GetBytesRequired();
 	mpData = malloc(data_len);
@@ -91,7 +99,9 @@ CNativeTexture::~CNativeTexture()
 	if (mpPalette)
 		free(mpPalette);
 
-	glDeleteTextures( 1, &mTextureId );
+	// Draws recorded before now may still be using it
+	GLuint texture_id = mTextureId;
+	RenderThreadGL_Run([texture_id]() { glDeleteTextures( 1, &texture_id ); });
 }
 
 bool CNativeTexture::HasData() const
@@ -101,6 +111,10 @@ bool CNativeTexture::HasData() const
 
 void CNativeTexture::InstallTexture() const
 {
+	// Recorded draws bind their own textures
+	if (RenderThreadGL_IsRecording())
+		return;
+
 	glBindTexture( GL_TEXTURE_2D, mTextureId );
 }
 
@@ -270,120 +284,169 @@ std::shared_ptr<CNativeTexture>	CNativeTexture::CreateFromPng( const std::filesy
 }
 
 
-void CNativeTexture::SetData( void * data, void * palette )
+static void UploadTexture( GLuint texture_id, ETextureFormat format, u32 width, u32 height, u32 pitch, const void * data, const void * palette )
 {
-	// It's pretty gross that we don't pass this in, or better yet, provide a way for
-	// the caller to write directly to our buffers instead of setting the data.
-	size_t data_len = GetBytesRequired();
-	memcpy(mpData, data, data_len);
+	glBindTexture( GL_TEXTURE_2D, texture_id );
+	glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
 
-	if (mTextureFormat == TexFmt_CI4_8888)
+	switch (format)
 	{
-		memcpy(mpPalette, palette, kPalette4BytesRequired);
-	}
-	else if (mTextureFormat == TexFmt_CI8_8888)
-	{
-		memcpy(mpPalette, palette, kPalette8BytesRequired);
-	}
+	case TexFmt_5650:
+		glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA,
+					  width, height,
+					  0, GL_RGB, GL_UNSIGNED_SHORT_5_6_5_REV, data );
+		break;
+	case TexFmt_5551:
+		glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA,
+					  width, height,
+					  0, GL_RGBA, GL_UNSIGNED_SHORT_1_5_5_5_REV, data );
+		break;
+	case TexFmt_4444:
+		glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA,
+					  width, height,
+					  0, GL_RGBA, GL_UNSIGNED_SHORT_4_4_4_4_REV, data );
+
+		break;
+	case TexFmt_8888:
+		glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA,
+					  width, height,
+					  0, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV, data );
+
+		break;
+	case TexFmt_CI4_8888:
+		{
+			// Convert palletised texture to non-palletised. This is wsteful - we should avoid generating these updated for OSX.
+			const NativePfCI44 * pix_ptr = static_cast< const NativePfCI44 * >( data );
+			const NativePf8888 * pal_ptr = static_cast< const NativePf8888 * >( palette );
 
-	if (HasData())
-	{
-		glBindTexture( GL_TEXTURE_2D, mTextureId );
-		glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+			NativePf8888 * out = static_cast<NativePf8888 *>( malloc(width * height * sizeof(NativePf8888)) );
+			NativePf8888 * out_ptr = out;
 
-		switch (mTextureFormat)
-		{
-		case TexFmt_5650:
-			glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA,
-						  mCorrectedWidth, mCorrectedHeight,
-						  0, GL_RGB, GL_UNSIGNED_SHORT_5_6_5_REV, data );
-			break;
-		case TexFmt_5551:
-			glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA,
-						  mCorrectedWidth, mCorrectedHeight,
-						  0, GL_RGBA, GL_UNSIGNED_SHORT_1_5_5_5_REV, data );
-			break;
-		case TexFmt_4444:
-			glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA,
-						  mCorrectedWidth, mCorrectedHeight,
-						  0, GL_RGBA, GL_UNSIGNED_SHORT_4_4_4_4_REV, data );
+			for (u32 y = 0; y < height; ++y)
+			{
+				for (u32 x = 0; x < width; ++x)
+				{
+					NativePfCI44	colors  = pix_ptr[ x / 2 ];
+					u8				pal_idx = (x&1) ? colors.GetIdxA() : colors.GetIdxB();
+
+					*out_ptr = pal_ptr[ pal_idx ];
+					out_ptr++;
+				}
+
+				pix_ptr = reinterpret_cast<const NativePfCI44 *>( reinterpret_cast<const u8 *>(pix_ptr) + pitch );
+			}
 
-			break;
-		case TexFmt_8888:
 			glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA,
-						  mCorrectedWidth, mCorrectedHeight,
-						  0, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV, data );
+						  width, height,
+						  0, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV, out );
 
-			break;
-		case TexFmt_CI4_8888:
-			{
-				// Convert palletised texture to non-palletised. This is wsteful - we should avoid generating these updated for OSX.
-				const NativePfCI44 * pix_ptr = static_cast< const NativePfCI44 * >( data );
-				const NativePf8888 * pal_ptr = static_cast< const NativePf8888 * >( palette );
+			free(out);
+		}
+		break;
 
-				NativePf8888 * out = static_cast<NativePf8888 *>( malloc(mCorrectedWidth * mCorrectedHeight * sizeof(NativePf8888)) );
-				NativePf8888 * out_ptr = out;
+	case TexFmt_CI8_8888:
+		{
+			// Convert palletised texture to non-palletised. This is wsteful - we should avoid generating these updated for OSX.
+			const NativePfCI8 *  pix_ptr = static_cast< const NativePfCI8 * >( data );
+			const NativePf8888 * pal_ptr = static_cast< const NativePf8888 * >( palette );
 
-				u32 pitch = GetStride();
+			NativePf8888 * out = static_cast<NativePf8888 *>( malloc(width * height * sizeof(NativePf8888)) );
+			NativePf8888 * out_ptr = out;
 
-				for (u32 y = 0; y < mCorrectedHeight; ++y)
+			for (u32 y = 0; y < height; ++y)
+			{
+				for (u32 x = 0; x < width; ++x)
 				{
-					for (u32 x = 0; x < mCorrectedWidth; ++x)
-					{
-						NativePfCI44	colors  = pix_ptr[ x / 2 ];
-						u8				pal_idx = (x&1) ? colors.GetIdxA() : colors.GetIdxB();
-
-						*out_ptr = pal_ptr[ pal_idx ];
-						out_ptr++;
-					}
+					u8	pal_idx = pix_ptr[ x ].Bits;
 
-					pix_ptr = reinterpret_cast<const NativePfCI44 *>( reinterpret_cast<const u8 *>(pix_ptr) + pitch );
+					*out_ptr = pal_ptr[ pal_idx ];
+					out_ptr++;
 				}
 
-				glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA,
-							  mCorrectedWidth, mCorrectedHeight,
-							  0, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV, out );
-
-				free(out);
+				pix_ptr = reinterpret_cast<const NativePfCI8 *>( reinterpret_cast<const u8 *>(pix_ptr) + pitch );
 			}
-			break;
 
-		case TexFmt_CI8_8888:
-			{
-				// Convert palletised texture to non-palletised. This is wsteful - we should avoid generating these updated for OSX.
-				const NativePfCI8 *  pix_ptr = static_cast< const NativePfCI8 * >( data );
-				const NativePf8888 * pal_ptr = static_cast< const NativePf8888 * >( palette );
+			glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA,
+						  width, height,
+						  0, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV, out );
 
-				NativePf8888 * out = static_cast<NativePf8888 *>( malloc(mCorrectedWidth * mCorrectedHeight * sizeof(NativePf8888)) );
-				NativePf8888 * out_ptr = out;
+			free(out);
+		}
+		break;
 
-				u32 pitch = GetStride();
+	default:
+		DAEDALUS_ASSERT( !IsTextureFormatPalettised( format ), "Unhandled palette texture" );
+		DAEDALUS_ASSERT( palette == NULL, "Palette provided when not needed" );
+		break;
+	}
+}
 
-				for (u32 y = 0; y < mCorrectedHeight; ++y)
-				{
-					for (u32 x = 0; x < mCorrectedWidth; ++x)
-					{
-						u8	pal_idx = pix_ptr[ x ].Bits;
+namespace
+{
+	// Followed by the pixels, then the palette if there is one
+	struct TextureUploadCommand
+	{
+		GLuint			TextureId;
+		ETextureFormat	Format;
+		u32				Width;
+		u32				Height;
+		u32				Pitch;
+		u32				DataSize;
+		u32				PaletteSize;
+	};
+
+	void ExecuteTextureUpload( const void * p_command )
+	{
+		const TextureUploadCommand * command = static_cast< const TextureUploadCommand * >( p_command );
+		const u8 * data    = reinterpret_cast< const u8 * >( command + 1 );
+		const u8 * palette = command->PaletteSize ? data + command->DataSize : NULL;
 
-						*out_ptr = pal_ptr[ pal_idx ];
-						out_ptr++;
-					}
+		UploadTexture( command->TextureId, command->Format, command->Width, command->Height, command->Pitch, data, palette );
+	}
+}
 
-					pix_ptr = reinterpret_cast<const NativePfCI8 *>( reinterpret_cast<const u8 *>(pix_ptr) + pitch );
-				}
+void CNativeTexture::SetData( void * data, void * palette )
+{
+	// It's pretty gross that we don't pass this in, or better yet, provide a way for
+	// the caller to write directly to our buffers instead of setting the data.
+	size_t data_len = GetBytesRequired();
+	memcpy(mpData, data, data_len);
 
-				glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA,
-							  mCorrectedWidth, mCorrectedHeight,
-							  0, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV, out );
+	if (mTextureFormat == TexFmt_CI4_8888)
+	{
+		memcpy(mpPalette, palette, kPalette4BytesRequired);
+	}
+	else if (mTextureFormat == TexFmt_CI8_8888)
+	{
+		memcpy(mpPalette, palette, kPalette8BytesRequired);
+	}
 
-				free(out);
-			}
-			break;
+	if (HasData())
+	{
+		const u32 palette_len = palette ? ( (mTextureFormat == TexFmt_CI4_8888) ? kPalette4BytesRequired :
+											(mTextureFormat == TexFmt_CI8_8888) ? kPalette8BytesRequired : 0 ) : 0;
 
-		default:
-			DAEDALUS_ASSERT( !IsTextureFormatPalettised( mTextureFormat ), "Unhandled palette texture" );
-			DAEDALUS_ASSERT( palette == NULL, "Palette provided when not needed" );
-			break;
+		if (RenderThreadGL_IsRecording())
+		{
+			// The caller's buffers won't be around by the time it's uploaded, so take a copy
+			void * p_command = RenderThreadGL_AllocCommand( sizeof( TextureUploadCommand ) + data_len + palette_len, ExecuteTextureUpload );
+			TextureUploadCommand * command = static_cast< TextureUploadCommand * >( p_command );
+			command->TextureId   = mTextureId;
+			command->Format      = mTextureFormat;
+			command->Width       = mCorrectedWidth;
+			command->Height      = mCorrectedHeight;
+			command->Pitch       = GetStride();
+			command->DataSize    = data_len;
+			command->PaletteSize = palette_len;
+
+			u8 * p_data = reinterpret_cast< u8 * >( command + 1 );
+			memcpy( p_data, data, data_len );
+			if (palette_len)
+				memcpy( p_data + data_len, palette, palette_len );
+		}
+		else
+		{
+			UploadTexture( mTextureId, mTextureFormat, mCorrectedWidth, mCorrectedHeight, GetStride(), data, palette );
 		}
 	}
 }
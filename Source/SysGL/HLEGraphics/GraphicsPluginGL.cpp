@@ -19,6 +19,7 @@
 #include "System/Timing.h"
 
 #include "SysGL/GL.h"
+#include "SysGL/HLEGraphics/RenderThreadGL.h"
 
 extern SDL_Window * gWindow;
 
@@ -151,6 +152,21 @@ bool CGraphicsPluginImpl::Initialise()
 
 void CGraphicsPluginImpl::ProcessDList()
 {
+	bool threaded = gGlobalPreferences.ThreadedRenderer;
+#ifdef DAEDALUS_DEBUG_DISPLAYLIST
+	// The debugger reads back from GL, so it needs the context on this thread
+	threaded &= !DLDebugger_IsDebugging();
+#endif
+
+	if (threaded)
+	{
+		RenderThreadGL_Start();
+	}
+	else
+	{
+		RenderThreadGL_Stop();
+	}
+
 #ifdef DAEDALUS_DEBUG_DISPLAYLIST
 	if (!DLDebugger_Process())
 	{
@@ -159,6 +175,9 @@ void CGraphicsPluginImpl::ProcessDList()
 #else
 	DLParser_Process();
 #endif
+
+	// Let the render thread get on with this list while the core carries on
+	RenderThreadGL_Submit();
 }
 
 bool ShowFPSonmenu = false;
@@ -188,6 +207,7 @@ void CGraphicsPluginImpl::RomClosed()
 {
 	DBGConsole_Msg(0, "Finalising GLGraphics");
 
+	RenderThreadGL_Stop();
 	DLParser_Finalise();
 	CTextureCache::Destroy();
 	DestroyRenderer();
@@ -0,0 +1,290 @@
+#include "Base/Types.h"
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "Debug/DBGConsole.h"
+#include "SysGL/HLEGraphics/ProgramCacheGL.h"
+#include "Utility/Paths.h"
+
+namespace
+{
+	const u32 MAGIC_HEADER = 0x47504C43;	// 'GLPC'
+	const u32 CACHE_VERSION = 1;
+
+	// Anything larger than this in the file means it's corrupt
+	const u32 MAX_PROGRAMS = 4096;
+	const u32 MAX_BINARY_SIZE = 4 * 1024 * 1024;
+
+	void WriteU32( std::ofstream & fp, u32 data )
+	{
+		fp.write( reinterpret_cast< const char * >( &data ), sizeof( data ) );
+	}
+
+	bool ReadU32( std::ifstream & fp, u32 & data )
+	{
+		fp.read( reinterpret_cast< char * >( &data ), sizeof( data ) );
+		return fp.good();
+	}
+}
+
+CProgramCacheGL		gProgramCacheGL;
+
+//*****************************************************************************
+//
+//*****************************************************************************
+CProgramCacheGL::CProgramCacheGL()
+:	mBuildHash( 0 )
+,	mOpen( false )
+,	mDirty( false )
+,	mSupportsBinaries( false )
+,	mNumLoaded( 0 )
+,	mNumRejected( 0 )
+{
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void CProgramCacheGL::Open( const RomID & rom_id, u32 build_hash )
+{
+	Close();
+
+	std::ostringstream name;
+	name << std::hex << std::setfill( '0' )
+		 << std::setw( 8 ) << rom_id.CRC[0] << std::setw( 8 ) << rom_id.CRC[1]
+		 << "-" << std::setw( 2 ) << static_cast< int >( rom_id.CountryID ) << ".glp";
+
+	mFilename  = setBasePath( "SaveGames/Cache" ) / name.str();
+	mBuildHash = build_hash;
+	mOpen      = true;
+
+	mSupportsBinaries = false;
+	if( GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary )
+	{
+		GLint num_formats = 0;
+		glGetIntegerv( GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats );
+		mSupportsBinaries = num_formats > 0;
+	}
+
+	if( !Load() )
+	{
+		mEntries.clear();
+	}
+#ifdef DAEDALUS_DEBUG_CONSOLE
+	DBGConsole_Msg( 0, "Program cache %s: %d programs%s", mFilename.string().c_str(), u32( mEntries.size() ),
+					mSupportsBinaries ? "" : " (no binary support)" );
+#endif
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void CProgramCacheGL::Close()
+{
+	if( mOpen && mDirty )
+	{
+		Save();
+	}
+#ifdef DAEDALUS_DEBUG_CONSOLE
+	if( mOpen )
+	{
+		DBGConsole_Msg( 0, "Program cache: %d loaded, %d rejected", mNumLoaded, mNumRejected );
+	}
+#endif
+
+	mEntries.clear();
+	mOpen = false;
+	mDirty = false;
+	mNumLoaded = 0;
+	mNumRejected = 0;
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+std::vector< SProgramCacheKey > CProgramCacheGL::GetKeys() const
+{
+	std::vector< SProgramCacheKey > keys;
+	keys.reserve( mEntries.size() );
+	for( const auto & it : mEntries )
+	{
+		keys.push_back( it.first );
+	}
+	return keys;
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+GLuint CProgramCacheGL::LoadProgram( const SProgramCacheKey & key, u32 source_hash )
+{
+	if( !mOpen || !mSupportsBinaries )
+		return 0;
+
+	EntryMap::iterator it( mEntries.find( key ) );
+	if( it == mEntries.end() )
+		return 0;
+
+	SEntry & entry( it->second );
+	if( entry.Binary.empty() || entry.SourceHash != source_hash )
+		return 0;
+
+	GLuint program = glCreateProgram();
+	if( program == 0 )
+		return 0;
+
+	glProgramBinary( program, entry.Format, entry.Binary.data(), entry.Binary.size() );
+
+	GLint program_ok = GL_FALSE;
+	glGetProgramiv( program, GL_LINK_STATUS, &program_ok );
+	if( program_ok != GL_TRUE )
+	{
+		// Drivers are allowed to reject binaries for any reason - just build it again
+		glDeleteProgram( program );
+		entry.Binary.clear();
+		mDirty = true;
+		mNumRejected++;
+		return 0;
+	}
+
+	mNumLoaded++;
+	return program;
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void CProgramCacheGL::AddProgram( const SProgramCacheKey & key, u32 source_hash, GLuint program )
+{
+	if( !mOpen || mEntries.size() >= MAX_PROGRAMS )
+		return;
+
+	EntryMap::iterator it( mEntries.find( key ) );
+	if( it != mEntries.end() && it->second.SourceHash == source_hash && ( !it->second.Binary.empty() || !mSupportsBinaries ) )
+		return;
+
+	SEntry & entry( mEntries[ key ] );
+	entry.SourceHash = source_hash;
+	entry.Format     = 0;
+	entry.Binary.clear();
+	mDirty = true;
+
+	if( mSupportsBinaries )
+	{
+		GLint length = 0;
+		glGetProgramiv( program, GL_PROGRAM_BINARY_LENGTH, &length );
+		if( length > 0 && u32( length ) <= MAX_BINARY_SIZE )
+		{
+			entry.Binary.resize( length );
+
+			GLsizei written = 0;
+			glGetProgramBinary( program, length, &written, &entry.Format, entry.Binary.data() );
+			entry.Binary.resize( written );
+		}
+	}
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+bool CProgramCacheGL::Load()
+{
+	std::ifstream fp( mFilename, std::ios::in | std::ios::binary );
+	if( !fp.is_open() )
+		return false;
+
+	u32 data( 0 );
+	if( !ReadU32( fp, data ) || data != MAGIC_HEADER )
+		return false;
+	if( !ReadU32( fp, data ) || data != CACHE_VERSION )
+		return false;
+
+	// Binaries built for another driver (or shader library) are no use, but the list of programs still is
+	u32 build_hash( 0 );
+	if( !ReadU32( fp, build_hash ) )
+		return false;
+	const bool keep_binaries = build_hash == mBuildHash && mSupportsBinaries;
+	if( !keep_binaries )
+		mDirty = true;
+
+	u32 num_programs( 0 );
+	if( !ReadU32( fp, num_programs ) || num_programs > MAX_PROGRAMS )
+		return false;
+
+	for( u32 i = 0; i < num_programs; ++i )
+	{
+		SProgramCacheKey	key;
+		SEntry				entry;
+		u32					mux_hi( 0 );
+		u32					mux_lo( 0 );
+		u32					format( 0 );
+		u32					length( 0 );
+
+		if( !ReadU32( fp, mux_hi ) ||
+			!ReadU32( fp, mux_lo ) ||
+			!ReadU32( fp, key.Flags ) ||
+			!ReadU32( fp, entry.SourceHash ) ||
+			!ReadU32( fp, format ) ||
+			!ReadU32( fp, length ) )
+			return false;
+
+		if( length > MAX_BINARY_SIZE )
+			return false;
+
+		key.Mux      = ( u64( mux_hi ) << 32 ) | mux_lo;
+		entry.Format = format;
+
+		if( keep_binaries )
+		{
+			entry.Binary.resize( length );
+			fp.read( reinterpret_cast< char * >( entry.Binary.data() ), length );
+		}
+		else
+		{
+			fp.seekg( length, std::ios::cur );
+		}
+		if( !fp.good() )
+			return false;
+
+		mEntries[ key ] = std::move( entry );
+	}
+
+	return true;
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void CProgramCacheGL::Save() const
+{
+	std::filesystem::create_directories( mFilename.parent_path() );
+
+	std::ofstream fp( mFilename, std::ios::binary );
+	if( !fp.is_open() )
+		return;
+
+	WriteU32( fp, MAGIC_HEADER );
+	WriteU32( fp, CACHE_VERSION );
+	WriteU32( fp, mBuildHash );
+	WriteU32( fp, mEntries.size() );
+
+	for( const auto & it : mEntries )
+	{
+		const SProgramCacheKey & key( it.first );
+		const SEntry & entry( it.second );
+
+		WriteU32( fp, u32( key.Mux >> 32 ) );
+		WriteU32( fp, u32( key.Mux ) );
+		WriteU32( fp, key.Flags );
+		WriteU32( fp, entry.SourceHash );
+		WriteU32( fp, entry.Format );
+		WriteU32( fp, entry.Binary.size() );
+		fp.write( reinterpret_cast< const char * >( entry.Binary.data() ), entry.Binary.size() );
+	}
+
+#ifdef DAEDALUS_DEBUG_CONSOLE
+	DBGConsole_Msg( 0, "Wrote %d programs to %s", u32( mEntries.size() ), mFilename.string().c_str() );
+#endif
+}
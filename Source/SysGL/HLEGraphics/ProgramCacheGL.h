@@ -0,0 +1,85 @@
+#ifndef SYSGL_HLEGRAPHICS_PROGRAMCACHEGL_H_
+#define SYSGL_HLEGRAPHICS_PROGRAMCACHEGL_H_
+
+#include "Base/Types.h"
+
+#include <filesystem>
+#include <map>
+#include <vector>
+
+#include "Core/ROM.h"
+#include "SysGL/GL.h"
+
+//*****************************************************************************
+//	Remembers every combiner program a ROM has used, along with the linked
+//	program binary where the driver can give us one, and writes them out per
+//	ROM (SaveGames/Cache/<crc1><crc2>-<country>.glp).
+//	When the ROM is next opened the renderer builds all of them up front,
+//	usually straight from the binaries, rather than compiling each one the
+//	first time it's drawn with.
+//	Binaries are only used if the driver and the shader library they were
+//	built with match the current ones, and each one carries a hash of its
+//	fragment source. Anything that doesn't match is compiled from source.
+//*****************************************************************************
+
+// Everything in a ShaderConfiguration, packed
+struct SProgramCacheKey
+{
+	u64		Mux;
+	u32		Flags;
+
+	bool operator<( const SProgramCacheKey & rhs ) const
+	{
+		return Mux != rhs.Mux ? Mux < rhs.Mux : Flags < rhs.Flags;
+	}
+};
+
+class CProgramCacheGL
+{
+public:
+	CProgramCacheGL();
+
+	// build_hash identifies the driver and the shader sources shared by every program
+	void					Open( const RomID & rom_id, u32 build_hash );
+	void					Close();
+
+	bool					IsOpen() const							{ return mOpen; }
+
+	// Every program recorded for this ROM, in no particular order
+	std::vector< SProgramCacheKey >	GetKeys() const;
+
+	// Returns a linked program, or 0 if there's no usable binary for it
+	GLuint					LoadProgram( const SProgramCacheKey & key, u32 source_hash );
+	// Records a program built from source, keeping its binary if we can get it
+	void					AddProgram( const SProgramCacheKey & key, u32 source_hash, GLuint program );
+
+	// Programs need to be linked with the retrievable hint set for AddProgram to get their binary
+	bool					SupportsBinaries() const				{ return mSupportsBinaries; }
+
+private:
+	bool					Load();
+	void					Save() const;
+
+private:
+	struct SEntry
+	{
+		u32					SourceHash;
+		GLenum				Format;
+		std::vector< u8 >	Binary;			// Empty if we don't have one
+	};
+	using EntryMap = std::map< SProgramCacheKey, SEntry >;
+
+	std::filesystem::path	mFilename;
+	EntryMap				mEntries;
+	u32						mBuildHash;
+	bool					mOpen;
+	bool					mDirty;
+	bool					mSupportsBinaries;
+
+	u32						mNumLoaded;			// Programs linked from a binary this session
+	u32						mNumRejected;		// Binaries the driver wouldn't take
+};
+
+extern CProgramCacheGL		gProgramCacheGL;
+
+#endif // SYSGL_HLEGRAPHICS_PROGRAMCACHEGL_H_
@@ -0,0 +1,287 @@
+#include "Base/Types.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Debug/DBGConsole.h"
+#include "SysGL/HLEGraphics/RenderThreadGL.h"
+#include "Utility/Profiler.h"
+
+extern SDL_GLContext gContext;
+
+namespace
+{
+	struct RenderCommandHeader
+	{
+		RenderCommandFn		Fn;
+		u32					Size;		// Including the header
+	};
+
+	const u32 kCommandAlignment     = alignof( std::max_align_t );
+	const u32 kCommandHeaderSize    = ( sizeof( RenderCommandHeader ) + kCommandAlignment - 1 ) & ~( kCommandAlignment - 1 );
+	const u32 kInitialCommandBytes  = 1024 * 1024;
+	const u32 kInitialVertices      = 64 * 1024;
+	const u32 kNumSpareTextureNames = 64;
+
+	struct RenderBuffer
+	{
+		std::vector< u8 >			Commands;
+		std::vector< DaedalusVtx >	Vertices;
+	};
+
+	RenderBuffer					gBuffers[ 2 ];
+	RenderBuffer *					gRecording = &gBuffers[ 0 ];	// Emulation thread only
+	RenderBuffer *					gQueued    = NULL;				// Submitted, but not picked up yet
+	RenderBuffer *					gExecuting = NULL;				// Being played back
+	const RenderBuffer *			gPlayback  = NULL;				// Render thread only
+
+	std::thread						gThread;
+	std::thread::id					gThreadId;
+	std::atomic< bool >				gRunning( false );
+	bool							gStopRequested = false;
+
+	std::mutex						gMutex;
+	std::condition_variable			gWakeRenderThread;
+	std::condition_variable			gWakeEmulationThread;
+
+	std::vector< GLuint >			gSpareTextureNames;
+	bool							gWantTextureNames = false;
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+static void ExecuteBuffer( const RenderBuffer & buffer )
+{
+	DAEDALUS_PROFILE( "RenderThreadGL::ExecuteBuffer" );
+
+	gPlayback = &buffer;
+
+	const u8 * p       = buffer.Commands.data();
+	const u8 * p_end   = p + buffer.Commands.size();
+	while( p < p_end )
+	{
+		const RenderCommandHeader * header = reinterpret_cast< const RenderCommandHeader * >( p );
+		header->Fn( p + kCommandHeaderSize );
+		p += header->Size;
+	}
+
+	gPlayback = NULL;
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+static void RenderThreadLoop()
+{
+	SDL_GL_MakeCurrent( gWindow, gContext );
+
+	std::unique_lock< std::mutex > lock( gMutex );
+	for( ;; )
+	{
+		if( gWantTextureNames )
+		{
+			size_t num_spare = gSpareTextureNames.size();
+			gSpareTextureNames.resize( kNumSpareTextureNames );
+			glGenTextures( kNumSpareTextureNames - num_spare, &gSpareTextureNames[ num_spare ] );
+
+			gWantTextureNames = false;
+			gWakeEmulationThread.notify_all();
+		}
+
+		if( gQueued != NULL )
+		{
+			gExecuting = gQueued;
+			gQueued    = NULL;
+
+			const RenderBuffer * buffer = gExecuting;
+			lock.unlock();
+			ExecuteBuffer( *buffer );
+			lock.lock();
+
+			gExecuting = NULL;
+			gWakeEmulationThread.notify_all();
+			continue;
+		}
+
+		if( gStopRequested )
+			break;
+
+		gWakeRenderThread.wait( lock );
+	}
+
+	if( !gSpareTextureNames.empty() )
+	{
+		glDeleteTextures( gSpareTextureNames.size(), gSpareTextureNames.data() );
+		gSpareTextureNames.clear();
+	}
+
+	SDL_GL_MakeCurrent( gWindow, NULL );
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+bool RenderThreadGL_Start()
+{
+	if( gRunning )
+		return true;
+
+	// The UI might still be drawing through an SDL renderer rather than our context
+	if( gWindow == NULL || gContext == NULL || gSdlRenderer != NULL )
+		return false;
+
+	for( RenderBuffer & buffer : gBuffers )
+	{
+		buffer.Commands.clear();
+		buffer.Commands.reserve( kInitialCommandBytes );
+		buffer.Vertices.clear();
+		buffer.Vertices.reserve( kInitialVertices );
+	}
+	gRecording        = &gBuffers[ 0 ];
+	gQueued           = NULL;
+	gExecuting        = NULL;
+	gStopRequested    = false;
+	gWantTextureNames = true;
+
+	// A context can only be current on one thread at a time
+	SDL_GL_MakeCurrent( gWindow, NULL );
+
+	gThread   = std::thread( RenderThreadLoop );
+	gThreadId = gThread.get_id();
+	gRunning  = true;
+
+	DBGConsole_Msg( 0, "Render thread started" );
+	return true;
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void RenderThreadGL_Stop()
+{
+	if( !gRunning )
+		return;
+
+	RenderThreadGL_Submit();
+
+	{
+		std::lock_guard< std::mutex > lock( gMutex );
+		gStopRequested = true;
+	}
+	gWakeRenderThread.notify_one();
+	gThread.join();
+
+	gRunning = false;
+	SDL_GL_MakeCurrent( gWindow, gContext );
+
+	DBGConsole_Msg( 0, "Render thread stopped" );
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+bool RenderThreadGL_IsRunning()
+{
+	return gRunning;
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+bool RenderThreadGL_IsRecording()
+{
+	return gRunning && std::this_thread::get_id() != gThreadId;
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void RenderThreadGL_Submit()
+{
+	if( !gRunning || gRecording->Commands.empty() )
+		return;
+
+	DAEDALUS_PROFILE( "RenderThreadGL_Submit" );
+
+	std::unique_lock< std::mutex > lock( gMutex );
+
+	// The other buffer is free once the render thread has nothing queued or in progress
+	gWakeEmulationThread.wait( lock, [] { return gQueued == NULL && gExecuting == NULL; } );
+
+	gQueued    = gRecording;
+	gRecording = ( gRecording == &gBuffers[ 0 ] ) ? &gBuffers[ 1 ] : &gBuffers[ 0 ];
+	gRecording->Commands.clear();
+	gRecording->Vertices.clear();
+
+	gWakeRenderThread.notify_one();
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+void * RenderThreadGL_AllocCommand( u32 size, RenderCommandFn fn )
+{
+	#ifdef DAEDALUS_ENABLE_ASSERTS
+	DAEDALUS_ASSERT( RenderThreadGL_IsRecording(), "Recording a command, but we're not recording" );
+	#endif
+
+	std::vector< u8 > & commands = gRecording->Commands;
+
+	const u32		total_size = kCommandHeaderSize + ( ( size + kCommandAlignment - 1 ) & ~( kCommandAlignment - 1 ) );
+	const size_t	offset     = commands.size();
+	commands.resize( offset + total_size );
+
+	RenderCommandHeader * header = reinterpret_cast< RenderCommandHeader * >( &commands[ offset ] );
+	header->Fn   = fn;
+	header->Size = total_size;
+
+	return &commands[ offset + kCommandHeaderSize ];
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+DaedalusVtx * RenderThreadGL_AllocVertices( u32 count, u32 * p_first )
+{
+	std::vector< DaedalusVtx > & vertices = gRecording->Vertices;
+
+	const u32 first = vertices.size();
+	vertices.resize( first + count );
+
+	*p_first = first;
+	return &vertices[ first ];
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+const DaedalusVtx * RenderThreadGL_GetVertices( u32 first )
+{
+	return &gPlayback->Vertices[ first ];
+}
+
+//*****************************************************************************
+//
+//*****************************************************************************
+GLuint RenderThreadGL_AllocTextureName()
+{
+	std::unique_lock< std::mutex > lock( gMutex );
+
+	// Ask for more before we run out, so we don't usually have to wait
+	if( gSpareTextureNames.size() <= kNumSpareTextureNames / 2 && !gWantTextureNames )
+	{
+		gWantTextureNames = true;
+		gWakeRenderThread.notify_one();
+	}
+
+	gWakeEmulationThread.wait( lock, [] { return !gSpareTextureNames.empty(); } );
+
+	GLuint name = gSpareTextureNames.back();
+	gSpareTextureNames.pop_back();
+	return name;
+}
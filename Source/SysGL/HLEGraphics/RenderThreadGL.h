@@ -0,0 +1,67 @@
+#ifndef SYSGL_HLEGRAPHICS_RENDERTHREADGL_H_
+#define SYSGL_HLEGRAPHICS_RENDERTHREADGL_H_
+
+#include "Base/Types.h"
+
+#include <new>
+#include <type_traits>
+
+#include "HLEGraphics/DaedalusVtx.h"
+#include "SysGL/GL.h"
+
+//*****************************************************************************
+//	While the render thread is running it owns the GL context. Display lists
+//	are still parsed on the emulation thread, but everything that would have
+//	touched GL is recorded into a command buffer instead, and played back on
+//	the render thread once the buffer is submitted.
+//	There are two buffers, so the emulation thread only waits if it submits a
+//	second buffer before the render thread has finished with the first.
+//*****************************************************************************
+
+using RenderCommandFn = void (*)( const void * p_command );
+
+// Hands the GL context over to the render thread. Does nothing if it's already running.
+bool			RenderThreadGL_Start();
+// Waits for everything to be played back, and takes the GL context back.
+void			RenderThreadGL_Stop();
+bool			RenderThreadGL_IsRunning();
+
+// True if GL calls need to be recorded rather than made - i.e. the render
+// thread is running, and this isn't it.
+bool			RenderThreadGL_IsRecording();
+
+// Passes everything recorded so far over to the render thread
+void			RenderThreadGL_Submit();
+
+// Space for a command of the given size, which is passed to fn on the render thread.
+// Commands must be trivially copyable, as they're never destroyed.
+void *			RenderThreadGL_AllocCommand( u32 size, RenderCommandFn fn );
+
+// Vertices are kept apart from the commands, so they can be written before the
+// command that draws them. The pointer is only valid until the next call.
+DaedalusVtx *	RenderThreadGL_AllocVertices( u32 count, u32 * p_first );
+// Called while a command is being played back, to find the vertices it recorded
+const DaedalusVtx *	RenderThreadGL_GetVertices( u32 first );
+
+// Texture names can only be generated on the thread that owns the context, so
+// the render thread keeps a few spare for the emulation thread to use.
+GLuint			RenderThreadGL_AllocTextureName();
+
+// Records a call to fn if GL calls are being recorded, or calls it straight away if not.
+// fn is copied into the command buffer, so it should only capture by value.
+template< typename Fn >
+inline void RenderThreadGL_Run( const Fn & fn )
+{
+	static_assert( std::is_trivially_copyable< Fn >::value, "Render commands must be trivially copyable" );
+
+	if( !RenderThreadGL_IsRecording() )
+	{
+		fn();
+		return;
+	}
+
+	void * p_command = RenderThreadGL_AllocCommand( sizeof( Fn ), []( const void * p ) { ( *static_cast< const Fn * >( p ) )(); } );
+	new( p_command ) Fn( fn );
+}
+
+#endif // SYSGL_HLEGRAPHICS_RENDERTHREADGL_H_
@@ -2,6 +2,8 @@
 #include "Base/Types.h"
 
 
+#include <deque>
+#include <unordered_map>
 #include <vector>
 #include <GL/glew.h>
 #include <fstream>
@@ -16,10 +18,13 @@
 #include "HLEGraphics/RDPStateManager.h"
 #include "Ultra/ultra_gbi.h"
 #include "SysGL/GL.h"
+#include "SysGL/HLEGraphics/ProgramCacheGL.h"
 #include "SysGL/HLEGraphics/RendererGL.h"
+#include "SysGL/HLEGraphics/RenderThreadGL.h"
 #include <glm/gtc/type_ptr.hpp> 
 
 #include "Base/Macros.h"
+#include "Utility/Hash.h"
 #include "Utility/Paths.h"
 #include "Utility/Profiler.h"
 
@@ -65,23 +70,169 @@ const float kShiftScales[] = {
 };
 DAEDALUS_STATIC_ASSERT(std::size(kShiftScales) == 16);
 
-enum
-{
-	kPositionBuffer,
-	kTexCoordBuffer,
-	kColorBuffer,
+static GLuint gVAO;
 
-	kNumBuffers,
+// All vertices are streamed through one ring buffer, interleaved as DaedalusVtx.
+// With GL 4.4/ARB_buffer_storage the ring stays mapped for its whole lifetime,
+// otherwise each allocation is mapped unsynchronized and unmapped before the draw.
+// A fence is dropped at the end of every frame; we only ever wait on one if we
+// catch up with vertices the GPU might still be reading.
+static const u32 kVertexRingVertices = 128 * 1024;
+
+struct VertexRingFence
+{
+	GLsync		Sync;
+	u64			Position;		// Everything before this has been consumed once Sync signals
 };
 
-static GLuint gVAO;
-static GLuint gVBOs[kNumBuffers];
+static GLuint						gVertexRingVBO = 0;
+static DaedalusVtx *				gVertexRingBase = NULL;		// Persistent mapping, if we have one
+static u64							gVertexRingHead = 0;		// Vertices handed out so far, including those skipped on wrapping
+static std::deque<VertexRingFence>	gVertexRingFences;
+
+// The most recent allocation, which is drawn by RenderDaedalusVtx
+static DaedalusVtx *				gVertexRingPending = NULL;
+static u32							gVertexRingPendingFirst = 0;
+
+static void WaitForFence(GLsync sync)
+{
+	GLenum result;
+	do
+	{
+		result = glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+	}
+	while (result == GL_TIMEOUT_EXPIRED);
+
+	glDeleteSync(sync);
+}
 
-const int kMaxVertices = 1000;
+static void InitVertexRing()
+{
+	const GLsizeiptr size = kVertexRingVertices * sizeof(DaedalusVtx);
+
+	glGenBuffers(1, &gVertexRingVBO);
+	glBindBuffer(GL_ARRAY_BUFFER, gVertexRingVBO);
+
+	if (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage)
+	{
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+		gVertexRingBase = static_cast<DaedalusVtx *>(glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags));
+	}
+
+	if (gVertexRingBase == NULL)
+	{
+		glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+	}
+
+	DBGConsole_Msg(0, "Vertex ring: %dKB, %s", u32(size / 1024), gVertexRingBase ? "persistent" : "unsynchronized");
+}
+
+// Make sure the GPU is done with everything before the given ring position
+static void WaitForVertexRing(u64 position)
+{
+	while (!gVertexRingFences.empty())
+	{
+		VertexRingFence fence = gVertexRingFences.front();
+		gVertexRingFences.pop_front();
+
+		// Any earlier fences are covered by a later one
+		if (fence.Position >= position)
+		{
+			WaitForFence(fence.Sync);
+			return;
+		}
+		glDeleteSync(fence.Sync);
+	}
+
+	// This frame has been all the way round the ring - wait for what we've issued so far
+	WaitForFence(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+}
 
-static float 	gPositionBuffer[kMaxVertices][3];
-static TexCoord gTexCoordBuffer[kMaxVertices];
-static u32 		gColorBuffer[kMaxVertices];
+static void UnmapVertexRing()
+{
+	if (gVertexRingPending != NULL && gVertexRingBase == NULL)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, gVertexRingVBO);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	}
+	gVertexRingPending = NULL;
+}
+
+static DaedalusVtx * AllocVertexRing(u32 count)
+{
+	if (gVertexRingVBO == 0 || count == 0 || count > kVertexRingVertices)
+		return NULL;
+
+	UnmapVertexRing();
+
+	// Allocations never straddle the end of the ring
+	u32 first = u32(gVertexRingHead % kVertexRingVertices);
+	if (first + count > kVertexRingVertices)
+	{
+		gVertexRingHead += kVertexRingVertices - first;
+		first = 0;
+	}
+
+	const u64 end = gVertexRingHead + count;
+	if (end > kVertexRingVertices)
+	{
+		WaitForVertexRing(end - kVertexRingVertices);
+	}
+
+	DaedalusVtx * p_vertices;
+	if (gVertexRingBase != NULL)
+	{
+		p_vertices = gVertexRingBase + first;
+	}
+	else
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, gVertexRingVBO);
+		p_vertices = static_cast<DaedalusVtx *>(glMapBufferRange(GL_ARRAY_BUFFER, first * sizeof(DaedalusVtx), count * sizeof(DaedalusVtx),
+												GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT));
+		if (p_vertices == NULL)
+			return NULL;
+	}
+
+	gVertexRingHead = end;
+	gVertexRingPending = p_vertices;
+	gVertexRingPendingFirst = first;
+	return p_vertices;
+}
+
+// Anything that wasn't written straight into the ring is copied there first
+static void DrawVertexRing(GLenum prim, const DaedalusVtx * vertices, u32 count)
+{
+	if (vertices != gVertexRingPending)
+	{
+		DaedalusVtx * p_vertices = AllocVertexRing(count);
+		if (p_vertices == NULL)
+			return;
+
+		memcpy(p_vertices, vertices, count * sizeof(DaedalusVtx));
+	}
+
+	const u32 first = gVertexRingPendingFirst;
+	UnmapVertexRing();
+
+	glDrawArrays(prim, first, count);
+}
+
+// Called once the frame's commands have all been issued
+void endframegl()
+{
+	if (gVertexRingVBO == 0)
+		return;
+
+	// Nothing new drawn since the last fence, so there's no need for another one
+	if (!gVertexRingFences.empty() && gVertexRingFences.back().Position == gVertexRingHead)
+		return;
+
+	VertexRingFence fence;
+	fence.Sync     = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	fence.Position = gVertexRingHead;
+	gVertexRingFences.push_back(fence);
+}
 
 bool loadShader(const std::filesystem::path& shader_path)
 {
@@ -128,16 +279,7 @@ bool initgl()
 	glGenVertexArrays(1, &gVAO);
 	glBindVertexArray(gVAO);
 
-	glGenBuffers(kNumBuffers, gVBOs);
-
-	glBindBuffer(GL_ARRAY_BUFFER, gVBOs[kPositionBuffer]);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(gPositionBuffer), gPositionBuffer, GL_DYNAMIC_DRAW);
-
-	glBindBuffer(GL_ARRAY_BUFFER, gVBOs[kTexCoordBuffer]);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(gTexCoordBuffer), gTexCoordBuffer, GL_DYNAMIC_DRAW);
-
-	glBindBuffer(GL_ARRAY_BUFFER, gVBOs[kColorBuffer]);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(gColorBuffer), gColorBuffer, GL_DYNAMIC_DRAW);
+	InitVertexRing();
 	return true;
 }
 
@@ -184,12 +326,47 @@ inline bool operator==(const ShaderConfiguration & a, const ShaderConfiguration
 		a.AlphaThreshold == b.AlphaThreshold;
 }
 
+// Everything but the mux, packed into one word for hashing and for the program cache
+static inline u32 PackShaderFlags(const ShaderConfiguration & config)
+{
+	return  config.CycleType           |
+		   (config.BilerpFilter   << 2) |
+		   (config.ClampS0        << 3) |
+		   (config.ClampT0        << 4) |
+		   (config.ClampS1        << 5) |
+		   (config.ClampT1        << 6) |
+		   (config.AlphaThreshold << 8);
+}
+
+static inline ShaderConfiguration UnpackShaderConfig(const SProgramCacheKey & key)
+{
+	ShaderConfiguration config;
+	config.Mux            = key.Mux;
+	config.CycleType      = key.Flags & 0x3;
+	config.BilerpFilter   = (key.Flags >> 2) & 1;
+	config.ClampS0        = (key.Flags >> 3) & 1;
+	config.ClampT0        = (key.Flags >> 4) & 1;
+	config.ClampS1        = (key.Flags >> 5) & 1;
+	config.ClampT1        = (key.Flags >> 6) & 1;
+	config.AlphaThreshold = (key.Flags >> 8) & 0xff;
+	return config;
+}
+
+struct ShaderConfigurationHash
+{
+	size_t operator()(const ShaderConfiguration & config) const
+	{
+		return std::hash<u64>()(config.Mux ^ (u64(PackShaderFlags(config)) * 0x9e3779b97f4a7c15ull));
+	}
+};
+
 struct ShaderProgram
 {
 	ShaderConfiguration config;
 	GLuint 				program;
 
 	GLint				uloc_project;
+	GLint				uloc_uvtransform;
 	GLint				uloc_primcol;
 	GLint				uloc_envcol;
 	GLint				uloc_primlodfrac;
@@ -206,7 +383,12 @@ struct ShaderProgram
 
 	GLint				uloc_foo;
 };
-static std::vector<ShaderProgram *>		gShaders;
+static std::unordered_map<ShaderConfiguration, ShaderProgram *, ShaderConfigurationHash>	gShaders;
+static const ShaderProgram *			gLastShader = NULL;
+
+// Set when a ROM is opened. The programs it used last time are built before its first draw.
+static bool							gWarmShaderCache = false;
+static RomID						gShaderCacheRomID;
 
 
 /* Creates a shader object of the specified type using the specified text
@@ -264,6 +446,12 @@ static GLuint make_shader_program(const char ** vertex_lines, size_t num_vertex_
 				glAttachShader(program, vertex_shader);
 				glAttachShader(program, fragment_shader);
 
+				// Needed if we want to keep the binary
+				if (gProgramCacheGL.SupportsBinaries())
+				{
+					glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+				}
+
 				glLinkProgram(program);
 				glGetProgramiv(program, GL_LINK_STATUS, &program_ok);
 
@@ -341,6 +529,7 @@ static const char * kAlphaParams8[8] = {
 static const char* default_vertex_shader =
 "#version 150\n"
 "uniform mat4 uProject;\n"
+"uniform vec4 uUVTransform;\n"
 "in      vec3 in_pos;\n"
 "in      vec2 in_uv;\n"
 "in      vec4 in_col;\n"
@@ -349,7 +538,7 @@ static const char* default_vertex_shader =
 "\n"
 "void main()\n"
 "{\n"
-"	v_st = in_uv;\n"
+"	v_st = trunc(in_uv * uUVTransform.xy + uUVTransform.zw);\n"
 "	v_col = in_col;\n"
 "	gl_Position = uProject * vec4(in_pos, 1.0);\n"
 "}\n";
@@ -472,6 +661,7 @@ static void InitShaderProgram(ShaderProgram * program, const ShaderConfiguration
 	program->config            = config;
 	program->program           = shader_program;
 	program->uloc_project      = glGetUniformLocation(shader_program, "uProject");
+	program->uloc_uvtransform  = glGetUniformLocation(shader_program, "uUVTransform");
 	program->uloc_primcol      = glGetUniformLocation(shader_program, "uPrimColour");
 	program->uloc_envcol       = glGetUniformLocation(shader_program, "uEnvColour");
 	program->uloc_primlodfrac  = glGetUniformLocation(shader_program, "uPrimLODFrac");
@@ -496,21 +686,21 @@ static void InitShaderProgram(ShaderProgram * program, const ShaderConfiguration
 	program->uloc_texscale[1]   = glGetUniformLocation(shader_program, "uTexScale1");
 	program->uloc_texture[1]    = glGetUniformLocation(shader_program, "uTexture1");
 
+	// Vertices are read straight out of the ring, as the renderer wrote them
+	glBindBuffer(GL_ARRAY_BUFFER, gVertexRingVBO);
+
 	GLuint attrloc;
 	attrloc = glGetAttribLocation(program->program, "in_pos");
-	glBindBuffer(GL_ARRAY_BUFFER, gVBOs[kPositionBuffer]);
 	glEnableVertexAttribArray(attrloc);
-	glVertexAttribPointer(attrloc, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	glVertexAttribPointer(attrloc, 3, GL_FLOAT, GL_FALSE, sizeof(DaedalusVtx), (const void *)offsetof(DaedalusVtx, Position));
 
 	attrloc = glGetAttribLocation(program->program, "in_uv");
-	glBindBuffer(GL_ARRAY_BUFFER, gVBOs[kTexCoordBuffer]);
 	glEnableVertexAttribArray(attrloc);
-	glVertexAttribPointer(attrloc, 2, GL_SHORT, GL_FALSE, 0, 0);
+	glVertexAttribPointer(attrloc, 2, GL_FLOAT, GL_FALSE, sizeof(DaedalusVtx), (const void *)offsetof(DaedalusVtx, Texture));
 
 	attrloc = glGetAttribLocation(program->program, "in_col");
-	glBindBuffer(GL_ARRAY_BUFFER, gVBOs[kColorBuffer]);
 	glEnableVertexAttribArray(attrloc);
-	glVertexAttribPointer(attrloc, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, 0);
+	glVertexAttribPointer(attrloc, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(DaedalusVtx), (const void *)offsetof(DaedalusVtx, Colour));
 }
 
 void RendererGL::MakeShaderConfigFromCurrentState(ShaderConfiguration * config) const
@@ -568,127 +758,148 @@ void RendererGL::MakeShaderConfigFromCurrentState(ShaderConfiguration * config)
 	}
 }
 
-static ShaderProgram * GetShaderForConfig(const ShaderConfiguration & config)
+static ShaderProgram * BuildShaderForConfig(const ShaderConfiguration & config)
 {
-
-	for (u32 i = 0; i < gShaders.size(); ++i)
-	{
-		ShaderProgram * program = gShaders[i];
-		if (program->config == config)
-			return program;
-	}
+	DAEDALUS_PROFILE("BuildShaderForConfig");
 
 	char frag_shader[2048];
 	SprintShader(frag_shader, config);
 
-	const char * vertex_lines[] = { default_vertex_shader };
-	const char * fragment_lines[] = { gN64FragmentLibrary.c_str(), frag_shader };
+	const SProgramCacheKey key = { config.Mux, PackShaderFlags(config) };
+	const u32 source_hash = murmur2_hash(frag_shader, strlen(frag_shader), 0);
 
-	GLuint shader_program = make_shader_program(
-								vertex_lines, std::size(vertex_lines),
-								fragment_lines, std::size(fragment_lines));
+	GLuint shader_program = gProgramCacheGL.LoadProgram(key, source_hash);
 	if (shader_program == 0)
 	{
-		fprintf(stderr, "ERROR: during creation of the shader program\n");
-		return NULL;
+		const char * vertex_lines[] = { default_vertex_shader };
+		const char * fragment_lines[] = { gN64FragmentLibrary.c_str(), frag_shader };
+
+		shader_program = make_shader_program(
+									vertex_lines, std::size(vertex_lines),
+									fragment_lines, std::size(fragment_lines));
+		if (shader_program == 0)
+		{
+			fprintf(stderr, "ERROR: during creation of the shader program\n");
+			return NULL;
+		}
+
+		gProgramCacheGL.AddProgram(key, source_hash, shader_program);
 	}
 
 	ShaderProgram * program = new ShaderProgram;
 	InitShaderProgram(program, config, shader_program);
-	gShaders.push_back(program);
+	gShaders[config] = program;
 
 	return program;
 }
 
-void RendererGL::RestoreRenderStates()
+// Identifies everything that goes into every program, other than its own fragment source
+static u32 GetProgramBuildHash()
 {
-	// Initialise the device to our default state
-
-	// No fog
-	glDisable(GL_FOG);
+	const char * strings[] = {
+		(const char *)glGetString(GL_VENDOR),
+		(const char *)glGetString(GL_RENDERER),
+		(const char *)glGetString(GL_VERSION),
+		default_vertex_shader,
+		gN64FragmentLibrary.c_str(),
+	};
 
-	// We do our own culling
-	glDisable(GL_CULL_FACE);
+	u32 hash = 0;
+	for (const char * str : strings)
+	{
+		if (str != NULL)
+			hash = murmur2_hash(str, strlen(str), hash);
+	}
+	return hash;
+}
 
-	u32 width, height;
-	CGraphicsContext::Get()->GetScreenSize(&width, &height);
+static void WarmShaderCache()
+{
+	DAEDALUS_PROFILE("WarmShaderCache");
 
-	glScissor(0,0, width,height);
-	glEnable(GL_SCISSOR_TEST);
+	gWarmShaderCache = false;
+	gProgramCacheGL.Open(gShaderCacheRomID, GetProgramBuildHash());
 
-	// We do our own lighting
-	glDisable(GL_LIGHTING);
+	u32 num_built = 0;
+	for (const SProgramCacheKey & key : gProgramCacheGL.GetKeys())
+	{
+		const ShaderConfiguration config = UnpackShaderConfig(key);
+		if (gShaders.find(config) == gShaders.end() && BuildShaderForConfig(config) != NULL)
+			++num_built;
+	}
 
-	glBlendColor(0.f, 0.f, 0.f, 0.f);
-	glBlendEquation(GL_ADD);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	DBGConsole_Msg(0, "Built %d programs ahead of time", num_built);
+}
 
-	glDisable( GL_BLEND );
+// Each ROM starts with none, so the cache records every program it uses
+static void DeleteShaders()
+{
+	for (auto & it : gShaders)
+	{
+		glDeleteProgram(it.second->program);
+		delete it.second;
+	}
+	gShaders.clear();
+	gLastShader = NULL;
+}
 
-	// Default is ZBuffer disabled
-	glDepthMask(GL_FALSE);		// GL_FALSE to disable z-writes
-	glDepthFunc(GL_LEQUAL);
-	glDisable(GL_DEPTH_TEST);
+static const ShaderProgram * GetShaderForConfig(const ShaderConfiguration & config)
+{
+	// Runs of draws usually share a combiner
+	if (gLastShader != NULL && gLastShader->config == config)
+		return gLastShader;
 
-	// Initialise all the renderstate to our defaults.
-	glShadeModel(GL_SMOOTH);
+	if (gWarmShaderCache)
+		WarmShaderCache();
 
-	//glFog(near,far,mFogColour);
+	auto it = gShaders.find(config);
+	const ShaderProgram * program = it != gShaders.end() ? it->second : BuildShaderForConfig(config);
 
-	// Enable this for rendering decals (glPolygonOffset).
-	glEnable(GL_POLYGON_OFFSET_FILL);
+	if (program != NULL)
+		gLastShader = program;
+	return program;
 }
 
-// Strip out vertex stream into separate buffers.
-// TODO(strmnnrmn): Renderer should support generating this data directly.
-void RendererGL::RenderDaedalusVtx(int prim, const DaedalusVtx * vertices, int count)
+void RendererGL::RestoreRenderStates()
 {
-	DAEDALUS_ASSERT(count <= kMaxVertices, "Too many vertices!");
+	u32 width, height;
+	CGraphicsContext::Get()->GetScreenSize(&width, &height);
 
-	// Avoid crashing in the unlikely even that our buffers aren't long enough.
-	if (count > kMaxVertices)
-		count = kMaxVertices;
+	RenderThreadGL_Run([width, height]()
+	{
+		// Initialise the device to our default state
 
-	// Hack to fix the sun in Zelda OOT/MM
-	const f32 scale = ( g_ROM.ZELDA_HACK &&(gRDPOtherMode.L == 0x0c184241) ) ? 16.f : 32.f;
+		// No fog
+		glDisable(GL_FOG);
 
-	for (int i = 0; i < count; ++i)
-	{
-		const DaedalusVtx * vtx = &vertices[i];
+		// We do our own culling
+		glDisable(GL_CULL_FACE);
 
-		gPositionBuffer[i][0] = vtx->Position.x;
-		gPositionBuffer[i][1] = vtx->Position.y;
-		gPositionBuffer[i][2] = vtx->Position.z;
+		glScissor(0,0, width,height);
+		glEnable(GL_SCISSOR_TEST);
 
-		// FIXME(strmnnrmn): maintain the texture coords in 10.5 format.
-		gTexCoordBuffer[i].s = (int)(vtx->Texture.x * scale);
-		gTexCoordBuffer[i].t = (int)(vtx->Texture.y * scale);
+		// We do our own lighting
+		glDisable(GL_LIGHTING);
 
-		gColorBuffer[i] = vtx->Colour.GetColour();
-	}
+		glBlendColor(0.f, 0.f, 0.f, 0.f);
+		glBlendEquation(GL_ADD);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-	RenderDaedalusVtxStreams(prim, &gPositionBuffer[0][0], &gTexCoordBuffer[0], &gColorBuffer[0], count);
-}
+		glDisable( GL_BLEND );
 
-void RendererGL::RenderDaedalusVtxStreams(int prim, const float * positions, const TexCoord * uvs, const u32 * colours, int count)
-{
-    // --- Update positions ---
-    glBindBuffer(GL_ARRAY_BUFFER, gVBOs[kPositionBuffer]);
-    // Orphan the buffer (allocate full size with NULL data)
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 3 * kMaxVertices, NULL, GL_DYNAMIC_DRAW);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float) * 3 * count, positions);
-
-    // --- Update texture coordinates ---
-    glBindBuffer(GL_ARRAY_BUFFER, gVBOs[kTexCoordBuffer]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(TexCoord) * kMaxVertices, NULL, GL_DYNAMIC_DRAW);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(TexCoord) * count, uvs);
-
-    // --- Update colors ---
-    glBindBuffer(GL_ARRAY_BUFFER, gVBOs[kColorBuffer]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(u32) * kMaxVertices, NULL, GL_DYNAMIC_DRAW);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(u32) * count, colours);
-
-    glDrawArrays(prim, 0, count);
+		// Default is ZBuffer disabled
+		glDepthMask(GL_FALSE);		// GL_FALSE to disable z-writes
+		glDepthFunc(GL_LEQUAL);
+		glDisable(GL_DEPTH_TEST);
+
+		// Initialise all the renderstate to our defaults.
+		glShadeModel(GL_SMOOTH);
+
+		//glFog(near,far,mFogColour);
+
+		// Enable this for rendering decals (glPolygonOffset).
+		glEnable(GL_POLYGON_OFFSET_FILL);
+	});
 }
 
 /*
@@ -746,7 +957,14 @@ static inline void DebugBlender(u32 cycle_type, u32 blender, u32 alpha_cvg_sel,
 }
 #endif
 
-static void InitBlenderMode()
+enum BlendType
+{
+	kBlendModeOpaque,
+	kBlendModeAlphaTrans,
+	kBlendModeFade,
+};
+
+static BlendType GetBlendMode()
 {
 	u32 cycle_type    = gRDPOtherMode.cycle_type;
 	u32 cvg_x_alpha   = gRDPOtherMode.cvg_x_alpha;
@@ -756,12 +974,6 @@ static void InitBlenderMode()
 	// NB: If we're running in 1cycle mode, ignore the 2nd cycle.
 	u32 active_mode = (cycle_type == CYCLE_2CYCLE) ? blendmode : (blendmode & 0xcccc);
 
-	enum BlendType
-	{
-		kBlendModeOpaque,
-		kBlendModeAlphaTrans,
-		kBlendModeFade,
-	};
 	BlendType type = kBlendModeOpaque;
 
 	// FIXME(strmnnrmn): lots of these need fog!
@@ -854,6 +1066,11 @@ static void InitBlenderMode()
 	if (type == kBlendModeAlphaTrans && !have_alpha)
 		type = kBlendModeOpaque;
 
+	return type;
+}
+
+static void ApplyBlendMode(BlendType type)
+{
 	switch (type)
 	{
 	case kBlendModeOpaque:
@@ -884,59 +1101,80 @@ inline u32 MakeMirror(u32 mirror, u32 m)
 {
 	return (mirror && m) ? (1<<m) : 0;
 }
-void RendererGL::PrepareRenderState(const float *mat_project, bool disable_zbuffer) {
-    DAEDALUS_PROFILE("RendererGL::PrepareRenderState");
+// Everything needed to set up GL for a draw. It's captured up front, so the
+// draw can be played back on the render thread while the DL parser moves on.
+struct RenderStateTextureGL
+{
+	GLuint				TextureId;		// 0 if there's nothing to install
+	GLint				Clamp[2];
+	GLint				Mask[2];
+	GLint				Mirror[2];
+	GLint				TopLeft[2];
+	GLint				BottomRight[2];
+	f32					Shift[2];
+	f32					Scale[2];
+	GLint				Filter;
+	GLint				Wrap[2];
+};
 
-    if (disable_zbuffer) {
-        glDisable(GL_DEPTH_TEST);
-        glDepthMask(GL_FALSE);
-    } else {
-        if (gRDPOtherMode.zmode == 3) {
-            glPolygonOffset(-1.0, -1.0);
-        } else {
-            glPolygonOffset(0.0, 0.0);
-        }
+struct RenderStateGL
+{
+	ShaderConfiguration		Config;
+	f32						Projection[16];
+	glm::vec4				UVTransform;
+	glm::vec4				PrimColour;
+	glm::vec4				EnvColour;
+	f32						PrimLODFrac;
+	u32						Frame;
+
+	bool					DisableZBuffer;
+	bool					DepthTest;
+	bool					DepthWrite;
+	f32						PolygonOffset;
+	BlendType				Blend;
+
+	GLuint					Texture2DId;	// Set by Draw2DTexture, which overrides the blend and filtering
+	RenderStateTextureGL	Textures[kNumTextures];
+};
 
-        if ((mTnL.Flags.Zbuffer & gRDPOtherMode.z_cmp) | gRDPOtherMode.z_upd) {
-            glEnable(GL_DEPTH_TEST);
-        } else {
-            glDisable(GL_DEPTH_TEST);
-        }
+struct DrawCommand
+{
+	RenderStateGL			State;
+	GLenum					Prim;
+	u32						FirstVertex;
+	u32						NumVertices;
+};
 
-        glDepthMask(gRDPOtherMode.z_upd ? GL_TRUE : GL_FALSE);
-    }
+void RendererGL::PrepareRenderState(RenderStateGL * state, const float *mat_project, bool disable_zbuffer, const glm::vec4 & uv_transform) const {
+    DAEDALUS_PROFILE("RendererGL::PrepareRenderState");
 
-    u32 cycle_mode = gRDPOtherMode.cycle_type;
+    *state = RenderStateGL();
 
-    if (cycle_mode < CYCLE_COPY && gRDPOtherMode.force_bl) {
-        InitBlenderMode();
-    } else {
-        glDisable(GL_BLEND);
+    state->DisableZBuffer = disable_zbuffer;
+    if (!disable_zbuffer) {
+        state->PolygonOffset = (gRDPOtherMode.zmode == 3) ? -1.0f : 0.0f;
+        state->DepthTest     = (mTnL.Flags.Zbuffer & gRDPOtherMode.z_cmp) | gRDPOtherMode.z_upd;
+        state->DepthWrite    = gRDPOtherMode.z_upd;
     }
 
-    ShaderConfiguration config;
-    MakeShaderConfigFromCurrentState(&config);
+    u32 cycle_mode = gRDPOtherMode.cycle_type;
 
-    const ShaderProgram* program = GetShaderForConfig(config);
-    if (program == nullptr) {
-        DBGConsole_Msg(0, "Couldn't generate a shader for mux %llx, cycle %d, alpha %d\n", config.Mux, config.CycleType, config.AlphaThreshold);
-        return;
-    }
+    state->Blend = (cycle_mode < CYCLE_COPY && gRDPOtherMode.force_bl) ? GetBlendMode() : kBlendModeOpaque;
 
-    glUseProgram(program->program);
+    MakeShaderConfigFromCurrentState(&state->Config);
 
-    glUniformMatrix4fv(program->uloc_project, 1, GL_FALSE, mat_project);
+    memcpy(state->Projection, mat_project, sizeof(state->Projection));
+    state->UVTransform = uv_transform;
+    state->PrimColour  = glm::vec4(mPrimitiveColour.GetRf(), mPrimitiveColour.GetGf(), mPrimitiveColour.GetBf(), mPrimitiveColour.GetAf());
+    state->EnvColour   = glm::vec4(mEnvColour.GetRf(), mEnvColour.GetGf(), mEnvColour.GetBf(), mEnvColour.GetAf());
+    state->PrimLODFrac = mPrimLODFraction;
 
-    glUniform4f(program->uloc_primcol, mPrimitiveColour.GetRf(), mPrimitiveColour.GetGf(), mPrimitiveColour.GetBf(), mPrimitiveColour.GetAf());
-    glUniform4f(program->uloc_envcol, mEnvColour.GetRf(), mEnvColour.GetGf(), mEnvColour.GetBf(), mEnvColour.GetAf());
-    glUniform1f(program->uloc_primlodfrac, mPrimLODFraction);
+    extern u32 gRDPFrame;
+    state->Frame = gRDPFrame;
 
     bool use_t1 = cycle_mode == CYCLE_2CYCLE;
     bool install_textures[] = { true, use_t1 };
 
-    extern u32 gRDPFrame;
-    glUniform1i(program->uloc_foo, gRDPFrame);
-
     for (u32 i = 0; i < kNumTextures; ++i) {
         if (!install_textures[i])
             continue;
@@ -944,55 +1182,195 @@ void RendererGL::PrepareRenderState(const float *mat_project, bool disable_zbuff
         std::shared_ptr<CNativeTexture> texture = mBoundTexture[i];
 
         if (texture != nullptr) {
-            glActiveTexture(GL_TEXTURE0 + i);
-
-            texture->InstallTexture();
+            RenderStateTextureGL& tex_state = state->Textures[i];
 
             u8 tile_idx = mActiveTile[i];
             const RDP_Tile& rdp_tile = gRDPStateManager.GetTile(tile_idx);
             const RDP_TileSize& tile_size = gRDPStateManager.GetTileSize(tile_idx);
 
-            glUniform1i(program->uloc_texture[i], i);
-
-            bool clamp_s = rdp_tile.clamp_s || (rdp_tile.mask_s == 0);
-            bool clamp_t = rdp_tile.clamp_t || (rdp_tile.mask_t == 0);
+            tex_state.TextureId = texture->GetTextureId();
 
-            u32 mirror_bits_s = MakeMirror(rdp_tile.mirror_s, rdp_tile.mask_s);
-            u32 mirror_bits_t = MakeMirror(rdp_tile.mirror_t, rdp_tile.mask_t);
+            tex_state.Clamp[0] = rdp_tile.clamp_s || (rdp_tile.mask_s == 0);
+            tex_state.Clamp[1] = rdp_tile.clamp_t || (rdp_tile.mask_t == 0);
 
-            u32 mask_bits_s = MakeMask(rdp_tile.mask_s);
-            u32 mask_bits_t = MakeMask(rdp_tile.mask_t);
+            tex_state.Mirror[0] = MakeMirror(rdp_tile.mirror_s, rdp_tile.mask_s);
+            tex_state.Mirror[1] = MakeMirror(rdp_tile.mirror_t, rdp_tile.mask_t);
 
-            glUniform2i(program->uloc_tileclamp[i], clamp_s, clamp_t);
+            tex_state.Mask[0] = MakeMask(rdp_tile.mask_s);
+            tex_state.Mask[1] = MakeMask(rdp_tile.mask_t);
 
-            glUniform2f(program->uloc_tileshift[i], kShiftScales[rdp_tile.shift_s], kShiftScales[rdp_tile.shift_t]);
-            glUniform2i(program->uloc_tilemask[i], mask_bits_s, mask_bits_t);
-            glUniform2i(program->uloc_tilemirror[i], mirror_bits_s, mirror_bits_t);
+            tex_state.Shift[0] = kShiftScales[rdp_tile.shift_s];
+            tex_state.Shift[1] = kShiftScales[rdp_tile.shift_t];
 
-            glUniform2i(program->uloc_tiletl[i], mTileTopLeft[i].s, mTileTopLeft[i].t);
-            glUniform2i(program->uloc_tilebr[i], tile_size.right, tile_size.bottom);
+            tex_state.TopLeft[0]     = mTileTopLeft[i].s;
+            tex_state.TopLeft[1]     = mTileTopLeft[i].t;
+            tex_state.BottomRight[0] = tile_size.right;
+            tex_state.BottomRight[1] = tile_size.bottom;
 
-            glUniform2f(program->uloc_texscale[i], 1.f / texture->GetCorrectedWidth(), 1.f / texture->GetCorrectedHeight());
+            tex_state.Scale[0] = 1.f / texture->GetCorrectedWidth();
+            tex_state.Scale[1] = 1.f / texture->GetCorrectedHeight();
 
             if ((gRDPOtherMode.text_filt != G_TF_POINT) | (gGlobalPreferences.ForceLinearFilter)) {
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                tex_state.Filter = GL_LINEAR;
             } else {
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+                tex_state.Filter = GL_NEAREST;
             }
 
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, mTexWrap[i].u);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, mTexWrap[i].v);
+            tex_state.Wrap[0] = mTexWrap[i].u;
+            tex_state.Wrap[1] = mTexWrap[i].v;
+        }
+    }
+}
+
+static void ApplyRenderState(const RenderStateGL & state) {
+    DAEDALUS_PROFILE("RendererGL::ApplyRenderState");
+
+    if (state.DisableZBuffer) {
+        glDisable(GL_DEPTH_TEST);
+        glDepthMask(GL_FALSE);
+    } else {
+        glPolygonOffset(state.PolygonOffset, state.PolygonOffset);
+
+        if (state.DepthTest) {
+            glEnable(GL_DEPTH_TEST);
+        } else {
+            glDisable(GL_DEPTH_TEST);
+        }
+
+        glDepthMask(state.DepthWrite ? GL_TRUE : GL_FALSE);
+    }
+
+    ApplyBlendMode(state.Blend);
+
+    if (state.Texture2DId != 0) {
+        glBindTexture(GL_TEXTURE_2D, state.Texture2DId);
+    }
+
+    const ShaderProgram* program = GetShaderForConfig(state.Config);
+    if (program == nullptr) {
+        DBGConsole_Msg(0, "Couldn't generate a shader for mux %llx, cycle %d, alpha %d\n", state.Config.Mux, state.Config.CycleType, state.Config.AlphaThreshold);
+    } else {
+        glUseProgram(program->program);
+
+        glUniformMatrix4fv(program->uloc_project, 1, GL_FALSE, state.Projection);
+        glUniform4fv(program->uloc_uvtransform, 1, glm::value_ptr(state.UVTransform));
+
+        glUniform4fv(program->uloc_primcol, 1, glm::value_ptr(state.PrimColour));
+        glUniform4fv(program->uloc_envcol, 1, glm::value_ptr(state.EnvColour));
+        glUniform1f(program->uloc_primlodfrac, state.PrimLODFrac);
+
+        glUniform1i(program->uloc_foo, state.Frame);
+
+        for (u32 i = 0; i < kNumTextures; ++i) {
+            const RenderStateTextureGL& tex_state = state.Textures[i];
+            if (tex_state.TextureId == 0)
+                continue;
+
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, tex_state.TextureId);
+
+            glUniform1i(program->uloc_texture[i], i);
+
+            glUniform2i(program->uloc_tileclamp[i], tex_state.Clamp[0], tex_state.Clamp[1]);
+
+            glUniform2f(program->uloc_tileshift[i], tex_state.Shift[0], tex_state.Shift[1]);
+            glUniform2i(program->uloc_tilemask[i], tex_state.Mask[0], tex_state.Mask[1]);
+            glUniform2i(program->uloc_tilemirror[i], tex_state.Mirror[0], tex_state.Mirror[1]);
+
+            glUniform2i(program->uloc_tiletl[i], tex_state.TopLeft[0], tex_state.TopLeft[1]);
+            glUniform2i(program->uloc_tilebr[i], tex_state.BottomRight[0], tex_state.BottomRight[1]);
+
+            glUniform2f(program->uloc_texscale[i], tex_state.Scale[0], tex_state.Scale[1]);
+
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, tex_state.Filter);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, tex_state.Filter);
+
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, tex_state.Wrap[0]);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, tex_state.Wrap[1]);
         }
     }
+
+    if (state.Texture2DId != 0) {
+        glEnable(GL_BLEND);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+}
+
+static void ExecuteDrawCommand(const void * p_command)
+{
+	const DrawCommand * command = static_cast<const DrawCommand *>(p_command);
+
+	ApplyRenderState(command->State);
+	DrawVertexRing(command->Prim, RenderThreadGL_GetVertices(command->FirstVertex), command->NumVertices);
+}
+
+
+// While recording, vertices go in the command buffer rather than the ring
+static DaedalusVtx *	gRecordedVertices = NULL;
+static u32				gRecordedFirstVertex = 0;
+
+DaedalusVtx * RendererGL::AllocVertices(u32 num_vertices)
+{
+	if (RenderThreadGL_IsRecording())
+	{
+		gRecordedVertices = RenderThreadGL_AllocVertices(num_vertices, &gRecordedFirstVertex);
+		return gRecordedVertices;
+	}
+
+	return AllocVertexRing(num_vertices);
 }
 
+void RendererGL::RenderDaedalusVtx(int prim, const RenderStateGL & state, const DaedalusVtx * vertices, int count)
+{
+	if (RenderThreadGL_IsRecording())
+	{
+		if (vertices != gRecordedVertices)
+		{
+			memcpy(AllocVertices(count), vertices, count * sizeof(DaedalusVtx));
+		}
+
+		DrawCommand * command = static_cast<DrawCommand *>(RenderThreadGL_AllocCommand(sizeof(DrawCommand), ExecuteDrawCommand));
+		command->State       = state;
+		command->Prim        = prim;
+		command->FirstVertex = gRecordedFirstVertex;
+		command->NumVertices = count;
+
+		gRecordedVertices = NULL;
+		return;
+	}
+
+	ApplyRenderState(state);
+	DrawVertexRing(prim, vertices, count);
+}
+
+void RendererGL::RenderDaedalusVtxStreams(int prim, const RenderStateGL & state, const float * positions, const TexCoord * uvs, const u32 * colours, int count)
+{
+	DaedalusVtx * p_vertices = AllocVertices(count);
+	if (p_vertices == NULL)
+		return;
+
+	for (int i = 0; i < count; ++i)
+	{
+		p_vertices[i].Texture  = glm::vec2(uvs[i].s, uvs[i].t);
+		p_vertices[i].Colour   = c32(colours[i]);
+		p_vertices[i].Position = glm::vec3(positions[i*3+0], positions[i*3+1], positions[i*3+2]);
+	}
+
+	RenderDaedalusVtx(prim, state, p_vertices, count);
+}
 
 // FIXME(strmnnrmn): for fill/copy modes this does more work than needed.
 // It ends up copying colour/uv coords when not needed, and can use a shader uniform for the fill colour.
 void RendererGL::RenderTriangles( DaedalusVtx * p_vertices, u32 num_vertices, bool disable_zbuffer )
 {
+	// Texture coords are scaled up to 10.5 in the vertex shader.
+	// Hack to fix the sun in Zelda OOT/MM
+	const f32 scale = ( g_ROM.ZELDA_HACK &&(gRDPOtherMode.L == 0x0c184241) ) ? 16.f : 32.f;
+	glm::vec4 uv_transform( scale, scale, 0.f, 0.f );
+
 	if (mTnL.Flags.Texture)
 	{
 		UpdateTileSnapshots( mTextureTile );
@@ -1006,21 +1384,19 @@ void RendererGL::RenderTriangles( DaedalusVtx * p_vertices, u32 num_vertices, bo
 				// but without it the Goldeneye Rareware logo looks off.
 				// It implies that the RSP code is checking RDP tile state, which seems wrong.
 				// gsDPSetHilite1Tile might set up some RSP state?
+				// The vertices may already be in GPU memory, so this is applied in the shader.
 				float x = (float)mTileTopLeft[0].s / 4.f;
 				float y = (float)mTileTopLeft[0].t / 4.f;
 				float w = (float)texture->GetCorrectedWidth();
 				float h = (float)texture->GetCorrectedHeight();
-				for (u32 i = 0; i < num_vertices; ++i)
-				{
-					p_vertices[i].Texture.x = (p_vertices[i].Texture.x * w) + x;
-					p_vertices[i].Texture.y = (p_vertices[i].Texture.y * h) + y;
-				}
+				uv_transform = glm::vec4( w * scale, h * scale, x * scale, y * scale );
 			}
 		}
 	}
 
-	PrepareRenderState(gProjection.m, disable_zbuffer);
-	RenderDaedalusVtx(GL_TRIANGLES, p_vertices, num_vertices);
+	RenderStateGL state;
+	PrepareRenderState(&state, gProjection.m, disable_zbuffer, uv_transform);
+	RenderDaedalusVtx(GL_TRIANGLES, state, p_vertices, num_vertices);
 }
 
 void RendererGL::TexRect( u32 tile_idx, const glm::vec2 & xy0, const glm::vec2 & xy1, TexCoord st0, TexCoord st1 )
@@ -1033,7 +1409,8 @@ void RendererGL::TexRect( u32 tile_idx, const glm::vec2 & xy0, const glm::vec2 &
 	// We have to do it before PrepareRenderState, because those values are applied to the graphics state.
 	PrepareTexRectUVs(&st0, &st1);
 
-	PrepareRenderState(glm::value_ptr(mScreenToDevice), gRDPOtherMode.depth_source ? false : true);
+	RenderStateGL state;
+	PrepareRenderState(&state, glm::value_ptr(mScreenToDevice), gRDPOtherMode.depth_source ? false : true);
 
 	glm::vec2 screen0;
 	glm::vec2 screen1;
@@ -1066,7 +1443,7 @@ void RendererGL::TexRect( u32 tile_idx, const glm::vec2 & xy0, const glm::vec2 &
 		0xffffffff,
 	};
 
-	RenderDaedalusVtxStreams(GL_TRIANGLE_STRIP, positions, uvs, colours, 4);
+	RenderDaedalusVtxStreams(GL_TRIANGLE_STRIP, state, positions, uvs, colours, 4);
 
 #ifdef DAEDALUS_DEBUG_DISPLAYLIST
 	++mNumRect;
@@ -1081,7 +1458,8 @@ void RendererGL::TexRectFlip( u32 tile_idx, const glm::vec2 & xy0, const glm::ve
 	// We have to do it before PrepareRenderState, because those values are applied to the graphics state.
 	PrepareTexRectUVs(&st0, &st1);
 
-	PrepareRenderState(glm::value_ptr(mScreenToDevice), gRDPOtherMode.depth_source ? false : true);
+	RenderStateGL state;
+	PrepareRenderState(&state, glm::value_ptr(mScreenToDevice), gRDPOtherMode.depth_source ? false : true);
 
 	glm::vec2 screen0;
 	glm::vec2 screen1;
@@ -1114,7 +1492,7 @@ void RendererGL::TexRectFlip( u32 tile_idx, const glm::vec2 & xy0, const glm::ve
 		0xffffffff,
 	};
 
-	RenderDaedalusVtxStreams(GL_TRIANGLE_STRIP, positions, uvs, colours, 4);
+	RenderDaedalusVtxStreams(GL_TRIANGLE_STRIP, state, positions, uvs, colours, 4);
 
 #ifdef DAEDALUS_DEBUG_DISPLAYLIST
 	++mNumRect;
@@ -1123,7 +1501,8 @@ void RendererGL::TexRectFlip( u32 tile_idx, const glm::vec2 & xy0, const glm::ve
 
 void RendererGL::FillRect( const glm::vec2 & xy0, const glm::vec2 & xy1, u32 color )
 {
-	PrepareRenderState(glm::value_ptr(mScreenToDevice), gRDPOtherMode.depth_source ? false : true);
+	RenderStateGL state;
+	PrepareRenderState(&state, glm::value_ptr(mScreenToDevice), gRDPOtherMode.depth_source ? false : true);
 
 	glm::vec2 screen0;
 	glm::vec2 screen1;
@@ -1156,7 +1535,7 @@ void RendererGL::FillRect( const glm::vec2 & xy0, const glm::vec2 & xy1, u32 col
 		color,
 	};
 
-	RenderDaedalusVtxStreams(GL_TRIANGLE_STRIP, positions, uvs, colours, 4);
+	RenderDaedalusVtxStreams(GL_TRIANGLE_STRIP, state, positions, uvs, colours, 4);
 
 #ifdef DAEDALUS_DEBUG_DISPLAYLIST
 	++mNumRect;
@@ -1167,17 +1546,12 @@ void RendererGL::Draw2DTexture(f32 x0, f32 y0, f32 x1, f32 y1,
 							   f32 u0, f32 v0, f32 u1, f32 v1, std::shared_ptr<CNativeTexture> texture)
 {
 	DAEDALUS_PROFILE( "RendererGL::Draw2DTexture" );
-	texture->InstallTexture();
 	// FIXME(strmnnrmn): is this right? Gross anyway.
 	gRDPOtherMode.cycle_type = CYCLE_COPY;
 
-	PrepareRenderState(glm::value_ptr(mScreenToDevice), false /* disable_depth */);
-
-	glEnable(GL_BLEND);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	RenderStateGL state;
+	PrepareRenderState(&state, glm::value_ptr(mScreenToDevice), false /* disable_depth */);
+	state.Texture2DId = texture->GetTextureId();
 
 	float sx0 = N64ToScreenX(x0);
 	float sy0 = N64ToScreenY(y0);
@@ -1208,7 +1582,7 @@ void RendererGL::Draw2DTexture(f32 x0, f32 y0, f32 x1, f32 y1,
 		0xffffffff,
 	};
 
-	RenderDaedalusVtxStreams(GL_TRIANGLE_STRIP, positions, uvs, colours, 4);
+	RenderDaedalusVtxStreams(GL_TRIANGLE_STRIP, state, positions, uvs, colours, 4);
 }
 
 void RendererGL::Draw2DTextureR(f32 x0, f32 y0,
@@ -1217,19 +1591,14 @@ void RendererGL::Draw2DTextureR(f32 x0, f32 y0,
 								f32 x3, f32 y3,
 								f32 s, f32 t, std::shared_ptr<CNativeTexture> texture)	// With Rotation
 {
-		texture->InstallTexture();
 	DAEDALUS_PROFILE( "RendererGL::Draw2DTextureR" );
 
 	// FIXME(strmnnrmn): is this right? Gross anyway.
 	gRDPOtherMode.cycle_type = CYCLE_COPY;
 
-	PrepareRenderState(glm::value_ptr(mScreenToDevice), false /* disable_depth */);
-
-	glEnable(GL_BLEND);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	RenderStateGL state;
+	PrepareRenderState(&state, glm::value_ptr(mScreenToDevice), false /* disable_depth */);
+	state.Texture2DId = texture->GetTextureId();
 
 	const f32 depth = 0.0f;
 
@@ -1254,7 +1623,7 @@ void RendererGL::Draw2DTextureR(f32 x0, f32 y0,
 		0xffffffff,
 	};
 
-	RenderDaedalusVtxStreams(GL_TRIANGLE_FAN, positions, uvs, colours, 4);
+	RenderDaedalusVtxStreams(GL_TRIANGLE_FAN, state, positions, uvs, colours, 4);
 }
 
 bool CreateRenderer()
@@ -1262,10 +1631,18 @@ bool CreateRenderer()
 	DAEDALUS_ASSERT_Q(gRenderer == NULL);
 	gRendererGL = new RendererGL();
 	gRenderer   = gRendererGL;
+
+	// No GL calls yet - the UI may still own the context. We'll warm up on the first draw.
+	gShaderCacheRomID = g_ROM.mRomID;
+	gWarmShaderCache  = true;
 	return true;
 }
 void DestroyRenderer()
 {
+	gWarmShaderCache = false;
+	gProgramCacheGL.Close();
+	DeleteShaders();
+
 	delete gRendererGL;
 	gRendererGL = NULL;
 	gRenderer   = NULL;
@@ -8,6 +8,7 @@ class RendererGL : public BaseRenderer
 public:
 	virtual void		RestoreRenderStates();
 
+	virtual DaedalusVtx *	AllocVertices(u32 num_vertices);
 	virtual void		RenderTriangles(DaedalusVtx * p_vertices, u32 num_vertices, bool disable_zbuffer);
 
 	virtual void		TexRect(u32 tile_idx, const glm::vec2 & xy0, const glm::vec2 & xy1, TexCoord st0, TexCoord st1);
@@ -23,10 +24,11 @@ public:
 private:
 	void 				MakeShaderConfigFromCurrentState(struct ShaderConfiguration * config) const;
 
-	void 				PrepareRenderState(const float* mat_project, bool disable_zbuffer);
+	void 				PrepareRenderState(struct RenderStateGL * state, const float* mat_project, bool disable_zbuffer, const glm::vec4 & uv_transform = glm::vec4(1.f, 1.f, 0.f, 0.f)) const;
 
-	void 				RenderDaedalusVtx(int prim, const DaedalusVtx * vertices, int count);
-	void 				RenderDaedalusVtxStreams(int prim, const float * positions, const TexCoord * uvs, const u32 * colours, int count);
+	// These record the draw if the render thread is running
+	void 				RenderDaedalusVtx(int prim, const struct RenderStateGL & state, const DaedalusVtx * vertices, int count);
+	void 				RenderDaedalusVtxStreams(int prim, const struct RenderStateGL & state, const float * positions, const TexCoord * uvs, const u32 * colours, int count);
 };
 
 // NB: this is equivalent to gRenderer, but points to the implementation class, for platform-specific functionality.
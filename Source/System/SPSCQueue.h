@@ -0,0 +1,83 @@
+/*
+Copyright (C) 2007 StrmnNrmn
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#pragma once
+
+#ifndef SYSTEM_SPSCQUEUE_H_
+#define SYSTEM_SPSCQUEUE_H_
+
+#include <atomic>
+
+#include "Base/Types.h"
+
+//
+//	Fixed size queue for exactly one producer thread and one consumer thread.
+//	Push() must only be called by the producer and Pop() only by the consumer.
+//	Neither blocks - they return false if the queue is full or empty.
+//
+template< typename T, u32 Size >
+class CSPSCQueue
+{
+	static_assert( Size > 0 && (Size & (Size - 1)) == 0, "Size must be a power of two" );
+
+public:
+	CSPSCQueue()
+	:	mHead( 0 )
+	,	mTail( 0 )
+	{
+	}
+
+	bool	Push( const T & item )
+	{
+		u32 tail( mTail.load( std::memory_order_relaxed ) );
+		if( tail - mHead.load( std::memory_order_acquire ) >= Size )
+			return false;
+
+		mItems[ tail & (Size - 1) ] = item;
+		mTail.store( tail + 1, std::memory_order_release );
+		return true;
+	}
+
+	bool	Pop( T & item )
+	{
+		u32 head( mHead.load( std::memory_order_relaxed ) );
+		if( head == mTail.load( std::memory_order_acquire ) )
+			return false;
+
+		item = mItems[ head & (Size - 1) ];
+		mHead.store( head + 1, std::memory_order_release );
+		return true;
+	}
+
+	// Only exact when called from one of the two threads, and then only for that thread's end
+	u32		GetCount() const
+	{
+		return mTail.load( std::memory_order_acquire ) - mHead.load( std::memory_order_acquire );
+	}
+
+	bool	IsEmpty() const		{ return GetCount() == 0; }
+
+private:
+	// Keep the two indices on separate cache lines so the threads don't fight over them
+	alignas( 64 ) std::atomic< u32 >	mHead;
+	alignas( 64 ) std::atomic< u32 >	mTail;
+	T									mItems[ Size ];
+};
+
+#endif // SYSTEM_SPSCQUEUE_H_
@@ -92,6 +92,10 @@ IAdvancedOptionsScreen::IAdvancedOptionsScreen( CUIContext * p_context, const Ro
 	mElements.Add( std::make_unique<CBoolSetting>( &mRomPreferences.MemoryAccessOptimisation, "Dynarec Memory Optimisation", "Enable for speed-up (WARNING, can cause instability and/or crash on certain ROMs).", "Enabled", "Disabled" ) );
 	mElements.Add( std::make_unique<CBoolSetting>( &mRomPreferences.DynarecLoopOptimisation, "Dynarec Loop Optimisation", "Enable for speed-up (WARNING, quite unstable and can cause instability and/or crash on many ROMs).", "Enabled", "Disabled" ) );
 	mElements.Add( std::make_unique<CBoolSetting>( &mRomPreferences.DynarecDoublesOptimisation, "Dynarec Doubles Optimisation", "Enable for speed-up (WARNING, works on most but not all ROMs).", "Enabled", "Disabled" ) );
+	mElements.Add( std::make_unique<CBoolSetting>( &mRomPreferences.DynarecPersistentCache, "Dynarec Persistent Cache", "Save hot traces to disk so they are recompiled straight away next time this ROM is started.", "Enabled", "Disabled" ) );
+	mElements.Add( std::make_unique<CBoolSetting>( &mRomPreferences.DynarecBackgroundCompile, "Dynarec Background Compile", "Compile hot traces on a separate thread to avoid stutter (only supported by the x64 dynarec).", "Enabled", "Disabled" ) );
+	mElements.Add( std::make_unique<CBoolSetting>( &mRomPreferences.CachedInterpreterEnabled, "Cached Interpreter", "Decode blocks of code once and reuse them when interpreting. Faster than the plain interpreter when the dynarec is off or warming up.", "Enabled", "Disabled" ) );
+	mElements.Add( std::make_unique<CBoolSetting>( &mRomPreferences.AsyncPIDMAEnabled, "Asynchronous Cart DMA", "Load large transfers from the ROM in the background when it doesn't fit in memory. Disable if a game hangs while loading.", "Enabled", "Disabled" ) );
 	mElements.Add( std::make_unique<CBoolSetting>( &mRomPreferences.CleanSceneEnabled, "Clean Scene", "Force clear of frame buffer before drawing any primitives (Use it to clear out garbage on screen)", "Enabled", "Disabled" ) );
 	mElements.Add( std::make_unique<CBoolSetting>( &mRomPreferences.ClearDepthFrameBuffer, "Clear N64 Depth Buffer", "Z-buffer clears for special effects like sun/flames glare in Zelda and camera in DK64 (WARNING, don't use it unless needed)", "Enabled", "Disabled" ) );
 	mElements.Add( std::make_unique<CBoolSetting>( &mRomPreferences.DoubleDisplayEnabled, "Double Display Lists", "Double Display Lists enabled for a speed-up (works on most ROMs)", "Enabled", "Disabled" ) );
@@ -310,6 +310,9 @@ IGlobalSettingsComponent::IGlobalSettingsComponent( CUIContext * p_context )
 	}
 #endif
 	mElements.Add(std::make_unique<CBoolSetting>( &gGlobalPreferences.ForceLinearFilter,"Force Linear Filter", "Enable to force linear filter, this can improve the look of textures", "Yes", "No" ) );
+#ifdef DAEDALUS_GL
+	mElements.Add(std::make_unique<CBoolSetting>( &gGlobalPreferences.ThreadedRenderer,"Threaded Renderer", "Hand the work of drawing each frame to another thread, so emulation can carry on in the meantime. Faster on multi-core machines.", "Yes", "No" ) );
+#endif
 	mElements.Add(std::make_unique<CBoolSetting>( &gGlobalPreferences.RumblePak,"Controller add-on", "Enable either MemPak or RumblePak.", "RumblePak", "MemPak" ) );
 	// mElements.Add(std::make_unique<CAdjustDeadzoneSetting>( mpContext, "Stick Deadzone", "Adjust the size of the deadzone applied to the PSP stick while playing. Press Start/X to edit." ) );
 
@@ -317,6 +320,9 @@ IGlobalSettingsComponent::IGlobalSettingsComponent( CUIContext * p_context )
 	if (PSP_IS_SLIM) 
 		mElements.Add(std::make_unique<CBoolSetting>( &gGlobalPreferences.LargeROMBuffer, "ROM Buffering Mode", "File Cache, faster ROM boot but can stutter due to MS reads. ROM Buffer, no stutter but long boot time loading whole ROM into memory. Takes effect only @ ROM boot.", "File Cache", "ROM Buffer" ) );
 #endif
+#ifdef DAEDALUS_POSIX
+	mElements.Add(std::make_unique<CBoolSetting>( &gGlobalPreferences.MemoryMapROMs, "Memory Mapped ROMs", "Map uncompressed ROMs straight from disk instead of reading the whole ROM into memory. Byteswapped ROMs are converted once into the cache folder. Takes effect only @ ROM boot.", "Yes", "No" ) );
+#endif
 
 #ifdef DAEDALUS_DEBUG_DISPLAYLIST
 	mElements.Add(std::make_unique<CBoolSetting>( &gGlobalPreferences.HighlightInexactBlendModes, "Highlight Inexact Blend Modes",	"Replace inexact blend modes with a placeholder texture.", "Yes", "No" ) );
@@ -127,6 +127,8 @@ class CProfilerImpl
 		inline void				Enter( SProfileItemHandle handle );
 		inline void				Exit( SProfileItemHandle handle );
 
+		void					SetCounter( const char * p_str, u32 value );
+
 	private:
 		CProfileCallstack *		GetActiveStats();
 
@@ -143,6 +145,10 @@ class CProfilerImpl
 
 		f32						mFrequencyInv;
 		ProfileItemList			mItems;
+
+		using CounterList = std::vector< std::pair< const char *, u32 > >;
+
+		CounterList				mCounters;
 };
 
 
@@ -180,6 +186,20 @@ void CProfilerImpl::Display()
 {
 }
 
+void CProfilerImpl::SetCounter( const char * p_str, u32 value )
+{
+	for( CounterList::iterator it = mCounters.begin(); it != mCounters.end(); ++it )
+	{
+		if( it->first == p_str || strcmp( it->first, p_str ) == 0 )
+		{
+			it->second = value;
+			return;
+		}
+	}
+
+	mCounters.push_back( std::make_pair( p_str, value ) );
+}
+
 static void Pad( char * str, u32 length )
 {
 	u32 actLen = strlen( str );
@@ -289,6 +309,14 @@ void CProfilerImpl::Update()
 		//DBGConsole_Msg( 0, "%*s %s %d,%03dms (%d calls)", depth, "", p_item->GetName(), total_us / 1000, total_us % 1000, hit_count );
 	}
 
+	for( CounterList::const_iterator it = mCounters.begin(); it != mCounters.end(); ++it )
+	{
+		char line[ 1024 ];
+		snprintf( line, sizeof(line), "\033[2K %s", it->first );
+		Pad( line, 54 );
+		printf( "%s %10d%s\n", line, it->second, TERMINAL_ERASE_TO_EOL );
+	}
+
 	printf( "<*>");
 	//printf( "\033[2K----------------\n%s\n", TERMINAL_ERASE_TO_EOS );
 	//printf( TERMINAL_RESTORE_CURSOR );
@@ -438,6 +466,11 @@ void CProfiler::Exit( SProfileItemHandle handle )
 	mpImpl->Exit( handle );
 }
 
+void CProfiler::SetCounter( const char * p_str, u32 value )
+{
+	mpImpl->SetCounter( p_str, value );
+}
+
 void CProfiler::Update()
 {
 	mpImpl->Update();
@@ -28,6 +28,9 @@ class CProfiler : public CSingleton< CProfiler >
 		void					Enter( SProfileItemHandle handle );
 		void					Exit( SProfileItemHandle handle );
 
+		// Counters are shown below the timings. p_str must stay valid.
+		void					SetCounter( const char * p_str, u32 value );
+
 	protected:
 		class CProfilerImpl * mpImpl;
 };